@@ -0,0 +1,355 @@
+/**
+ * @file
+ * Autocompletion API approximate regex matching
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Regex matching allowing up to k edits, in the style of agrep (Wu-Manber).
+ *
+ * The automaton of the pattern (see nfa.c) runs with k + 1 state sets, the
+ * set of level i holding the states reached with at most i edits.  For every
+ * character of the item, each level moves on by the character, and takes the
+ * states of the level below moved on by any character (a substitution), not
+ * moved at all (an inserted character), or moved on without a character (a
+ * deleted one).  The edits are those of the Levenshtein distance, there are
+ * no transpositions.  The distance is the lowest level reaching the match,
+ * anywhere in the item.
+ *
+ * The sets are bit masks, and moving a set on is a table lookup per byte of
+ * it: the table holds the states following every combination of 8 states.
+ * So a character costs a few lookups per level, whatever the pattern.  The
+ * states taking a character are looked up in another table, for ASCII.
+ *
+ * The anchors hold at the start and end of the item.  Patterns the automaton
+ * doesn't support, or larger than APPROX_MAX_WORDS sets, aren't compiled.
+ */
+
+#include "private.h"
+
+// largest state set, in 64-bit words
+#define APPROX_MAX_WORDS 2
+
+/**
+ * struct RegexApprox - automaton of a regex, for matching with edits
+ */
+struct RegexApprox
+{
+  struct RegexNfa *nfa;  ///< automaton of the pattern
+  size_t words;          ///< size of a state set, in 64-bit words
+  int k;                 ///< maximum number of edits
+  int match;             ///< match state
+  uint64_t *follow;      ///< states after the states of a byte, by word, byte and value
+  uint64_t *ascii;       ///< states taking every ASCII character
+  uint64_t *consumes;    ///< states taking any character
+  uint64_t *restart;     ///< start states, added after every character
+  uint64_t *first;       ///< state sets of all levels at the start of the item
+  uint64_t *mem;         ///< work memory, state sets of all levels and a few others
+};
+
+/**
+ * approx_has - is a state in a set?
+ */
+static inline bool approx_has(const uint64_t *set, int st)
+{
+  return set[st / 64] & (1ULL << (st % 64));
+}
+
+/**
+ * approx_move - add the states following the states of a set
+ *
+ * @param a   automaton
+ * @param set state set, only states taking a character
+ * @param out state set, the states following them are added
+ */
+static inline void approx_move(const struct RegexApprox *a, const uint64_t *set, uint64_t *out)
+{
+  for (size_t w = 0; w < a->words; w++)
+  {
+    for (uint64_t bits = set[w], b = 0; bits; bits >>= 8, b++)
+    {
+      if ((bits & 0xff) == 0)
+        continue;
+
+      const uint64_t *t = a->follow + ((w * 8 + b) * 256 + (bits & 0xff)) * a->words;
+      for (size_t x = 0; x < a->words; x++)
+        out[x] |= t[x];
+    }
+  }
+}
+
+/**
+ * approx_takes - states taking a character
+ *
+ * @param a   automaton
+ * @param wc  character
+ * @param set set to the states, unless the table has them
+ * @retval ptr states taking the character
+ */
+static const uint64_t *approx_takes(const struct RegexApprox *a, wchar_t wc, uint64_t *set)
+{
+  if ((wc >= 0) && (wc < 128))
+    return a->ascii + wc * a->words;
+
+  memset(set, 0, a->words * sizeof(uint64_t));
+  for (size_t w = 0; w < a->words; w++)
+  {
+    for (uint64_t bits = a->consumes[w]; bits; bits &= bits - 1)
+    {
+      int st = w * 64 + __builtin_ctzll(bits);
+      if (nfa_takes(a->nfa, st, wc))
+        set[w] |= (1ULL << (st % 64));
+    }
+  }
+  return set;
+}
+
+/**
+ * approx_new - compile a regex for matching with edits
+ *
+ * @param pattern   regex, as for compl_regcomp()
+ * @param flags     matching flags, only COMPL_MATCH_IGNORECASE is used
+ * @param max_edits maximum number of edits
+ * @retval ptr automaton, or NULL if the pattern isn't supported
+ */
+struct RegexApprox *approx_new(const char *pattern, MuttMatchFlags flags, int max_edits)
+{
+  struct RegexNfa *nfa = nfa_compile(pattern, flags);
+  if (!nfa || (nfa_set_size(nfa) > APPROX_MAX_WORDS) || (max_edits < 0))
+  {
+    nfa_free(&nfa);
+    return NULL;
+  }
+
+  struct RegexApprox *a = mutt_mem_calloc(1, sizeof(struct RegexApprox));
+  const size_t words = nfa_set_size(nfa);
+  const int n_states = nfa_n_states(nfa);
+  a->nfa = nfa;
+  a->words = words;
+  a->k = max_edits;
+  a->match = n_states - 1;
+  a->follow = mutt_mem_calloc(words * 8 * 256 * words, sizeof(uint64_t));
+  a->ascii = mutt_mem_calloc(128 * words, sizeof(uint64_t));
+  a->consumes = mutt_mem_calloc(words, sizeof(uint64_t));
+  a->restart = mutt_mem_calloc(words, sizeof(uint64_t));
+  a->first = mutt_mem_calloc((a->k + 1) * words, sizeof(uint64_t));
+  a->mem = mutt_mem_calloc((4 * (a->k + 1) + 2) * words, sizeof(uint64_t));
+
+  // the states taking a character, and those taking each ASCII one
+  for (int st = 0; st < n_states; st++)
+  {
+    if (!nfa_consumes(nfa, st))
+      continue;
+
+    a->consumes[st / 64] |= (1ULL << (st % 64));
+    for (int c = 0; c < 128; c++)
+    {
+      if (nfa_takes(nfa, st, c))
+        a->ascii[c * words + st / 64] |= (1ULL << (st % 64));
+    }
+  }
+
+  // every entry is the one with a state less, plus the states after that one
+  uint64_t *single = a->mem;
+  for (size_t w = 0; w < words; w++)
+  {
+    for (int b = 0; b < 8; b++)
+    {
+      uint64_t *table = a->follow + (w * 8 + b) * 256 * words;
+      for (int v = 1; v < 256; v++)
+      {
+        int st = w * 64 + b * 8 + __builtin_ctz(v);
+        memcpy(table + v * words, table + (v & (v - 1)) * words, words * sizeof(uint64_t));
+        if ((st >= n_states) || !approx_has(a->consumes, st))
+          continue;
+
+        memset(single, 0, words * sizeof(uint64_t));
+        nfa_follow(nfa, st, single);
+        for (size_t x = 0; x < words; x++)
+          table[v * words + x] |= single[x];
+      }
+    }
+  }
+
+  // at the start, the pattern's first characters can be deleted
+  nfa_start(nfa, a->restart);
+  nfa_first(nfa, a->first);
+  for (int i = 1; i <= a->k; i++)
+  {
+    uint64_t *prev = a->first + (i - 1) * words;
+    uint64_t *cur = a->first + i * words;
+    for (size_t x = 0; x < words; x++)
+    {
+      cur[x] = prev[x];
+      single[x] = prev[x] & a->consumes[x];
+    }
+    approx_move(a, single, cur);
+  }
+
+  return a;
+}
+
+/**
+ * approx_free - free an automaton
+ *
+ * @param ptr automaton to free
+ */
+void approx_free(struct RegexApprox **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
+
+  struct RegexApprox *a = *ptr;
+  nfa_free(&a->nfa);
+  FREE(&a->follow);
+  FREE(&a->ascii);
+  FREE(&a->consumes);
+  FREE(&a->restart);
+  FREE(&a->first);
+  FREE(&a->mem);
+  FREE(ptr);
+}
+
+/**
+ * approx_edits - fewest edits for the regex to match somewhere in a string
+ *
+ * @param a   automaton
+ * @param str string, valid UTF-8
+ * @retval num number of edits, or -1 if more than the maximum are needed
+ */
+int approx_edits(struct RegexApprox *a, const char *str)
+{
+  if (!a || !str)
+    return -1;
+
+  const size_t words = a->words;
+  const size_t size = (a->k + 1) * words;
+  uint64_t *cur = a->mem;
+  uint64_t *next = cur + size;
+  // states of every level moved on without a character, before and after it
+  uint64_t *del = next + size;
+  uint64_t *next_del = del + size;
+  uint64_t *tmp = next_del + size;
+  uint64_t *takes = tmp + words;
+
+  // only the levels below the best match so far are still of interest
+  int best = a->k + 1;
+  memcpy(cur, a->first, size * sizeof(uint64_t));
+  memset(del, 0, size * sizeof(uint64_t));
+  for (int i = 0; i < best; i++)
+  {
+    if (approx_has(cur + i * words, a->match))
+      best = i;
+    for (size_t x = 0; x < words; x++)
+      tmp[x] = cur[i * words + x] & a->consumes[x];
+    approx_move(a, tmp, del + i * words);
+  }
+
+  wchar_t wc = 0;
+  int n = 0;
+  for (; (best > 0) && (*str != '\0'); str += n)
+  {
+    if ((unsigned char) *str < 0x80)
+    {
+      wc = *str;
+      n = 1;
+    }
+    else if ((n = utf8_next(str, &wc)) <= 0)
+    {
+      break;
+    }
+
+    const uint64_t *take = approx_takes(a, wc, takes);
+    for (int i = 0; i < best; i++)
+    {
+      uint64_t *set = next + i * words;
+      const uint64_t *old = cur + i * words;
+      for (size_t x = 0; x < words; x++)
+        tmp[x] = old[x] & take[x];
+
+      if (i == 0)
+      {
+        memcpy(set, a->restart, words * sizeof(uint64_t));
+      }
+      else
+      {
+        // an inserted or a replaced character, a deleted state, or fewer edits
+        const uint64_t *below = cur + (i - 1) * words;
+        const uint64_t *sub = del + (i - 1) * words;
+        const uint64_t *gone = next_del + (i - 1) * words;
+        const uint64_t *fewer = next + (i - 1) * words;
+        for (size_t x = 0; x < words; x++)
+          set[x] = below[x] | sub[x] | gone[x] | fewer[x];
+      }
+      approx_move(a, tmp, set);
+
+      if (approx_has(set, a->match))
+      {
+        best = i;
+        break;
+      }
+
+      uint64_t *set_del = next_del + i * words;
+      memset(set_del, 0, words * sizeof(uint64_t));
+      for (size_t x = 0; x < words; x++)
+        tmp[x] = set[x] & a->consumes[x];
+      approx_move(a, tmp, set_del);
+    }
+
+    uint64_t *swap = cur;
+    cur = next;
+    next = swap;
+    swap = del;
+    del = next_del;
+    next_del = swap;
+  }
+
+  // at the end of the string, the '$' anchors hold
+  for (int i = 0; i < best; i++)
+  {
+    if (nfa_accepts(a->nfa, cur + i * words, true))
+      best = i;
+  }
+
+  return (best <= a->k) ? best : -1;
+}
+
+/**
+ * score_approx - number of edits for the typed regex to match an item
+ *
+ * @param q     prepared query
+ * @param tar   item
+ * @param spans not used, approximate matches aren't highlighted
+ * @retval num number of edits, or -1 if the item doesn't match
+ */
+int score_approx(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans)
+{
+  (void) spans;
+
+  if (q->approx)
+    return approx_edits(q->approx, tar);
+
+  // patterns the automaton doesn't support only match without edits
+  if (!q->regex)
+    return -1;
+
+  return (regexec(q->regex, tar, 0, NULL, 0) == 0) ? 0 : -1;
+}
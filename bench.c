@@ -0,0 +1,624 @@
+/**
+ * @file
+ * Autocompletion API Benchmark: scoring loops and bulk ingestion
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Scores the same list of ASCII items with the generic kernels (deciding on
+ * flags and encoding for every item), and with the variants selected once per
+ * search, and fuzzy distances one by one with those of many items at once in
+ * SIMD lanes.  Compares the case-folding tables with towlower(), and fuzzy
+ * searches with a maximum distance with and without the BK-tree and the
+ * deletion index, and typing a fuzzy search with and without the trie, with
+ * and without a maximum distance.  Reports how many items the q-gram filter
+ * and the character signatures reject before the kernel.  Also times adding a
+ * large list with compl_add_many(), and loading a remote list from its
+ * snapshot.  Run with `make bench`.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <time.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+
+#define BENCH_ITEMS  100000
+#define BENCH_ROUNDS 10
+#define BENCH_INGEST 1000000
+#define BENCH_GROUPS 50000
+#define BENCH_SYMDEL 10000
+
+static const char *Words[] = { "folder", "inbox", "list", "neomutt", "devel",
+                               "archive", "sent", "drafts", "spam", "work" };
+
+/**
+ * bench_run - score all items a number of times
+ *
+ * @param q       prepared query
+ * @param generic generic kernel, or NULL to use the selected variant
+ * @param tars    items
+ * @param num     number of items
+ * @param dists   set to the distances
+ * @retval num seconds taken
+ */
+static double bench_run(const CompletionQuery *q, CompletionKernel generic,
+                        const char **tars, size_t num, int *dists)
+{
+  clock_t start = clock();
+
+  for (int r = 0; r < BENCH_ROUNDS; r++)
+  {
+    for (size_t i = 0; i < num; i += COMPL_BATCH_SIZE)
+    {
+      size_t n = MIN(COMPL_BATCH_SIZE, num - i);
+      if (generic)
+      {
+        for (size_t j = 0; j < n; j++)
+          dists[i + j] = generic(q, tars[i + j], NULL);
+      }
+      else
+      {
+        q->batch(q, &tars[i], n, &dists[i]);
+      }
+    }
+  }
+
+  return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/**
+ * bench_mode - compare the generic and the specialised path of a mode
+ *
+ * The generic path runs with the same query, minus the ASCII hint, so it has
+ * to handle multibyte targets.
+ */
+static void bench_mode(const char *name, CompletionKernel generic,
+                       void (*select)(CompletionQuery *q), const char *typed,
+                       MuttMatchFlags flags, const char **tars, size_t num)
+{
+  int *dists_generic = mutt_mem_calloc(num, sizeof(int));
+  int *dists_special = mutt_mem_calloc(num, sizeof(int));
+
+  CompletionQuery *q_generic = compl_query_new(typed, flags, false);
+  CompletionQuery *q_special = compl_query_new(typed, flags, true);
+  select(q_special);
+
+  double t_generic = bench_run(q_generic, generic, tars, num, dists_generic);
+  double t_special = bench_run(q_special, NULL, tars, num, dists_special);
+
+  size_t diff = 0;
+  for (size_t i = 0; i < num; i++)
+  {
+    if (dists_generic[i] != dists_special[i])
+      diff++;
+  }
+
+  printf("%-22s generic %8.1f ns/item  specialised %8.1f ns/item  (x%.1f)%s\n",
+         name, t_generic * 1e9 / (num * BENCH_ROUNDS),
+         t_special * 1e9 / (num * BENCH_ROUNDS), t_generic / MAX(t_special, 1e-9),
+         diff ? "  MISMATCH" : "");
+
+  compl_query_free(&q_generic);
+  compl_query_free(&q_special);
+  FREE(&dists_generic);
+  FREE(&dists_special);
+}
+
+/**
+ * bench_ingest - add a large list of items at once, a tenth of them duplicates
+ */
+static void bench_ingest(void)
+{
+  const size_t n_words = sizeof(Words) / sizeof(Words[0]);
+  char **items = mutt_mem_calloc(BENCH_INGEST, sizeof(char *));
+  size_t *lens = mutt_mem_calloc(BENCH_INGEST, sizeof(size_t));
+  for (size_t i = 0; i < BENCH_INGEST; i++)
+  {
+    char item[64];
+    size_t n = (i % 10 == 9) ? i - 1 : i;
+    snprintf(item, sizeof(item), "%s/%s_%zu", Words[n % n_words],
+             Words[(n / n_words) % n_words], n);
+    items[i] = mutt_str_dup(item);
+    lens[i] = strlen(item);
+  }
+
+  Completion *comp = compl_new(COMPL_MODE_SUBSTRING);
+  clock_t start = clock();
+  size_t added = compl_add_many(comp, (const char **) items, lens, BENCH_INGEST);
+  double t = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+  printf("%-22s %zu of %d items in %.0f ms (%.1f ns/item)\n", "compl_add_many",
+         added, BENCH_INGEST, t * 1e3, t * 1e9 / BENCH_INGEST);
+
+  compl_free(&comp);
+  for (size_t i = 0; i < BENCH_INGEST; i++)
+    FREE(&items[i]);
+  FREE(&items);
+  FREE(&lens);
+}
+
+static enum CompletionFetchResult bench_fetch(void *data, const char *since,
+                                              struct CompletionStringList *added,
+                                              struct CompletionStringList *removed,
+                                              struct Buffer *token)
+{
+  (void) data;
+  (void) since;
+  (void) removed;
+  const size_t n_words = sizeof(Words) / sizeof(Words[0]);
+  for (size_t i = 0; i < BENCH_GROUPS; i++)
+  {
+    char group[64];
+    snprintf(group, sizeof(group), "%s.%s.%zu", Words[i % n_words],
+             Words[(i / n_words) % n_words], i);
+    ARRAY_ADD(added, mutt_str_dup(group));
+  }
+
+  buf_strcpy(token, "1");
+  return COMPL_FETCH_FULL;
+}
+
+/**
+ * bench_snapshot - load a remote list of newsgroups from its snapshot
+ */
+static void bench_snapshot(void)
+{
+  const char *path = "bench_snapshot.tmp";
+  CompletionRemote *remote = compl_remote_new(COMPL_MODE_EXACT, path, bench_fetch, NULL);
+  compl_remote_refresh(remote);
+  compl_remote_free(&remote);
+
+  clock_t start = clock();
+  remote = compl_remote_new(COMPL_MODE_EXACT, path, bench_fetch, NULL);
+  double t = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+  printf("%-22s %d items in %.1f ms\n", "snapshot load",
+         compl_get_size(remote->comp) - 1, t * 1e3);
+
+  compl_remote_free(&remote);
+  remove(path);
+}
+
+/**
+ * bench_casefold - case-fold text with towlower() and with the tables
+ */
+static void bench_casefold(void)
+{
+  static const wchar_t text[] = L"NeoMutt Über Straße ΟΔΥΣΣΕΥΣ Кириллица ǅemal";
+  const size_t len = sizeof(text) / sizeof(text[0]) - 1;
+  const size_t rounds = BENCH_ITEMS * BENCH_ROUNDS / 10;
+  volatile wchar_t sink = 0;
+
+  clock_t start = clock();
+  for (size_t r = 0; r < rounds; r++)
+    for (size_t i = 0; i < len; i++)
+      sink += towlower(text[i]);
+  double t_libc = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for (size_t r = 0; r < rounds; r++)
+    for (size_t i = 0; i < len; i++)
+      sink += compl_casefold(text[i]);
+  double t_table = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+  printf("%-22s towlower %8.2f ns/char  tables %8.2f ns/char  (x%.1f)\n", "casefold",
+         t_libc * 1e9 / (rounds * len), t_table * 1e9 / (rounds * len),
+         t_libc / MAX(t_table, 1e-9));
+}
+
+/**
+ * bench_search - time a search of a Completion
+ */
+static double bench_search(Completion *comp, const char *typed)
+{
+  struct Buffer *buf = buf_new(typed);
+  clock_t start = clock();
+  compl_type(comp, buf);
+  compl_complete(comp);
+  double t = (double) (clock() - start) / CLOCKS_PER_SEC;
+  buf_free(&buf);
+  return t;
+}
+
+/**
+ * bench_bktree - fuzzy search with a maximum distance, BK-tree vs full scan
+ */
+static void bench_bktree(const char **tars, size_t num)
+{
+  Completion *scan = compl_new(COMPL_MODE_FUZZY);
+  compl_add_many(scan, tars, NULL, num);
+  bench_search(scan, "neomutt/devel-1");
+  double t_scan = bench_search(scan, "nomutt/devel-12");
+
+  for (int k = 1; k <= 3; k++)
+  {
+    Completion *comp = compl_new(COMPL_MODE_FUZZY);
+    compl_set_max_dist(comp, k);
+    compl_add_many(comp, tars, NULL, num);
+    double t_build = bench_search(comp, "neomutt/devel-1");
+    double t_tree = bench_search(comp, "nomutt/devel-12");
+
+    size_t n_dist = 0;
+    size_t n_nodes = bktree_stats(comp->bktree, &n_dist);
+    char name[32];
+    snprintf(name, sizeof(name), "bktree k=%d", k);
+    printf("%-22s scan %8.2f ms  tree %8.2f ms  (x%.1f)  %5.2f%% distances avoided, built in %.0f ms\n",
+           name, t_scan * 1e3, t_tree * 1e3, t_scan / MAX(t_tree, 1e-9),
+           100.0 * (n_nodes - n_dist) / n_nodes, t_build * 1e3);
+    compl_free(&comp);
+  }
+
+  compl_free(&scan);
+}
+
+/**
+ * bench_symdel - candidates within a small distance, deletion index vs BK-tree
+ *
+ * Only the lookups are timed, the scoring of the candidates is the same.  The
+ * deletion index holds a few hundred variants per item, so it's measured with
+ * a smaller list.
+ */
+static void bench_symdel(const char **tars, size_t num)
+{
+  Completion *comp = compl_new(COMPL_MODE_FUZZY);
+  compl_set_max_dist(comp, 1);
+  compl_add_many(comp, tars, NULL, num);
+  bench_search(comp, "neomutt/devel-1");
+  size_t mem_tree = compl_get_index_memory(comp);
+
+  clock_t start = clock();
+  compl_set_symdel(comp, true);
+  double t_build = (double) (clock() - start) / CLOCKS_PER_SEC;
+  size_t mem_symdel = compl_get_index_memory(comp) - mem_tree;
+
+  struct NgramIdList ids = ARRAY_HEAD_INITIALIZER;
+  for (int k = 1; k <= 2; k++)
+  {
+    start = clock();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+      bktree_query(comp->bktree, "nomutt/devel-12", k, &ids);
+    double t_tree = (double) (clock() - start) / CLOCKS_PER_SEC / BENCH_ROUNDS;
+
+    start = clock();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+      symdel_query(comp->symdel, "nomutt/devel-12", k, &ids);
+    double t_symdel = (double) (clock() - start) / CLOCKS_PER_SEC / BENCH_ROUNDS;
+
+    char name[32];
+    snprintf(name, sizeof(name), "symdel k=%d", k);
+    printf("%-22s tree %8.1f us (%zu KiB)  symdel %8.1f us (%zu KiB)  (x%.1f), built in %.0f ms\n",
+           name, t_tree * 1e6, mem_tree / 1024, t_symdel * 1e6, mem_symdel / 1024,
+           t_tree / MAX(t_symdel, 1e-9), t_build * 1e3);
+  }
+
+  ARRAY_FREE(&ids);
+  compl_free(&comp);
+}
+
+/**
+ * bench_trie - type a fuzzy search character by character, trie vs full scan
+ */
+static void bench_trie(const char **tars, size_t num, int max_dist)
+{
+  static const char *typed = "neomutt/devel-12";
+  Completion *scan = compl_new(COMPL_MODE_FUZZY);
+  Completion *comp = compl_new(COMPL_MODE_FUZZY);
+  compl_set_max_dist(scan, max_dist);
+  compl_set_max_dist(comp, max_dist);
+  compl_add_many(scan, tars, NULL, num);
+  compl_add_many(comp, tars, NULL, num);
+
+  clock_t start = clock();
+  compl_set_trie(comp, true);
+  double t_build = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+  // with a limit, the scan has a BK-tree, which is built on its first search
+  if (max_dist >= 0)
+    bench_search(scan, typed);
+
+  double t_scan = 0;
+  double t_trie = 0;
+  char buf[32] = { 0 };
+  size_t len = strlen(typed);
+  for (size_t i = 1; i <= len; i++)
+  {
+    memcpy(buf, typed, i);
+    t_scan += bench_search(scan, buf);
+    t_trie += bench_search(comp, buf);
+  }
+
+  char name[32];
+  if (max_dist < 0)
+    snprintf(name, sizeof(name), "trie typing");
+  else
+    snprintf(name, sizeof(name), "trie typing k=%d", max_dist);
+  printf("%-22s scan %8.2f ms/key  trie %8.2f ms/key  (x%.1f), %zu KiB, built in %.0f ms\n",
+         name, t_scan * 1e3 / len, t_trie * 1e3 / len,
+         t_scan / MAX(t_trie, 1e-9), compl_get_index_memory(comp) / 1024, t_build * 1e3);
+  compl_free(&scan);
+  compl_free(&comp);
+}
+
+/**
+ * bench_qgram - fuzzy distances with a maximum, with and without the q-gram filter
+ *
+ * Only the kernel runs for the items the filter lets through.
+ */
+static void bench_qgram(const char **tars, size_t num)
+{
+  static const char *typed[] = { "nomutt/devel-12", "inbox/lsit-4711", "sent/drafst" };
+  const size_t n_typed = sizeof(typed) / sizeof(typed[0]);
+  struct QgramFilter *f = qgram_new(false);
+  for (size_t i = 0; i < num; i++)
+    qgram_add(f, i + 1, tars[i]);
+
+  int *dists = mutt_mem_calloc(num, sizeof(int));
+  for (int k = 1; k <= 3; k++)
+  {
+    double t_kernel = 0;
+    double t_filter = 0;
+    size_t rejected_before = 0;
+    size_t checked_before = qgram_stats(f, &rejected_before);
+    for (size_t q = 0; q < n_typed; q++)
+    {
+      CompletionQuery *query = compl_query_new(typed[q], COMPL_MATCH_NOFLAGS, true);
+      score_fuzzy_select(query);
+      t_kernel += bench_run(query, NULL, tars, num, dists);
+
+      clock_t start = clock();
+      for (int r = 0; r < BENCH_ROUNDS; r++)
+      {
+        qgram_prepare(f, typed[q]);
+        for (size_t i = 0; i < num; i++)
+          dists[i] = qgram_check(f, i + 1, k) ? query->kernel(query, tars[i], NULL) : -1;
+      }
+      t_filter += (double) (clock() - start) / CLOCKS_PER_SEC;
+      compl_query_free(&query);
+    }
+
+    size_t rejected = 0;
+    size_t checked = qgram_stats(f, &rejected) - checked_before;
+    rejected -= rejected_before;
+
+    char name[32];
+    snprintf(name, sizeof(name), "qgram k=%d", k);
+    printf("%-22s kernel %8.1f ns/item  filtered %8.1f ns/item  (x%.1f)  %5.2f%% rejected\n",
+           name, t_kernel * 1e9 / (n_typed * num * BENCH_ROUNDS),
+           t_filter * 1e9 / (n_typed * num * BENCH_ROUNDS),
+           t_kernel / MAX(t_filter, 1e-9), 100.0 * rejected / MAX(checked, 1));
+  }
+
+  printf("%-22s %zu KiB of signatures\n", "qgram memory", qgram_memory(f) / 1024);
+  FREE(&dists);
+  qgram_free(&f);
+}
+
+/**
+ * bench_charmask - subsequence searches, with and without the character filter
+ *
+ * The signatures are built once, like those of a Completion.  The filter runs
+ * over all of them, the kernel only for the items it lets through.
+ */
+static void bench_charmask(const char **tars, size_t num)
+{
+  static const char *typed[] = { "NBX/WRK-7", "drfts/spm-42", "vault", "neo/dev-99" };
+  const size_t n_typed = sizeof(typed) / sizeof(typed[0]);
+  uint64_t *masks = mutt_mem_calloc(num, sizeof(uint64_t));
+  for (size_t i = 0; i < num; i++)
+    masks[i] = charmask_str(tars[i], false);
+
+  int *dists = mutt_mem_calloc(num, sizeof(int));
+  uint8_t *pass = mutt_mem_calloc(num, sizeof(uint8_t));
+  for (size_t q = 0; q < n_typed; q++)
+  {
+    CompletionQuery *query = compl_query_new(typed[q], COMPL_MATCH_IGNORECASE, false);
+    double t_kernel = bench_run(query, score_subseq, tars, num, dists);
+
+    size_t n_pass = 0;
+    clock_t start = clock();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+    {
+      n_pass = charmask_filter(masks, num, charmask_str(typed[q], false), 0, pass);
+      for (size_t i = 0; i < num; i++)
+        dists[i] = pass[i] ? score_subseq(query, tars[i], NULL) : -1;
+    }
+    double t_filter = (double) (clock() - start) / CLOCKS_PER_SEC;
+    compl_query_free(&query);
+
+    char name[32];
+    snprintf(name, sizeof(name), "charmask %s", typed[q]);
+    printf("%-22s kernel %8.1f ns/item  filtered %8.1f ns/item  (x%.1f)  %5.2f%% rejected\n",
+           name, t_kernel * 1e9 / (num * BENCH_ROUNDS), t_filter * 1e9 / (num * BENCH_ROUNDS),
+           t_kernel / MAX(t_filter, 1e-9), 100.0 * (num - n_pass) / num);
+  }
+
+  FREE(&pass);
+  FREE(&dists);
+  FREE(&masks);
+}
+
+/**
+ * bench_lanes - fuzzy distances of ASCII items, one by one and in SIMD lanes
+ */
+static void bench_lanes(const char **tars, size_t num)
+{
+  static const char *typed[] = { "nomutt", "inbox/lsit", "sent/drafst-47" };
+  static const int widths[] = { 1, 8, 16 };
+  int *dists = mutt_mem_calloc(num, sizeof(int));
+  int *want = mutt_mem_calloc(num, sizeof(int));
+  for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+  {
+    CompletionQuery *query = compl_query_new(typed[q], COMPL_MATCH_NOFLAGS, true);
+    double t_scalar = 0;
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+    {
+      if ((widths[w] > 1) && (fuzzy_lanes_width(widths[w]) != widths[w]))
+        continue;
+
+      clock_t start = clock();
+      for (int r = 0; r < BENCH_ROUNDS; r++)
+        fuzzy_lanes_score(query, tars, num, (w == 0) ? want : dists, widths[w]);
+      double t = (double) (clock() - start) / CLOCKS_PER_SEC;
+      if (w == 0)
+      {
+        t_scalar = t;
+        continue;
+      }
+
+      char name[32];
+      snprintf(name, sizeof(name), "lanes %d %s", widths[w], typed[q]);
+      printf("%-22s scalar %8.1f ns/item  lanes %8.1f ns/item  (x%.1f)%s\n", name,
+             t_scalar * 1e9 / (num * BENCH_ROUNDS), t * 1e9 / (num * BENCH_ROUNDS),
+             t_scalar / MAX(t, 1e-9),
+             memcmp(dists, want, num * sizeof(int)) ? "  MISMATCH" : "");
+    }
+    compl_query_free(&query);
+  }
+
+  FREE(&want);
+  FREE(&dists);
+}
+
+/**
+ * bench_regex_trie - regex searches, regexec() per item vs the automaton over the trie
+ */
+static void bench_regex_trie(const char **tars, size_t num)
+{
+  static const char *typed[] = { "neomutt/de", "^inbox", "(sent|drafts)/.*-4[0-9]$" };
+  Completion *scan = compl_new(COMPL_MODE_REGEX);
+  Completion *comp = compl_new(COMPL_MODE_REGEX);
+  compl_add_many(scan, tars, NULL, num);
+  compl_add_many(comp, tars, NULL, num);
+  compl_set_trie(comp, true);
+
+  for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+  {
+    double t_scan = bench_search(scan, typed[q]);
+    double t_trie = bench_search(comp, typed[q]);
+    char name[32];
+    snprintf(name, sizeof(name), "regex %s", typed[q]);
+    printf("%-22s scan %8.2f ms  trie %8.2f ms  (x%.1f)%s\n", name, t_scan * 1e3,
+           t_trie * 1e3, t_scan / MAX(t_trie, 1e-9),
+           mutt_str_equal(buf_string(compl_complete(scan)), buf_string(compl_complete(comp))) ?
+               "" :
+               "  MISMATCH");
+  }
+
+  compl_free(&scan);
+  compl_free(&comp);
+}
+
+/**
+ * bench_approx - approximate regex searches, by the number of edits allowed
+ */
+static void bench_approx(const char **tars, size_t num)
+{
+  static const char *typed[] = { "nemoutt/dve", "^(snet|drafst)/.*-4[0-9]$" };
+  Completion *comp = compl_new(COMPL_MODE_APPROX);
+  compl_add_many(comp, tars, NULL, num);
+
+  for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+  {
+    for (int k = 0; k <= 2; k++)
+    {
+      compl_set_max_dist(comp, k);
+      double t = bench_search(comp, typed[q]);
+      char name[40];
+      snprintf(name, sizeof(name), "approx k=%d %s", k, typed[q]);
+      printf("%-40s %8.2f ms  (%.1f ns/item)\n", name, t * 1e3, t * 1e9 / num);
+    }
+  }
+
+  compl_free(&comp);
+}
+
+/**
+ * bench_step - fuzzy search in slices of 2 ms, the longest slice vs the whole search
+ */
+static void bench_step(const char **tars, size_t num)
+{
+  Completion *comp = compl_new(COMPL_MODE_FUZZY);
+  compl_add_many(comp, tars, NULL, num);
+  double t_full = bench_search(comp, "nomutt/devel-12");
+
+  struct Buffer *buf = buf_new("neomutt/dvel-12");
+  compl_type(comp, buf);
+  int calls = 0;
+  uint64_t longest = 0;
+  uint64_t total = 0;
+  for (int left = 1; left > 0; calls++)
+  {
+    uint64_t start = compl_now_us();
+    left = compl_score_step(comp, 0, start + 2000, NULL);
+    uint64_t t = compl_now_us() - start;
+    longest = MAX(longest, t);
+    total += t;
+  }
+  buf_free(&buf);
+
+  printf("%-22s full %8.2f ms  sliced %8.2f ms in %d calls, longest %.2f ms\n",
+         "score step 2 ms", t_full * 1e3, total / 1e3, calls, longest / 1e3);
+  compl_free(&comp);
+}
+
+int main(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  const size_t n_words = sizeof(Words) / sizeof(Words[0]);
+  char **items = mutt_mem_calloc(BENCH_ITEMS, sizeof(char *));
+  for (size_t i = 0; i < BENCH_ITEMS; i++)
+  {
+    char item[64];
+    snprintf(item, sizeof(item), "%s/%s-%zu", Words[i % n_words],
+             Words[(i / n_words) % n_words], i);
+    items[i] = mutt_str_dup(item);
+  }
+  const char **tars = (const char **) items;
+
+  printf("%d items, %d rounds\n", BENCH_ITEMS, BENCH_ROUNDS);
+  bench_mode("exact", score_exact, score_exact_select, "neomutt/de",
+             COMPL_MATCH_NOFLAGS, tars, BENCH_ITEMS);
+  bench_mode("exact ignorecase", score_exact, score_exact_select, "NeoMutt/De",
+             COMPL_MATCH_IGNORECASE, tars, BENCH_ITEMS);
+  bench_mode("fuzzy", score_fuzzy, score_fuzzy_select, "nomutt/dev",
+             COMPL_MATCH_NOFLAGS, tars, BENCH_ITEMS);
+  bench_lanes(tars, BENCH_ITEMS);
+  bench_casefold();
+  bench_bktree(tars, BENCH_ITEMS);
+  bench_symdel(tars, BENCH_SYMDEL);
+  bench_trie(tars, BENCH_ITEMS, -1);
+  bench_trie(tars, BENCH_ITEMS, 2);
+  bench_qgram(tars, BENCH_ITEMS);
+  bench_charmask(tars, BENCH_ITEMS);
+  bench_regex_trie(tars, BENCH_ITEMS);
+  bench_approx(tars, BENCH_ITEMS);
+  bench_step(tars, BENCH_ITEMS);
+  bench_ingest();
+  bench_snapshot();
+
+  for (size_t i = 0; i < BENCH_ITEMS; i++)
+    FREE(&items[i]);
+  FREE(&items);
+  return 0;
+}
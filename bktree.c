@@ -0,0 +1,323 @@
+/**
+ * @file
+ * Autocompletion API BK-tree for fuzzy matching
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * BK-tree over the items, to find the fuzzy candidates within a maximum
+ * distance without scoring every item.
+ *
+ * Every child of a node is filed under its distance to the node.  By the
+ * triangle inequality, the items within distance k of the typed string can
+ * only be below the children with a distance of d-k to d+k, where d is the
+ * distance of the typed string to the node.
+ *
+ * That needs a true metric, which the fuzzy kernel (optimal string alignment)
+ * isn't.  The tree uses the unrestricted Damerau-Levenshtein distance, which
+ * is a metric and never larger, so it finds a superset of the matches, and
+ * the kernel has the last word.  The kernel always aligns the first
+ * characters, so the tree only keys the rest of each item.
+ *
+ * Items can't be taken out of the tree, removed ids are skipped by the caller.
+ */
+
+#include "private.h"
+
+/**
+ * struct BkNode - node of a BK-tree
+ *
+ * The children of a node are a linked list of siblings.
+ */
+struct BkNode
+{
+  uint32_t id;        ///< item id
+  uint32_t key;       ///< offset of the key in the key pool
+  uint32_t dist;      ///< distance to the parent
+  uint32_t child;     ///< first child, 0 for none
+  uint32_t sibling;   ///< next child of the parent, 0 for none
+};
+
+ARRAY_HEAD(BkNodeList, struct BkNode);
+
+/**
+ * struct BkTree - BK-tree with the unrestricted Damerau-Levenshtein metric
+ */
+struct BkTree
+{
+  struct BkNodeList nodes;   ///< all nodes, the first one is the root
+  CompletionPool keys;       ///< keys of the nodes, decoded on demand
+  CompletionScratch scratch; ///< work memory of the distance calculation
+  bool magic;                ///< keys are the normalised forms
+  size_t n_dist;             ///< distances calculated by the last query
+};
+
+/**
+ * bk_key - the part of a string the tree is keyed by
+ *
+ * @param str item or typed string
+ * @retval ptr string without its first character
+ */
+static const char *bk_key(const char *str)
+{
+  int n = MBCHARLEN(str);
+  return (n > 0) ? str + n : str;
+}
+
+/**
+ * bk_dist - unrestricted damerau-levenshtein distance
+ *
+ * Lowrance and Wagner's algorithm.  The last row of the matrix in which each
+ * target character occurred in the source is kept per column, so it works for
+ * any alphabet.
+ *
+ * @param t tree, for the work memory
+ * @param a first string
+ * @param b second string
+ * @retval num distance
+ */
+static int bk_dist(struct BkTree *t, const char *a, const char *b)
+{
+  t->n_dist++;
+
+  int n = mbs_char_count(a);
+  int m = mbs_char_count(b);
+  if ((n <= 0) || (m <= 0))
+    return MAX(n, 0) + MAX(m, 0);
+
+  // the matrix has two extra rows and columns for the borders
+  const size_t cols = m + 2;
+  size_t size = ((size_t) (n + 2) * cols + m + 1) * sizeof(int) +
+                (n + m + 2) * sizeof(wchar_t);
+  int *d = compl_scratch_reserve(&t->scratch, size);
+  int *last_row = d + (size_t) (n + 2) * cols;
+  wchar_t *wa = (wchar_t *) (last_row + m + 1);
+  wchar_t *wb = wa + n + 1;
+  utf8_decode(a, wa);
+  utf8_decode(b, wb);
+
+#define D(I, J) d[(size_t) ((I) + 1) * cols + (J) + 1]
+  const int inf = n + m;
+  D(-1, -1) = inf;
+  for (int i = 0; i <= n; i++)
+  {
+    D(i, -1) = inf;
+    D(i, 0) = i;
+  }
+  for (int j = 0; j <= m; j++)
+  {
+    D(-1, j) = inf;
+    D(0, j) = j;
+    last_row[j] = 0;
+  }
+
+  for (int i = 1; i <= n; i++)
+  {
+    int last_col = 0;
+    for (int j = 1; j <= m; j++)
+    {
+      int k = last_row[j];
+      int l = last_col;
+      int cost = 1;
+      if (wa[i - 1] == wb[j - 1])
+      {
+        cost = 0;
+        last_col = j;
+      }
+
+      int best = MIN(D(i - 1, j - 1) + cost, MIN(D(i, j - 1) + 1, D(i - 1, j) + 1));
+      if ((k > 0) && (l > 0))
+        best = MIN(best, D(k - 1, l - 1) + (i - k - 1) + 1 + (j - l - 1));
+      D(i, j) = best;
+    }
+
+    // this row is now the last one with its character
+    for (int j = 1; j <= m; j++)
+    {
+      if (wb[j - 1] == wa[i - 1])
+        last_row[j] = i;
+    }
+  }
+
+  int dist = D(n, m);
+#undef D
+  return dist;
+}
+
+/**
+ * bktree_new - create an empty BK-tree
+ *
+ * @param magic true if the keys are the normalised forms of the items
+ * @retval ptr new tree
+ */
+struct BkTree *bktree_new(bool magic)
+{
+  struct BkTree *t = mutt_mem_calloc(1, sizeof(struct BkTree));
+  ARRAY_INIT(&t->nodes);
+  t->magic = magic;
+  return t;
+}
+
+/**
+ * bktree_free - free a BK-tree
+ *
+ * @param ptr tree to free
+ */
+void bktree_free(struct BkTree **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
+
+  struct BkTree *t = *ptr;
+  ARRAY_FREE(&t->nodes);
+  compl_pool_free(&t->keys);
+  compl_scratch_free(&t->scratch);
+  FREE(ptr);
+}
+
+/**
+ * bktree_magic - does the tree hold the normalised forms of the items?
+ *
+ * @param t tree
+ * @retval bool true for normalised forms
+ */
+bool bktree_magic(const struct BkTree *t)
+{
+  return t->magic;
+}
+
+/**
+ * bktree_add - add an item to a BK-tree
+ *
+ * @param t   tree
+ * @param id  item id
+ * @param str string of the item (its normalised form for a magic tree)
+ */
+void bktree_add(struct BkTree *t, uint32_t id, const char *str)
+{
+  struct BkNode node = { 0 };
+  node.id = id;
+  node.key = compl_pool_add(&t->keys, bk_key(str));
+
+  if (ARRAY_EMPTY(&t->nodes))
+  {
+    ARRAY_ADD(&t->nodes, node);
+    return;
+  }
+
+  uint32_t cur = 0;
+  while (true)
+  {
+    struct BkNode *parent = ARRAY_GET(&t->nodes, cur);
+    int dist = bk_dist(t, t->keys.data + parent->key, t->keys.data + node.key);
+
+    uint32_t child = parent->child;
+    while (child && (ARRAY_GET(&t->nodes, child)->dist != (uint32_t) dist))
+      child = ARRAY_GET(&t->nodes, child)->sibling;
+
+    if (child)
+    {
+      cur = child;
+      continue;
+    }
+
+    // new child, the list may move when it grows
+    uint32_t idx = ARRAY_SIZE(&t->nodes);
+    node.dist = dist;
+    node.sibling = parent->child;
+    parent->child = idx;
+    if (ARRAY_SIZE(&t->nodes) == ARRAY_CAPACITY(&t->nodes))
+      ARRAY_RESERVE(&t->nodes, ARRAY_SIZE(&t->nodes) * 2);
+    ARRAY_ADD(&t->nodes, node);
+    return;
+  }
+}
+
+/**
+ * bktree_query - find the items within a distance of the typed string
+ *
+ * @param t        tree
+ * @param str      typed string (normalised for a magic tree)
+ * @param max_dist maximum distance
+ * @param ids      list to fill with the candidate ids, in no particular order
+ * @retval num number of candidates
+ */
+int bktree_query(struct BkTree *t, const char *str, int max_dist, struct NgramIdList *ids)
+{
+  ARRAY_SHRINK(ids, ARRAY_SIZE(ids));
+  t->n_dist = 0;
+  if (ARRAY_EMPTY(&t->nodes))
+    return 0;
+
+  const char *key = bk_key(str);
+  struct NgramIdList todo = ARRAY_HEAD_INITIALIZER;
+  ARRAY_ADD(&todo, 0);
+
+  while (!ARRAY_EMPTY(&todo))
+  {
+    uint32_t cur = *ARRAY_LAST(&todo);
+    ARRAY_SHRINK(&todo, 1);
+
+    const struct BkNode *node = ARRAY_GET(&t->nodes, cur);
+    int dist = bk_dist(t, key, t->keys.data + node->key);
+    if (dist <= max_dist)
+      ARRAY_ADD(ids, node->id);
+
+    for (uint32_t child = node->child; child; child = ARRAY_GET(&t->nodes, child)->sibling)
+    {
+      int d = ARRAY_GET(&t->nodes, child)->dist;
+      if ((d >= dist - max_dist) && (d <= dist + max_dist))
+        ARRAY_ADD(&todo, child);
+    }
+  }
+
+  ARRAY_FREE(&todo);
+  return ARRAY_SIZE(ids);
+}
+
+/**
+ * bktree_stats - number of items and distance calculations of the last query
+ *
+ * @param t      tree
+ * @param n_dist set to the number of distances the last query calculated
+ * @retval num number of items in the tree
+ */
+size_t bktree_stats(const struct BkTree *t, size_t *n_dist)
+{
+  if (n_dist)
+    *n_dist = t->n_dist;
+  return ARRAY_SIZE(&t->nodes);
+}
+
+/**
+ * bktree_memory - memory used by a BK-tree
+ *
+ * @param t tree
+ * @retval num size in bytes
+ */
+size_t bktree_memory(const struct BkTree *t)
+{
+  if (!t)
+    return 0;
+
+  return sizeof(struct BkTree) + ARRAY_CAPACITY(&t->nodes) * sizeof(struct BkNode) +
+         t->keys.size + t->scratch.size;
+}
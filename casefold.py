@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+#
+# Generate casefold.c, the Unicode simple case-folding and character class tables
+#
+# Usage: casefold.py [CaseFolding.txt] > casefold.c
+#
+# With CaseFolding.txt (https://www.unicode.org/Public/UCD/latest/ucd/), the
+# common (C) and simple (S) mappings are used.  Without it, the mappings are
+# taken from Python's unicodedata, keeping only the ones to a single character.
+#
+# The table is two-level: the high bits of a character select a block, the low
+# bits a delta within the block.  Identical blocks are stored once, most of the
+# blocks don't map anything.
+#
+# The character classes (space, lowercase, uppercase, other letter) are always
+# taken from Python's unicodedata, and stored the same way.
+
+import sys
+import unicodedata
+
+SHIFT = 7
+BLOCK = 1 << SHIFT
+
+
+def read_casefolding(path):
+    folds = {}
+    with open(path, encoding="utf-8") as f:
+        for line in f:
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            code, status, mapping = [x.strip() for x in line.split(";")[:3]]
+            if status in ("C", "S"):
+                folds[int(code, 16)] = int(mapping, 16)
+    return folds
+
+
+def derive_casefolding():
+    folds = {}
+    for cp in range(sys.maxunicode + 1):
+        if 0xD800 <= cp <= 0xDFFF:
+            continue
+        c = chr(cp)
+        fold = c.casefold()
+        if len(fold) != 1:
+            # full folding only, e.g. U+1E9E -> "ss", keep the simple lowercase
+            fold = c.lower()
+        if len(fold) == 1 and fold != c:
+            folds[cp] = ord(fold)
+    return folds
+
+
+# enum UnicodeClass in private.h
+UC_OTHER, UC_SPACE, UC_LOWER, UC_UPPER, UC_LETTER = range(5)
+
+
+def char_class(cp):
+    cat = unicodedata.category(chr(cp))
+    # like iswspace(), no-break spaces aren't spaces
+    if 0x09 <= cp <= 0x0D or (cat in ("Zs", "Zl", "Zp") and cp not in (0xA0, 0x2007, 0x202F)):
+        return UC_SPACE
+    if cat == "Ll":
+        return UC_LOWER
+    if cat in ("Lu", "Lt"):
+        return UC_UPPER
+    if cat[0] == "L":
+        return UC_LETTER
+    return UC_OTHER
+
+
+def two_level(values, limit):
+    blocks = []
+    block_idx = {}
+    index = []
+    for start in range(0, limit, BLOCK):
+        block = tuple(values(cp) for cp in range(start, start + BLOCK))
+        if block not in block_idx:
+            block_idx[block] = len(blocks)
+            blocks.append(block)
+        index.append(block_idx[block])
+
+    assert len(blocks) <= 256
+    return index, blocks
+
+
+def write_table(out, name, index, blocks):
+    out.write("const uint8_t %sIndex[%d] = {\n" % (name, len(index)))
+    write_values(out, ["%d" % i for i in index], 16)
+    out.write("};\n\n")
+
+    out.write("const uint8_t %sBlocks[%d][%d] = {\n" % (name, len(blocks), BLOCK))
+    for block in blocks:
+        out.write("  {\n")
+        write_values(out, ["%d" % i for i in block], 16, "    ")
+        out.write("  },\n")
+    out.write("};\n")
+
+
+def main():
+    if len(sys.argv) > 1:
+        folds = read_casefolding(sys.argv[1])
+        source = "CaseFolding.txt"
+    else:
+        folds = derive_casefolding()
+        source = "Unicode %s" % unicodedata.unidata_version
+
+    limit = (max(folds) // BLOCK + 1) * BLOCK
+
+    deltas = [0]
+    delta_idx = {0: 0}
+
+    def delta(cp):
+        d = folds.get(cp, cp) - cp
+        if d not in delta_idx:
+            delta_idx[d] = len(deltas)
+            deltas.append(d)
+        return delta_idx[d]
+
+    index, blocks = two_level(delta, limit)
+    assert len(deltas) <= 256
+
+    last_class = max(cp for cp in range(sys.maxunicode + 1) if char_class(cp) != UC_OTHER)
+    class_limit = (last_class // BLOCK + 1) * BLOCK
+    class_index, class_blocks = two_level(char_class, class_limit)
+
+    out = sys.stdout
+    out.write(HEADER % source)
+    out.write("const uint32_t CaseFoldLimit = 0x%X;\n\n" % limit)
+
+    out.write("const int32_t CaseFoldDeltas[%d] = {\n" % len(deltas))
+    write_values(out, ["%d" % d for d in deltas], 10)
+    out.write("};\n\n")
+
+    write_table(out, "CaseFold", index, blocks)
+
+    out.write("\nconst uint32_t CharClassLimit = 0x%X;\n\n" % class_limit)
+    write_table(out, "CharClass", class_index, class_blocks)
+
+
+def write_values(out, values, per_line, indent="  "):
+    for i in range(0, len(values), per_line):
+        out.write(indent + ", ".join(values[i:i + per_line]) + ",\n")
+
+
+HEADER = """\
+/**
+ * @file
+ * Autocompletion API Unicode case-folding tables
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Simple case folding and character classes of %s, generated by
+ * casefold.py -- do not edit.  Use compl_casefold() and compl_char_class() to
+ * look up a character.
+ */
+
+#include <stdint.h>
+
+"""
+
+if __name__ == "__main__":
+    main()
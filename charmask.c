@@ -0,0 +1,152 @@
+/**
+ * @file
+ * Autocompletion API character class signatures
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Character class signatures, 64 bits per string.
+ *
+ * Every case-folded letter and digit has a bit of its own.  The magic
+ * separators share one, the other ASCII characters are spread over a few
+ * bits, and all other characters are hashed into the rest.  A string sets
+ * the bits of all its characters.
+ *
+ * A string can only contain the typed characters (as a prefix, substring or
+ * subsequence) if its signature has all bits of the typed string.  And every
+ * fuzzy edit adds one character at most, so an item lacking more of the
+ * typed bits than the maximum distance can't be within it.  Folded and
+ * shared bits only let more items through, never fewer.
+ */
+
+#include "private.h"
+
+// first bits of the character classes
+#define CHARMASK_DIGITS    26  ///< '0' to '9'
+#define CHARMASK_SEPARATOR 36  ///< '-' and '_'
+#define CHARMASK_PUNCT     37  ///< other ASCII characters, 11 bits
+#define CHARMASK_OTHER     48  ///< all other characters, 16 bits
+
+/**
+ * charmask_char - character class bit of a character
+ *
+ * @param wc character
+ * @retval num signature with the bit of the character
+ */
+static inline uint64_t charmask_char(wchar_t wc)
+{
+  uint32_t c = (uint32_t) compl_casefold(wc);
+  if ((c >= 'a') && (c <= 'z'))
+    return 1ULL << (c - 'a');
+  if ((c >= '0') && (c <= '9'))
+    return 1ULL << (CHARMASK_DIGITS + c - '0');
+  if ((c == '-') || (c == '_'))
+    return 1ULL << CHARMASK_SEPARATOR;
+  if (c < 0x80)
+    return 1ULL << (CHARMASK_PUNCT + c % 11);
+
+  c *= 0x9E3779B1U;
+  return 1ULL << (CHARMASK_OTHER + (c >> 28));
+}
+
+/**
+ * charmask_str - character class signature of a string
+ *
+ * @param str        string, valid UTF-8
+ * @param skip_first leave out the first character
+ * @retval num signature
+ */
+uint64_t charmask_str(const char *str, bool skip_first)
+{
+  if (!str)
+    return 0;
+
+  uint64_t mask = 0;
+  for (; *str; str++)
+  {
+    // the ASCII characters are the common case
+    unsigned char c = (unsigned char) *str;
+    if (c < 0x80)
+    {
+      if (!skip_first)
+        mask |= charmask_char(c);
+      skip_first = false;
+      continue;
+    }
+
+    wchar_t wc = 0;
+    int n = utf8_next(str, &wc);
+    if (n <= 0)
+      break;
+    if (!skip_first)
+      mask |= charmask_char(wc);
+    skip_first = false;
+    str += n - 1;
+  }
+
+  return mask;
+}
+
+/**
+ * charmask_popcount - number of bits set
+ *
+ * @param x bits
+ * @retval num number of bits set
+ */
+static inline int charmask_popcount(uint64_t x)
+{
+  x -= (x >> 1) & 0x5555555555555555ULL;
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return (x * 0x0101010101010101ULL) >> 56;
+}
+
+/**
+ * charmask_filter - find the signatures that can match the typed one
+ *
+ * The loops don't branch, so that the compiler can vectorise them.
+ *
+ * @param masks       signatures
+ * @param num         number of signatures
+ * @param need        signature of the typed string
+ * @param max_missing number of typed bits a signature may lack
+ * @param pass        set to 1 for every signature that may match, 0 otherwise
+ * @retval num number of signatures that may match
+ */
+size_t charmask_filter(const uint64_t *masks, size_t num, uint64_t need,
+                       int max_missing, uint8_t *pass)
+{
+  if (max_missing <= 0)
+  {
+    for (size_t i = 0; i < num; i++)
+      pass[i] = ((masks[i] & need) == need);
+  }
+  else
+  {
+    for (size_t i = 0; i < num; i++)
+      pass[i] = (charmask_popcount(need & ~masks[i]) <= max_missing);
+  }
+
+  size_t n_pass = 0;
+  for (size_t i = 0; i < num; i++)
+    n_pass += pass[i];
+  return n_pass;
+}
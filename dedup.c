@@ -0,0 +1,220 @@
+/**
+ * @file
+ * Autocompletion API duplicate detection
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Hash table of the item strings, to skip duplicates and to find the items to
+ * remove.
+ *
+ * It uses open addressing with linear probing, like the trigram index, so
+ * adding an item doesn't allocate anything, and a lookup usually touches a
+ * single cache line.  Each slot keeps the hash of its string, so strings are
+ * only compared on a full hash match.  The same string may be stored several
+ * times (e.g. rows with the same first field).
+ */
+
+#include "private.h"
+
+/**
+ * struct DedupSlot - hash table slot
+ */
+struct DedupSlot
+{
+  const char *str; ///< item string, owned by the Completion
+  uint32_t hash;   ///< hash of the string
+  uint32_t id;     ///< item id, 0 for an empty slot
+};
+
+/**
+ * struct DedupTable - open addressing hash table of item strings
+ */
+struct DedupTable
+{
+  struct DedupSlot *slots; ///< hash table
+  size_t num_slots;        ///< size of the hash table (power of two)
+  size_t num_used;         ///< number of strings in the table
+};
+
+static uint32_t dedup_hash(const char *str)
+{
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (; *str; str++)
+  {
+    hash ^= (unsigned char) *str;
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash ^ (hash >> 32);
+}
+
+/**
+ * dedup_place - store a slot in the first empty slot of its chain
+ */
+static void dedup_place(struct DedupTable *t, const struct DedupSlot *slot)
+{
+  size_t mask = t->num_slots - 1;
+  size_t i = slot->hash & mask;
+
+  while (t->slots[i].id)
+    i = (i + 1) & mask;
+
+  t->slots[i] = *slot;
+}
+
+/**
+ * dedup_new - create an empty table
+ *
+ * @param num number of strings to make room for
+ * @retval ptr new table
+ */
+struct DedupTable *dedup_new(size_t num)
+{
+  struct DedupTable *t = mutt_mem_calloc(1, sizeof(struct DedupTable));
+  t->num_slots = COMPL_DEDUP_SLOTS;
+  dedup_reserve(t, num);
+  return t;
+}
+
+void dedup_free(struct DedupTable **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
+
+  FREE(&(*ptr)->slots);
+  FREE(ptr);
+}
+
+/**
+ * dedup_reserve - grow the table to hold a number of strings
+ *
+ * The table is kept at most half full.
+ *
+ * @param t   table
+ * @param num number of strings
+ */
+void dedup_reserve(struct DedupTable *t, size_t num)
+{
+  size_t num_slots = t->num_slots;
+  while (num * 2 > num_slots)
+    num_slots *= 2;
+
+  if (t->slots && (num_slots == t->num_slots))
+    return;
+
+  struct DedupSlot *old = t->slots;
+  size_t old_num = t->slots ? t->num_slots : 0;
+
+  t->num_slots = num_slots;
+  t->slots = mutt_mem_calloc(num_slots, sizeof(struct DedupSlot));
+
+  for (size_t i = 0; i < old_num; i++)
+  {
+    if (old[i].id)
+      dedup_place(t, &old[i]);
+  }
+
+  FREE(&old);
+}
+
+/**
+ * dedup_find - find an item by its string
+ *
+ * @param t   table
+ * @param str item string
+ * @retval num id of the item, 0 if there is none
+ */
+uint32_t dedup_find(const struct DedupTable *t, const char *str)
+{
+  if (!t || !str)
+    return 0;
+
+  uint32_t hash = dedup_hash(str);
+  size_t mask = t->num_slots - 1;
+
+  for (size_t i = hash & mask; t->slots[i].id; i = (i + 1) & mask)
+  {
+    if ((t->slots[i].hash == hash) && mutt_str_equal(t->slots[i].str, str))
+      return t->slots[i].id;
+  }
+
+  return 0;
+}
+
+/**
+ * dedup_add - add an item string
+ *
+ * The string isn't copied, it has to stay valid while it is in the table.
+ *
+ * @param t   table
+ * @param str item string
+ * @param id  item id
+ */
+void dedup_add(struct DedupTable *t, const char *str, uint32_t id)
+{
+  dedup_reserve(t, t->num_used + 1);
+
+  struct DedupSlot slot = { str, dedup_hash(str), id };
+  dedup_place(t, &slot);
+  t->num_used++;
+}
+
+/**
+ * dedup_delete - remove an item string
+ *
+ * The following slots of the chain are shifted back, so lookups never need to
+ * skip deleted slots.
+ *
+ * @param t   table
+ * @param str item string
+ * @param id  item id
+ */
+void dedup_delete(struct DedupTable *t, const char *str, uint32_t id)
+{
+  if (!t || !str)
+    return;
+
+  size_t mask = t->num_slots - 1;
+  size_t i = dedup_hash(str) & mask;
+
+  while (t->slots[i].id && (t->slots[i].id != id))
+    i = (i + 1) & mask;
+
+  if (!t->slots[i].id)
+    return;
+
+  for (size_t j = (i + 1) & mask; t->slots[j].id; j = (j + 1) & mask)
+  {
+    // a slot can move back, unless its home lies between the gap and itself
+    size_t home = t->slots[j].hash & mask;
+    if (((j - home) & mask) < ((j - i) & mask))
+      continue;
+
+    t->slots[i] = t->slots[j];
+    i = j;
+  }
+
+  t->slots[i].id = 0;
+  t->num_used--;
+}
@@ -0,0 +1,237 @@
+/**
+ * @file
+ * Autocompletion API item removal and delta updates
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Lists can be updated in place, e.g. when the mailboxes or the alias file
+ * change, without rebuilding (and deduplicating) the whole list.
+ *
+ * Removing an item only leaves a tombstone for its id, and takes it out of the
+ * dedup table.  The list of items is compacted before the next search, which
+ * goes through all items anyway.  The indexes and string pools (trigrams,
+ * normalised forms, column fields) are only compacted once enough of their
+ * items have been removed.  So are the item strings, which live in one arena.
+ * The BK-tree can't drop items, so it's rebuilt by the next fuzzy search.
+ */
+
+#include "private.h"
+
+/**
+ * compl_changed - the items changed, so the next completion has to search again
+ *
+ * @param comp Completion struct
+ */
+static void compl_changed(Completion *comp)
+{
+  comp->cur_item = comp->typed_item;
+  if (comp->state != COMPL_STATE_NEW)
+    comp->state = COMPL_STATE_INIT;
+}
+
+/**
+ * remove an item from a Completion
+ *
+ * For lists with columns, all rows with this first field are removed.
+ *
+ * @param comp Completion struct
+ * @param buf string of the item to remove
+ * @retval num number of removed items
+ */
+int compl_remove(Completion *comp, const struct Buffer *buf)
+{
+  if (!compl_health_check(comp))
+    return 0;
+
+  if (buf_is_empty(buf))
+    return 0;
+
+  int num = 0;
+  uint32_t id = 0;
+  while ((id = dedup_find(comp->dedup, buf_string(buf))))
+  {
+    dedup_delete(comp->dedup, buf_string(buf), id);
+
+    ARRAY_SET(&comp->removed, id, true);
+    comp->n_removed++;
+    comp->n_garbage++;
+    num++;
+  }
+
+  if (num > 0)
+  {
+    logdeb(4, "Removed item '%s'.", buf_string(buf));
+    compl_changed(comp);
+  }
+
+  return num;
+}
+
+/**
+ * apply a list of changes to a Completion
+ *
+ * Removals are applied first, so an item can be replaced by removing and
+ * adding it.  Lists with columns have to use compl_add_row() and
+ * compl_remove() instead.
+ *
+ * @param comp Completion struct
+ * @param added strings to add (may be NULL)
+ * @param removed strings to remove (may be NULL)
+ * @retval num number of added and removed items
+ */
+int compl_apply_delta(Completion *comp, const struct CompletionStringList *added,
+                      const struct CompletionStringList *removed)
+{
+  if (!compl_health_check(comp))
+    return 0;
+
+  if (!ARRAY_EMPTY(&comp->columns))
+  {
+    logerr("CompApplyDelta: use compl_add_row() for lists with columns.");
+    return 0;
+  }
+
+  int num = 0;
+  struct Buffer *buf = buf_new(NULL);
+  char **str = NULL;
+
+  if (removed)
+  {
+    ARRAY_FOREACH(str, removed)
+    {
+      buf_strcpy(buf, *str);
+      num += compl_remove(comp, buf);
+    }
+  }
+
+  if (added)
+  {
+    ARRAY_FOREACH(str, added)
+    {
+      buf_strcpy(buf, *str);
+      num += compl_add(comp, buf);
+    }
+  }
+
+  buf_free(&buf);
+
+  if (num > 0)
+    compl_changed(comp);
+
+  return num;
+}
+
+/**
+ * compl_compact_norms - rebuild the pool of normalised strings without the removed items
+ *
+ * @param comp Completion struct
+ */
+static void compl_compact_norms(Completion *comp)
+{
+  CompletionPool norms = { 0 };
+
+  CompletionItem *item = NULL;
+  ARRAY_FOREACH_FROM(item, comp->items, 1)
+  {
+    if (item->norm_off != COMPL_NORM_SAME)
+      item->norm_off = compl_pool_add(&norms, comp->norms.data + item->norm_off);
+  }
+
+  compl_pool_free(&comp->norms);
+  comp->norms = norms;
+}
+
+/**
+ * compl_compact_strings - copy the strings of the remaining items into a new arena
+ *
+ * The dedup table refers to the strings, so it's rebuilt as well.
+ *
+ * @param comp Completion struct
+ */
+static void compl_compact_strings(Completion *comp)
+{
+  CompletionArena strings = { 0 };
+
+  size_t bytes = 0;
+  CompletionItem *item = NULL;
+  ARRAY_FOREACH_FROM(item, comp->items, 1)
+  {
+    bytes += strlen(item->str) + 1;
+  }
+  compl_arena_reserve(&strings, bytes);
+
+  ARRAY_FOREACH_FROM(item, comp->items, 1)
+  {
+    item->str = compl_arena_add(&strings, item->str, strlen(item->str));
+  }
+
+  compl_arena_free(&comp->strings);
+  comp->strings = strings;
+  compl_dedup_rebuild(comp);
+}
+
+/**
+ * compl_compact - drop the removed items
+ *
+ * The list of items is compacted whenever items have been removed.  The
+ * indexes and string pools only once one in COMPL_COMPACT_RATIO of their
+ * items is gone, until then the removed ids are simply never looked up.
+ *
+ * @param comp Completion struct
+ */
+void compl_compact(Completion *comp)
+{
+  if (comp->n_removed > 0)
+  {
+    size_t keep = 1;
+    for (size_t i = 1; i < ARRAY_SIZE(comp->items); i++)
+    {
+      CompletionItem *item = ARRAY_GET(comp->items, i);
+      if (compl_is_removed(comp, item->id))
+        continue;
+
+      if (keep != i)
+        *ARRAY_GET(comp->items, keep) = *item;
+      keep++;
+    }
+
+    ARRAY_SHRINK(comp->items, ARRAY_SIZE(comp->items) - keep);
+    comp->n_removed = 0;
+  }
+
+  if ((comp->n_garbage == 0) ||
+      (comp->n_garbage * COMPL_COMPACT_RATIO < (size_t) compl_get_size(comp)))
+  {
+    return;
+  }
+
+  logdeb(4, "Compacting the indexes, %zu items removed.", comp->n_garbage);
+  ngram_remove(comp->ngrams, &comp->removed);
+  symdel_remove(comp->symdel, &comp->removed);
+  trie_remove(comp->trie, &comp->removed);
+  qgram_remove(comp->qgrams, &comp->removed);
+  bktree_free(&comp->bktree);
+  compl_compact_norms(comp);
+  compl_compact_strings(comp);
+  compl_columns_compact(comp);
+  comp->n_garbage = 0;
+}
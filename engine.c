@@ -42,6 +42,8 @@ Completion *compl_new(enum MuttMatchMode mode)
   comp->typed_item->buf = buf_new("");
   comp->typed_item->is_match = true;
   comp->typed_item->match_dist = -(MAX_TYPED + 1);
+  comp->typed_item->span_slot = -1;
+  comp->typed_item->id = 0;
 
   comp->cur_item = comp->typed_item;
 
@@ -53,8 +55,35 @@ Completion *compl_new(enum MuttMatchMode mode)
   logdeb(4, "Memory allocation for comp->items done.");
   ARRAY_INIT(comp->items);
   ARRAY_ADD(comp->items, *comp->cur_item);
+  comp->ascii = true;
 
   comp->regex_compiled = false;
+  comp->regex = NULL;
+  comp->regexes = NULL;
+
+  comp->dedup = dedup_new(0);
+  ARRAY_INIT(&comp->removed);
+  comp->n_removed = 0;
+  comp->n_garbage = 0;
+
+  comp->next_id = 1;
+  comp->ngrams = NULL;
+  comp->max_dist = -1;
+  comp->bktree = NULL;
+  comp->symdel = NULL;
+  comp->trie = NULL;
+  comp->qgrams = (mode == COMPL_MODE_FUZZY) ? qgram_new(false) : NULL;
+
+  memset(&comp->strings, 0, sizeof(comp->strings));
+  memset(&comp->norms, 0, sizeof(comp->norms));
+  ARRAY_INIT(&comp->masks);
+  ARRAY_INIT(&comp->columns);
+
+  comp->n_highlight = 0;
+  comp->spans = NULL;
+
+  comp->max_len = 0;
+  comp->scratch = mutt_mem_calloc(1, sizeof(CompletionScratch));
   return comp;
 }
 
@@ -68,33 +97,366 @@ Completion *compl_new(enum MuttMatchMode mode)
 Completion * compl_from_array(const struct CompletionStringList *list, enum MuttMatchMode mode)
 {
   Completion *comp = compl_new(mode);
+  compl_add_many(comp, (const char **) list->entries, NULL, ARRAY_SIZE(list));
+  return comp;
+}
 
-  char **item;
-  ARRAY_FOREACH(item, list)
+/**
+ * compl_scan_release - free the tables of a prepared search
+ *
+ * @param scan prepared search
+ */
+static void compl_scan_release(CompletionScan *scan)
+{
+  if (scan->filter)
   {
-    struct Buffer *buf = buf_new(*item);
-    compl_add(comp, buf);
-    buf_free(&buf);
-  };
+    size_t rejected = 0;
+    size_t checked = qgram_stats(scan->filter, &rejected);
+    logdeb(5, "Q-gram filter: %zu of %zu items rejected.", rejected - scan->n_rejected,
+           checked - scan->n_checked);
+    scan->filter = NULL;
+  }
 
-  return comp;
+  if (scan->searching)
+    compl_search_free(&scan->search);
+  scan->searching = false;
+  FREE(&scan->row_dist);
+  FREE(&scan->trie_dist);
+  FREE(&scan->pass);
+  FREE(&scan->cand);
+}
+
+/**
+ * compl_scan_abort - drop a search scored in slices
+ *
+ * @param comp Completion struct
+ */
+static void compl_scan_abort(Completion *comp)
+{
+  if (!comp->scan)
+    return;
+
+  compl_scan_release(comp->scan);
+  FREE(&comp->scan);
 }
 
 /**
  * Function to free the Completion struct
  *
- * @param comp Completion struct to free
+ * @param ptr Completion struct to free, set to NULL
  */
-void compl_free(Completion *comp) {
-  CompletionItem *item;
-  ARRAY_FOREACH(item, comp->items)
-  {
-    buf_free(&item->buf);
-  };
+void compl_free(Completion **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
 
-  /* the typed item is the only one which is allocated */
+  Completion *comp = *ptr;
+  /* the typed item is the only one with a buffer, the list only has a copy */
+  buf_free(&comp->typed_item->buf);
   free(comp->typed_item);
   ARRAY_FREE(comp->items);
+  FREE(&comp->items);
+  compl_arena_free(&comp->strings);
+  FREE(&comp->spans);
+  regcache_free(&comp->regexes);
+  compl_pool_free(&comp->norms);
+  ARRAY_FREE(&comp->masks);
+  compl_columns_free(comp);
+  ngram_free(&comp->ngrams);
+  bktree_free(&comp->bktree);
+  symdel_free(&comp->symdel);
+  trie_free(&comp->trie);
+  qgram_free(&comp->qgrams);
+  dedup_free(&comp->dedup);
+  ARRAY_FREE(&comp->removed);
+  compl_scan_abort(comp);
+  compl_scratch_free(comp->scratch);
+  FREE(&comp->scratch);
+  FREE(ptr);
+}
+
+/**
+ * build the trigram index over all items
+ *
+ * The index expects ascending ids, but the list may have been sorted already.
+ *
+ * @param comp Completion struct
+ */
+static void compl_build_ngrams(Completion *comp)
+{
+  CompletionItem **by_id = mutt_mem_calloc(comp->next_id, sizeof(CompletionItem *));
+  CompletionItem *item = NULL;
+  ARRAY_FOREACH_FROM(item, comp->items, 1)
+  {
+    by_id[item->id] = item;
+  }
+
+  comp->ngrams = ngram_new();
+  for (uint32_t id = 1; id < comp->next_id; id++)
+  {
+    if (by_id[id])
+      ngram_add(comp->ngrams, id, by_id[id]->str);
+  }
+
+  FREE(&by_id);
+}
+
+/**
+ * make sure the next strings of a given total size fit into the current block
+ *
+ * @param arena string arena
+ * @param size number of bytes, including the terminating '\0's
+ */
+void compl_arena_reserve(CompletionArena *arena, size_t size)
+{
+  if (!ARRAY_EMPTY(&arena->blocks) && (arena->used + size <= arena->size))
+    return;
+
+  arena->size = MAX(size, COMPL_ARENA_BLOCK);
+  arena->used = 0;
+  ARRAY_ADD(&arena->blocks, mutt_mem_malloc(arena->size));
+}
+
+/**
+ * copy a string into a string arena
+ *
+ * Unlike a string pool, the arena never reallocates, so the strings can be
+ * referenced directly.
+ *
+ * @param arena string arena
+ * @param str string to add
+ * @param len length of the string
+ * @retval ptr copy of the string
+ */
+const char *compl_arena_add(CompletionArena *arena, const char *str, size_t len)
+{
+  compl_arena_reserve(arena, len + 1);
+
+  char *copy = *ARRAY_LAST(&arena->blocks) + arena->used;
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  arena->used += len + 1;
+  return copy;
+}
+
+/**
+ * give back the space of the string added last, e.g. a skipped duplicate
+ *
+ * @param arena string arena
+ * @param str string returned by the last compl_arena_add()
+ */
+void compl_arena_undo(CompletionArena *arena, const char *str)
+{
+  const char *block = *ARRAY_LAST(&arena->blocks);
+  arena->used = str - block;
+}
+
+/**
+ * free all strings of a string arena
+ *
+ * @param arena string arena
+ */
+void compl_arena_free(CompletionArena *arena)
+{
+  char **block = NULL;
+  ARRAY_FOREACH(block, &arena->blocks)
+  {
+    FREE(block);
+  }
+
+  ARRAY_FREE(&arena->blocks);
+  arena->used = 0;
+  arena->size = 0;
+}
+
+/**
+ * add a string to a string pool
+ *
+ * @param pool string pool
+ * @param str string to add
+ * @retval num offset of the string in the pool
+ */
+uint32_t compl_pool_add(CompletionPool *pool, const char *str)
+{
+  if (!str)
+    str = "";
+
+  size_t len = mutt_str_len(str) + 1;
+  if (pool->len + len > pool->size)
+  {
+    pool->size = MAX(pool->size * 2, pool->len + len + 256);
+    mutt_mem_realloc(&pool->data, pool->size);
+  }
+
+  uint32_t off = pool->len;
+  memcpy(pool->data + off, str, len);
+  pool->len += len;
+  return off;
+}
+
+/**
+ * free the memory of a string pool
+ *
+ * @param pool string pool
+ */
+void compl_pool_free(CompletionPool *pool)
+{
+  FREE(&pool->data);
+  pool->len = 0;
+  pool->size = 0;
+}
+
+/**
+ * make sure the scratch memory has at least a given size
+ *
+ * The memory only ever grows, and its contents aren't kept when it does.
+ *
+ * @param scratch scratch memory
+ * @param size number of bytes needed
+ * @retval ptr scratch memory
+ */
+void *compl_scratch_reserve(CompletionScratch *scratch, size_t size)
+{
+  if (size <= scratch->size)
+    return scratch->data;
+
+  FREE(&scratch->data);
+  scratch->size = MAX(size, scratch->size * 2);
+  scratch->data = mutt_mem_malloc(scratch->size);
+  return scratch->data;
+}
+
+/**
+ * free the scratch memory
+ *
+ * @param scratch scratch memory
+ */
+void compl_scratch_free(CompletionScratch *scratch)
+{
+  FREE(&scratch->data);
+  scratch->size = 0;
+}
+
+/**
+ * store the normalised form of an item for magic matching
+ *
+ * Most items don't change when normalised, so only the ones that do are
+ * stored, one after the other in a single string pool.
+ *
+ * @param comp Completion struct
+ * @param item item to normalise
+ */
+static void compl_add_norm(Completion *comp, CompletionItem *item)
+{
+  item->norm_off = COMPL_NORM_SAME;
+
+  char *norm = mbs_fold(item->str);
+  if (!norm)
+    return;
+
+  item->norm_off = compl_pool_add(&comp->norms, norm);
+  FREE(&norm);
+}
+
+/**
+ * get the normalised form of an item for magic matching
+ *
+ * @param comp Completion struct
+ * @param item item
+ * @retval ptr normalised string
+ */
+static const char *compl_item_norm(const Completion *comp, const CompletionItem *item)
+{
+  if (item->norm_off == COMPL_NORM_SAME)
+    return item->str;
+
+  return comp->norms.data + item->norm_off;
+}
+
+/**
+ * make room for more items, keeping the current item
+ *
+ * Growing the list may move the items, so cur_item is pointed at the same
+ * item again.  It may also be the typed item, which isn't part of the list.
+ *
+ * @param comp Completion struct
+ * @param num  number of items to make room for
+ */
+void compl_items_reserve(Completion *comp, size_t num)
+{
+  if (ARRAY_CAPACITY(comp->items) > num)
+    return;
+
+  const bool in_list = (comp->cur_item != comp->typed_item);
+  const size_t idx = in_list ? ARRAY_IDX(comp->items, comp->cur_item) : 0;
+  ARRAY_RESERVE(comp->items, num);
+  if (in_list)
+    comp->cur_item = ARRAY_GET(comp->items, idx);
+}
+
+/**
+ * add a string to the items, unless it's a duplicate
+ *
+ * The trigram index is left to the caller.
+ *
+ * Strings that aren't valid UTF-8 are skipped, they're returned as they are,
+ * so they can't be repaired.
+ *
+ * @param comp Completion struct
+ * @param str string to add
+ * @param len length of the string
+ * @retval ptr new item, or NULL for a duplicate or an invalid string
+ */
+static CompletionItem *compl_add_str(Completion *comp, const char *str, size_t len)
+{
+  CompletionItem new_item = { 0 };
+
+  int n_chars = utf8_validate(str, len);
+  if (n_chars < 0)
+  {
+    logdeb(4, "Invalid UTF-8 item skipped.");
+    return NULL;
+  }
+
+  // the string is copied first, so the dedup table can look up a terminated string
+  new_item.str = compl_arena_add(&comp->strings, str, len);
+
+  // don't add duplicates
+  if (dedup_find(comp->dedup, new_item.str))
+  {
+    compl_arena_undo(&comp->strings, new_item.str);
+    return NULL;
+  }
+
+  new_item.id = comp->next_id++;
+  new_item.is_match = false;
+  new_item.match_dist = -1;
+  new_item.span_slot = -1;
+  compl_add_norm(comp, &new_item);
+  dedup_add(comp->dedup, new_item.str, new_item.id);
+  if (new_item.id >= ARRAY_CAPACITY(&comp->masks))
+    ARRAY_RESERVE(&comp->masks, MAX(new_item.id, ARRAY_SIZE(&comp->masks) * 2));
+  ARRAY_SET(&comp->masks, new_item.id, charmask_str(new_item.str, false));
+  if ((size_t) n_chars != len)
+    comp->ascii = false;
+  if (len > comp->max_len)
+    comp->max_len = len;
+  if (comp->bktree)
+    bktree_add(comp->bktree, new_item.id,
+               bktree_magic(comp->bktree) ? compl_item_norm(comp, &new_item) : new_item.str);
+  if (comp->symdel)
+    symdel_add(comp->symdel, new_item.id,
+               symdel_magic(comp->symdel) ? compl_item_norm(comp, &new_item) : new_item.str);
+  if (comp->trie)
+    trie_add(comp->trie, new_item.id,
+             trie_magic(comp->trie) ? compl_item_norm(comp, &new_item) : new_item.str);
+  if (comp->qgrams)
+    qgram_add(comp->qgrams, new_item.id,
+              qgram_magic(comp->qgrams) ? compl_item_norm(comp, &new_item) : new_item.str);
+
+  compl_items_reserve(comp, ARRAY_SIZE(comp->items) + 1);
+  ARRAY_ADD(comp->items, new_item);
+  return ARRAY_LAST(comp->items);
 }
 
 /**
@@ -111,29 +473,159 @@ int compl_add(Completion *comp, const struct Buffer *buf)
   if (buf_is_empty(buf))
     return 0;
 
-  CompletionItem new_item = { 0 };
+  // rows have to be added with all of their fields
+  if (!ARRAY_EMPTY(&comp->columns))
+  {
+    logerr("CompAdd: use compl_add_row() for lists with columns.");
+    return 0;
+  }
+
+  CompletionItem *item = compl_add_str(comp, buf_string(buf), buf_len(buf));
+  if (!item)
+  {
+    logdeb(4, "Duplicate or invalid item skipped.");
+    return 0;
+  }
 
-  // use buffer copying for memory allocation
-  new_item.buf = buf_dup(buf);
+  logdeb(4, "Added item '%s' successfully.", item->str);
 
-  new_item.is_match = false;
-  new_item.match_dist = -1;
+  // keep the trigram index up to date, once it's worth having one
+  if (comp->ngrams)
+    ngram_add(comp->ngrams, item->id, item->str);
+  else if (compl_get_size(comp) > COMPL_NGRAM_THRESHOLD)
+    compl_build_ngrams(comp);
 
-  // don't add duplicates
-  if (!compl_check_duplicate(comp, new_item.buf))
+  return 1;
+}
+
+/**
+ * adds many strings to the list of possible completions at once
+ *
+ * Storage for the strings, the items and the dedup table is sized once for the
+ * whole batch, and the trigram index is built once at the end, instead of
+ * growing with every single item.
+ *
+ * @param comp Completion struct
+ * @param strs strings to add, empty ones and duplicates are skipped
+ * @param lens length of every string, or NULL to use strlen()
+ * @param num number of strings
+ * @retval num number of added items
+ */
+size_t compl_add_many(Completion *comp, const char **strs, const size_t *lens, size_t num)
+{
+  if (!compl_health_check(comp) || !strs || (num == 0))
+    return 0;
+
+  if (!ARRAY_EMPTY(&comp->columns))
   {
-    ARRAY_ADD(comp->items, new_item);
-    logdeb(4, "Added item '%s' successfully.", buf_strdup(new_item.buf));
+    logerr("CompAddMany: use compl_add_row() for lists with columns.");
+    return 0;
   }
-  else
+
+  size_t bytes = 0;
+  for (size_t i = 0; i < num; i++)
+  {
+    if (strs[i])
+      bytes += (lens ? lens[i] : strlen(strs[i])) + 1;
+  }
+
+  size_t size = compl_get_size(comp);
+  compl_arena_reserve(&comp->strings, bytes);
+  compl_items_reserve(comp, ARRAY_SIZE(comp->items) + num);
+  ARRAY_RESERVE(&comp->masks, comp->next_id + num);
+  dedup_reserve(comp->dedup, size + num);
+
+  bool index = (comp->ngrams != NULL);
+  size_t added = 0;
+  for (size_t i = 0; i < num; i++)
+  {
+    if (!strs[i])
+      continue;
+
+    size_t len = lens ? lens[i] : strlen(strs[i]);
+    if (len == 0)
+      continue;
+
+    CompletionItem *item = compl_add_str(comp, strs[i], len);
+    if (!item)
+      continue;
+
+    if (index)
+      ngram_add(comp->ngrams, item->id, item->str);
+    added++;
+  }
+
+  if (!comp->ngrams && (compl_get_size(comp) > COMPL_NGRAM_THRESHOLD))
+    compl_build_ngrams(comp);
+
+  logdeb(4, "Added %zu of %zu items.", added, num);
+  return added;
+}
+
+/**
+ * stream the items of a Completion from a source
+ *
+ * Instead of adding all items up front, they are pulled in chunks while
+ * searching, only until the next match is found.  Pulled items are kept, so
+ * the next search starts with them, and only pulls more when it runs out of
+ * matches.
+ *
+ * @param comp Completion struct
+ * @param provider callback returning the next strings, NULL to stop streaming
+ * @param data passed to the provider
+ * @param chunk number of strings to pull at once, 0 for the default
+ * @retval success 1 if successful, 0 otherwise
+ */
+int compl_set_provider(Completion *comp, CompletionProvider provider, void *data, size_t chunk)
+{
+  if (!compl_health_check(comp))
+    return 0;
+
+  if (!ARRAY_EMPTY(&comp->columns))
   {
-    logdeb(4, "Duplicate item '%s' skipped.", buf_strdup(new_item.buf));
+    logerr("CompSetProvider: lists with columns can't be streamed.");
     return 0;
   }
 
+  comp->provider = provider;
+  comp->provider_data = data;
+  comp->provider_chunk = chunk ? chunk : COMPL_PROVIDER_CHUNK;
+  if (comp->state != COMPL_STATE_NEW)
+    comp->state = COMPL_STATE_INIT;
+
   return 1;
 }
 
+/**
+ * compl_pull - add the next chunk of items from the provider
+ *
+ * The provider is dropped once it is exhausted.
+ *
+ * @param comp Completion struct
+ * @retval bool true if the provider returned any strings
+ */
+static bool compl_pull(Completion *comp)
+{
+  if (!comp->provider)
+    return false;
+
+  const char **strs = mutt_mem_calloc(comp->provider_chunk, sizeof(char *));
+  size_t num = comp->provider(comp->provider_data, strs, comp->provider_chunk);
+  if (num > 0)
+    compl_add_many(comp, strs, NULL, MIN(num, comp->provider_chunk));
+  FREE(&strs);
+
+  if (num == 0)
+  {
+    logdeb(4, "Provider exhausted after %d items.", compl_get_size(comp) - 1);
+    comp->provider = NULL;
+    comp->provider_data = NULL;
+    return false;
+  }
+
+  return true;
+}
+
 /**
  * compile the regular expression from the typed string
  *
@@ -143,36 +635,50 @@ int compl_add(Completion *comp, const struct Buffer *buf)
  * @note this is automatically called when using the API functions
  */
 int compl_compile_regex(Completion *comp) {
+  if (!comp->regexes)
+    comp->regexes = regcache_new(COMPL_REGEX_CACHE);
+
+  comp->regex = regcache_get(comp->regexes, buf_string(comp->typed_item->buf), comp->flags);
+  comp->regex_compiled = (comp->regex != NULL);
+  return comp->regex_compiled;
+}
+
+/**
+ * compile a regular expression with the matching flags
+ *
+ * @param regex set to the compiled regex
+ * @param str regular expression
+ * @param flags matching flags
+ * @retval success 1 if successful, 0 otherwise
+ */
+int compl_regcomp(regex_t *regex, const char *str, MuttMatchFlags flags)
+{
   int comp_flags = REG_EXTENDED | REG_NEWLINE;
 
-  if (comp->flags & COMPL_MATCH_IGNORECASE)
+  if (flags & COMPL_MATCH_IGNORECASE)
     comp_flags |= REG_ICASE;
 
-  int errcode = regcomp(&comp->regex, buf_strdup(comp->typed_item->buf), comp_flags);
+  int errcode = regcomp(regex, str, comp_flags);
 
   // successful compilation
   if (errcode == 0)
-  {
-    comp->regex_compiled = true;
     return 1;
-  }
 
   // try a error message size of 20 first
   char *errmsg = calloc(20, sizeof(char));
-  int errsize = regerror(errcode, &comp->regex, errmsg, 20);
+  int errsize = regerror(errcode, regex, errmsg, 20);
 
   // potential reallocation to fit the whole error message
   if (errsize >= 20)
   {
     free(errmsg);
-    char *errmsg = calloc(errsize, sizeof(char));
-    regerror(errcode, &comp->regex, errmsg, errsize);
+    errmsg = calloc(errsize, sizeof(char));
+    regerror(errcode, regex, errmsg, errsize);
   }
 
   logerr("RegexCompilation: Error when compiling string. %s", errmsg);
 
   free(errmsg);
-  comp->regex_compiled = false;
   return 0;
 }
 
@@ -196,98 +702,1050 @@ int compl_type(Completion *comp, const struct Buffer *buf)
     return 1;
   }
 
-  // copy typed string into completion
-  buf_copy(comp->typed_item->buf, buf);
+  // copy typed string into completion, the kernels rely on valid UTF-8
+  if (utf8_sanitise(buf_string(buf), buf_len(buf), comp->typed_item->buf) > 0)
+    logdeb(4, "Invalid UTF-8 in the typed string replaced.");
 
   logdeb(4, "Typing: '%s'", buf_strdup(comp->typed_item->buf));
 
   comp->state = COMPL_STATE_INIT;
 
-  // flag regex compilation out of date after typing
+  // a search scored in slices is for the old input
+  compl_scan_abort(comp);
+
+  // flag regex compilation out of date after typing, the old pattern stays cached
   comp->regex_compiled = false;
+  comp->regex = NULL;
   return 1;
 }
 
 /**
- * qsort sorting function for CompletionItems.
+ * set the maximum distance of fuzzy matches
  *
- * Items will be sorted following these criteria (in sequence)
- *  - match
- *  - match distance
- *  - alphabetical
+ * With a limit, large lists find their fuzzy candidates with a BK-tree,
+ * instead of scoring every item.  Approximate regex matches allow as many
+ * edits.
  *
- * @param a pointer to CompletionItem a
- * @param b pointer to CompletionItem b
- * @retval cmp -1 if a precedes b, 0 if a equals b, 1 if b preceds a
+ * @param comp Completion struct
+ * @param max_dist maximum distance, -1 for no limit
+ * @retval success 1 if successful, 0 otherwise
  */
-static int compl_sort_fn(const void *a, const void *b) {
-  const CompletionItem *itema = (const CompletionItem *)a;
-  const CompletionItem *itemb = (const CompletionItem *)b;
+int compl_set_max_dist(Completion *comp, int max_dist)
+{
+  if (!compl_health_check(comp))
+    return 0;
 
-  // non-matches go to the back of the list (and are sorted alphabetically)
-  if (itema->is_match && !itemb->is_match)
+  comp->max_dist = (max_dist < 0) ? -1 : max_dist;
+  if (comp->state != COMPL_STATE_NEW)
+    comp->state = COMPL_STATE_INIT;
+  return 1;
+}
+
+/**
+ * set the number of matches whose spans are recorded for highlighting
+ *
+ * The spans of a match are kept in a slot of Completion.spans, numbered by a
+ * 16-bit CompletionItem.span_slot, so there are at most COMPL_MAX_HIGHLIGHT.
+ *
+ * @param comp Completion struct
+ * @param num number of matches with spans, 0 for none
+ * @retval success 1 if successful, 0 otherwise
+ */
+int compl_set_highlight(Completion *comp, size_t num)
+{
+  if (!compl_health_check(comp))
+    return 0;
+
+  comp->n_highlight = MIN(num, COMPL_MAX_HIGHLIGHT);
+
+  // the slots of a search scored in slices are numbered for the old count
+  compl_scan_abort(comp);
+  if (comp->state != COMPL_STATE_NEW)
+    comp->state = COMPL_STATE_INIT;
+  return 1;
+}
+
+/**
+ * compl_build_symdel - index the deletion variants of all items
+ *
+ * @param comp Completion struct
+ * @param magic index the normalised forms
+ */
+static void compl_build_symdel(Completion *comp, bool magic)
+{
+  symdel_free(&comp->symdel);
+  comp->symdel = symdel_new(magic);
+
+  CompletionItem *item = NULL;
+  ARRAY_FOREACH_FROM(item, comp->items, 1)
+  {
+    if (!compl_is_removed(comp, item->id))
+      symdel_add(comp->symdel, item->id, magic ? compl_item_norm(comp, item) : item->str);
+  }
+
+  size_t n_variants = 0;
+  size_t bytes = symdel_memory(comp->symdel, &n_variants);
+  logdeb(4, "Built the deletion index, %zu variants, %zu KiB.", n_variants, bytes / 1024);
+}
+
+/**
+ * index the deletion variants of the items, for fuzzy searches
+ *
+ * The index answers fuzzy searches with a maximum distance of up to 2 with a
+ * few hash lookups, whatever the size of the list.  It holds a few hundred
+ * variants per item though, see compl_get_index_memory().  It's built right
+ * away, and kept up to date by compl_add().
+ *
+ * @param comp Completion struct
+ * @param enable true to build the index, false to drop it
+ * @retval success 1 if successful, 0 otherwise
+ */
+int compl_set_symdel(Completion *comp, bool enable)
+{
+  if (!compl_health_check(comp))
+    return 0;
+
+  if (!enable)
+    symdel_free(&comp->symdel);
+  else if (!comp->symdel)
+    compl_build_symdel(comp, comp->flags & COMPL_MATCH_MAGIC);
+
+  return 1;
+}
+
+/**
+ * compl_build_trie - add all items to a new trie
+ *
+ * @param comp Completion struct
+ * @param magic add the normalised forms
+ */
+static void compl_build_trie(Completion *comp, bool magic)
+{
+  trie_free(&comp->trie);
+  comp->trie = trie_new(magic);
+
+  CompletionItem *item = NULL;
+  ARRAY_FOREACH_FROM(item, comp->items, 1)
+  {
+    if (!compl_is_removed(comp, item->id))
+      trie_add(comp->trie, item->id, magic ? compl_item_norm(comp, item) : item->str);
+  }
+
+  logdeb(4, "Built the trie, %zu KiB.", trie_memory(comp->trie) / 1024);
+}
+
+/**
+ * score fuzzy and regex searches over a trie of the items
+ *
+ * Items sharing a prefix share the work for it, and each keystroke only
+ * extends the work of the last one, so a search costs about one step per
+ * distinct prefix, instead of a matrix per item.  Regex searches run an
+ * automaton of the pattern over the trie the same way, skipping the subtrees
+ * below a match or where the pattern can't match any more.  The trie keeps a
+ * few cells per node, see compl_get_index_memory().  It's built right away,
+ * and kept up to date by compl_add().
+ *
+ * @param comp Completion struct
+ * @param enable true to build the trie, false to drop it
+ * @retval success 1 if successful, 0 otherwise
+ */
+int compl_set_trie(Completion *comp, bool enable)
+{
+  if (!compl_health_check(comp))
+    return 0;
+
+  if (!enable)
+    trie_free(&comp->trie);
+  else if (!comp->trie)
+    compl_build_trie(comp, comp->flags & COMPL_MATCH_MAGIC);
+
+  return 1;
+}
+
+/**
+ * qsort sorting function for CompletionItems.
+ *
+ * Items will be sorted following these criteria (in sequence)
+ *  - match
+ *  - match distance
+ *  - alphabetical
+ *
+ * @param a pointer to CompletionItem a
+ * @param b pointer to CompletionItem b
+ * @retval cmp -1 if a precedes b, 0 if a equals b, 1 if b preceds a
+ */
+static int compl_sort_fn(const void *a, const void *b) {
+  const CompletionItem *itema = (const CompletionItem *)a;
+  const CompletionItem *itemb = (const CompletionItem *)b;
+
+  // non-matches go to the back of the list (and are sorted alphabetically)
+  if (itema->is_match && !itemb->is_match)
+    return -1;
+  else if (!itema->is_match && itemb->is_match)
+    return 1;
+  else if (!itema->is_match && !itemb->is_match)
+    return mutt_str_coll(itema->str, itemb->str);
+
+  // the typed string stays at the front
+  if (itema->match_dist == -(MAX_TYPED + 1))
+    return -1;
+  else if (itemb->match_dist == -(MAX_TYPED + 1))
+    return 1;
+
+  // matches are sorted by match distance
+  int dist_diff = itema->match_dist - itemb->match_dist;
+  if (dist_diff != 0)
+    return dist_diff;
+
+  // matches with equal match distance are sorted alphabetically
+  return mutt_str_coll(itema->str, itemb->str);
+}
+
+/**
+ * compl_keep_spans - store the match spans of an item if it is among the best matches
+ *
+ * Only the best n_highlight matches keep their spans.  Once all slots are
+ * taken, a better match takes over the slot of the worst one.
+ *
+ * @param comp Completion struct
+ * @param item matched item
+ * @param spans spans recorded while scoring the item
+ * @param top items currently holding a slot
+ * @param n_top number of items in top
+ * @param worst index in top of the worst match holding a slot
+ */
+static void compl_keep_spans(Completion *comp, CompletionItem *item,
+                             const struct CompletionSpanList *spans,
+                             CompletionItem **top, size_t *n_top, size_t *worst)
+{
+  size_t t = *n_top;
+
+  if (*n_top < comp->n_highlight)
+  {
+    item->span_slot = (*n_top)++;
+  }
+  else
+  {
+    // not better than the worst match with spans
+    if (compl_sort_fn(item, top[*worst]) >= 0)
+      return;
+
+    t = *worst;
+    item->span_slot = top[t]->span_slot;
+    top[t]->span_slot = -1;
+    top[t]->n_spans = 0;
+  }
+
+  top[t] = item;
+  item->n_spans = ARRAY_SIZE(spans);
+  memcpy(&comp->spans[item->span_slot * COMPL_MAX_SPANS], spans->entries,
+         item->n_spans * sizeof(CompletionSpan));
+
+  // find the next match to be replaced
+  for (size_t i = 0; i < *n_top; i++)
+  {
+    if (compl_sort_fn(top[i], top[*worst]) > 0)
+      *worst = i;
+  }
+}
+
+/**
+ * compl_fuzzy_candidates - find the items within the maximum distance
+ *
+ * The deletion index is used if it's enabled and the distance is small
+ * enough.  Otherwise the BK-tree, which is built on the first search that can
+ * use it, and kept up to date by compl_add() from then on.
+ *
+ * @param comp Completion struct
+ * @param ids list to fill with the candidate ids
+ * @retval num number of candidates, or -1 if all items need scoring
+ */
+static int compl_fuzzy_candidates(Completion *comp, struct NgramIdList *ids)
+{
+  const char *typed = buf_string(comp->typed_item->buf);
+  // the trie scores all items anyway
+  if ((comp->max_dist < 0) || (*typed == '\0') || comp->trie)
+    return -1;
+
+  bool magic = (comp->flags & COMPL_MATCH_MAGIC);
+  char *norm = magic ? mbs_fold(typed) : NULL;
+  const char *key = norm ? norm : typed;
+
+  if (comp->symdel)
+  {
+    if (symdel_magic(comp->symdel) != magic)
+      compl_build_symdel(comp, magic);
+
+    int num = symdel_query(comp->symdel, key, comp->max_dist, ids);
+    if (num >= 0)
+    {
+      FREE(&norm);
+      return num;
+    }
+  }
+
+  if (compl_get_size(comp) <= COMPL_BKTREE_THRESHOLD)
+  {
+    FREE(&norm);
+    return -1;
+  }
+
+  if (comp->bktree && (bktree_magic(comp->bktree) != magic))
+    bktree_free(&comp->bktree);
+
+  if (!comp->bktree)
+  {
+    comp->bktree = bktree_new(magic);
+    CompletionItem *item = NULL;
+    ARRAY_FOREACH_FROM(item, comp->items, 1)
+    {
+      bktree_add(comp->bktree, item->id, magic ? compl_item_norm(comp, item) : item->str);
+    }
+    logdeb(4, "Built the BK-tree, %d items.", compl_get_size(comp));
+  }
+
+  int num = bktree_query(comp->bktree, key, comp->max_dist, ids);
+  FREE(&norm);
+  return num;
+}
+
+/**
+ * compl_candidates - use an index to limit the items to score
+ *
+ * Substring and suffix searches use the trigram index, fuzzy searches with a
+ * maximum distance the deletion index or the BK-tree.
+ *
+ * @param comp Completion struct
+ * @retval ptr bitmap of candidate item ids, NULL if all items need scoring
+ */
+static uint8_t *compl_candidates(Completion *comp)
+{
+  if (!ARRAY_EMPTY(&comp->columns))
+    return NULL;
+
+  struct NgramIdList ids = ARRAY_HEAD_INITIALIZER;
+  int num = -1;
+  if (comp->ngrams && ((comp->mode == COMPL_MODE_SUBSTRING) || (comp->mode == COMPL_MODE_SUFFIX)))
+    num = ngram_query(comp->ngrams, buf_string(comp->typed_item->buf), &ids);
+  else if (comp->mode == COMPL_MODE_FUZZY)
+    num = compl_fuzzy_candidates(comp, &ids);
+
+  if (num < 0)
+  {
+    ARRAY_FREE(&ids);
+    return NULL;
+  }
+
+  uint8_t *cand = mutt_mem_calloc(comp->next_id / 8 + 1, sizeof(uint8_t));
+  uint32_t *id = NULL;
+  ARRAY_FOREACH(id, &ids)
+  {
+    cand[*id / 8] |= (1 << (*id % 8));
+  }
+
+  logdeb(5, "Index: %zu candidates.", ARRAY_SIZE(&ids));
+  ARRAY_FREE(&ids);
+  return cand;
+}
+
+/**
+ * compl_charmask_pass - reject the items lacking characters of the typed string
+ *
+ * A single pass over the signatures of all items, before any kernel runs.
+ * Prefix, substring, suffix and subsequence matches need all typed
+ * characters, fuzzy matches all but the maximum distance of them (the first
+ * one aside, the kernel aligns it anyway).
+ *
+ * @param comp   Completion struct
+ * @param num    set to the number of flags
+ * @param passed set to the number of items that may match
+ * @retval ptr flag per item id, 0 for items that can't match, NULL if all can
+ */
+static uint8_t *compl_charmask_pass(Completion *comp, size_t *num, size_t *passed)
+{
+  const char *typed = buf_string(comp->typed_item->buf);
+  int max_missing = 0;
+  uint64_t need = 0;
+  switch (comp->mode)
+  {
+    case COMPL_MODE_EXACT:
+    case COMPL_MODE_SUBSTRING:
+    case COMPL_MODE_SUFFIX:
+    case COMPL_MODE_SUBSEQ:
+      need = charmask_str(typed, false);
+      break;
+    case COMPL_MODE_FUZZY:
+      if (comp->max_dist < 0)
+        return NULL;
+      max_missing = comp->max_dist;
+      need = charmask_str(typed, true);
+      break;
+    default:
+      return NULL;
+  }
+
+  if (need == 0)
+    return NULL;
+
+  *num = ARRAY_SIZE(&comp->masks);
+  uint8_t *pass = mutt_mem_malloc(MAX(*num, 1));
+  *passed = charmask_filter(comp->masks.entries, *num, need, max_missing, pass);
+  logdeb(5, "Character filter: %zu of %zu item ids may match.", *passed, *num);
+  return pass;
+}
+
+/**
+ * compl_trie_regex - regex distances of all items from the trie
+ *
+ * The automaton only tells which items match, their distances are those of
+ * score_regex().  Patterns the automaton doesn't support are left to regexec().
+ *
+ * @param comp Completion struct
+ * @retval ptr distance of every item, indexed by id, NULL if the trie can't be used
+ */
+static int *compl_trie_regex(Completion *comp)
+{
+  const char *typed = buf_string(comp->typed_item->buf);
+  struct RegexNfa *nfa = comp->regex_compiled ? regcache_nfa(comp->regexes, typed, comp->flags) : NULL;
+  if (!nfa)
+    return NULL;
+
+  // regexes match the items themselves
+  if (trie_magic(comp->trie))
+    compl_build_trie(comp, false);
+
+  uint8_t *matched = mutt_mem_calloc(comp->next_id, sizeof(uint8_t));
+  size_t steps = trie_regex(comp->trie, nfa, matched);
+
+  int *dists = mutt_mem_calloc(comp->next_id, sizeof(int));
+  size_t len = mutt_str_len(typed);
+  size_t n_matched = 0;
+  CompletionItem *item = NULL;
+  ARRAY_FOREACH_FROM(item, comp->items, 1)
+  {
+    size_t len_tar = mutt_str_len(item->str);
+    size_t diff = (len <= len_tar) ? len_tar - len : len - len_tar;
+    dists[item->id] = matched[item->id] ? (int) diff : -1;
+    n_matched += matched[item->id];
+  }
+  FREE(&matched);
+
+  logdeb(5, "Trie: regex stepped through %zu nodes, %zu items matched.", steps, n_matched);
+  return dists;
+}
+
+/**
+ * compl_trie_score - fuzzy or regex distances of all items from the trie
+ *
+ * @param comp Completion struct
+ * @retval ptr distance of every item, indexed by id, NULL if the trie can't be used
+ */
+static int *compl_trie_score(Completion *comp)
+{
+  const char *typed = buf_string(comp->typed_item->buf);
+  if (!comp->trie || (*typed == '\0'))
+    return NULL;
+
+  if (comp->mode == COMPL_MODE_REGEX)
+    return compl_trie_regex(comp);
+
+  if (comp->mode != COMPL_MODE_FUZZY)
+    return NULL;
+
+  bool magic = (comp->flags & COMPL_MATCH_MAGIC);
+  if (trie_magic(comp->trie) != magic)
+    compl_build_trie(comp, magic);
+
+  int *dists = mutt_mem_calloc(comp->next_id, sizeof(int));
+  char *norm = magic ? mbs_fold(typed) : NULL;
+  int extended = trie_fuzzy(comp->trie, norm ? norm : typed, dists);
+  FREE(&norm);
+  if (extended < 0)
+  {
+    FREE(&dists);
+    return NULL;
+  }
+
+  logdeb(5, "Trie: %d columns extended.", extended);
+  return dists;
+}
+
+/**
+ * compl_qgram_filter - prepare the q-gram filter for a fuzzy search
+ *
+ * The signatures are calculated by compl_add() for fuzzy lists, other lists
+ * get them on their first fuzzy search with a maximum distance.
+ *
+ * @param comp Completion struct
+ * @retval ptr filter prepared for the typed string, NULL if it can't be used
+ */
+static struct QgramFilter *compl_qgram_filter(Completion *comp)
+{
+  const char *typed = buf_string(comp->typed_item->buf);
+  if ((comp->mode != COMPL_MODE_FUZZY) || (comp->max_dist < 0) || (*typed == '\0'))
+    return NULL;
+
+  bool magic = (comp->flags & COMPL_MATCH_MAGIC);
+  if (!comp->qgrams || (qgram_magic(comp->qgrams) != magic))
+  {
+    qgram_free(&comp->qgrams);
+    comp->qgrams = qgram_new(magic);
+    CompletionItem *item = NULL;
+    ARRAY_FOREACH_FROM(item, comp->items, 1)
+    {
+      qgram_add(comp->qgrams, item->id, magic ? compl_item_norm(comp, item) : item->str);
+    }
+    logdeb(4, "Built the q-gram signatures, %zu KiB.", qgram_memory(comp->qgrams) / 1024);
+  }
+
+  char *norm = magic ? mbs_fold(typed) : NULL;
+  bool ready = qgram_prepare(comp->qgrams, norm ? norm : typed);
+  FREE(&norm);
+  return ready ? comp->qgrams : NULL;
+}
+
+/**
+ * compl_score_batch - score a batch of items and store their distances
+ *
+ * @param search prepared search
+ * @param batch items to score
+ * @param tars target strings of the items
+ * @param num number of items
+ * @param max_dist items further away don't match, -1 for no limit
+ */
+static void compl_score_batch(const CompletionSearch *search, CompletionItem **batch,
+                              const char **tars, size_t num, int max_dist)
+{
+  int dists[COMPL_BATCH_SIZE];
+
+  compl_search_batch(search, tars, num, dists);
+  for (size_t i = 0; i < num; i++)
+    batch[i]->match_dist = ((max_dist >= 0) && (dists[i] > max_dist)) ? -1 : dists[i];
+}
+
+/**
+ * compl_scan_search - prepare the typed string of a search for the kernel
+ *
+ * The items are scored in batches by the kernel variant for the flags (and
+ * encoding) of the search, with scratch memory for the longest item.
+ *
+ * @param comp Completion struct
+ * @param scan search to prepare
+ */
+static void compl_scan_search(Completion *comp, CompletionScan *scan)
+{
+  if (scan->searching)
+    compl_search_free(&scan->search);
+
+  scan->searching = !scan->row_dist &&
+                    compl_search_init(&scan->search, comp, comp->mode, comp->flags, comp->ascii);
+  scan->ascii = comp->ascii;
+  scan->max_len = comp->max_len;
+}
+
+/**
+ * compl_scan_prepare - prepare a search of the items
+ *
+ * The indexes and filters are queried once for all items, the items
+ * themselves are scored by compl_scan_items().
+ *
+ * @param comp Completion struct
+ * @param scan search to prepare
+ */
+static void compl_scan_prepare(Completion *comp, CompletionScan *scan)
+{
+  scan->mode = comp->mode;
+  scan->flags = comp->flags;
+  scan->next_id = comp->next_id;
+  scan->cand = compl_candidates(comp);
+
+  // rows are matched column by column, before going through the items
+  scan->row_dist = ARRAY_EMPTY(&comp->columns) ? NULL : compl_rows_score(comp);
+
+  memset(&scan->search, 0, sizeof(scan->search));
+  scan->searching = false;
+  compl_scan_search(comp, scan);
+  scan->max_dist = (comp->mode == COMPL_MODE_FUZZY) ? comp->max_dist : -1;
+  scan->n_pass = 0;
+  size_t passed = 0;
+  scan->pass = scan->searching ? compl_charmask_pass(comp, &scan->n_pass, &passed) : NULL;
+
+  // the trie scores every item, the kernel only those passing the character
+  // filter, so a selective filter beats the trie
+  bool trie = scan->searching &&
+              (!scan->pass || (passed * COMPL_TRIE_MIN_PASS >= scan->n_pass));
+  scan->trie_dist = trie ? compl_trie_score(comp) : NULL;
+  scan->filter = (scan->searching && !scan->trie_dist) ? compl_qgram_filter(comp) : NULL;
+  scan->n_rejected = 0;
+  scan->n_checked = qgram_stats(scan->filter, &scan->n_rejected);
+}
+
+/**
+ * compl_scan_extend - carry a prepared search over to the items added since
+ *
+ * The indexes and the trie only answer for the ids up to next_id, the items
+ * added later are left to the kernel, so the search isn't prepared again for
+ * every chunk of a streamed list.  Only the typed string is, if the new items
+ * are longer or not plain ASCII.  Rows are scored all at once, so a list with
+ * columns is prepared anew.
+ *
+ * @param comp Completion struct
+ * @param scan prepared search
+ */
+static void compl_scan_extend(Completion *comp, CompletionScan *scan)
+{
+  if (scan->row_dist)
+  {
+    compl_scan_release(scan);
+    compl_scan_prepare(comp, scan);
+    return;
+  }
+
+  if ((scan->ascii != comp->ascii) || (scan->max_len < comp->max_len))
+    compl_scan_search(comp, scan);
+}
+
+/**
+ * compl_scan_items - score the items in a range
+ *
+ * Earlier items keep their distances (and spans), but a better match among the
+ * new items can still take over their span slots.
+ *
+ * @param comp     Completion struct
+ * @param scan     prepared search
+ * @param from     index of the first item to score
+ * @param to       index after the last item to score
+ * @param deadline stop once compl_now_us() passes it, checked every batch, 0 for none
+ * @param n_matches set to the number of matches among the scored items
+ * @retval num index after the last item scored
+ */
+static size_t compl_scan_items(Completion *comp, CompletionScan *scan, size_t from,
+                               size_t to, uint64_t deadline, int *n_matches)
+{
+  CompletionItem *item = NULL;
+
+  // spans are recorded into a scratch list, and only kept for the best matches
+  struct CompletionSpanList scratch = ARRAY_HEAD_INITIALIZER;
+  struct CompletionSpanList *record = NULL;
+  CompletionItem **top = NULL;
+  size_t n_top = 0;
+  size_t worst = 0;
+
+  // n_highlight may have been set directly, the slot numbers are 16-bit
+  if (comp->n_highlight > COMPL_MAX_HIGHLIGHT)
+    comp->n_highlight = COMPL_MAX_HIGHLIGHT;
+
+  if (comp->n_highlight > 0)
+  {
+    mutt_mem_realloc(&comp->spans, comp->n_highlight * COMPL_MAX_SPANS * sizeof(CompletionSpan));
+    top = mutt_mem_calloc(comp->n_highlight, sizeof(CompletionItem *));
+    ARRAY_RESERVE(&scratch, COMPL_MAX_SPANS);
+    record = &scratch;
+
+    // the slots taken by the items scored before
+    ARRAY_FOREACH_FROM_TO(item, comp->items, 1, from)
+    {
+      if (item->span_slot < 0)
+        continue;
+
+      if ((n_top > 0) && (compl_sort_fn(item, top[worst]) > 0))
+        worst = n_top;
+      top[n_top++] = item;
+    }
+  }
+
+  const CompletionSearch *search = &scan->search;
+  const int max_dist = scan->max_dist;
+  CompletionItem *batch[COMPL_BATCH_SIZE];
+  const char *tars[COMPL_BATCH_SIZE];
+  size_t n_batch = 0;
+  size_t end = to;
+
+  ARRAY_FOREACH_FROM_TO(item, comp->items, from, to)
+  {
+    // a slice ends on the first batch boundary after its deadline
+    size_t idx = ARRAY_FOREACH_IDX_item;
+    if (deadline && (idx > from) && (((idx - from) % COMPL_BATCH_SIZE) == 0) &&
+        (compl_now_us() >= deadline))
+    {
+      end = idx;
+      break;
+    }
+
+    item->match_dist = -1;
+    item->span_slot = -1;
+    item->n_spans = 0;
+
+    // items without all trigrams of the typed string can't match
+    if (scan->cand && (item->id < scan->next_id) &&
+        !(scan->cand[item->id / 8] & (1 << (item->id % 8))))
+      continue;
+
+    if (scan->row_dist)
+    {
+      item->match_dist = scan->row_dist[item->id];
+      continue;
+    }
+
+    if (!scan->searching)
+      continue;
+
+    // items lacking typed characters, or enough bigrams of the typed string
+    if (scan->pass && (item->id < scan->n_pass) && !scan->pass[item->id])
+      continue;
+    if (scan->filter && !qgram_check(scan->filter, item->id, max_dist))
+      continue;
+
+    // magic searches match the normalised forms
+    const char *target = search->magic ? compl_item_norm(comp, item) : item->str;
+
+    // the trie has scored all items, only the best matches need the kernel for their spans
+    if (scan->trie_dist && (item->id < scan->next_id))
+    {
+      item->match_dist = scan->trie_dist[item->id];
+      if ((max_dist >= 0) && (item->match_dist > max_dist))
+        item->match_dist = -1;
+      item->is_match = (item->match_dist >= 0);
+      if (record && item->is_match &&
+          ((n_top < comp->n_highlight) || (compl_sort_fn(item, top[worst]) < 0)))
+      {
+        ARRAY_SHRINK(&scratch, ARRAY_SIZE(&scratch));
+        compl_search_score(search, target, record);
+        compl_keep_spans(comp, item, &scratch, top, &n_top, &worst);
+      }
+      continue;
+    }
+
+    // spans are recorded one item at a time
+    if (record)
+    {
+      ARRAY_SHRINK(&scratch, ARRAY_SIZE(&scratch));
+      item->match_dist = compl_search_score(search, target, record);
+      if ((max_dist >= 0) && (item->match_dist > max_dist))
+        item->match_dist = -1;
+      item->is_match = (item->match_dist >= 0);
+      if (item->is_match)
+        compl_keep_spans(comp, item, &scratch, top, &n_top, &worst);
+      continue;
+    }
+
+    batch[n_batch] = item;
+    tars[n_batch] = target;
+    n_batch++;
+    if (n_batch == COMPL_BATCH_SIZE)
+    {
+      compl_score_batch(search, batch, tars, n_batch, max_dist);
+      n_batch = 0;
+    }
+  }
+
+  if (n_batch > 0)
+    compl_score_batch(search, batch, tars, n_batch, max_dist);
+
+  *n_matches = 0;
+  ARRAY_FOREACH_FROM_TO(item, comp->items, from, end)
+  {
+    item->is_match = (item->match_dist >= 0);
+    if (item->is_match)
+    {
+      logdeb(5, "'%s' matched: '%s'", buf_string(comp->typed_item->buf), item->str);
+      (*n_matches)++;
+    }
+  }
+
+  FREE(&top);
+  ARRAY_FREE(&scratch);
+
+  return end;
+}
+
+/**
+ * compl_pull_matches - pull items from the provider until some of them match
+ *
+ * @param comp Completion struct
+ * @param scan prepared search, carried over to the pulled items
+ * @retval num number of matches among the pulled items
+ */
+static int compl_pull_matches(Completion *comp, CompletionScan *scan)
+{
+  int n_matches = 0;
+  while ((n_matches == 0) && comp->provider)
+  {
+    size_t from = ARRAY_SIZE(comp->items);
+    if (!compl_pull(comp))
+      break;
+
+    compl_scan_extend(comp, scan);
+    compl_scan_items(comp, scan, from, ARRAY_SIZE(comp->items), 0, &n_matches);
+  }
+
+  return n_matches;
+}
+
+static void compl_state_init(Completion *comp)
+{
+  logdeb(5, "Initialising completion...");
+
+  // a search scored in slices is done over
+  compl_scan_abort(comp);
+
+  // drop removed items before scoring
+  compl_compact(comp);
+
+  // the items pulled so far are searched first, a streamed list only pulls
+  // more items if none of them match
+  CompletionScan scan = { 0 };
+  int n_matches = 0;
+  compl_scan_prepare(comp, &scan);
+  compl_scan_items(comp, &scan, 1, ARRAY_SIZE(comp->items), 0, &n_matches);
+  if (n_matches == 0)
+    n_matches = compl_pull_matches(comp, &scan);
+  compl_scan_release(&scan);
+
+  ARRAY_SORT(comp->items, compl_sort_fn);
+
+  if (n_matches == 0)
+  {
+    comp->state = COMPL_STATE_NOMATCH;
+    comp->cur_item = comp->typed_item;
+    logdeb(4, "No match for '%s'.", buf_strdup(comp->typed_item->buf));
+  }
+  else if (n_matches >= 1)
+  {
+    if (n_matches > 1)
+      comp->state = COMPL_STATE_MULTI;
+    else
+      comp->state = COMPL_STATE_SINGLE;
+
+    // first found item gets assigned to match
+    comp->cur_item = ARRAY_GET(comp->items, 1);
+  }
+}
+
+/**
+ * compl_state_more - continue a streamed search after its last match
+ *
+ * The new matches are sorted in after the matches shown already, so cycling
+ * carries on with them, instead of returning to the typed string.
+ *
+ * @param comp Completion struct
+ */
+static void compl_state_more(Completion *comp)
+{
+  CompletionScan scan = { 0 };
+  compl_scan_prepare(comp, &scan);
+  int n_matches = compl_pull_matches(comp, &scan);
+  compl_scan_release(&scan);
+  if (n_matches == 0)
+    return;
+
+  size_t first = 1;
+  while ((first < ARRAY_SIZE(comp->items)) && ARRAY_GET(comp->items, first)->is_match)
+    first++;
+
+  qsort(comp->items->entries + first, ARRAY_SIZE(comp->items) - first,
+        sizeof(CompletionItem), compl_sort_fn);
+
+  comp->state = COMPL_STATE_MULTI;
+  comp->cur_item = ARRAY_GET(comp->items, first);
+}
+
+/**
+ * compl_now_us - monotonic clock, for the deadlines of compl_score_step()
+ *
+ * @retval num microseconds since an unspecified point in time
+ */
+uint64_t compl_now_us(void)
+{
+  struct timespec ts = { 0 };
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * compl_rank_slice - sort the matches of a slice in with the matches found before
+ *
+ * The matches are moved to the front, after the typed item, and the
+ * non-matches take their places.  So whenever a slice ends, the matches found
+ * so far are ranked as they will be once the search is finished.
+ *
+ * @param comp Completion struct
+ * @param scan search scored in slices
+ * @param from index of the first item of the slice
+ * @param end  index after the last item of the slice
+ */
+static void compl_rank_slice(Completion *comp, CompletionScan *scan, size_t from, size_t end)
+{
+  CompletionItem *items = comp->items->entries;
+  const size_t first = scan->n_ranked + 1;
+  size_t last = first;
+
+  for (size_t i = from; i < end; i++)
+  {
+    if (!items[i].is_match)
+      continue;
+
+    if (i != last)
+    {
+      CompletionItem tmp = items[i];
+      items[i] = items[last];
+      items[last] = tmp;
+    }
+    last++;
+  }
+
+  const size_t num = last - first;
+  if (num == 0)
+    return;
+
+  // merge from the back, only the matches ranked after new ones move
+  qsort(items + first, num, sizeof(CompletionItem), compl_sort_fn);
+  CompletionItem *run = mutt_mem_malloc(num * sizeof(CompletionItem));
+  memcpy(run, items + first, num * sizeof(CompletionItem));
+  size_t a = first;
+  size_t b = num;
+  size_t out = last;
+  while (b > 0)
+  {
+    if ((a > 1) && (compl_sort_fn(&items[a - 1], &run[b - 1]) > 0))
+      items[--out] = items[--a];
+    else
+      items[--out] = run[--b];
+  }
+  FREE(&run);
+
+  scan->n_ranked += num;
+}
+
+/**
+ * compl_score_step - score the items in slices, for a single-threaded event loop
+ *
+ * Every call carries on with the search of the typed string, until max_items
+ * are scored or the deadline passes (checked every COMPL_BATCH_SIZE items).
+ * In between, the matches found so far are ranked at the front of the list,
+ * after the typed item.  Typing drops the search, so the next call starts
+ * over, and compl_complete() finishes it in one go.
+ *
+ * The indexes answer for all items in the first slice.  Items added in
+ * between are scored by the kernel, non-matches are only sorted with
+ * COMPL_MATCH_SHOWALL.
+ *
+ * @param comp      Completion struct
+ * @param max_items maximum number of items to score, 0 for no limit
+ * @param deadline  stop once compl_now_us() passes it, 0 for no deadline
+ * @param n_matches optional, set to the number of matches found so far
+ * @retval num number of items left to score, 0 once the search is finished, -1 on error
+ */
+int compl_score_step(Completion *comp, size_t max_items, uint64_t deadline, size_t *n_matches)
+{
+  if (!compl_health_check(comp))
     return -1;
-  else if (!itema->is_match && itemb->is_match)
-    return 1;
-  else if (!itema->is_match && !itemb->is_match)
-    return buf_coll(itema->buf, itemb->buf);
 
-  // the typed string stays at the front
-  if (itema->match_dist == -(MAX_TYPED + 1))
-    return -1;
-  else if (itemb->match_dist == -(MAX_TYPED + 1))
-    return 1;
+  if (n_matches)
+    *n_matches = 0;
 
-  // matches are sorted by match distance
-  int dist_diff = itema->match_dist - itemb->match_dist;
-  if (dist_diff != 0)
-    return dist_diff;
+  // the typed string and flags of a search don't change halfway
+  if ((comp->state == COMPL_STATE_SCORING) &&
+      ((comp->scan->mode != comp->mode) || (comp->scan->flags != comp->flags)))
+  {
+    comp->state = COMPL_STATE_INIT;
+  }
 
-  // matches with equal match distance are sorted alphabetically
-  return buf_coll(itema->buf, itemb->buf);
-}
+  // nothing typed, or the search is finished, its matches are at the front
+  if ((comp->state != COMPL_STATE_INIT) && (comp->state != COMPL_STATE_SCORING))
+  {
+    size_t n = 1;
+    while ((comp->state != COMPL_STATE_NEW) && (n < ARRAY_SIZE(comp->items)) &&
+           ARRAY_GET(comp->items, n)->is_match)
+    {
+      n++;
+    }
+    if (n_matches)
+      *n_matches = n - 1;
+    return 0;
+  }
 
-static void compl_state_init(Completion *comp)
-{
-  logdeb(5, "Initialising completion...");
-  int n_matches = 0;
-  CompletionItem *item = NULL;
+  if (comp->state == COMPL_STATE_INIT)
+  {
+    if ((comp->mode == COMPL_MODE_REGEX) && !comp->regex_compiled && !compl_compile_regex(comp))
+      return -1;
 
-  ARRAY_FOREACH_FROM(item, comp->items, 1)
+    compl_scan_abort(comp);
+    compl_compact(comp);
+    comp->scan = mutt_mem_calloc(1, sizeof(CompletionScan));
+    comp->scan->next = 1;
+    compl_scan_prepare(comp, comp->scan);
+    comp->state = COMPL_STATE_SCORING;
+    logdeb(5, "Scoring in slices...");
+  }
+
+  CompletionScan *scan = comp->scan;
+
+  // items added since are left to the kernel
+  compl_scan_extend(comp, scan);
+
+  // the matches are ranked every COMPL_STEP_ITEMS, so that ranking them
+  // doesn't overrun the deadline much either
+  size_t budget = max_items ? max_items : SIZE_MAX;
+  while (budget > 0)
   {
-    item->match_dist = match_dist(item->buf, comp);
-    if (item->match_dist >= 0)
+    if (scan->next == ARRAY_SIZE(comp->items))
     {
-      logdeb(5, "'%s' matched: '%s'", buf_strdup(comp->typed_item->buf), buf_strdup(item->buf));
-      item->is_match = true;
+      // a streamed list only pulls more items if none of them match
+      if ((scan->n_ranked > 0) || !compl_pull(comp))
+        break;
 
-      n_matches++;
+      compl_scan_extend(comp, scan);
     }
+
+    size_t to = MIN(ARRAY_SIZE(comp->items), scan->next + MIN(budget, COMPL_STEP_ITEMS));
+    int n = 0;
+    size_t end = compl_scan_items(comp, scan, scan->next, to, deadline, &n);
+    compl_rank_slice(comp, scan, scan->next, end);
+    budget -= end - scan->next;
+    scan->next = end;
+
+    if (deadline && (compl_now_us() >= deadline))
+      break;
   }
 
-  ARRAY_SORT(comp->items, compl_sort_fn);
+  if (n_matches)
+    *n_matches = scan->n_ranked;
 
-  if (n_matches == 0)
+  size_t left = ARRAY_SIZE(comp->items) - scan->next;
+  if ((left == 0) && (scan->n_ranked == 0) && comp->provider)
+    left = comp->provider_chunk;
+  if (left > 0)
+    return MIN(left, INT_MAX);
+
+  const size_t n_ranked = scan->n_ranked;
+  compl_scan_abort(comp);
+
+  if (comp->flags & COMPL_MATCH_SHOWALL)
+  {
+    qsort(comp->items->entries + n_ranked + 1, ARRAY_SIZE(comp->items) - n_ranked - 1,
+          sizeof(CompletionItem), compl_sort_fn);
+  }
+
+  // the next compl_complete() returns the first match
+  if (n_ranked == 0)
   {
     comp->state = COMPL_STATE_NOMATCH;
     comp->cur_item = comp->typed_item;
-    logdeb(4, "No match for '%s'.", buf_strdup(comp->typed_item->buf));
+    logdeb(4, "No match for '%s'.", buf_string(comp->typed_item->buf));
   }
-  else if (n_matches >= 1)
+  else
   {
-    if (n_matches > 1)
-      comp->state = COMPL_STATE_MULTI;
-    else
-      comp->state = COMPL_STATE_SINGLE;
-
-    // first found item gets assigned to match
-    comp->cur_item = ARRAY_GET(comp->items, 1);
+    comp->state = (n_ranked > 1) ? COMPL_STATE_MULTI : COMPL_STATE_SINGLE;
+    comp->cur_item = ARRAY_GET(comp->items, 0);
   }
+
+  return 0;
 }
 
 static void compl_state_single(Completion *comp)
 {
-  int next_i = ARRAY_IDX(comp->items, comp->cur_item) + 1;
+  size_t next_i = ARRAY_IDX(comp->items, comp->cur_item) + 1;
 
   // cycle back to beginning if reaching end of array
   if (next_i == ARRAY_SIZE(comp->items))
@@ -305,7 +1763,7 @@ static void compl_state_multi(Completion *comp)
 {
   CompletionItem *item = NULL;
 
-  int next_i = ARRAY_IDX(comp->items, comp->cur_item) + 1;
+  size_t next_i = ARRAY_IDX(comp->items, comp->cur_item) + 1;
 
   // cycle back to beginning
   if (next_i == ARRAY_SIZE(comp->items))
@@ -322,8 +1780,9 @@ static void compl_state_multi(Completion *comp)
     }
   }
 
-  // when we reach the end without finding anything, step back to the typed item
-  comp->cur_item = comp->typed_item;
+  // when we reach the end without finding anything, step back to the typed
+  // item (its copy in the list, so the next call starts over from there)
+  comp->cur_item = ARRAY_GET(comp->items, 0);
 }
 
 struct Buffer *compl_complete(Completion *comp)
@@ -340,7 +1799,7 @@ struct Buffer *compl_complete(Completion *comp)
   // recompile out-of-date regex
   if ((comp->mode == COMPL_MODE_REGEX) && !comp->regex_compiled)
   {
-    if (compl_compile_regex(comp) != 0)
+    if (!compl_compile_regex(comp))
     {
       return NULL;
       // TODO how do we handle a failed regex compilation
@@ -355,6 +1814,13 @@ struct Buffer *compl_complete(Completion *comp)
       compl_state_init(comp);
       break;
 
+    // finish a search scored in slices, with its first match
+    case COMPL_STATE_SCORING:
+      compl_score_step(comp, 0, 0, NULL);
+      if (comp->state != COMPL_STATE_NOMATCH)
+        comp->cur_item = ARRAY_GET(comp->items, 1);
+      break;
+
     // no match -> keep the typed item
     case COMPL_STATE_NOMATCH:
       comp->cur_item = comp->typed_item;
@@ -363,30 +1829,137 @@ struct Buffer *compl_complete(Completion *comp)
     // return to typed string after matching single item
     case COMPL_STATE_SINGLE:
       compl_state_single(comp);
+
+      // a streamed list may have more matches
+      if ((comp->cur_item->id == 0) && comp->provider && !(comp->flags & COMPL_MATCH_FIRSTMATCH))
+        compl_state_more(comp);
       break;
 
     case COMPL_STATE_MULTI: // use next match
       // matching only first hit -> return to the initial match
       if (comp->flags & COMPL_MATCH_FIRSTMATCH)
+      {
         compl_state_single(comp);
-      else
-        compl_state_multi(comp);
+        break;
+      }
+
+      compl_state_multi(comp);
+
+      // a streamed list may have more matches
+      if ((comp->cur_item->id == 0) && comp->provider)
+        compl_state_more(comp);
       break;
     case COMPL_STATE_NEW:
     default:
       comp->cur_item = comp->typed_item;
   }
 
-  struct Buffer *result = comp->cur_item->buf;
+  // the list only holds a copy of the typed item
+  const char *result = (comp->cur_item->id == 0) ? buf_string(comp->typed_item->buf) :
+                                                   comp->cur_item->str;
 
   // TODO shall we use an existing pointer argument instead?
 
   // allocate new pointer for result
-  struct Buffer *match = buf_dup(result);
+  struct Buffer *match = buf_new(result);
   logdeb(4, "Match is '%s'\n", buf_strdup(match));
   return match;
 }
 
+/**
+ * get the match spans of the current completion, for highlighting
+ *
+ * Spans are only recorded for the best n_highlight matches.
+ *
+ * @param comp Completion struct
+ * @param spans set to the spans of the current item
+ * @retval num number of spans (0 if none are available)
+ */
+size_t compl_get_spans(const Completion *comp, const CompletionSpan **spans)
+{
+  if (!compl_health_check(comp) || !spans)
+    return 0;
+
+  *spans = NULL;
+  const CompletionItem *item = comp->cur_item;
+  if (!item || (item->span_slot < 0) || !comp->spans)
+    return 0;
+
+  *spans = &comp->spans[item->span_slot * COMPL_MAX_SPANS];
+  return item->n_spans;
+}
+
+/**
+ * get the memory used by the search indexes
+ *
+ * Counts the trigram index, the BK-tree, the deletion index and the trie, to decide
+ * whether an index is worth its memory for a list.
+ *
+ * @param comp Completion struct
+ * @retval num size in bytes
+ */
+size_t compl_get_index_memory(const Completion *comp)
+{
+  if (!compl_health_check(comp))
+    return 0;
+
+  return ngram_memory(comp->ngrams) + bktree_memory(comp->bktree) +
+         symdel_memory(comp->symdel, NULL) + trie_memory(comp->trie);
+}
+
+/**
+ * get the number of regex compilations saved by the cache
+ *
+ * The last few patterns stay compiled, so typing, backspacing and typing
+ * again only compiles each of them once.
+ *
+ * @param comp Completion struct
+ * @param n_compiled set to the number of patterns compiled (may be NULL)
+ * @retval num number of patterns found compiled
+ */
+size_t compl_get_regex_stats(const Completion *comp, size_t *n_compiled)
+{
+  if (n_compiled)
+    *n_compiled = 0;
+
+  if (!compl_health_check(comp))
+    return 0;
+
+  return regcache_stats(comp->regexes, n_compiled);
+}
+
+/**
+ * add a match to a list of spans
+ *
+ * Matches directly following the last span extend it.  If the list is full,
+ * the last span is extended to cover the new match instead.
+ *
+ * @param spans list of spans
+ * @param start first matched character
+ * @param len number of matched characters
+ */
+void compl_span_add(struct CompletionSpanList *spans, int start, int len)
+{
+  if (!spans || (len <= 0) || (start < 0))
+    return;
+
+  // positions are 16-bit, the rest of a longer item isn't highlighted
+  if (start >= UINT16_MAX)
+    return;
+  if (len > UINT16_MAX - start)
+    len = UINT16_MAX - start;
+
+  CompletionSpan *last = ARRAY_LAST(spans);
+  if (last && ((last->start + last->len == start) || (ARRAY_SIZE(spans) >= COMPL_MAX_SPANS)))
+  {
+    last->len = start + len - last->start;
+    return;
+  }
+
+  CompletionSpan span = { .start = start, .len = len };
+  ARRAY_ADD(spans, span);
+}
+
 int compl_health_check(const Completion *comp)
 {
   if (!comp)
@@ -411,7 +1984,7 @@ int compl_health_check(const Completion *comp)
 
 int compl_get_size(Completion *comp)
 {
-  return ARRAY_SIZE(comp->items);
+  return ARRAY_SIZE(comp->items) - comp->n_removed;
 }
 
 bool compl_check_duplicate(const Completion *comp, const struct Buffer *buf)
@@ -422,30 +1995,55 @@ bool compl_check_duplicate(const Completion *comp, const struct Buffer *buf)
   if (buf_is_empty(buf))
     return true;
 
-  CompletionItem *item;
-  ARRAY_FOREACH(item, comp->items)
+  return dedup_find(comp->dedup, buf_string(buf)) != 0;
+}
+
+/**
+ * compl_dedup_rebuild - rebuild the dedup table, e.g. after the strings moved
+ *
+ * @param comp Completion struct
+ */
+void compl_dedup_rebuild(Completion *comp)
+{
+  dedup_free(&comp->dedup);
+  comp->dedup = dedup_new(compl_get_size(comp));
+
+  CompletionItem *item = NULL;
+  ARRAY_FOREACH_FROM(item, comp->items, 1)
   {
-    if (buf_str_equal(item->buf, buf))
-      return true;
-  };
+    if (!compl_is_removed(comp, item->id))
+      dedup_add(comp->dedup, item->str, item->id);
+  }
+}
 
-  return false;
+/**
+ * compl_is_removed - check for the tombstone of an item
+ *
+ * @param comp Completion struct
+ * @param id item id
+ * @retval bool true if the item has been removed
+ */
+bool compl_is_removed(const Completion *comp, uint32_t id)
+{
+  const bool *removed = ARRAY_GET(&comp->removed, id);
+  return removed && *removed;
 }
 
 /**
- * dist_regex calculates the string distance between the source- and target-string,
+ * score_regex calculates the string distance between the source- and target-string,
  * by utilising the compiled regular expression
  *
+ * @param q prepared query with the compiled regular expression
  * @param tar target string
- * @param regex compiled regular expression
+ * @param spans optional list to record the matched characters in
  * @retval int distance between the strings (or -1 if no match at all)
  */
-static int dist_regex(const char *tar, const Completion *comp)
+int score_regex(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans)
 {
   int dist = -1;
   regmatch_t pmatch[1];
 
-  if (!comp->regex_compiled)
+  if (!q->regex)
   {
     logerr("DistRegex: Regex needs to be compiled first!");
     return -1;
@@ -455,13 +2053,26 @@ static int dist_regex(const char *tar, const Completion *comp)
   int regex_flags = REG_EXTENDED;
 
   // check for a match
-  if (regexec(&comp->regex, tar, 1, pmatch, regex_flags) == REG_NOMATCH)
+  if (regexec(q->regex, tar, 1, pmatch, regex_flags) == REG_NOMATCH)
   {
     logdeb(4, "DistRegex: No match found.");
     return -1;
   }
 
-  size_t src_len = mutt_str_len(comp->typed_item->buf->data);
+  // regmatch_t holds byte offsets, spans are counted in characters
+  if (spans && (pmatch[0].rm_eo > pmatch[0].rm_so))
+  {
+    int start = 0;
+    int len = 0;
+    const char *c = tar;
+    for (; c < tar + pmatch[0].rm_so; c += MAX(MBCHARLEN(c), 1))
+      start++;
+    for (; c < tar + pmatch[0].rm_eo; c += MAX(MBCHARLEN(c), 1))
+      len++;
+    compl_span_add(spans, start, len);
+  }
+
+  size_t src_len = q->len;
   size_t tar_len = mutt_str_len(tar);
 
   // match distance is the number of additions needed to match the string
@@ -475,98 +2086,296 @@ static int dist_regex(const char *tar, const Completion *comp)
   return dist;
 }
 
+/**
+ * exact_kernel - exact matching, specialised through its constant arguments
+ *
+ * Returns -1 if there is no match, or the number of characters to add to the
+ * typed string to get to the target.
+ *
+ * @param q prepared query
+ * @param tar target string
+ * @param spans optional list to record the matched characters in
+ * @param ignorecase true to ignore the case of the characters
+ * @param ascii true if typed string and target are plain ASCII
+ * @retval int distance between the strings (or -1 if no match at all)
+ */
+static inline int exact_kernel(const CompletionQuery *q, const char *tar,
+                               struct CompletionSpanList *spans,
+                               const bool ignorecase, const bool ascii)
+{
+  if (!tar || (q->n_chars < 0))
+    return -1;
+
+  // the prefix is compared first, most targets don't match
+  if (ascii || !ignorecase)
+  {
+    if (ignorecase ? (mutt_istrn_cmp(q->src, tar, q->len) != 0) :
+                     !mutt_strn_equal(q->src, tar, q->len))
+    {
+      return -1;
+    }
+
+    // plain ASCII: characters are bytes
+    if (ascii)
+    {
+      compl_span_add(spans, 0, q->len);
+      return mutt_str_len(tar) - q->len;
+    }
+
+    compl_span_add(spans, 0, q->n_chars);
+    return mbs_char_count(tar) - q->n_chars;
+  }
+
+  // the typed characters are lowercase already
+  const char *c = tar;
+  for (int i = 0; i < q->n_chars; i++)
+  {
+    wchar_t wc = 0;
+    int n = utf8_next(c, &wc);
+    if (n <= 0)
+      return -1;
+    if (compl_casefold(wc) != q->w_src[i])
+      return -1;
+    c += n;
+  }
+
+  compl_span_add(spans, 0, q->n_chars);
+  return mbs_char_count(tar) - q->n_chars;
+}
+
 /**
  * matches the source against the target string, using exact comparison.
  * Returns -1 if there is no match, or 0 if the strings match.
  * If COMPL_MATCH_IGNORECASE is set, it will ignore case.
  *
- * @param src source string
+ * This is the generic version, deciding on the flags for every target.
+ *
+ * @param q prepared query
  * @param tar target string
- * @param flags completion flags
+ * @param spans optional list to record the matched characters in
  */
-static int dist_exact(const char *tar, const Completion *comp)
+int score_exact(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans)
 {
-  char *src = buf_strdup(comp->typed_item->buf);
-  bool src_mbs = is_mbs(src);
-  bool tar_mbs = is_mbs(tar);
+  return exact_kernel(q, tar, spans, q->flags & COMPL_MATCH_IGNORECASE, q->ascii);
+}
+
+/**
+ * EXACT_VARIANT - exact matching kernel and scoring loop for fixed flags
+ */
+#define EXACT_VARIANT(NAME, IGNORECASE, ASCII)                                 \
+  static int NAME(const CompletionQuery *q, const char *tar,                   \
+                  struct CompletionSpanList *spans)                            \
+  {                                                                            \
+    return exact_kernel(q, tar, spans, IGNORECASE, ASCII);                     \
+  }                                                                            \
+                                                                               \
+  static void NAME##_batch(const CompletionQuery *q, const char **tars,        \
+                           size_t num, int *dists)                             \
+  {                                                                            \
+    for (size_t i = 0; i < num; i++)                                           \
+      dists[i] = exact_kernel(q, tars[i], NULL, IGNORECASE, ASCII);            \
+  }
+
+EXACT_VARIANT(exact_mbs, false, false)
+EXACT_VARIANT(exact_mbs_icase, true, false)
+EXACT_VARIANT(exact_ascii, false, true)
+EXACT_VARIANT(exact_ascii_icase, true, true)
+
+/**
+ * score_exact_select - pick the exact matching variant for a query
+ *
+ * @param q prepared query
+ */
+void score_exact_select(CompletionQuery *q)
+{
+  if (q->ascii)
+  {
+    q->kernel = (q->flags & COMPL_MATCH_IGNORECASE) ? exact_ascii_icase : exact_ascii;
+    q->batch = (q->flags & COMPL_MATCH_IGNORECASE) ? exact_ascii_icase_batch : exact_ascii_batch;
+  }
+  else
+  {
+    q->kernel = (q->flags & COMPL_MATCH_IGNORECASE) ? exact_mbs_icase : exact_mbs;
+    q->batch = (q->flags & COMPL_MATCH_IGNORECASE) ? exact_mbs_icase_batch : exact_mbs_batch;
+  }
+}
+
+/**
+ * score_substring_scratch - scratch memory of the substring and suffix kernels
+ *
+ * @param len_src number of typed characters, not used
+ * @param len_tar number of target characters
+ * @retval num bytes needed for the decoded target
+ */
+size_t score_substring_scratch(int len_src, size_t len_tar)
+{
+  (void) len_src;
+  return (len_tar + 1) * sizeof(wchar_t);
+}
+
+/**
+ * find_substring - find the typed string in the target
+ *
+ * @param q prepared query
+ * @param tar target string
+ * @param suffix true if the typed string has to be at the end of the target
+ * @param len_tar set to the number of target characters
+ * @retval num character position of the match, or -1 for no match
+ */
+static int find_substring(const CompletionQuery *q, const char *tar, bool suffix, int *len_tar)
+{
+  if (!tar)
+    tar = "";
 
-  int len_src = mutt_str_len(src);
-  int len_tar = mutt_str_len(tar);
+  *len_tar = mbs_char_count(tar);
 
-  // source string length needs to be shorter for substring matching
-  if (len_src > len_tar)
+  if ((q->n_chars < 0) || (*len_tar < 0) || (q->n_chars > *len_tar))
     return -1;
 
-  // compare all bytes of src with tar
-  if (comp->flags & COMPL_MATCH_IGNORECASE)
+  if (!(q->flags & COMPL_MATCH_IGNORECASE))
   {
-    if (src_mbs || tar_mbs)
+    const char *found = NULL;
+    if (suffix)
     {
-      len_src = mbs_char_count(src);
-      len_tar = mbs_char_count(tar);
-      wchar_t w_src[len_src + 1];
-      wchar_t w_tar[len_tar + 1];
-      // TODO add an equivalent function to mutt/mbyte
-      mbstowcs(w_src, src, len_src + 1);
-      mbstowcs(w_tar, tar, len_src + 1);
-
-      for (int i = 0; i < mbs_char_count(src); i++)
-      {
-        if (iswalpha(w_src[i]) && iswalpha(w_tar[i])) {
-          if (towlower(w_src[i]) != towlower(w_tar[i]))
-            return -1;
-        }
-        else if (w_src[i] != w_tar[i]) {
-          return -1;
-        }
-      }
-
-      return (len_tar - len_src);
+      // fewer typed characters can still take more bytes
+      size_t bytes_tar = mutt_str_len(tar);
+      if (((size_t) q->len <= bytes_tar) && mutt_str_equal(q->src, tar + bytes_tar - q->len))
+        return *len_tar - q->n_chars;
+    }
+    else
+    {
+      found = strstr(tar, q->src);
     }
 
-    if (mutt_istrn_cmp(src, tar, len_src) == 0)
-      return len_tar - len_src;
-  }
-  else {
-    if (!mutt_strn_equal(src, tar, len_src))
+    if (!found)
       return -1;
 
-    // insertions are calculated differently for mbs
-    if (src_mbs || tar_mbs)
-      return (mbs_char_count(tar) - mbs_char_count(src));
-    else
-      return len_tar - len_src;
+    // convert the byte offset into a character position
+    int pos = 0;
+    for (const char *c = tar; c < found; c += MBCHARLEN(c))
+      pos++;
+    return pos;
+  }
+
+  if (q->n_chars == 0)
+    return suffix ? *len_tar : 0;
+
+  // the typed characters are lowercase already
+  wchar_t *w_tar = compl_scratch_reserve(q->scratch, score_substring_scratch(q->n_chars, *len_tar));
+  utf8_decode(tar, w_tar);
+  for (int i = 0; i < *len_tar; i++)
+    w_tar[i] = compl_casefold(w_tar[i]);
+
+  if (suffix)
+  {
+    if (wmemcmp(q->w_src, &w_tar[*len_tar - q->n_chars], q->n_chars) == 0)
+      return *len_tar - q->n_chars;
+    return -1;
   }
 
-  // no match
-  return -1;
+  const wchar_t *found = wcsstr(w_tar, q->w_src);
+  return found ? (found - w_tar) : -1;
+}
+
+/**
+ * matches the typed string anywhere in the target string.
+ *
+ * The distance is the number of characters around the match, where the
+ * characters in front of the match count double, so that matches closer to the
+ * start are preferred.
+ *
+ * @param q prepared query
+ * @param tar target string
+ * @param spans optional list to record the matched characters in
+ * @retval int distance between the strings (or -1 if no match at all)
+ */
+int score_substring(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans)
+{
+  int len_tar = 0;
+
+  int pos = find_substring(q, tar, false, &len_tar);
+  if (pos < 0)
+    return -1;
+
+  compl_span_add(spans, pos, q->n_chars);
+  return (len_tar - q->n_chars) + pos;
+}
+
+/**
+ * matches the typed string at the end of the target string.
+ *
+ * @param q prepared query
+ * @param tar target string
+ * @param spans optional list to record the matched characters in
+ * @retval int distance between the strings (or -1 if no match at all)
+ */
+int score_suffix(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans)
+{
+  int len_tar = 0;
+
+  int pos = find_substring(q, tar, true, &len_tar);
+  if (pos < 0)
+    return -1;
+
+  compl_span_add(spans, pos, q->n_chars);
+  return len_tar - q->n_chars;
 }
 
 /**
  * match_dist calculates the string distance between the typed and target-string,
  * based on the match method (MuttMatchFlags)
  *
- * When using COMPL_MODE_REGEX, the regular expression needs to be compiled
- * first (compl_compile_regex).
- *
  * @param strb target string
  * @retval int distance between the strings (or -1 if no match at all)
  */
 int match_dist(const struct Buffer *tar, const Completion *comp)
 {
-  int dist = -1;
-  const char *target = buf_strdup(tar);
+  return match_spans(tar, comp, NULL);
+}
 
-  switch (comp->mode)
-  {
-    case COMPL_MODE_FUZZY:
-      return dist_dam_lev(target, comp);
-    case COMPL_MODE_REGEX:
-      return dist_regex(target, comp);
-    case COMPL_MODE_EXACT:
-    default:
-      return dist_exact(target, comp);
-  }
+/**
+ * match_spans calculates the string distance like match_dist, and records which
+ * characters of the target were matched while doing so
+ *
+ * @param tar target string
+ * @param comp Completion
+ * @param spans optional list to record the matched characters in
+ * @retval int distance between the strings (or -1 if no match at all)
+ */
+int match_spans(const struct Buffer *tar, const Completion *comp, struct CompletionSpanList *spans)
+{
+  CompletionSearch search;
+  if (!compl_search_init(&search, comp, comp->mode, comp->flags, false))
+    return -1;
+
+  // normalise the target on the fly, compl_state_init() uses the stored forms
+  char *target = search.magic ? mbs_fold(buf_string(tar)) : NULL;
+  int dist = compl_search_score(&search, target ? target : buf_string(tar), spans);
+
+  FREE(&target);
+  compl_search_free(&search);
+  return dist;
+}
+
+/**
+ * match_str runs the matcher of the current mode on a target string
+ *
+ * The typed string is prepared for every call, so this is only meant for
+ * single strings, compl_state_init() prepares it once for all items.
+ *
+ * @param tar target string
+ * @param comp Completion
+ * @param spans optional list to record the matched characters in
+ * @retval int distance between the strings (or -1 if no match at all)
+ */
+int match_str(const char *tar, const Completion *comp, struct CompletionSpanList *spans)
+{
+  CompletionSearch search;
+  if (!compl_search_init(&search, comp, comp->mode, comp->flags & ~COMPL_MATCH_MAGIC, false))
+    return -1;
+
+  int dist = compl_search_score(&search, tar, spans);
 
+  compl_search_free(&search);
   return dist;
 }
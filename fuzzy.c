@@ -24,19 +24,25 @@ static int min(const int a, const int b, const int c)
   }
 }
 
-bool is_mbs(const char *str)
+/**
+ * is_ascii - check whether a string is plain ASCII
+ *
+ * @param str string to check
+ * @retval bool true if all bytes are 7-bit characters
+ */
+bool is_ascii(const char *str)
 {
-  if (str == NULL)
-    return false;
+  if (!str)
+    return true;
 
-  while (*str != '\0')
-  {
-    if (MBCHARLEN(str) > 1)
-      return true;
-    str++;
-  }
+  size_t len = strlen(str);
+  return utf8_ascii_prefix(str, len) == len;
+}
 
-  return false;
+bool is_mbs(const char *str)
+{
+  // in UTF-8, every non-ASCII byte belongs to a multibyte character
+  return str && !is_ascii(str);
 }
 
 /**
@@ -50,25 +56,64 @@ bool is_mbs(const char *str)
  */
 int mbs_char_count(const char *str)
 {
-  int i = 0, len = 0;
-
   if (!str)
     return 0;
 
-  while (str[i] && str[i] != '\0')
+  return utf8_validate(str, strlen(str));
+}
+
+/**
+ * mbs_fold - normalise a string for magic matching
+ *
+ * All characters are lowercased, and underscores are turned into dashes.  Every
+ * character maps to exactly one character, so character positions in the
+ * normalised string are the same as in the original one.
+ *
+ * @param str string to normalise
+ * @retval ptr allocated normalised string, or NULL if it equals the original
+ */
+char *mbs_fold(const char *str)
+{
+  if (!str)
+    return NULL;
+
+  // most strings are ASCII, and most of those don't change at all
+  if (is_ascii(str))
   {
-    // TODO does this make sense?
-    if (ISBADMBYTE(&str[i]))
-      return -1;
-    else if (ISLONGMBYTE(&str[i]))
-      i += mblen(&str[i], MB_CUR_MAX);
-    else
-      i += 1;
+    const char *c = str;
+    while (*c && !((*c >= 'A') && (*c <= 'Z')) && (*c != '_'))
+      c++;
+    if (*c == '\0')
+      return NULL;
 
-    len += 1;
+    char *folded = mutt_str_dup(str);
+    for (char *f = folded; *f; f++)
+      *f = (*f == '_') ? COMPL_MAGIC_SEPARATOR : compl_casefold(*f);
+    return folded;
+  }
+
+  int len = mbs_char_count(str);
+  if (len <= 0)
+    return NULL;
+
+  // fold one character at a time, long strings aren't decoded onto the stack
+  char *folded = mutt_mem_calloc(len * 4 + 1, sizeof(char));
+  char *f = folded;
+  wchar_t wc[2] = { 0 };
+  int n = 0;
+  for (const char *c = str; (n = utf8_next(c, &wc[0])) > 0; c += n)
+  {
+    wc[0] = (wc[0] == L'_') ? COMPL_MAGIC_SEPARATOR : compl_casefold(wc[0]);
+    f += utf8_encode(wc, f);
+  }
+
+  if (mutt_str_equal(folded, str))
+  {
+    FREE(&folded);
+    return NULL;
   }
 
-  return len;
+  return folded;
 }
 
 /**
@@ -157,6 +202,70 @@ int dist_lev(const char *stra, const char *strb)
   }
 }
 
+/**
+ * dam_lev_trace - walk the damerau-levenshtein matrix back to find the matches
+ *
+ * @param src typed string
+ * @param tar target string
+ * @param ca_idx byte offsets of the typed characters
+ * @param cb_idx byte offsets of the target characters
+ * @param len_src number of typed characters
+ * @param len_tar number of target characters
+ * @param d calculated distance matrix
+ * @param matched work memory for a flag per target character
+ * @param spans list to record the matched characters in
+ */
+static void dam_lev_trace(const char *src, const char *tar, const int *ca_idx,
+                          const int *cb_idx, int len_src, int len_tar,
+                          int d[len_src][len_tar], bool *matched,
+                          struct CompletionSpanList *spans)
+{
+  for (int j = 0; j < len_tar; j++)
+    matched[j] = false;
+
+  int i = len_src - 1;
+  int j = len_tar - 1;
+  while (i > 0 && j > 0)
+  {
+    bool equal = mb_equal(&src[ca_idx[i]], &tar[cb_idx[j]]);
+
+    if (d[i][j] == d[i - 1][j - 1] + (equal ? 0 : 1))
+    {
+      // unchanged or substituted
+      matched[j] = equal;
+      i--;
+      j--;
+    }
+    else if (i > 1 && j > 1 && (d[i][j] == d[i - 2][j - 2] + 1) &&
+             mb_equal(&src[ca_idx[i]], &tar[cb_idx[j - 1]]) &&
+             mb_equal(&src[ca_idx[i - 1]], &tar[cb_idx[j]]))
+    {
+      // transposed characters are still there, just swapped
+      matched[j] = true;
+      matched[j - 1] = true;
+      i -= 2;
+      j -= 2;
+    }
+    else if (d[i][j] == d[i - 1][j] + 1)
+    {
+      i--;
+    }
+    else
+    {
+      j--;
+    }
+  }
+
+  // the first characters are always aligned
+  matched[0] = mb_equal(src, tar);
+
+  for (j = 0; j < len_tar; j++)
+  {
+    if (matched[j])
+      compl_span_add(spans, j, 1);
+  }
+}
+
 /**
  * dam_lev - Calculate the damerau-levenshtein distance between two strings
  *
@@ -172,18 +281,56 @@ int dist_lev(const char *stra, const char *strb)
  */
 int dist_dam_lev(const char *tar, const struct Completion *comp)
 {
-  char *src;
-  if (!buf_is_empty(comp->typed_item->buf))
-  {
-    src = buf_strdup(comp->typed_item->buf);
-  }
-  else
-  {
-    src = "";
-  }
+  return dist_dam_lev_spans(tar, comp, NULL);
+}
 
-  int len_src = mbs_char_count(src);
-  int len_tar = mbs_char_count(tar);
+/**
+ * dist_dam_lev_spans - damerau-levenshtein distance, recording the match spans
+ *
+ * @param tar target string
+ * @param comp Completion
+ * @param spans optional list to record the matched characters in
+ * @retval int damerau-levenshtein distance between strings
+ */
+int dist_dam_lev_spans(const char *tar, const struct Completion *comp,
+                       struct CompletionSpanList *spans)
+{
+  CompletionQuery *q = compl_query_new(buf_string(comp->typed_item->buf), comp->flags, false);
+  int dist = score_fuzzy(q, tar, spans);
+  compl_query_free(&q);
+  return dist;
+}
+
+/**
+ * score_fuzzy_scratch - scratch memory of the damerau-levenshtein kernel
+ *
+ * @param len_src number of typed characters
+ * @param len_tar number of target characters
+ * @retval num bytes needed for the matrix, the target offsets and the trace
+ */
+size_t score_fuzzy_scratch(int len_src, size_t len_tar)
+{
+  return ((size_t) len_src * len_tar + len_tar) * sizeof(int) + len_tar * sizeof(bool);
+}
+
+/**
+ * dam_lev_kernel - damerau-levenshtein distance, specialised through its constant argument
+ *
+ * The characters of the target which are kept unchanged (or only transposed)
+ * by the cheapest edit sequence are recorded as match spans.
+ *
+ * @param q prepared query
+ * @param tar target string
+ * @param spans optional list to record the matched characters in
+ * @param ascii true if typed string and target are plain ASCII
+ * @retval int damerau-levenshtein distance between strings
+ */
+static inline int dam_lev_kernel(const CompletionQuery *q, const char *tar,
+                                 struct CompletionSpanList *spans, const bool ascii)
+{
+  const char *src = q->src;
+  int len_src = q->n_chars;
+  int len_tar = ascii ? (int) mutt_str_len(tar) : mbs_char_count(tar);
 
   // TODO maybe move these string sanity checks to function?
   if (len_src == -1 || len_tar == -1)
@@ -199,34 +346,30 @@ int dist_dam_lev(const char *tar, const struct Completion *comp)
     return len_src;
   }
 
-  int d[len_src][len_tar];
-  int ca_idx[len_src];
-  int cb_idx[len_tar];
+  // the matrix, the target offsets and the trace flags live in the scratch memory
+  int *mem = compl_scratch_reserve(q->scratch, score_fuzzy_scratch(len_src, len_tar));
+  int(*restrict d)[len_tar] = (int(*)[len_tar]) mem;
+  const int *ca_idx = q->idx;
+  int *restrict cb_idx = mem + (size_t) len_src * len_tar;
 
   int i = 0;
   int j = 0;
   int cost = 0;
 
   // initialise the list of symbol indices (supporting mbyte)
-  ca_idx[0] = 0;
-  for (i = 1; i < len_src; i++)
-  {
-    ca_idx[i] = ca_idx[i - 1] + MBCHARLEN(&src[ca_idx[i - 1]]);
-  }
-
   cb_idx[0] = 0;
   for (j = 1; j < len_tar; j++)
   {
-    cb_idx[j] = cb_idx[j - 1] + MBCHARLEN(&tar[cb_idx[j - 1]]);
+    cb_idx[j] = ascii ? j : cb_idx[j - 1] + MBCHARLEN(&tar[cb_idx[j - 1]]);
   }
 
-  // initialise calculation matrix
+  // plain ASCII characters are single bytes
+#define DAM_LEV_EQ(I, J)                                                       \
+  (ascii ? (src[I] == tar[J]) : mb_equal(&src[ca_idx[I]], &tar[cb_idx[J]]))
+
+  // initialise the borders of the matrix, all other cells are calculated
   for (i = 0; i < len_src; i++)
   {
-    for (j = 0; j < len_tar; j++)
-    {
-      d[i][j] = 0;
-    }
     d[i][0] = i;
   }
 
@@ -242,15 +385,14 @@ int dist_dam_lev(const char *tar, const struct Completion *comp)
     j = 1;
     while (j < len_tar)
     {
-      cost = mb_equal(&src[ca_idx[i]], &tar[cb_idx[j]]) ? 0 : 1;
+      cost = DAM_LEV_EQ(i, j) ? 0 : 1;
 
       d[i][j] = min(d[i - 1][j] + 1,         // deletion
                     d[i][j - 1] + 1,         // insertion
                     d[i - 1][j - 1] + cost); // substitution
 
       // transposition if symbols next to each other are equal
-      if (i > 1 && j > 1 && mb_equal(&src[ca_idx[i]], &tar[cb_idx[j - 1]]) &&
-          mb_equal(&src[ca_idx[i - 1]], &tar[cb_idx[j]]))
+      if (i > 1 && j > 1 && DAM_LEV_EQ(i, j - 1) && DAM_LEV_EQ(i - 1, j))
       {
         d[i][j] = (d[i][j] < d[i - 2][j - 2] + 1) ? d[i][j] : d[i - 2][j - 2] + 1;
       }
@@ -259,6 +401,68 @@ int dist_dam_lev(const char *tar, const struct Completion *comp)
     }
     i += 1;
   }
+#undef DAM_LEV_EQ
+
+  if (spans)
+    dam_lev_trace(src, tar, ca_idx, cb_idx, len_src, len_tar, d,
+                  (bool *) (cb_idx + len_tar), spans);
 
   return d[len_src - 1][len_tar - 1];
 }
+
+/**
+ * score_fuzzy - damerau-levenshtein distance of a prepared query
+ *
+ * This is the generic version, deciding on the encoding for every target.
+ *
+ * @param q prepared query
+ * @param tar target string
+ * @param spans optional list to record the matched characters in
+ * @retval int damerau-levenshtein distance between strings
+ */
+int score_fuzzy(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans)
+{
+  return dam_lev_kernel(q, tar, spans, q->ascii);
+}
+
+/**
+ * FUZZY_VARIANT - damerau-levenshtein kernel for a fixed encoding
+ */
+#define FUZZY_VARIANT(NAME, ASCII)                                             \
+  static int NAME(const CompletionQuery *q, const char *tar,                   \
+                  struct CompletionSpanList *spans)                            \
+  {                                                                            \
+    return dam_lev_kernel(q, tar, spans, ASCII);                               \
+  }
+
+FUZZY_VARIANT(fuzzy_mbs, false)
+FUZZY_VARIANT(fuzzy_ascii, true)
+
+/**
+ * fuzzy_mbs_batch - scoring loop of the multibyte variant
+ *
+ * @param q     prepared query
+ * @param tars  targets
+ * @param num   number of targets
+ * @param dists set to the distances
+ */
+static void fuzzy_mbs_batch(const CompletionQuery *q, const char **tars,
+                            size_t num, int *dists)
+{
+  for (size_t i = 0; i < num; i++)
+    dists[i] = dam_lev_kernel(q, tars[i], NULL, false);
+}
+
+/**
+ * score_fuzzy_select - pick the damerau-levenshtein variant for a query
+ *
+ * Fuzzy matching is always case-sensitive, only the encoding matters.  ASCII
+ * items are scored several at once, see lanes.c.
+ *
+ * @param q prepared query
+ */
+void score_fuzzy_select(CompletionQuery *q)
+{
+  q->kernel = q->ascii ? fuzzy_ascii : fuzzy_mbs;
+  q->batch = q->ascii ? fuzzy_lanes_batch : fuzzy_mbs_batch;
+}
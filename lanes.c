@@ -0,0 +1,322 @@
+/**
+ * @file
+ * Autocompletion API fuzzy scoring of many items at once
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Inter-sequence damerau-levenshtein scoring of ASCII items.
+ *
+ * Typed strings and items are short, so there's little to gain inside a single
+ * matrix.  Instead, every SIMD lane holds the matrix of another item, and one
+ * instruction works on a cell of 8 (SSE4.1) or 16 (AVX2) items at once.  The
+ * lanes walk the target columns together, the distance of every lane is taken
+ * from its own last column.
+ *
+ * The items of a batch are bucketed by length first, so that the items sharing
+ * a group have the same length, or nearly so, and few cells are wasted.  The
+ * cells are 16-bit, items and typed strings longer than COMPL_LANES_MAX_LEN are
+ * scored one by one.  The instruction set is picked at runtime; on other
+ * machines, or without either of them, all items are scored one by one.
+ *
+ * The matrices are the same as those of the scalar kernel, and so are the
+ * distances.
+ */
+
+#include "private.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COMPL_LANES_X86
+#include <immintrin.h>
+#endif
+
+// most lanes of any instruction set
+#define LANES_MAX 16
+
+/**
+ * LanesKernel - score a group of items, one per lane
+ *
+ * @param src   typed characters
+ * @param n     number of typed characters
+ * @param chars target characters, column by column, a lane after the other
+ * @param len   number of columns
+ * @param last  last column of every lane
+ * @param dists set to the distance of every lane
+ */
+typedef void (*LanesKernel)(const int16_t *src, int n, const int16_t *chars,
+                            int len, const int16_t *last, int16_t *dists);
+
+#ifdef COMPL_LANES_X86
+/**
+ * lanes_sse41 - score a group of 8 items with SSE4.1
+ */
+__attribute__((target("sse4.1"))) static void
+lanes_sse41(const int16_t *src, int n, const int16_t *chars, int len,
+            const int16_t *last, int16_t *dists)
+{
+  __m128i buf[3][COMPL_LANES_MAX_LEN];
+  __m128i *prev2 = buf[0];
+  __m128i *prev = buf[1];
+  __m128i *col = buf[2];
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i v_last = _mm_loadu_si128((const __m128i *) last);
+
+  // the first column, and the distance of the items with a single character
+  for (int i = 0; i < n; i++)
+    prev[i] = _mm_set1_epi16(i);
+  __m128i res = prev[n - 1];
+
+  __m128i t_prev = _mm_loadu_si128((const __m128i *) chars);
+  for (int j = 1; j < len; j++)
+  {
+    const __m128i t = _mm_loadu_si128((const __m128i *) (chars + j * 8));
+    col[0] = _mm_set1_epi16(j);
+    __m128i eq_prev = _mm_cmpeq_epi16(t, _mm_set1_epi16(src[0]));
+    for (int i = 1; i < n; i++)
+    {
+      const __m128i s = _mm_set1_epi16(src[i]);
+      const __m128i eq = _mm_cmpeq_epi16(t, s);
+      __m128i d = _mm_min_epi16(_mm_add_epi16(prev[i], one), _mm_add_epi16(col[i - 1], one));
+      d = _mm_min_epi16(d, _mm_add_epi16(prev[i - 1], _mm_andnot_si128(eq, one)));
+
+      // transposition, where the characters next to each other are swapped
+      if ((i > 1) && (j > 1))
+      {
+        const __m128i swap = _mm_and_si128(_mm_cmpeq_epi16(t_prev, s), eq_prev);
+        const __m128i d_swap = _mm_min_epi16(d, _mm_add_epi16(prev2[i - 2], one));
+        d = _mm_blendv_epi8(d, d_swap, swap);
+      }
+
+      col[i] = d;
+      eq_prev = eq;
+    }
+
+    res = _mm_blendv_epi8(res, col[n - 1], _mm_cmpeq_epi16(v_last, _mm_set1_epi16(j)));
+    __m128i *tmp = prev2;
+    prev2 = prev;
+    prev = col;
+    col = tmp;
+    t_prev = t;
+  }
+
+  _mm_storeu_si128((__m128i *) dists, res);
+}
+
+/**
+ * lanes_avx2 - score a group of 16 items with AVX2
+ */
+__attribute__((target("avx2"))) static void
+lanes_avx2(const int16_t *src, int n, const int16_t *chars, int len,
+           const int16_t *last, int16_t *dists)
+{
+  __m256i buf[3][COMPL_LANES_MAX_LEN];
+  __m256i *prev2 = buf[0];
+  __m256i *prev = buf[1];
+  __m256i *col = buf[2];
+  const __m256i one = _mm256_set1_epi16(1);
+  const __m256i v_last = _mm256_loadu_si256((const __m256i *) last);
+
+  // the first column, and the distance of the items with a single character
+  for (int i = 0; i < n; i++)
+    prev[i] = _mm256_set1_epi16(i);
+  __m256i res = prev[n - 1];
+
+  __m256i t_prev = _mm256_loadu_si256((const __m256i *) chars);
+  for (int j = 1; j < len; j++)
+  {
+    const __m256i t = _mm256_loadu_si256((const __m256i *) (chars + j * 16));
+    col[0] = _mm256_set1_epi16(j);
+    __m256i eq_prev = _mm256_cmpeq_epi16(t, _mm256_set1_epi16(src[0]));
+    for (int i = 1; i < n; i++)
+    {
+      const __m256i s = _mm256_set1_epi16(src[i]);
+      const __m256i eq = _mm256_cmpeq_epi16(t, s);
+      __m256i d = _mm256_min_epi16(_mm256_add_epi16(prev[i], one),
+                                   _mm256_add_epi16(col[i - 1], one));
+      d = _mm256_min_epi16(d, _mm256_add_epi16(prev[i - 1], _mm256_andnot_si256(eq, one)));
+
+      // transposition, where the characters next to each other are swapped
+      if ((i > 1) && (j > 1))
+      {
+        const __m256i swap = _mm256_and_si256(_mm256_cmpeq_epi16(t_prev, s), eq_prev);
+        const __m256i d_swap = _mm256_min_epi16(d, _mm256_add_epi16(prev2[i - 2], one));
+        d = _mm256_blendv_epi8(d, d_swap, swap);
+      }
+
+      col[i] = d;
+      eq_prev = eq;
+    }
+
+    res = _mm256_blendv_epi8(res, col[n - 1], _mm256_cmpeq_epi16(v_last, _mm256_set1_epi16(j)));
+    __m256i *tmp = prev2;
+    prev2 = prev;
+    prev = col;
+    col = tmp;
+    t_prev = t;
+  }
+
+  _mm256_storeu_si256((__m256i *) dists, res);
+}
+#endif
+
+/**
+ * lanes_kernel - the kernel for a number of lanes
+ *
+ * @param width number of lanes, 0 for the widest the machine supports
+ * @param lanes set to the number of lanes of the kernel
+ * @retval ptr kernel, or NULL if the machine can't score that many items at once
+ */
+static LanesKernel lanes_kernel(int width, int *lanes)
+{
+#ifdef COMPL_LANES_X86
+  if (((width == 0) || (width == 16)) && __builtin_cpu_supports("avx2"))
+  {
+    *lanes = 16;
+    return lanes_avx2;
+  }
+  if (((width == 0) || (width == 8)) && __builtin_cpu_supports("sse4.1"))
+  {
+    *lanes = 8;
+    return lanes_sse41;
+  }
+#endif
+  *lanes = 1;
+  return NULL;
+}
+
+/**
+ * fuzzy_lanes_width - number of items the machine scores at once
+ *
+ * @param width number of lanes to check, 0 for the widest there is
+ * @retval num number of lanes, 1 if the items are scored one by one
+ */
+int fuzzy_lanes_width(int width)
+{
+  int lanes = 1;
+  lanes_kernel(width, &lanes);
+  return lanes;
+}
+
+/**
+ * fuzzy_lanes_score - damerau-levenshtein distances of ASCII items, a number at once
+ *
+ * @param q     prepared query, plain ASCII
+ * @param tars  targets, plain ASCII
+ * @param num   number of targets
+ * @param dists set to the distances
+ * @param width number of lanes, 0 for the widest the machine supports, 1 for none
+ */
+void fuzzy_lanes_score(const CompletionQuery *q, const char **tars, size_t num,
+                       int *dists, int width)
+{
+  int lanes = 1;
+  LanesKernel kernel = (width == 1) ? NULL : lanes_kernel(width, &lanes);
+  int n = q->n_chars;
+  if (!kernel || (n < 1) || (n > COMPL_LANES_MAX_LEN))
+  {
+    for (size_t i = 0; i < num; i++)
+      dists[i] = score_fuzzy(q, tars[i], NULL);
+    return;
+  }
+
+  // the batches of the engine are scored at once, longer ones in parts
+  if (num > COMPL_BATCH_SIZE)
+  {
+    for (size_t i = 0; i < num; i += COMPL_BATCH_SIZE)
+      fuzzy_lanes_score(q, tars + i, MIN(COMPL_BATCH_SIZE, num - i), dists + i, width);
+    return;
+  }
+
+  int16_t src[COMPL_LANES_MAX_LEN];
+  for (int i = 0; i < n; i++)
+    src[i] = (unsigned char) q->src[i];
+
+  // bucket the items by length, the long and empty ones are scored one by one
+  size_t count[COMPL_LANES_MAX_LEN + 1] = { 0 };
+  uint8_t lens[COMPL_BATCH_SIZE];
+  uint16_t order[COMPL_BATCH_SIZE];
+  for (size_t i = 0; i < num; i++)
+  {
+    size_t len = mutt_str_len(tars[i]);
+    if ((len == 0) || (len > COMPL_LANES_MAX_LEN))
+    {
+      lens[i] = 0;
+      dists[i] = score_fuzzy(q, tars[i], NULL);
+      continue;
+    }
+    lens[i] = len;
+    count[len]++;
+  }
+
+  size_t n_order = 0;
+  for (int len = 1; len <= COMPL_LANES_MAX_LEN; len++)
+  {
+    size_t c = count[len];
+    count[len] = n_order;
+    n_order += c;
+  }
+  for (size_t i = 0; i < num; i++)
+  {
+    if (lens[i] > 0)
+      order[count[lens[i]]++] = i;
+  }
+
+  // fill the lanes of a group, column by column, and score it
+  int16_t chars[COMPL_LANES_MAX_LEN * LANES_MAX];
+  int16_t last[LANES_MAX];
+  int16_t out[LANES_MAX];
+  for (size_t g = 0; g < n_order; g += lanes)
+  {
+    int n_lanes = MIN((size_t) lanes, n_order - g);
+    int len = lens[order[g + n_lanes - 1]];
+    memset(chars, 0, len * lanes * sizeof(int16_t));
+    for (int l = 0; l < lanes; l++)
+    {
+      if (l >= n_lanes)
+      {
+        last[l] = -1;
+        continue;
+      }
+
+      const char *tar = tars[order[g + l]];
+      last[l] = lens[order[g + l]] - 1;
+      for (int j = 0; j <= last[l]; j++)
+        chars[j * lanes + l] = (unsigned char) tar[j];
+    }
+
+    kernel(src, n, chars, len, last, out);
+    for (int l = 0; l < n_lanes; l++)
+      dists[order[g + l]] = out[l];
+  }
+}
+
+/**
+ * fuzzy_lanes_batch - score a batch of ASCII items, as many at once as the machine can
+ *
+ * @param q     prepared query, plain ASCII
+ * @param tars  targets, plain ASCII
+ * @param num   number of targets
+ * @param dists set to the distances
+ */
+void fuzzy_lanes_batch(const CompletionQuery *q, const char **tars, size_t num, int *dists)
+{
+  fuzzy_lanes_score(q, tars, num, dists, 0);
+}
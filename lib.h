@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <regex.h>
+#include <time.h>
 #include "mutt/array.h"
 
 #ifndef COMPLETION
@@ -35,12 +36,17 @@ typedef uint8_t MuttCompletionState;
 #define COMPL_STATE_SINGLE    (1 << 1)  /// < Match found
 #define COMPL_STATE_MULTI     (1 << 2)  /// < Multiple matches with common stem
 #define COMPL_STATE_NOMATCH   (1 << 3)  /// < No Match found
+#define COMPL_STATE_SCORING   (1 << 4)  /// < Search scored in slices, not finished yet
 
 enum MuttMatchMode
 {
   COMPL_MODE_EXACT = 1,
   COMPL_MODE_FUZZY,
-  COMPL_MODE_REGEX
+  COMPL_MODE_REGEX,
+  COMPL_MODE_SUBSEQ,
+  COMPL_MODE_SUBSTRING, // exact match anywhere in the string
+  COMPL_MODE_SUFFIX,    // exact match at the end of the string
+  COMPL_MODE_APPROX     // regex match allowing up to max_dist edits
 };
 
 typedef uint8_t MuttMatchFlags;
@@ -49,18 +55,113 @@ typedef uint8_t MuttMatchFlags;
 #define COMPL_MATCH_IGNORECASE  (1 << 1) /// ignore case when matching
 #define COMPL_MATCH_FIRSTMATCH  (1 << 2) /// < Return only the first match
 #define COMPL_MATCH_SHOWALL     (1 << 3) /// < Return non-matches after all matches
+#define COMPL_MATCH_MAGIC       (1 << 4) /// < Ignore case, and treat dash and underscore as equal (not for regex)
 
 // needed for regcomp error reporting
 #define COMPL_REGERRORSIZE 30
 
+// the normalised form of an item is the item string itself
+#define COMPL_NORM_SAME UINT32_MAX
+
+// maximum number of highlight spans stored per item (further matches extend the last span)
+#define COMPL_MAX_SPANS 16
+
+// maximum number of matches with highlight spans (CompletionItem.span_slot is 16-bit)
+#define COMPL_MAX_HIGHLIGHT INT16_MAX
+
+/**
+ * CompletionSpan - a matched part of an item, used for highlighting
+ *
+ * Positions are counted in characters (not bytes).  Characters after the
+ * first 65535 aren't highlighted.
+ */
+typedef struct CompletionSpan {
+  uint16_t start; ///< first matched character
+  uint16_t len;   ///< number of matched characters
+} CompletionSpan;
+
+ARRAY_HEAD(CompletionSpanList, CompletionSpan);
+
 typedef struct CompletionItem {
-  struct Buffer *buf;
+  struct Buffer *buf; ///< typed string (only used by the typed item)
+  const char *str;   ///< item string, stored in Completion.strings
+  uint32_t id;       ///< stable id of the item (insertion order), used by the indexes
   int match_dist;
   bool is_match;
+  int16_t span_slot; ///< slot in Completion.spans, or -1 if no spans are stored
+  uint8_t n_spans;   ///< number of match spans in the slot
+  uint32_t norm_off; ///< offset of the normalised string in Completion.norms (COMPL_NORM_SAME if unchanged)
 } CompletionItem;
 
 ARRAY_HEAD(CompletionList, CompletionItem);
 ARRAY_HEAD(CompletionStringList, char *);
+ARRAY_HEAD(CompletionOffsetList, uint32_t);
+ARRAY_HEAD(CompletionBoolList, bool);
+ARRAY_HEAD(CompletionMaskList, uint64_t);
+
+ARRAY_HEAD(CompletionBlockList, char *);
+
+/**
+ * CompletionArena - strings stored in large blocks, they never move once added
+ */
+typedef struct CompletionArena {
+  struct CompletionBlockList blocks;
+  size_t used; ///< used bytes of the last block
+  size_t size; ///< size of the last block
+} CompletionArena;
+
+/**
+ * CompletionPool - strings stored back to back ('\0'-separated) in one allocation
+ */
+typedef struct CompletionPool {
+  char *data;
+  size_t len;  ///< used bytes
+  size_t size; ///< allocated bytes
+} CompletionPool;
+
+/**
+ * CompletionScratch - work memory of the matching kernels, reused for every item
+ */
+typedef struct CompletionScratch {
+  void *data;
+  size_t size; ///< allocated bytes
+} CompletionScratch;
+
+/**
+ * CompletionColumn - one field of every row, matched with its own mode and flags
+ *
+ * The fields of a column are stored together, so that matching a column is a
+ * single pass over contiguous memory.
+ */
+typedef struct CompletionColumn {
+  enum MuttMatchMode mode;
+  MuttMatchFlags flags;
+  int bias;                             ///< added to the distance of matches in this column
+  CompletionPool fields;                ///< fields of all rows (normalised for COMPL_MATCH_MAGIC)
+  struct CompletionOffsetList offsets;  ///< offset of each row's field, indexed by item id
+  bool ascii;                           ///< all fields are plain ASCII
+} CompletionColumn;
+
+ARRAY_HEAD(CompletionColumnList, CompletionColumn);
+
+struct NgramIndex;
+struct DedupTable;
+struct BkTree;
+struct SymDelIndex;
+struct Trie;
+struct QgramFilter;
+struct RegexCache;
+struct CompletionScan;
+
+/**
+ * CompletionProvider - pull the next strings of a streamed list
+ *
+ * @param data user data passed to compl_set_provider()
+ * @param strs set to the next strings, they only need to stay valid until the next call
+ * @param max  maximum number of strings
+ * @retval num number of strings, 0 once the source is exhausted
+ */
+typedef size_t (*CompletionProvider)(void *data, const char **strs, size_t max);
 
 typedef struct Completion {
   CompletionItem *typed_item;
@@ -70,21 +171,197 @@ typedef struct Completion {
   enum MuttMatchMode mode;
   MuttMatchFlags flags;
   struct CompletionList *items;
-  // store the compiled regcomp regex for faster list matching
+  CompletionArena strings; // strings of the items
+  size_t max_len; // longest item (or field) in bytes, to size the scratch memory
+  CompletionScratch *scratch; // work memory of the kernels, used by one search at a time
+  bool ascii; // all items are plain ASCII, matchers can use faster kernels
+  // store the compiled regcomp regex for faster list matching, the last few
+  // patterns stay compiled, so backspacing and retyping doesn't compile again
   bool regex_compiled;
-  regex_t regex;
+  regex_t *regex;
+  struct RegexCache *regexes;
+  // hash table of the item strings, to skip duplicates and find items to remove
+  struct DedupTable *dedup;
+  // removed items are tombstoned, and compacted out before the next search
+  struct CompletionBoolList removed; // indexed by item id
+  size_t n_removed;                  // tombstones still in the list of items
+  size_t n_garbage;                  // tombstones still in the indexes and string pools
+  // trigram index for substring/suffix matching, built once the list grows large
+  uint32_t next_id;
+  struct NgramIndex *ngrams;
+  // fuzzy matching: items further away don't match (-1 for no limit), and with
+  // a limit, a BK-tree finds the candidates, built on the first search
+  int max_dist;
+  struct BkTree *bktree;
+  // optional index of the deletion variants, for a maximum distance of up to 2
+  struct SymDelIndex *symdel;
+  // optional trie of the items, for fuzzy and regex searches stepping once per distinct prefix
+  struct Trie *trie;
+  // bigram signatures of the items, rejecting those too far away before the kernel runs
+  struct QgramFilter *qgrams;
+  // normalised (case- and separator-folded) items for magic matching
+  CompletionPool norms;
+  // character classes of every item, indexed by id, to reject items lacking typed characters
+  struct CompletionMaskList masks;
+  // multi-field rows: an item per row, its fields are matched column by column
+  struct CompletionColumnList columns;
+  // match spans are recorded while scoring, but only for the best n_highlight matches
+  // (set with compl_set_highlight(), at most COMPL_MAX_HIGHLIGHT)
+  size_t n_highlight;
+  CompletionSpan *spans; // n_highlight slots of COMPL_MAX_SPANS spans
+  // streamed items are pulled in chunks while searching, and kept for the next search
+  CompletionProvider provider;
+  void *provider_data;
+  size_t provider_chunk;
+  // search scored in slices by compl_score_step(), dropped when the input changes
+  struct CompletionScan *scan;
 } Completion;
 
+/**
+ * CompletionMatcher - callback functions implementing a matching mode
+ *
+ * prepare() is called once per search, with the typed string and the flags of
+ * the search (the typed string is normalised already for COMPL_MATCH_MAGIC).
+ * Its result is passed to the scoring functions, which return the match
+ * distance of a target (lower is better), or -1 if it doesn't match.
+ */
+typedef struct CompletionMatcher {
+  const char *name;
+  // optional, NULL for matchers without a query; returning NULL fails the search
+  void *(*prepare)(const Completion *comp, const char *typed, MuttMatchFlags flags);
+  // score a single target, optionally recording the match spans
+  int   (*score)(const void *query, const char *tar, struct CompletionSpanList *spans);
+  // optional, score num targets at once (falls back to score())
+  void  (*score_batch)(const void *query, const char **tars, size_t num, int *dists);
+  // optional, free the prepared query
+  void  (*free)(void **query);
+} CompletionMatcher;
+
+/**
+ * CompletionDir - cached entries of a directory, for path completion
+ */
+typedef struct CompletionDir {
+  char *path;                         ///< directory as typed, "" for the current one
+  struct timespec mtime;              ///< modification time of the directory when read
+  bool racy;                          ///< modified in the second it was read, read again next time
+  struct CompletionStringList names;  ///< sorted entries, directories end in '/'
+  Completion *comp;                   ///< entries without the '/', item id n is names[n - 1]
+  unsigned long used;                 ///< last use, to evict the least recently used directory
+} CompletionDir;
+
+ARRAY_HEAD(CompletionDirList, CompletionDir);
+
+/**
+ * CompletionPath - path completion, one component at a time
+ */
+typedef struct CompletionPath {
+  enum MuttMatchMode mode;
+  MuttMatchFlags flags;
+  struct CompletionDirList dirs;  ///< cached directories
+  unsigned long tick;             ///< use counter of the cache
+  int cur;                        ///< index of the directory being completed, -1 for none
+  struct Buffer *typed;           ///< path typed by the user
+  struct Buffer *result;          ///< path returned last, cycling goes on while it comes back
+  size_t stem;                    ///< length of the directory part of the typed path
+  size_t pos;                     ///< next entry, when listing a directory
+} CompletionPath;
+
+/**
+ * enum CompletionFetchResult - what a CompletionFetch callback returned
+ */
+enum CompletionFetchResult
+{
+  COMPL_FETCH_ERROR = -1, ///< the list couldn't be fetched, keep the old one
+  COMPL_FETCH_DELTA,      ///< changes since the given token
+  COMPL_FETCH_FULL,       ///< the whole list, replacing the old one
+};
+
+/**
+ * CompletionFetch - fetch a remote list, e.g. IMAP folders or NNTP newsgroups
+ *
+ * @param data    user data passed to compl_remote_new()
+ * @param since   token of the last fetch, NULL if the whole list is needed
+ * @param added   add allocated strings to be added
+ * @param removed add allocated strings to be removed (only for COMPL_FETCH_DELTA)
+ * @param token   set to the state of the list on the server, passed as since next time
+ * @retval enum CompletionFetchResult
+ */
+typedef enum CompletionFetchResult (*CompletionFetch)(void *data, const char *since,
+                                                      struct CompletionStringList *added,
+                                                      struct CompletionStringList *removed,
+                                                      struct Buffer *token);
+
+/**
+ * CompletionRemote - a remote list, completed from a local snapshot
+ */
+typedef struct CompletionRemote {
+  Completion *comp;       ///< the list, for compl_type() and compl_complete()
+  char *snapshot;         ///< path of the local snapshot
+  struct Buffer *token;   ///< state of the list on the server, from the last fetch
+  CompletionFetch fetch;
+  void *fetch_data;
+} CompletionRemote;
+
 // user functions
 Completion *compl_new(enum MuttMatchMode mode);
 Completion *compl_from_array(const struct CompletionStringList *list, enum MuttMatchMode mode);
-void        compl_free(Completion *comp);
+void        compl_free(Completion **ptr);
 
-// TODO handle strings with dynamic size (keep track of longest string)
 int         compl_add(Completion *comp, const struct Buffer *buf);
+// bulk version of compl_add(), lens may be NULL for '\0'-terminated strings
+size_t      compl_add_many(Completion *comp, const char **strs, const size_t *lens, size_t num);
 int         compl_type(Completion *comp, const struct Buffer *buf);
+// fuzzy mode: only items within this distance match, -1 (the default) for no limit
+// approximate regex mode: number of edits allowed, -1 for COMPL_APPROX_EDITS
+int         compl_set_max_dist(Completion *comp, int max_dist);
+// record the match spans of the best num matches, at most COMPL_MAX_HIGHLIGHT
+int         compl_set_highlight(Completion *comp, size_t num);
+// fuzzy mode: index the deletion variants of the items, faster than the BK-tree for distances up to 2
+int         compl_set_symdel(Completion *comp, bool enable);
+// fuzzy and regex modes: score the items over a trie, so shared prefixes (and earlier keystrokes) are reused;
+// worth it for regex searches, fuzzy ones are about as fast with the kernels (see `make bench`)
+int         compl_set_trie(Completion *comp, bool enable);
+// stream the items from a source, only pulling as many as needed for the next match
+int         compl_set_provider(Completion *comp, CompletionProvider provider, void *data, size_t chunk);
+
+// update a list in place, instead of rebuilding it
+int         compl_remove(Completion *comp, const struct Buffer *buf);
+int         compl_apply_delta(Completion *comp, const struct CompletionStringList *added,
+                              const struct CompletionStringList *removed);
+
+// multi-field rows: define all columns first, the first field of a row is the one completed
+int         compl_add_column(Completion *comp, enum MuttMatchMode mode, MuttMatchFlags flags, int bias);
+int         compl_add_row(Completion *comp, const char **fields);
 
 // this is the main interface function for users to collect/cycle the next matched string
 struct Buffer *      compl_complete(Completion *comp);
 
+// event loops: score the items in slices, until max_items are scored or the deadline
+// (of compl_now_us()) passes, 0 for no limit; returns the items left, 0 once finished
+int         compl_score_step(Completion *comp, size_t max_items, uint64_t deadline, size_t *n_matches);
+uint64_t    compl_now_us(void);
+
+// custom matchers: returns the mode to pass to compl_new() or compl_add_column(), 0 on failure
+enum MuttMatchMode compl_register_matcher(const CompletionMatcher *matcher);
+
+// path completion: complete the last component of a path, cycling on repeated calls
+CompletionPath *compl_path_new(enum MuttMatchMode mode, MuttMatchFlags flags);
+void            compl_path_free(CompletionPath **ptr);
+struct Buffer * compl_path_complete(CompletionPath *cp, const struct Buffer *typed);
+
+// remote lists: load the local snapshot, refresh it from the server whenever convenient
+CompletionRemote *compl_remote_new(enum MuttMatchMode mode, const char *snapshot,
+                                   CompletionFetch fetch, void *data);
+int               compl_remote_refresh(CompletionRemote *remote);
+void              compl_remote_free(CompletionRemote **ptr);
+
+// match spans of the current completion (only if it is among the best n_highlight matches)
+size_t      compl_get_spans(const Completion *comp, const CompletionSpan **spans);
+
+// memory used by the search indexes (trigrams, BK-tree, deletion variants, trie) in bytes
+size_t      compl_get_index_memory(const Completion *comp);
+
+// regex mode: number of patterns found compiled, and of those compiled anew
+size_t      compl_get_regex_stats(const Completion *comp, size_t *n_compiled);
+
 #endif
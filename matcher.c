@@ -0,0 +1,433 @@
+/**
+ * @file
+ * Autocompletion API matchers
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Every matching mode is a CompletionMatcher, a set of callback functions.
+ *
+ * A search prepares the typed string once (decoding, case-folding, compiling
+ * the regex), and then scores the items in batches with the prepared query.
+ * Neither the mode nor the typed string is looked at again per item.
+ *
+ * Users can register their own matchers with compl_register_matcher(), and
+ * use the returned mode just like a built-in one.
+ */
+
+#include "private.h"
+
+/**
+ * compl_query_scratch - let a query use the scratch memory of the Completion
+ *
+ * The memory is sized for the longest item up front, so the kernel doesn't
+ * have to grow it while scoring.  Queries without a Completion use their own.
+ *
+ * @param q     prepared query
+ * @param comp  Completion being searched, or NULL
+ * @param size  scratch memory the kernel needs, or NULL if it needs none
+ */
+static void compl_query_scratch(CompletionQuery *q, const Completion *comp,
+                                size_t (*size)(int len_src, size_t len_tar))
+{
+  if (!comp || !comp->scratch)
+    return;
+
+  q->scratch = comp->scratch;
+  if (size && (q->n_chars > 0))
+    compl_scratch_reserve(q->scratch, size(q->n_chars, comp->max_len));
+}
+
+/**
+ * MATCHER_KERNEL - callback functions around a built-in matching kernel
+ *
+ * The batch function calls the kernel directly, so the only indirect call is
+ * the one per batch.
+ */
+#define MATCHER_KERNEL(NAME, KERNEL)                                           \
+  static int NAME##_score(const void *query, const char *tar,                  \
+                          struct CompletionSpanList *spans)                    \
+  {                                                                            \
+    return KERNEL(query, tar, spans);                                          \
+  }                                                                            \
+                                                                               \
+  static void NAME##_score_batch(const void *query, const char **tars,         \
+                                 size_t num, int *dists)                       \
+  {                                                                            \
+    for (size_t i = 0; i < num; i++)                                           \
+      dists[i] = KERNEL(query, tars[i], NULL);                                 \
+  }
+
+/**
+ * MATCHER_PREPARE - prepare function of a built-in kernel
+ *
+ * The query uses the scratch memory of the Completion, sized for the kernel.
+ */
+#define MATCHER_PREPARE(NAME, SCRATCH)                                         \
+  static void *NAME##_prepare(const Completion *comp, const char *typed,       \
+                              MuttMatchFlags flags)                            \
+  {                                                                            \
+    CompletionQuery *q = compl_query_new(typed, flags, false);                        \
+    compl_query_scratch(q, comp, SCRATCH);                                     \
+    return q;                                                                  \
+  }
+
+/**
+ * MATCHER_SELECTED - callback functions around the kernel variant of the query
+ *
+ * The variant is selected in prepare(), for the flags of the search.  Searches
+ * of plain ASCII targets go through NAME_prepare_ascii() instead, which can
+ * select a faster variant.
+ */
+#define MATCHER_SELECTED(NAME, SELECT, SCRATCH)                                \
+  static void *NAME##_prepare_ascii(const Completion *comp, const char *typed, \
+                                    MuttMatchFlags flags, bool ascii)          \
+  {                                                                            \
+    CompletionQuery *q = compl_query_new(typed, flags, ascii);                 \
+    compl_query_scratch(q, comp, SCRATCH);                                     \
+    SELECT(q);                                                                 \
+    return q;                                                                  \
+  }                                                                            \
+                                                                               \
+  static void *NAME##_prepare(const Completion *comp, const char *typed,       \
+                              MuttMatchFlags flags)                            \
+  {                                                                            \
+    return NAME##_prepare_ascii(comp, typed, flags, false);                    \
+  }                                                                            \
+                                                                               \
+  static int NAME##_score(const void *query, const char *tar,                  \
+                          struct CompletionSpanList *spans)                    \
+  {                                                                            \
+    const CompletionQuery *q = query;                                          \
+    return q->kernel(q, tar, spans);                                           \
+  }                                                                            \
+                                                                               \
+  static void NAME##_score_batch(const void *query, const char **tars,         \
+                                 size_t num, int *dists)                       \
+  {                                                                            \
+    const CompletionQuery *q = query;                                          \
+    q->batch(q, tars, num, dists);                                             \
+  }
+
+MATCHER_SELECTED(exact, score_exact_select, NULL)
+MATCHER_SELECTED(fuzzy, score_fuzzy_select, score_fuzzy_scratch)
+MATCHER_KERNEL(regex, score_regex)
+MATCHER_KERNEL(subseq, score_subseq)
+MATCHER_KERNEL(substring, score_substring)
+MATCHER_KERNEL(suffix, score_suffix)
+MATCHER_KERNEL(approx, score_approx)
+MATCHER_PREPARE(subseq, score_subseq_scratch)
+MATCHER_PREPARE(substring, score_substring_scratch)
+MATCHER_PREPARE(suffix, score_substring_scratch)
+
+/**
+ * regex_prepare - prepare a regex query
+ *
+ * The regex compiled by compl_compile_regex() is reused if it belongs to the
+ * same pattern, otherwise the query compiles its own.
+ */
+static void *regex_prepare(const Completion *comp, const char *typed, MuttMatchFlags flags)
+{
+  CompletionQuery *q = compl_query_new(typed, flags, false);
+
+  if (comp && comp->regex_compiled && (comp->mode == COMPL_MODE_REGEX) &&
+      !((comp->flags ^ flags) & COMPL_MATCH_IGNORECASE) &&
+      mutt_str_equal(typed, buf_string(comp->typed_item->buf)))
+  {
+    q->regex = comp->regex;
+    return q;
+  }
+
+  if (!compl_regcomp(&q->own_regex, typed, flags))
+  {
+    compl_query_free(&q);
+    return NULL;
+  }
+
+  q->regex = &q->own_regex;
+  q->regex_owned = true;
+  return q;
+}
+
+/**
+ * approx_prepare - prepare an approximate regex query
+ *
+ * The edits allowed are the maximum distance of the Completion, or
+ * COMPL_APPROX_EDITS without one.  Patterns the automaton doesn't support
+ * are compiled by regcomp(), and only match without edits.
+ */
+static void *approx_prepare(const Completion *comp, const char *typed, MuttMatchFlags flags)
+{
+  CompletionQuery *q = compl_query_new(typed, flags, false);
+  int max_edits = (comp && (comp->max_dist >= 0)) ? comp->max_dist : COMPL_APPROX_EDITS;
+  q->approx = approx_new(typed, flags, max_edits);
+  if (q->approx)
+    return q;
+
+  if (!compl_regcomp(&q->own_regex, typed, flags))
+  {
+    compl_query_free(&q);
+    return NULL;
+  }
+
+  q->regex = &q->own_regex;
+  q->regex_owned = true;
+  return q;
+}
+
+static void query_free(void **query)
+{
+  compl_query_free((CompletionQuery **) query);
+}
+
+static const CompletionMatcher MatcherExact = {
+  "exact", exact_prepare, exact_score, exact_score_batch, query_free,
+};
+
+static const CompletionMatcher MatcherFuzzy = {
+  "fuzzy", fuzzy_prepare, fuzzy_score, fuzzy_score_batch, query_free,
+};
+
+static const CompletionMatcher MatcherRegex = {
+  "regex", regex_prepare, regex_score, regex_score_batch, query_free,
+};
+
+static const CompletionMatcher MatcherSubseq = {
+  "subseq", subseq_prepare, subseq_score, subseq_score_batch, query_free,
+};
+
+static const CompletionMatcher MatcherSubstring = {
+  "substring", substring_prepare, substring_score, substring_score_batch, query_free,
+};
+
+static const CompletionMatcher MatcherSuffix = {
+  "suffix", suffix_prepare, suffix_score, suffix_score_batch, query_free,
+};
+
+static const CompletionMatcher MatcherApprox = {
+  "approx", approx_prepare, approx_score, approx_score_batch, query_free,
+};
+
+// matchers by mode, registered ones follow the built-in ones
+static const CompletionMatcher *Matchers[COMPL_MAX_MATCHERS] = {
+  [COMPL_MODE_EXACT] = &MatcherExact,         [COMPL_MODE_FUZZY] = &MatcherFuzzy,
+  [COMPL_MODE_REGEX] = &MatcherRegex,         [COMPL_MODE_SUBSEQ] = &MatcherSubseq,
+  [COMPL_MODE_SUBSTRING] = &MatcherSubstring, [COMPL_MODE_SUFFIX] = &MatcherSuffix,
+  [COMPL_MODE_APPROX] = &MatcherApprox,
+};
+
+/**
+ * compl_register_matcher - add a custom matching mode
+ *
+ * The matcher isn't copied, it has to stay valid as long as it is used.
+ *
+ * @param matcher callback functions of the mode, score() is mandatory
+ * @retval mode new matching mode, or 0 if it couldn't be registered
+ */
+enum MuttMatchMode compl_register_matcher(const CompletionMatcher *matcher)
+{
+  if (!matcher || !matcher->score)
+  {
+    logerr("CompRegisterMatcher: a matcher needs a score function.");
+    return 0;
+  }
+
+  for (int mode = COMPL_MODE_APPROX + 1; mode < COMPL_MAX_MATCHERS; mode++)
+  {
+    if (!Matchers[mode])
+    {
+      Matchers[mode] = matcher;
+      return mode;
+    }
+  }
+
+  logerr("CompRegisterMatcher: no more than %d matchers.", COMPL_MAX_MATCHERS - 1);
+  return 0;
+}
+
+/**
+ * compl_get_matcher - get the matcher of a mode
+ *
+ * @param mode matching mode
+ * @retval ptr matcher, unknown modes use exact matching
+ */
+const CompletionMatcher *compl_get_matcher(enum MuttMatchMode mode)
+{
+  if ((mode > 0) && (mode < COMPL_MAX_MATCHERS) && Matchers[mode])
+    return Matchers[mode];
+
+  return &MatcherExact;
+}
+
+/**
+ * compl_query_new - prepare the typed string for the built-in kernels
+ *
+ * @param typed typed string
+ * @param flags matching flags
+ * @param ascii all targets are plain ASCII
+ * @retval ptr prepared query
+ */
+CompletionQuery *compl_query_new(const char *typed, MuttMatchFlags flags, bool ascii)
+{
+  CompletionQuery *q = mutt_mem_calloc(1, sizeof(CompletionQuery));
+
+  // mutt_str_dup() turns an empty string into NULL, the kernels need a string
+  q->len = mutt_str_len(typed);
+  q->src = mutt_mem_calloc(q->len + 1, sizeof(char));
+  if (typed)
+    memcpy(q->src, typed, q->len);
+  q->flags = flags;
+  q->scratch = &q->own_scratch;
+  q->n_chars = mbs_char_count(q->src);
+  q->mbs = is_mbs(q->src);
+  q->ascii = ascii && is_ascii(q->src);
+
+  if (q->n_chars <= 0)
+    return q;
+
+  q->w_src = mutt_mem_calloc(q->n_chars + 1, sizeof(wchar_t));
+  utf8_decode(q->src, q->w_src);
+  if (flags & COMPL_MATCH_IGNORECASE)
+  {
+    for (int i = 0; i < q->n_chars; i++)
+      q->w_src[i] = compl_casefold(q->w_src[i]);
+  }
+
+  q->idx = mutt_mem_calloc(q->n_chars, sizeof(int));
+  for (int i = 1; i < q->n_chars; i++)
+    q->idx[i] = q->idx[i - 1] + MBCHARLEN(&q->src[q->idx[i - 1]]);
+
+  return q;
+}
+
+/**
+ * compl_query_free - free a prepared query
+ *
+ * @param ptr query to free
+ */
+void compl_query_free(CompletionQuery **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
+
+  CompletionQuery *q = *ptr;
+  if (q->regex_owned)
+    regfree(&q->own_regex);
+  approx_free(&q->approx);
+  FREE(&q->src);
+  FREE(&q->w_src);
+  FREE(&q->idx);
+  compl_scratch_free(&q->own_scratch);
+  FREE(ptr);
+}
+
+/**
+ * compl_search_init - prepare a search with the matcher of a mode
+ *
+ * Magic matching runs the matcher on normalised strings, which are case-folded
+ * already, so the matcher doesn't need to handle it.
+ *
+ * @param search search to initialise
+ * @param comp   Completion with the typed string
+ * @param mode   matching mode
+ * @param flags  matching flags
+ * @param ascii  all targets are plain ASCII
+ * @retval bool true if the search is ready, false if nothing can match
+ */
+bool compl_search_init(CompletionSearch *search, const Completion *comp,
+                       enum MuttMatchMode mode, MuttMatchFlags flags, bool ascii)
+{
+  const char *typed = buf_string(comp->typed_item->buf);
+
+  search->matcher = compl_get_matcher(mode);
+  search->query = NULL;
+  search->magic = (flags & COMPL_MATCH_MAGIC) && (mode != COMPL_MODE_REGEX) &&
+                  (mode != COMPL_MODE_APPROX);
+
+  if (!search->matcher->prepare)
+    return true;
+
+  char *norm = NULL;
+  if (search->magic)
+  {
+    norm = mbs_fold(typed);
+    flags &= ~COMPL_MATCH_IGNORECASE;
+  }
+
+  // the built-in exact and fuzzy kernels have variants for plain ASCII targets
+  if (ascii && (search->matcher == &MatcherExact))
+    search->query = exact_prepare_ascii(comp, norm ? norm : typed, flags, true);
+  else if (ascii && (search->matcher == &MatcherFuzzy))
+    search->query = fuzzy_prepare_ascii(comp, norm ? norm : typed, flags, true);
+  else
+    search->query = search->matcher->prepare(comp, norm ? norm : typed, flags);
+  FREE(&norm);
+
+  return search->query != NULL;
+}
+
+/**
+ * compl_search_score - score a single target
+ *
+ * @param search prepared search
+ * @param tar    target string (normalised for magic searches)
+ * @param spans  optional list to record the matched characters in
+ * @retval int distance (or -1 if no match at all)
+ */
+int compl_search_score(const CompletionSearch *search, const char *tar,
+                       struct CompletionSpanList *spans)
+{
+  return search->matcher->score(search->query, tar, spans);
+}
+
+/**
+ * compl_search_batch - score a batch of targets
+ *
+ * @param search prepared search
+ * @param tars   target strings (normalised for magic searches)
+ * @param num    number of targets
+ * @param dists  set to the distance of every target (-1 for no match)
+ */
+void compl_search_batch(const CompletionSearch *search, const char **tars,
+                        size_t num, int *dists)
+{
+  if (search->matcher->score_batch)
+  {
+    search->matcher->score_batch(search->query, tars, num, dists);
+    return;
+  }
+
+  for (size_t i = 0; i < num; i++)
+    dists[i] = search->matcher->score(search->query, tars[i], NULL);
+}
+
+/**
+ * compl_search_free - release the prepared query of a search
+ *
+ * @param search search
+ */
+void compl_search_free(CompletionSearch *search)
+{
+  if (search->query && search->matcher->free)
+    search->matcher->free(&search->query);
+
+  search->query = NULL;
+}
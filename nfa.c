@@ -0,0 +1,872 @@
+/**
+ * @file
+ * Autocompletion API regex automaton
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Thompson automaton of a regex, run one character at a time.
+ *
+ * regexec() needs the whole string, so every item is scanned from its start.
+ * The automaton instead keeps the set of its active states, and a character
+ * moves from one set to the next.  The sets after a prefix are the same for
+ * all items sharing it, so the automaton can be walked over the trie of the
+ * items, see trie_regex().
+ *
+ * The common subset of the extended syntax of compl_regcomp() is supported:
+ * characters, `.`, bracket expressions with ranges and classes, groups,
+ * alternatives, `*`, `+`, `?` and the anchors.  As with REG_NEWLINE, `.` and
+ * negated brackets don't match a newline, and the anchors match around one.
+ * Like score_regex(), `^` doesn't match at the start of the string.
+ * Everything else (bounds, back references, GNU escapes, ...) isn't compiled,
+ * those patterns are left to regexec().
+ *
+ * Searches aren't anchored, the start state is added at every position.  Only
+ * whether a string matches is answered, not where.  The states can also be
+ * taken one by one, for approximate matching, see approx.c.
+ */
+
+#include "private.h"
+#include <ctype.h>
+#include <wctype.h>
+
+// deepest nesting of groups
+#define NFA_MAX_DEPTH 64
+
+/**
+ * enum NfaType - kind of an automaton state
+ */
+enum NfaType
+{
+  NFA_CHAR,   ///< a character
+  NFA_ANY,    ///< any character but a newline
+  NFA_SET,    ///< a bracket expression
+  NFA_SPLIT,  ///< both ways, without a character
+  NFA_BOL,    ///< start of a line
+  NFA_EOL,    ///< end of a line
+  NFA_MATCH,  ///< the pattern has matched
+};
+
+/**
+ * struct NfaState - state of the automaton
+ */
+struct NfaState
+{
+  enum NfaType type;  ///< kind of state
+  wchar_t ch;         ///< character (NFA_CHAR), folded for a case-insensitive pattern
+  uint32_t set;       ///< bracket expression (NFA_SET)
+  int out;            ///< next state
+  int out1;           ///< other next state (NFA_SPLIT)
+};
+
+/**
+ * struct NfaBracket - bracket expression, ranges and classes of characters
+ */
+struct NfaBracket
+{
+  uint32_t range;    ///< first range in RegexNfa.ranges
+  uint32_t n_ranges; ///< number of ranges
+  uint32_t cls;      ///< first class in RegexNfa.classes
+  uint32_t n_cls;    ///< number of classes
+  bool negate;       ///< the bracket matches the characters not listed
+};
+
+/**
+ * struct NfaRange - range of characters of a bracket expression
+ */
+struct NfaRange
+{
+  wchar_t lo;  ///< first character
+  wchar_t hi;  ///< last character
+};
+
+ARRAY_HEAD(NfaStateList, struct NfaState);
+ARRAY_HEAD(NfaBracketList, struct NfaBracket);
+ARRAY_HEAD(NfaRangeList, struct NfaRange);
+ARRAY_HEAD(NfaClassList, wctype_t);
+
+/**
+ * struct RegexNfa - automaton of a regex
+ */
+struct RegexNfa
+{
+  struct NfaStateList states;      ///< all states
+  struct NfaBracketList brackets;  ///< bracket expressions
+  struct NfaRangeList ranges;      ///< ranges of the bracket expressions
+  struct NfaClassList classes;     ///< classes of the bracket expressions
+  int start;                       ///< start state
+  bool icase;                      ///< ignore the case of the characters
+  size_t words;                    ///< size of a state set, in 64-bit words
+  int *stack;                      ///< work memory of the closures
+  uint64_t *restart;               ///< start states, added after every character
+  int restart_live;                ///< number of waiting states of restart
+  uint64_t *tmp;                   ///< work state set
+  uint64_t *end;                   ///< work state set, at the end of a string
+};
+
+/**
+ * struct NfaFrag - part of the automaton, with its dangling exits
+ *
+ * The exits are chained through the unset out fields themselves, a slot being
+ * a state times two, plus one for out1.
+ */
+struct NfaFrag
+{
+  int start;     ///< first state
+  int dangling;  ///< first unset exit, -1 for none
+};
+
+/**
+ * struct NfaParser - pattern being compiled
+ */
+struct NfaParser
+{
+  struct RegexNfa *nfa;  ///< automaton being built
+  const wchar_t *pat;    ///< decoded pattern
+  int len;               ///< number of characters
+  int pos;               ///< next character
+  int depth;             ///< nesting of groups
+};
+
+static bool nfa_parse_alt(struct NfaParser *p, struct NfaFrag *frag);
+static int nfa_closure(struct RegexNfa *nfa, uint64_t *set, int st, bool bol, bool eol);
+
+/**
+ * nfa_state - add a state
+ *
+ * @param nfa  automaton
+ * @param type kind of state
+ * @retval num index of the state
+ */
+static int nfa_state(struct RegexNfa *nfa, enum NfaType type)
+{
+  struct NfaState st = { type, 0, 0, -1, -1 };
+  if (ARRAY_SIZE(&nfa->states) == ARRAY_CAPACITY(&nfa->states))
+    ARRAY_RESERVE(&nfa->states, ARRAY_SIZE(&nfa->states) * 2);
+  ARRAY_ADD(&nfa->states, st);
+  return ARRAY_SIZE(&nfa->states) - 1;
+}
+
+/**
+ * nfa_get_state - look up a state
+ *
+ * @param nfa automaton
+ * @param st  index of the state
+ * @retval ptr state
+ */
+static inline struct NfaState *nfa_get_state(const struct RegexNfa *nfa, int st)
+{
+  return ARRAY_GET(&nfa->states, (size_t) st);
+}
+
+/**
+ * nfa_slot - exit of a state
+ *
+ * @param nfa  automaton
+ * @param slot state times two, plus one for out1
+ * @retval ptr the out field
+ */
+static int *nfa_slot(struct RegexNfa *nfa, int slot)
+{
+  struct NfaState *st = nfa_get_state(nfa, slot / 2);
+  return (slot % 2) ? &st->out1 : &st->out;
+}
+
+/**
+ * nfa_patch - connect the dangling exits of a fragment to a state
+ *
+ * @param nfa      automaton
+ * @param dangling first dangling exit
+ * @param target   state to connect them to
+ */
+static void nfa_patch(struct RegexNfa *nfa, int dangling, int target)
+{
+  while (dangling >= 0)
+  {
+    int *slot = nfa_slot(nfa, dangling);
+    dangling = *slot;
+    *slot = target;
+  }
+}
+
+/**
+ * nfa_append - join two chains of dangling exits
+ *
+ * @param nfa automaton
+ * @param l1  first chain
+ * @param l2  second chain
+ * @retval num the joined chain
+ */
+static int nfa_append(struct RegexNfa *nfa, int l1, int l2)
+{
+  if (l1 < 0)
+    return l2;
+
+  int last = l1;
+  while (*nfa_slot(nfa, last) >= 0)
+    last = *nfa_slot(nfa, last);
+  *nfa_slot(nfa, last) = l2;
+  return l1;
+}
+
+/**
+ * nfa_single - fragment of a single state, with its out dangling
+ *
+ * @param nfa  automaton
+ * @param type kind of state
+ * @retval obj fragment
+ */
+static struct NfaFrag nfa_single(struct RegexNfa *nfa, enum NfaType type)
+{
+  int st = nfa_state(nfa, type);
+  return (struct NfaFrag){ st, st * 2 };
+}
+
+/**
+ * nfa_parse_bracket - compile a bracket expression, after its '['
+ *
+ * @param p    parser
+ * @param frag set to the fragment of the expression
+ * @retval bool false if the expression isn't supported
+ */
+static bool nfa_parse_bracket(struct NfaParser *p, struct NfaFrag *frag)
+{
+  struct RegexNfa *nfa = p->nfa;
+  struct NfaBracket br = { ARRAY_SIZE(&nfa->ranges), 0, ARRAY_SIZE(&nfa->classes), 0, false };
+
+  if ((p->pos < p->len) && (p->pat[p->pos] == L'^'))
+  {
+    br.negate = true;
+    p->pos++;
+  }
+
+  // a ']' right at the start is a character
+  bool first = true;
+  while ((p->pos < p->len) && ((p->pat[p->pos] != L']') || first))
+  {
+    first = false;
+    const wchar_t *c = &p->pat[p->pos];
+    if ((c[0] == L'[') && (p->pos + 1 < p->len) && (c[1] == L':'))
+    {
+      char name[16] = { 0 };
+      int n = 0;
+      p->pos += 2;
+      while ((p->pos + 1 < p->len) && !((p->pat[p->pos] == L':') && (p->pat[p->pos + 1] == L']')))
+      {
+        if ((n + 1 >= (int) sizeof(name)) || (p->pat[p->pos] >= 0x80))
+          return false;
+        name[n++] = p->pat[p->pos++];
+      }
+      wctype_t cls = wctype(name);
+      if ((p->pos + 1 >= p->len) || (cls == 0))
+        return false;
+      p->pos += 2;
+      ARRAY_ADD(&nfa->classes, cls);
+      br.n_cls++;
+      continue;
+    }
+
+    // equivalence classes and collating symbols
+    if ((c[0] == L'[') && (p->pos + 1 < p->len) && ((c[1] == L'=') || (c[1] == L'.')))
+      return false;
+
+    struct NfaRange range = { c[0], c[0] };
+    p->pos++;
+    if ((p->pos + 1 < p->len) && (p->pat[p->pos] == L'-') && (p->pat[p->pos + 1] != L']'))
+    {
+      range.hi = p->pat[p->pos + 1];
+      if ((range.hi < range.lo) || (range.hi == L'['))
+        return false;
+      p->pos += 2;
+    }
+    ARRAY_ADD(&nfa->ranges, range);
+    br.n_ranges++;
+  }
+
+  if (p->pos >= p->len)
+    return false;
+  p->pos++;
+
+  *frag = nfa_single(nfa, NFA_SET);
+  nfa_get_state(nfa, frag->start)->set = ARRAY_SIZE(&nfa->brackets);
+  ARRAY_ADD(&nfa->brackets, br);
+  return true;
+}
+
+/**
+ * nfa_parse_atom - compile a character, bracket, group or anchor
+ *
+ * @param p      parser
+ * @param frag   set to the fragment of the atom
+ * @param anchor set to true for an anchor, which can't be repeated
+ * @retval bool false if the atom isn't supported
+ */
+static bool nfa_parse_atom(struct NfaParser *p, struct NfaFrag *frag, bool *anchor)
+{
+  struct RegexNfa *nfa = p->nfa;
+  wchar_t c = p->pat[p->pos++];
+  *anchor = false;
+
+  switch (c)
+  {
+    case L'(':
+      if ((p->pos >= p->len) || (p->pat[p->pos] == L')') || (++p->depth > NFA_MAX_DEPTH))
+        return false;
+      if (!nfa_parse_alt(p, frag) || (p->pos >= p->len) || (p->pat[p->pos] != L')'))
+        return false;
+      p->pos++;
+      p->depth--;
+      return true;
+
+    case L'.':
+      *frag = nfa_single(nfa, NFA_ANY);
+      return true;
+
+    case L'[':
+      return nfa_parse_bracket(p, frag);
+
+    case L'^':
+    case L'$':
+      *frag = nfa_single(nfa, (c == L'^') ? NFA_BOL : NFA_EOL);
+      *anchor = true;
+      return true;
+
+    // repeating nothing, or a closing parenthesis without an opening one
+    case L'*':
+    case L'+':
+    case L'?':
+    case L'{':
+    case L')':
+      return false;
+
+    case L'\\':
+      if (p->pos >= p->len)
+        return false;
+      c = p->pat[p->pos++];
+      // back references and the GNU escapes
+      if (((c < 0x80) && isalnum((int) c)) || (c == L'<') || (c == L'>') ||
+          (c == L'`') || (c == L'\''))
+      {
+        return false;
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  *frag = nfa_single(nfa, NFA_CHAR);
+  nfa_get_state(nfa, frag->start)->ch = nfa->icase ? compl_casefold(c) : c;
+  return true;
+}
+
+/**
+ * nfa_parse_repeat - compile an atom, with the repetitions following it
+ *
+ * @param p    parser
+ * @param frag set to the fragment
+ * @retval bool false if the pattern isn't supported
+ */
+static bool nfa_parse_repeat(struct NfaParser *p, struct NfaFrag *frag)
+{
+  struct RegexNfa *nfa = p->nfa;
+  bool anchor = false;
+  if (!nfa_parse_atom(p, frag, &anchor))
+    return false;
+
+  while (p->pos < p->len)
+  {
+    wchar_t c = p->pat[p->pos];
+    if ((c != L'*') && (c != L'+') && (c != L'?'))
+      break;
+    if (anchor)
+      return false;
+    p->pos++;
+
+    int split = nfa_state(nfa, NFA_SPLIT);
+    nfa_get_state(nfa, split)->out = frag->start;
+    if (c == L'*')
+    {
+      // the split loops back through the atom
+      nfa_patch(nfa, frag->dangling, split);
+      *frag = (struct NfaFrag){ split, split * 2 + 1 };
+    }
+    else if (c == L'+')
+    {
+      nfa_patch(nfa, frag->dangling, split);
+      frag->dangling = split * 2 + 1;
+    }
+    else
+    {
+      frag->dangling = nfa_append(nfa, frag->dangling, split * 2 + 1);
+      frag->start = split;
+    }
+  }
+
+  return (p->pos >= p->len) || (p->pat[p->pos] != L'{');
+}
+
+/**
+ * nfa_parse_concat - compile a sequence of atoms
+ *
+ * @param p    parser
+ * @param frag set to the fragment
+ * @retval bool false if the pattern isn't supported, or the sequence is empty
+ */
+static bool nfa_parse_concat(struct NfaParser *p, struct NfaFrag *frag)
+{
+  if ((p->pos >= p->len) || (p->pat[p->pos] == L'|') || (p->pat[p->pos] == L')'))
+    return false;
+
+  if (!nfa_parse_repeat(p, frag))
+    return false;
+
+  while ((p->pos < p->len) && (p->pat[p->pos] != L'|') && (p->pat[p->pos] != L')'))
+  {
+    struct NfaFrag next = { 0 };
+    if (!nfa_parse_repeat(p, &next))
+      return false;
+    nfa_patch(p->nfa, frag->dangling, next.start);
+    frag->dangling = next.dangling;
+  }
+
+  return true;
+}
+
+/**
+ * nfa_parse_alt - compile alternatives
+ *
+ * @param p    parser
+ * @param frag set to the fragment
+ * @retval bool false if the pattern isn't supported
+ */
+static bool nfa_parse_alt(struct NfaParser *p, struct NfaFrag *frag)
+{
+  if (!nfa_parse_concat(p, frag))
+    return false;
+
+  while ((p->pos < p->len) && (p->pat[p->pos] == L'|'))
+  {
+    p->pos++;
+    struct NfaFrag other = { 0 };
+    if (!nfa_parse_concat(p, &other))
+      return false;
+
+    int split = nfa_state(p->nfa, NFA_SPLIT);
+    nfa_get_state(p->nfa, split)->out = frag->start;
+    nfa_get_state(p->nfa, split)->out1 = other.start;
+    frag->start = split;
+    frag->dangling = nfa_append(p->nfa, frag->dangling, other.dangling);
+  }
+
+  return true;
+}
+
+/**
+ * nfa_compile - compile a regex into an automaton
+ *
+ * @param pattern regex, as for compl_regcomp()
+ * @param flags   matching flags, only COMPL_MATCH_IGNORECASE is used
+ * @retval ptr automaton, or NULL if the pattern isn't supported
+ */
+struct RegexNfa *nfa_compile(const char *pattern, MuttMatchFlags flags)
+{
+  int len = mbs_char_count(pattern);
+  if (len <= 0)
+    return NULL;
+
+  wchar_t *pat = mutt_mem_calloc(len + 1, sizeof(wchar_t));
+  utf8_decode(pattern, pat);
+
+  struct RegexNfa *nfa = mutt_mem_calloc(1, sizeof(struct RegexNfa));
+  ARRAY_INIT(&nfa->states);
+  ARRAY_INIT(&nfa->brackets);
+  ARRAY_INIT(&nfa->ranges);
+  ARRAY_INIT(&nfa->classes);
+  ARRAY_RESERVE(&nfa->states, 2 * (size_t) len + 1);
+  nfa->icase = (flags & COMPL_MATCH_IGNORECASE);
+
+  struct NfaParser p = { nfa, pat, len, 0, 0 };
+  struct NfaFrag frag = { 0 };
+  bool ok = nfa_parse_alt(&p, &frag) && (p.pos == len);
+  FREE(&pat);
+  if (!ok)
+  {
+    nfa_free(&nfa);
+    return NULL;
+  }
+
+  nfa_patch(nfa, frag.dangling, nfa_state(nfa, NFA_MATCH));
+  nfa->start = frag.start;
+  nfa->words = (ARRAY_SIZE(&nfa->states) + 63) / 64;
+  // a state is pushed once for every way into it, at most twice
+  nfa->stack = mutt_mem_calloc(2 * ARRAY_SIZE(&nfa->states) + 1, sizeof(int));
+  nfa->tmp = mutt_mem_calloc(nfa->words, sizeof(uint64_t));
+  nfa->end = mutt_mem_calloc(nfa->words, sizeof(uint64_t));
+  nfa->restart = mutt_mem_calloc(nfa->words, sizeof(uint64_t));
+  // score_regex() passes REG_EXTENDED to regexec(), which is REG_NOTBOL there
+  nfa->restart_live = nfa_closure(nfa, nfa->restart, nfa->start, false, false);
+  return nfa;
+}
+
+/**
+ * nfa_free - free an automaton
+ *
+ * @param ptr automaton to free
+ */
+void nfa_free(struct RegexNfa **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
+
+  struct RegexNfa *nfa = *ptr;
+  ARRAY_FREE(&nfa->states);
+  ARRAY_FREE(&nfa->brackets);
+  ARRAY_FREE(&nfa->ranges);
+  ARRAY_FREE(&nfa->classes);
+  FREE(&nfa->stack);
+  FREE(&nfa->tmp);
+  FREE(&nfa->end);
+  FREE(&nfa->restart);
+  FREE(ptr);
+}
+
+/**
+ * nfa_set_size - size of a state set
+ *
+ * @param nfa automaton
+ * @retval num number of 64-bit words
+ */
+size_t nfa_set_size(const struct RegexNfa *nfa)
+{
+  return nfa->words;
+}
+
+static inline bool nfa_has(const uint64_t *set, int st)
+{
+  return set[st / 64] & (1ULL << (st % 64));
+}
+
+/**
+ * nfa_closure - add a state, and the states it leads to without a character
+ *
+ * The anchors that don't hold stay in the set, without being followed.
+ *
+ * @param nfa automaton
+ * @param set state set
+ * @param st  state to add
+ * @param bol at the start of a line
+ * @param eol at the end of a line
+ * @retval num number of states added that wait for a character, an anchor or the end
+ */
+static int nfa_closure(struct RegexNfa *nfa, uint64_t *set, int st, bool bol, bool eol)
+{
+  int live = 0;
+  int n = 0;
+  nfa->stack[n++] = st;
+  while (n > 0)
+  {
+    st = nfa->stack[--n];
+    if ((st < 0) || nfa_has(set, st))
+      continue;
+    set[st / 64] |= (1ULL << (st % 64));
+
+    const struct NfaState *s = nfa_get_state(nfa, st);
+    switch (s->type)
+    {
+      case NFA_SPLIT:
+        nfa->stack[n++] = s->out1;
+        nfa->stack[n++] = s->out;
+        break;
+      case NFA_BOL:
+        if (bol)
+          nfa->stack[n++] = s->out;
+        break;
+      case NFA_EOL:
+        if (eol)
+          nfa->stack[n++] = s->out;
+        else
+          live++;
+        break;
+      default:
+        live++;
+        break;
+    }
+  }
+
+  return live;
+}
+
+/**
+ * nfa_eol - follow the end of line anchors of a set
+ *
+ * @param nfa automaton
+ * @param set state set, the states after the anchors are added
+ */
+static void nfa_eol(struct RegexNfa *nfa, uint64_t *set)
+{
+  memcpy(nfa->tmp, set, nfa->words * sizeof(uint64_t));
+  for (size_t w = 0; w < nfa->words; w++)
+  {
+    for (uint64_t bits = nfa->tmp[w]; bits; bits &= bits - 1)
+    {
+      const struct NfaState *s = ARRAY_GET(&nfa->states, w * 64 + __builtin_ctzll(bits));
+      if (s->type == NFA_EOL)
+        nfa_closure(nfa, set, s->out, false, true);
+    }
+  }
+}
+
+/**
+ * nfa_bracket - does a bracket expression match a character?
+ *
+ * @param nfa automaton
+ * @param br  bracket expression
+ * @param wc  character
+ * @retval bool true if it's listed (not taking negation into account)
+ */
+static bool nfa_bracket(const struct RegexNfa *nfa, const struct NfaBracket *br, wchar_t wc)
+{
+  for (uint32_t i = 0; i < br->n_ranges; i++)
+  {
+    const struct NfaRange *r = ARRAY_GET(&nfa->ranges, br->range + i);
+    if ((wc >= r->lo) && (wc <= r->hi))
+      return true;
+  }
+  for (uint32_t i = 0; i < br->n_cls; i++)
+  {
+    if (iswctype(wc, *ARRAY_GET(&nfa->classes, br->cls + i)))
+      return true;
+  }
+  return false;
+}
+
+/**
+ * nfa_accept_char - does a state take a character?
+ *
+ * @param nfa automaton
+ * @param s      state
+ * @param wc     character
+ * @param folded character, case-folded for a case-insensitive pattern
+ * @retval bool true if it does
+ */
+static bool nfa_accept_char(const struct RegexNfa *nfa, const struct NfaState *s,
+                            wchar_t wc, wchar_t folded)
+{
+  switch (s->type)
+  {
+    case NFA_CHAR:
+      return s->ch == folded;
+    case NFA_ANY:
+      return wc != L'\n';
+    case NFA_SET:
+    {
+      const struct NfaBracket *br = ARRAY_GET(&nfa->brackets, s->set);
+      bool listed = nfa_bracket(nfa, br, wc);
+      if (!listed && nfa->icase)
+        listed = nfa_bracket(nfa, br, towlower(wc)) || nfa_bracket(nfa, br, towupper(wc));
+      return br->negate ? (!listed && (wc != L'\n')) : listed;
+    }
+    default:
+      return false;
+  }
+}
+
+/**
+ * nfa_start - state set at the start of a string
+ *
+ * @param nfa automaton
+ * @param set set to the states
+ * @retval num number of states waiting for a character, an anchor or the end
+ */
+int nfa_start(struct RegexNfa *nfa, uint64_t *set)
+{
+  memcpy(set, nfa->restart, nfa->words * sizeof(uint64_t));
+  return nfa->restart_live;
+}
+
+/**
+ * nfa_step - state set after a character
+ *
+ * @param nfa  automaton
+ * @param from state set before the character
+ * @param wc   character
+ * @param to   set to the states after it
+ * @retval num number of states waiting for a character, an anchor or the end
+ */
+int nfa_step(struct RegexNfa *nfa, const uint64_t *from, wchar_t wc, uint64_t *to)
+{
+  // a newline ends a line, the anchors before it hold
+  const bool newline = (wc == L'\n');
+  const uint64_t *cur = from;
+  if (newline)
+  {
+    memcpy(to, from, nfa->words * sizeof(uint64_t));
+    nfa_eol(nfa, to);
+    memcpy(nfa->tmp, to, nfa->words * sizeof(uint64_t));
+    cur = nfa->tmp;
+  }
+
+  // the match can start anywhere, after a newline at a '^' too
+  int live = 0;
+  if (newline)
+  {
+    memset(to, 0, nfa->words * sizeof(uint64_t));
+    live += nfa_closure(nfa, to, nfa->start, true, false);
+  }
+  else
+  {
+    memcpy(to, nfa->restart, nfa->words * sizeof(uint64_t));
+    live += nfa->restart_live;
+  }
+
+  // a match, even one just before the newline, stays a match
+  int match = ARRAY_SIZE(&nfa->states) - 1;
+  if (nfa_has(cur, match))
+    live += nfa_closure(nfa, to, match, false, false);
+
+  const wchar_t folded = nfa->icase ? compl_casefold(wc) : wc;
+  for (size_t w = 0; w < nfa->words; w++)
+  {
+    for (uint64_t bits = cur[w]; bits; bits &= bits - 1)
+    {
+      const struct NfaState *s = ARRAY_GET(&nfa->states, w * 64 + __builtin_ctzll(bits));
+      if (nfa_accept_char(nfa, s, wc, folded))
+        live += nfa_closure(nfa, to, s->out, newline, false);
+    }
+  }
+
+  return live;
+}
+
+/**
+ * nfa_accepts - has the pattern matched?
+ *
+ * @param nfa    automaton
+ * @param set    state set
+ * @param at_end true at the end of the string, where the '$' anchors hold
+ * @retval bool true if the pattern has matched
+ */
+bool nfa_accepts(struct RegexNfa *nfa, const uint64_t *set, bool at_end)
+{
+  int match = ARRAY_SIZE(&nfa->states) - 1;
+  if (nfa_has(set, match) || !at_end)
+    return nfa_has(set, match);
+
+  memcpy(nfa->end, set, nfa->words * sizeof(uint64_t));
+  nfa_eol(nfa, nfa->end);
+  return nfa_has(nfa->end, match);
+}
+
+/**
+ * nfa_match - does the pattern match a string?
+ *
+ * @param nfa automaton
+ * @param str string, valid UTF-8
+ * @retval bool true if the pattern matches somewhere in the string
+ */
+bool nfa_match(struct RegexNfa *nfa, const char *str)
+{
+  if (!nfa || !str)
+    return false;
+
+  uint64_t *mem = mutt_mem_calloc(2 * nfa->words, sizeof(uint64_t));
+  uint64_t *set = mem;
+  uint64_t *next = mem + nfa->words;
+  nfa_start(nfa, set);
+
+  wchar_t wc = 0;
+  int n = 0;
+  bool matched = nfa_accepts(nfa, set, *str == '\0');
+  for (; !matched && ((n = utf8_next(str, &wc)) > 0); str += n)
+  {
+    nfa_step(nfa, set, wc, next);
+    uint64_t *tmp = set;
+    set = next;
+    next = tmp;
+    matched = nfa_accepts(nfa, set, str[n] == '\0');
+  }
+
+  FREE(&mem);
+  return matched;
+}
+
+/**
+ * nfa_n_states - number of states of an automaton
+ *
+ * @param nfa automaton
+ * @retval num number of states, the last one is the match
+ */
+int nfa_n_states(const struct RegexNfa *nfa)
+{
+  return ARRAY_SIZE(&nfa->states);
+}
+
+/**
+ * nfa_consumes - does a state take a character to move on?
+ *
+ * @param nfa automaton
+ * @param st  state
+ * @retval bool true for characters, '.' and bracket expressions
+ */
+bool nfa_consumes(const struct RegexNfa *nfa, int st)
+{
+  enum NfaType type = nfa_get_state(nfa, st)->type;
+  return (type == NFA_CHAR) || (type == NFA_ANY) || (type == NFA_SET);
+}
+
+/**
+ * nfa_takes - does a state take a character?
+ *
+ * @param nfa automaton
+ * @param st  state
+ * @param wc  character
+ * @retval bool true if it does
+ */
+bool nfa_takes(const struct RegexNfa *nfa, int st, wchar_t wc)
+{
+  const wchar_t folded = nfa->icase ? compl_casefold(wc) : wc;
+  return nfa_accept_char(nfa, nfa_get_state(nfa, st), wc, folded);
+}
+
+/**
+ * nfa_follow - add the states after a character, the anchors aren't followed
+ *
+ * @param nfa automaton
+ * @param st  state taking the character
+ * @param set state set, the states are added
+ */
+void nfa_follow(struct RegexNfa *nfa, int st, uint64_t *set)
+{
+  nfa_closure(nfa, set, nfa_get_state(nfa, st)->out, false, false);
+}
+
+/**
+ * nfa_first - state set at the start of a string, where '^' holds
+ *
+ * @param nfa automaton
+ * @param set set to the states
+ */
+void nfa_first(struct RegexNfa *nfa, uint64_t *set)
+{
+  memset(set, 0, nfa->words * sizeof(uint64_t));
+  nfa_closure(nfa, set, nfa->start, true, false);
+}
@@ -0,0 +1,342 @@
+/**
+ * @file
+ * Autocompletion API trigram index
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Trigram index for substring queries.
+ *
+ * Every item is split into its (case- and separator-folded) trigrams of characters, and the
+ * index maps each trigram to the ascending list of item ids containing it.
+ * Any item containing the typed string has to contain all of its trigrams, so
+ * intersecting their lists gives a (small) candidate set, which is then
+ * verified by the matching kernel.
+ */
+
+#include "private.h"
+
+// initial number of hash table slots (power of two)
+#define NGRAM_INITIAL_SLOTS 1024
+
+/**
+ * struct NgramSlot - hash table slot, mapping a trigram to its item ids
+ */
+struct NgramSlot
+{
+  uint64_t key;              ///< packed trigram, 0 for an empty slot
+  struct NgramIdList ids;    ///< ascending item ids containing the trigram
+};
+
+/**
+ * struct NgramIndex - open addressing hash table of trigrams
+ */
+struct NgramIndex
+{
+  struct NgramSlot *slots; ///< hash table
+  size_t num_slots;        ///< size of the hash table (power of two)
+  size_t num_used;         ///< number of trigrams in the table
+};
+
+/**
+ * ngram_key - pack three characters into a hash key
+ *
+ * Unicode code points fit into 21 bits, the top bit marks a used slot.
+ */
+static uint64_t ngram_key(const wchar_t *w)
+{
+  return (1ULL << 63) | ((uint64_t) (w[0] & 0x1FFFFF) << 42) |
+         ((uint64_t) (w[1] & 0x1FFFFF) << 21) | (uint64_t) (w[2] & 0x1FFFFF);
+}
+
+static size_t ngram_hash(uint64_t key)
+{
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return key;
+}
+
+/**
+ * ngram_slot - find the slot of a trigram
+ *
+ * @retval ptr slot holding the key, or the empty slot where it belongs
+ */
+static struct NgramSlot *ngram_slot(const struct NgramIndex *idx, uint64_t key)
+{
+  size_t mask = idx->num_slots - 1;
+  size_t i = ngram_hash(key) & mask;
+
+  while (idx->slots[i].key && (idx->slots[i].key != key))
+    i = (i + 1) & mask;
+
+  return &idx->slots[i];
+}
+
+static void ngram_grow(struct NgramIndex *idx)
+{
+  struct NgramSlot *old = idx->slots;
+  size_t old_num = idx->num_slots;
+
+  idx->num_slots *= 2;
+  idx->slots = mutt_mem_calloc(idx->num_slots, sizeof(struct NgramSlot));
+
+  for (size_t i = 0; i < old_num; i++)
+  {
+    if (old[i].key)
+      *ngram_slot(idx, old[i].key) = old[i];
+  }
+
+  FREE(&old);
+}
+
+/**
+ * ngram_decode - decode and case-fold a string for the index
+ *
+ * Separators are folded as well, so the index also serves magic matching.
+ * @param str string to decode
+ * @param len set to the number of characters
+ * @retval ptr allocated wide string, NULL for invalid strings
+ */
+static wchar_t *ngram_decode(const char *str, int *len)
+{
+  // ASCII strings don't need the (slow) locale functions
+  if (is_ascii(str))
+  {
+    *len = strlen(str);
+    wchar_t *w = mutt_mem_calloc(*len + 1, sizeof(wchar_t));
+    for (int i = 0; i < *len; i++)
+      w[i] = (str[i] == '_') ? COMPL_MAGIC_SEPARATOR : compl_casefold(str[i]);
+    return w;
+  }
+
+  *len = mbs_char_count(str);
+  if (*len < 0)
+    return NULL;
+
+  wchar_t *w = mutt_mem_calloc(*len + 1, sizeof(wchar_t));
+  utf8_decode(str, w);
+  for (int i = 0; i < *len; i++)
+    w[i] = (w[i] == L'_') ? COMPL_MAGIC_SEPARATOR : compl_casefold(w[i]);
+
+  return w;
+}
+
+struct NgramIndex *ngram_new(void)
+{
+  struct NgramIndex *idx = mutt_mem_calloc(1, sizeof(struct NgramIndex));
+  idx->num_slots = NGRAM_INITIAL_SLOTS;
+  idx->slots = mutt_mem_calloc(idx->num_slots, sizeof(struct NgramSlot));
+  return idx;
+}
+
+void ngram_free(struct NgramIndex **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
+
+  struct NgramIndex *idx = *ptr;
+  for (size_t i = 0; i < idx->num_slots; i++)
+  {
+    if (idx->slots[i].key)
+      ARRAY_FREE(&idx->slots[i].ids);
+  }
+
+  FREE(&idx->slots);
+  FREE(ptr);
+}
+
+/**
+ * ngram_add - add the trigrams of an item to the index
+ *
+ * Items have to be added with ascending ids.
+ *
+ * @param idx index
+ * @param id  id of the item
+ * @param str item string
+ */
+void ngram_add(struct NgramIndex *idx, uint32_t id, const char *str)
+{
+  if (!idx || !str)
+    return;
+
+  int len = 0;
+  wchar_t *w = ngram_decode(str, &len);
+  if (!w)
+    return;
+
+  for (int i = 0; i + 3 <= len; i++)
+  {
+    if ((idx->num_used + 1) * 4 > idx->num_slots * 3)
+      ngram_grow(idx);
+
+    uint64_t key = ngram_key(&w[i]);
+    struct NgramSlot *slot = ngram_slot(idx, key);
+    if (!slot->key)
+    {
+      slot->key = key;
+      idx->num_used++;
+    }
+
+    // repeated trigrams of the same item are only listed once
+    uint32_t *last = ARRAY_LAST(&slot->ids);
+    if (last && (*last == id))
+      continue;
+
+    // ARRAY_ADD() only grows by a few entries, common trigrams have long lists
+    if (ARRAY_SIZE(&slot->ids) == ARRAY_CAPACITY(&slot->ids))
+      ARRAY_RESERVE(&slot->ids, ARRAY_SIZE(&slot->ids) * 2);
+    ARRAY_ADD(&slot->ids, id);
+  }
+
+  FREE(&w);
+}
+
+/**
+ * ngram_remove - drop removed items from the index
+ *
+ * @param idx     index
+ * @param removed tombstones, indexed by item id
+ */
+void ngram_remove(struct NgramIndex *idx, const struct CompletionBoolList *removed)
+{
+  if (!idx || !removed)
+    return;
+
+  for (size_t i = 0; i < idx->num_slots; i++)
+  {
+    struct NgramIdList *ids = &idx->slots[i].ids;
+    if (!idx->slots[i].key || ARRAY_EMPTY(ids))
+      continue;
+
+    // the lists stay sorted, as they are filtered in place
+    size_t keep = 0;
+    for (size_t j = 0; j < ARRAY_SIZE(ids); j++)
+    {
+      uint32_t id = *ARRAY_GET(ids, j);
+      const bool *dead = ARRAY_GET(removed, id);
+      if (dead && *dead)
+        continue;
+
+      *ARRAY_GET(ids, keep) = id;
+      keep++;
+    }
+    ARRAY_SHRINK(ids, ARRAY_SIZE(ids) - keep);
+  }
+}
+
+/**
+ * ngram_query - find the candidate items for a substring query
+ *
+ * @param idx index
+ * @param str typed string
+ * @param ids list to fill with the ascending candidate ids
+ * @retval num number of candidates, or -1 if the query is too short to filter
+ */
+int ngram_query(const struct NgramIndex *idx, const char *str, struct NgramIdList *ids)
+{
+  if (!idx || !str || !ids)
+    return -1;
+
+  int len = 0;
+  wchar_t *w = ngram_decode(str, &len);
+  if (!w || (len < 3))
+  {
+    FREE(&w);
+    return -1;
+  }
+
+  // start with the rarest trigram, to keep the intersections small
+  const struct NgramIdList *lists[len - 2];
+  int n_lists = 0;
+  for (int i = 0; i + 3 <= len; i++)
+  {
+    const struct NgramSlot *slot = ngram_slot(idx, ngram_key(&w[i]));
+    if (!slot->key)
+    {
+      n_lists = 0;
+      break;
+    }
+
+    lists[n_lists++] = &slot->ids;
+    if (ARRAY_SIZE(lists[n_lists - 1]) < ARRAY_SIZE(lists[0]))
+    {
+      const struct NgramIdList *tmp = lists[0];
+      lists[0] = lists[n_lists - 1];
+      lists[n_lists - 1] = tmp;
+    }
+  }
+  FREE(&w);
+
+  ARRAY_SHRINK(ids, ARRAY_SIZE(ids));
+  if (n_lists == 0)
+    return 0;
+
+  uint32_t *id = NULL;
+  ARRAY_FOREACH(id, lists[0])
+  {
+    ARRAY_ADD(ids, *id);
+  }
+
+  // intersect the sorted lists in place
+  for (int l = 1; l < n_lists && !ARRAY_EMPTY(ids); l++)
+  {
+    size_t keep = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(ids); i++)
+    {
+      uint32_t cur = *ARRAY_GET(ids, i);
+      while ((j < ARRAY_SIZE(lists[l])) && (*ARRAY_GET(lists[l], j) < cur))
+        j++;
+      if (j == ARRAY_SIZE(lists[l]))
+        break;
+      if (*ARRAY_GET(lists[l], j) == cur)
+      {
+        *ARRAY_GET(ids, keep) = cur;
+        keep++;
+      }
+    }
+    ARRAY_SHRINK(ids, ARRAY_SIZE(ids) - keep);
+  }
+
+  return ARRAY_SIZE(ids);
+}
+
+/**
+ * ngram_memory - memory used by a trigram index
+ *
+ * @param idx index
+ * @retval num size in bytes
+ */
+size_t ngram_memory(const struct NgramIndex *idx)
+{
+  if (!idx)
+    return 0;
+
+  size_t size = sizeof(struct NgramIndex) + idx->num_slots * sizeof(struct NgramSlot);
+  for (size_t i = 0; i < idx->num_slots; i++)
+  {
+    if (idx->slots[i].key)
+      size += ARRAY_CAPACITY(&idx->slots[i].ids) * sizeof(uint32_t);
+  }
+
+  return size;
+}
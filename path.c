@@ -0,0 +1,364 @@
+/**
+ * @file
+ * Autocompletion API path completion
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Path completion, e.g. for mailboxes in a Maildir tree.
+ *
+ * The last component of the typed path is completed against the entries of its
+ * directory, with the matching mode and flags of the CompletionPath.  Calling
+ * compl_path_complete() again with the returned path cycles through the
+ * matches, any other path starts a new completion.  Directories are completed
+ * with a trailing '/', so the next component can follow right away.
+ *
+ * The entries of a directory are read once, and kept with the directory's
+ * modification time.  Later completions only stat() the directory, and read it
+ * again if it changed.  A directory changed in the same second as it was read
+ * may change again without a new mtime (on filesystems with coarse
+ * timestamps), so it's read again next time as well.
+ *
+ * Entries starting with a dot are only completed if the typed component starts
+ * with one.
+ */
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include "mutt/file.h"
+#include "private.h"
+
+/**
+ * compl_path_new - create a path completion
+ *
+ * @param mode matching mode for the path components
+ * @param flags matching flags for the path components
+ * @retval ptr new path completion
+ */
+CompletionPath *compl_path_new(enum MuttMatchMode mode, MuttMatchFlags flags)
+{
+  CompletionPath *cp = mutt_mem_calloc(1, sizeof(CompletionPath));
+  cp->mode = mode;
+  cp->flags = flags;
+  ARRAY_INIT(&cp->dirs);
+  cp->cur = -1;
+  cp->typed = buf_new(NULL);
+  cp->result = buf_new(NULL);
+  return cp;
+}
+
+/**
+ * compl_dir_clear - free the entries of a cached directory
+ *
+ * @param dir directory
+ */
+static void compl_dir_clear(CompletionDir *dir)
+{
+  char **name = NULL;
+  ARRAY_FOREACH(name, &dir->names)
+  {
+    FREE(name);
+  }
+  ARRAY_FREE(&dir->names);
+
+  compl_free(&dir->comp);
+}
+
+/**
+ * compl_path_free - free a path completion and its cached directories
+ *
+ * @param ptr path completion to free
+ */
+void compl_path_free(CompletionPath **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
+
+  CompletionPath *cp = *ptr;
+  CompletionDir *dir = NULL;
+  ARRAY_FOREACH(dir, &cp->dirs)
+  {
+    compl_dir_clear(dir);
+    FREE(&dir->path);
+  }
+
+  ARRAY_FREE(&cp->dirs);
+  buf_free(&cp->typed);
+  buf_free(&cp->result);
+  FREE(ptr);
+}
+
+static int compl_name_sort(const void *a, const void *b)
+{
+  return mutt_str_coll(*(const char *const *) a, *(const char *const *) b);
+}
+
+/**
+ * compl_dir_read - read the entries of a directory
+ *
+ * @param cp path completion, for the matching mode and flags
+ * @param dir directory to fill
+ * @param path directory to open
+ * @retval bool true if the directory could be read
+ */
+static bool compl_dir_read(const CompletionPath *cp, CompletionDir *dir, const char *path)
+{
+  DIR *dp = opendir(path);
+  if (!dp)
+    return false;
+
+  struct dirent *de = NULL;
+  while ((de = readdir(dp)))
+  {
+    if (mutt_str_equal(de->d_name, ".") || mutt_str_equal(de->d_name, ".."))
+      continue;
+
+    // links and unknown types need a stat() to tell directories apart
+    bool is_dir = false;
+#if defined(_DIRENT_HAVE_D_TYPE) && defined(DT_DIR)
+    if ((de->d_type != DT_UNKNOWN) && (de->d_type != DT_LNK))
+      is_dir = (de->d_type == DT_DIR);
+    else
+#endif
+    {
+      struct stat st = { 0 };
+      struct Buffer *full = buf_new(path);
+      buf_addch(full, '/');
+      buf_addstr(full, de->d_name);
+      is_dir = (stat(buf_string(full), &st) == 0) && S_ISDIR(st.st_mode);
+      buf_free(&full);
+    }
+
+    struct Buffer *name = buf_new(de->d_name);
+    if (is_dir)
+      buf_addch(name, '/');
+    ARRAY_ADD(&dir->names, buf_strdup(name));
+    buf_free(&name);
+  }
+  closedir(dp);
+
+  ARRAY_SORT(&dir->names, compl_name_sort);
+
+  // the names are unique, so the items get the ids 1..n in this order
+  size_t num = ARRAY_SIZE(&dir->names);
+  size_t *lens = mutt_mem_calloc(MAX(num, 1), sizeof(size_t));
+  char **name = NULL;
+  ARRAY_FOREACH(name, &dir->names)
+  {
+    size_t len = strlen(*name);
+    lens[ARRAY_FOREACH_IDX_name] = ((*name)[len - 1] == '/') ? len - 1 : len;
+  }
+
+  dir->comp = compl_new(cp->mode);
+  dir->comp->flags = cp->flags;
+  compl_add_many(dir->comp, (const char **) dir->names.entries, lens, num);
+  FREE(&lens);
+
+  logdeb(4, "Read %zu entries of '%s'.", num, path);
+  return true;
+}
+
+/**
+ * compl_path_get_dir - look up a cached directory
+ *
+ * @param cp  path completion
+ * @param idx index of the directory
+ * @retval ptr directory
+ */
+static inline CompletionDir *compl_path_get_dir(const CompletionPath *cp, int idx)
+{
+  return ARRAY_GET(&cp->dirs, (size_t) idx);
+}
+
+/**
+ * compl_path_dir - get the entries of a directory, reading it only if it changed
+ *
+ * @param cp path completion
+ * @param path directory as typed, "" for the current one
+ * @retval num index of the directory in the cache, -1 if it can't be read
+ */
+static int compl_path_dir(CompletionPath *cp, const char *path)
+{
+  const char *open_path = (*path == '\0') ? "." : path;
+
+  CompletionDir *dir = NULL;
+  int idx = -1;
+  ARRAY_FOREACH(dir, &cp->dirs)
+  {
+    if (mutt_str_equal(dir->path, path))
+    {
+      idx = ARRAY_FOREACH_IDX_dir;
+      break;
+    }
+  }
+
+  struct stat st = { 0 };
+  if ((stat(open_path, &st) != 0) || !S_ISDIR(st.st_mode))
+    return -1;
+
+  struct timespec mtime = { 0 };
+  mutt_file_get_stat_timespec(&mtime, &st, MUTT_STAT_MTIME);
+
+  if (idx >= 0)
+  {
+    dir = compl_path_get_dir(cp, idx);
+    dir->used = ++cp->tick;
+    if (!dir->racy && (mutt_file_timespec_compare(&mtime, &dir->mtime) == 0))
+      return idx;
+
+    compl_dir_clear(dir);
+  }
+  else if (ARRAY_SIZE(&cp->dirs) < COMPL_PATH_DIRS)
+  {
+    CompletionDir new_dir = { 0 };
+    new_dir.path = mutt_str_dup(path);
+    ARRAY_ADD(&cp->dirs, new_dir);
+    idx = ARRAY_SIZE(&cp->dirs) - 1;
+  }
+  else
+  {
+    // replace the least recently used directory
+    idx = 0;
+    ARRAY_FOREACH(dir, &cp->dirs)
+    {
+      if (dir->used < compl_path_get_dir(cp, idx)->used)
+        idx = ARRAY_FOREACH_IDX_dir;
+    }
+
+    dir = compl_path_get_dir(cp, idx);
+    compl_dir_clear(dir);
+    mutt_str_replace(&dir->path, path);
+  }
+
+  dir = compl_path_get_dir(cp, idx);
+  dir->used = ++cp->tick;
+  dir->mtime = mtime;
+  dir->racy = (mtime.tv_sec >= time(NULL));
+
+  if (!compl_dir_read(cp, dir, open_path))
+  {
+    compl_dir_clear(dir);
+    dir->racy = true;
+    return -1;
+  }
+
+  return idx;
+}
+
+/**
+ * compl_path_next - find the next entry of the directory being completed
+ *
+ * @param cp path completion
+ * @retval ptr entry name, NULL when cycling back to the typed path
+ */
+static const char *compl_path_next(CompletionPath *cp)
+{
+  CompletionDir *dir = compl_path_get_dir(cp, cp->cur);
+  const char *component = buf_string(cp->typed) + cp->stem;
+  bool hidden = (*component == '.');
+
+  // nothing typed yet: list all entries
+  if (*component == '\0')
+  {
+    while (cp->pos < ARRAY_SIZE(&dir->names))
+    {
+      const char *name = *ARRAY_GET(&dir->names, cp->pos);
+      cp->pos++;
+      if (*name != '.')
+        return name;
+    }
+
+    cp->pos = 0;
+    return NULL;
+  }
+
+  while (true)
+  {
+    struct Buffer *match = compl_complete(dir->comp);
+    buf_free(&match);
+
+    uint32_t id = dir->comp->cur_item->id;
+    if (id == 0)
+      return NULL;
+
+    const char *name = *ARRAY_GET(&dir->names, id - 1);
+    if (hidden || (*name != '.'))
+      return name;
+  }
+}
+
+/**
+ * compl_path_complete - complete the last component of a path
+ *
+ * @param cp path completion
+ * @param typed typed path, or the path returned last to cycle to the next match
+ * @retval ptr allocated completed path (the typed one if nothing matches),
+ *             NULL on error
+ */
+struct Buffer *compl_path_complete(CompletionPath *cp, const struct Buffer *typed)
+{
+  if (!cp || !typed)
+    return NULL;
+
+  // a new completion, unless the last result is passed back
+  if ((cp->cur < 0) || !buf_str_equal(typed, cp->result))
+  {
+    buf_copy(cp->typed, typed);
+    const char *slash = strrchr(buf_string(typed), '/');
+    cp->stem = slash ? (slash - buf_string(typed) + 1) : 0;
+    cp->pos = 0;
+
+    char *path = mutt_strn_dup(buf_string(typed), cp->stem);
+    cp->cur = compl_path_dir(cp, path ? path : "");
+    FREE(&path);
+
+    if (cp->cur < 0)
+      return buf_dup(typed);
+
+    const char *component = buf_string(cp->typed) + cp->stem;
+    if (*component != '\0')
+    {
+      Completion *comp = compl_path_get_dir(cp, cp->cur)->comp;
+      struct Buffer *buf = buf_new(component);
+      compl_type(comp, buf);
+      buf_free(&buf);
+
+      // start over, even if the same component was completed before
+      comp->state = COMPL_STATE_INIT;
+    }
+  }
+
+  const char *name = compl_path_next(cp);
+
+  buf_reset(cp->result);
+  if (name)
+  {
+    buf_addstr_n(cp->result, buf_string(cp->typed), cp->stem);
+    buf_addstr(cp->result, name);
+  }
+  else
+  {
+    buf_copy(cp->result, cp->typed);
+  }
+
+  return buf_dup(cp->result);
+}
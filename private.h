@@ -26,9 +26,12 @@
  * Neomutt completion API
  */
 
+#include <ctype.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <strings.h>
 #include <wchar.h>
 #include <wctype.h>
@@ -54,6 +57,151 @@
     L, __FILE__, __LINE__, ##__VA_ARGS__)
 #endif
 
+// number of items from which on substring queries use a trigram index
+#ifndef COMPL_NGRAM_THRESHOLD
+#define COMPL_NGRAM_THRESHOLD 1000
+#endif
+
+// number of items from which on fuzzy queries with a maximum distance use a BK-tree
+#ifndef COMPL_BKTREE_THRESHOLD
+#define COMPL_BKTREE_THRESHOLD 1000
+#endif
+
+// the trie is left out of fuzzy searches whose character filter passes fewer than 1 in this many items
+#ifndef COMPL_TRIE_MIN_PASS
+#define COMPL_TRIE_MIN_PASS 8
+#endif
+
+// separator that all magic separators are folded into
+#ifndef COMPL_MAGIC_SEPARATOR
+#define COMPL_MAGIC_SEPARATOR L'-'
+#endif
+
+// minimum size of a block of item strings
+#ifndef COMPL_ARENA_BLOCK
+#define COMPL_ARENA_BLOCK (64 * 1024)
+#endif
+
+// number of items pulled from a provider at once
+#ifndef COMPL_PROVIDER_CHUNK
+#define COMPL_PROVIDER_CHUNK 256
+#endif
+
+// number of directories kept by path completion
+#ifndef COMPL_PATH_DIRS
+#define COMPL_PATH_DIRS 32
+#endif
+
+// initial number of slots of the dedup table (power of two)
+#ifndef COMPL_DEDUP_SLOTS
+#define COMPL_DEDUP_SLOTS 256
+#endif
+
+// the indexes are compacted once one in COMPL_COMPACT_RATIO of their items is removed
+#ifndef COMPL_COMPACT_RATIO
+#define COMPL_COMPACT_RATIO 4
+#endif
+
+// number of items scored per call of a matcher's score_batch()
+#ifndef COMPL_BATCH_SIZE
+#define COMPL_BATCH_SIZE 256
+#endif
+
+// number of items scored by compl_score_step() before the matches are ranked
+#ifndef COMPL_STEP_ITEMS
+#define COMPL_STEP_ITEMS 4096
+#endif
+
+// longest typed string and item (in bytes) scored in SIMD lanes, with 16-bit cells
+#ifndef COMPL_LANES_MAX_LEN
+#define COMPL_LANES_MAX_LEN 64
+#endif
+
+// number of regex patterns kept compiled, for typing and backspacing
+#ifndef COMPL_REGEX_CACHE
+#define COMPL_REGEX_CACHE 8
+#endif
+
+// number of edits approximate regex matches allow, without a maximum distance
+#ifndef COMPL_APPROX_EDITS
+#define COMPL_APPROX_EDITS 2
+#endif
+
+// number of matching modes, built-in and registered ones
+#ifndef COMPL_MAX_MATCHERS
+#define COMPL_MAX_MATCHERS 16
+#endif
+
+struct CompletionQuery;
+
+// matching kernel specialised for a mode and its flags, and its scoring loop
+typedef int (*CompletionKernel)(const struct CompletionQuery *q, const char *tar,
+                                struct CompletionSpanList *spans);
+typedef void (*CompletionBatchKernel)(const struct CompletionQuery *q,
+                                      const char **tars, size_t num, int *dists);
+
+/**
+ * CompletionQuery - typed string prepared for the built-in matchers
+ *
+ * Everything the kernels need to know about the typed string is worked out
+ * once per search, instead of once per item.
+ */
+typedef struct CompletionQuery {
+  char *src;                ///< typed string
+  MuttMatchFlags flags;     ///< matching flags
+  int len;                  ///< length of the typed string in bytes
+  int n_chars;              ///< number of characters (-1 for an invalid string)
+  bool mbs;                 ///< typed string contains multibyte characters
+  bool ascii;               ///< typed string and all targets are plain ASCII
+  wchar_t *w_src;           ///< decoded characters (lowercase for COMPL_MATCH_IGNORECASE)
+  int *idx;                 ///< byte offset of every character
+  const regex_t *regex;     ///< compiled regex (COMPL_MODE_REGEX)
+  regex_t own_regex;        ///< regex compiled for this query only
+  bool regex_owned;         ///< own_regex needs to be freed
+  struct RegexApprox *approx;     ///< automaton allowing edits (COMPL_MODE_APPROX)
+  CompletionScratch *scratch;     ///< work memory of the kernels
+  CompletionScratch own_scratch;  ///< work memory of a query without a Completion
+  CompletionKernel kernel;      ///< variant selected for the flags (exact and fuzzy)
+  CompletionBatchKernel batch;  ///< scoring loop of the selected variant
+} CompletionQuery;
+
+/**
+ * CompletionSearch - a matcher with its query prepared for one search
+ */
+typedef struct CompletionSearch {
+  const CompletionMatcher *matcher;
+  void *query;              ///< prepared query of the matcher
+  bool magic;               ///< targets need to be normalised (COMPL_MATCH_MAGIC)
+} CompletionSearch;
+
+/**
+ * CompletionScan - a search prepared for scoring the items, possibly in slices
+ *
+ * The indexes and the trie answer for the ids up to next_id, items added
+ * after that are left to the kernel.
+ */
+typedef struct CompletionScan {
+  CompletionSearch search;       ///< typed string prepared for the kernel
+  bool searching;                ///< the items are scored by the kernel
+  enum MuttMatchMode mode;       ///< mode of the search
+  MuttMatchFlags flags;          ///< flags of the search
+  bool ascii;                    ///< the search was prepared for plain ASCII items
+  size_t max_len;                ///< longest item the search was prepared for
+  int max_dist;                  ///< items further away don't match, -1 for no limit
+  uint32_t next_id;              ///< ids covered by the tables below
+  uint8_t *cand;                 ///< candidates of an index, NULL if all items are
+  int *row_dist;                 ///< distances of all rows, for lists with columns
+  int *trie_dist;                ///< distances of all items, from the trie
+  uint8_t *pass;                 ///< items passing the character filter
+  size_t n_pass;                 ///< number of flags in pass
+  struct QgramFilter *filter;    ///< q-gram filter prepared for the typed string
+  size_t n_rejected;             ///< rejected by the filter before this search
+  size_t n_checked;              ///< checked by the filter before this search
+  // progress of a search scored in slices
+  size_t next;                   ///< index of the next item to score
+  size_t n_ranked;               ///< matches sorted at the front, after the typed item
+} CompletionScan;
+
 #ifndef WSTR_EQ
 // TODO how can we best handle this...?
 // could use wcscoll as well (locale aware)
@@ -67,22 +215,253 @@ int         compl_str_check(const struct Buffer *str);
 int         compl_get_size(Completion *comp);
 bool        compl_check_duplicate(const Completion *comp, const struct Buffer *buf);
 int         compl_compile_regex(Completion *comp);
+int         compl_regcomp(regex_t *regex, const char *str, MuttMatchFlags flags);
 
 // the main matching function
 int         match_dist(const struct Buffer *tar, const Completion *comp);
+int         match_spans(const struct Buffer *tar, const Completion *comp, struct CompletionSpanList *spans);
+int         match_str(const char *tar, const Completion *comp, struct CompletionSpanList *spans);
+void        compl_span_add(struct CompletionSpanList *spans, int start, int len);
+void        compl_arena_reserve(CompletionArena *arena, size_t size);
+const char *compl_arena_add(CompletionArena *arena, const char *str, size_t len);
+void        compl_arena_undo(CompletionArena *arena, const char *str);
+void        compl_arena_free(CompletionArena *arena);
+uint32_t    compl_pool_add(CompletionPool *pool, const char *str);
+void        compl_pool_free(CompletionPool *pool);
+void       *compl_scratch_reserve(CompletionScratch *scratch, size_t size);
+void        compl_scratch_free(CompletionScratch *scratch);
+int        *compl_rows_score(Completion *comp);
+void        compl_columns_free(Completion *comp);
+void        compl_dedup_rebuild(Completion *comp);
+bool        compl_is_removed(const Completion *comp, uint32_t id);
+void        compl_compact(Completion *comp);
+void        compl_items_reserve(Completion *comp, size_t num);
+void        compl_columns_compact(Completion *comp);
+
+// matchers, see matcher.c
+const CompletionMatcher *compl_get_matcher(enum MuttMatchMode mode);
+CompletionQuery *compl_query_new(const char *typed, MuttMatchFlags flags, bool ascii);
+void        compl_query_free(CompletionQuery **ptr);
+bool        compl_search_init(CompletionSearch *search, const Completion *comp,
+                              enum MuttMatchMode mode, MuttMatchFlags flags, bool ascii);
+int         compl_search_score(const CompletionSearch *search, const char *tar,
+                               struct CompletionSpanList *spans);
+void        compl_search_batch(const CompletionSearch *search, const char **tars,
+                               size_t num, int *dists);
+void        compl_search_free(CompletionSearch *search);
+
+// matching kernels of the built-in modes
+void        score_exact_select(CompletionQuery *q);
+void        score_fuzzy_select(CompletionQuery *q);
+int         score_exact(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans);
+int         score_regex(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans);
+int         score_substring(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans);
+int         score_suffix(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans);
+int         score_fuzzy(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans);
+int         score_subseq(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans);
+int         score_approx(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans);
+
+// scratch memory the kernels need for a typed string and a target of the given length
+size_t      score_fuzzy_scratch(int len_src, size_t len_tar);
+size_t      score_subseq_scratch(int len_src, size_t len_tar);
+size_t      score_substring_scratch(int len_src, size_t len_tar);
 #endif
 
 #ifndef ISLONGMBYTE
+/**
+ * utf8_char_len - length of a UTF-8 character, from its first byte
+ *
+ * The continuation bytes aren't checked, the string has to be valid.
+ *
+ * @param str string
+ * @retval num length in bytes, 0 at the end of the string, -1 if it's no first byte
+ */
+static inline int utf8_char_len(const char *str)
+{
+  unsigned char c = (unsigned char) *str;
+  if (c < 0x80)
+    return c ? 1 : 0;
+  if (c < 0xC2)
+    return -1;
+  if (c < 0xE0)
+    return 2;
+  if (c < 0xF0)
+    return 3;
+  if (c < 0xF5)
+    return 4;
+  return -1;
+}
+
 // TODO might want to move these to mutt/mbyte.h or mutt/string2.h
-#define ISLONGMBYTE(mbyte) mblen(mbyte, MB_CUR_MAX) > 1
-#define MBCHARLEN(mbyte) mblen(mbyte, MB_CUR_MAX)
-#define ISBADMBYTE(mbyte) mblen(mbyte, MB_CUR_MAX) == -1
+#define ISLONGMBYTE(mbyte) (utf8_char_len(mbyte) > 1)
+#define MBCHARLEN(mbyte) utf8_char_len(mbyte)
+#define ISBADMBYTE(mbyte) (utf8_char_len(mbyte) == -1)
+
+ARRAY_HEAD(NgramIdList, uint32_t);
+
+// hash table of the item strings, to skip duplicates
+struct DedupTable *dedup_new(size_t num);
+void               dedup_free(struct DedupTable **ptr);
+void               dedup_reserve(struct DedupTable *t, size_t num);
+uint32_t           dedup_find(const struct DedupTable *t, const char *str);
+void               dedup_add(struct DedupTable *t, const char *str, uint32_t id);
+void               dedup_delete(struct DedupTable *t, const char *str, uint32_t id);
+
+// BK-tree of the items, to find fuzzy candidates within a distance
+struct BkTree *bktree_new(bool magic);
+void           bktree_free(struct BkTree **ptr);
+bool           bktree_magic(const struct BkTree *t);
+void           bktree_add(struct BkTree *t, uint32_t id, const char *str);
+int            bktree_query(struct BkTree *t, const char *str, int max_dist, struct NgramIdList *ids);
+size_t         bktree_stats(const struct BkTree *t, size_t *n_dist);
+size_t         bktree_memory(const struct BkTree *t);
+
+// deletion variants of the items, to find fuzzy candidates within a small distance
+struct SymDelIndex *symdel_new(bool magic);
+void                symdel_free(struct SymDelIndex **ptr);
+bool                symdel_magic(const struct SymDelIndex *idx);
+void                symdel_add(struct SymDelIndex *idx, uint32_t id, const char *str);
+void                symdel_remove(struct SymDelIndex *idx, const struct CompletionBoolList *removed);
+int                 symdel_query(const struct SymDelIndex *idx, const char *str, int max_dist, struct NgramIdList *ids);
+size_t              symdel_memory(const struct SymDelIndex *idx, size_t *n_variants);
+
+// automaton of a regex, run one character at a time
+struct RegexNfa *nfa_compile(const char *pattern, MuttMatchFlags flags);
+void             nfa_free(struct RegexNfa **ptr);
+size_t           nfa_set_size(const struct RegexNfa *nfa);
+int              nfa_start(struct RegexNfa *nfa, uint64_t *set);
+int              nfa_step(struct RegexNfa *nfa, const uint64_t *from, wchar_t wc, uint64_t *to);
+bool             nfa_accepts(struct RegexNfa *nfa, const uint64_t *set, bool at_end);
+bool             nfa_match(struct RegexNfa *nfa, const char *str);
+int              nfa_n_states(const struct RegexNfa *nfa);
+bool             nfa_consumes(const struct RegexNfa *nfa, int st);
+bool             nfa_takes(const struct RegexNfa *nfa, int st, wchar_t wc);
+void             nfa_follow(struct RegexNfa *nfa, int st, uint64_t *set);
+void             nfa_first(struct RegexNfa *nfa, uint64_t *set);
+
+// regex matching allowing a number of edits, bit-parallel over the automaton
+struct RegexApprox *approx_new(const char *pattern, MuttMatchFlags flags, int max_edits);
+void                approx_free(struct RegexApprox **ptr);
+int                 approx_edits(struct RegexApprox *a, const char *str);
+
+// the last few compiled regexes, and their automatons
+struct RegexCache *regcache_new(size_t size);
+void               regcache_free(struct RegexCache **ptr);
+regex_t *          regcache_get(struct RegexCache *rc, const char *pattern, MuttMatchFlags flags);
+struct RegexNfa *  regcache_nfa(struct RegexCache *rc, const char *pattern, MuttMatchFlags flags);
+size_t             regcache_stats(const struct RegexCache *rc, size_t *n_misses);
+
+// trie of the items, for fuzzy distances reusing the work of the previous keystroke
+struct Trie *trie_new(bool magic);
+void         trie_free(struct Trie **ptr);
+bool         trie_magic(const struct Trie *t);
+void         trie_add(struct Trie *t, uint32_t id, const char *str);
+void         trie_remove(struct Trie *t, const struct CompletionBoolList *removed);
+int          trie_fuzzy(struct Trie *t, const char *str, int *dists);
+size_t       trie_regex(const struct Trie *t, struct RegexNfa *nfa, uint8_t *matched);
+size_t       trie_memory(const struct Trie *t);
+
+// fuzzy distances of ASCII items, several at once in SIMD lanes
+int      fuzzy_lanes_width(int width);
+void     fuzzy_lanes_score(const CompletionQuery *q, const char **tars, size_t num, int *dists, int width);
+void     fuzzy_lanes_batch(const CompletionQuery *q, const char **tars, size_t num, int *dists);
 
+// character class signatures, to reject items lacking typed characters
+uint64_t charmask_str(const char *str, bool skip_first);
+size_t   charmask_filter(const uint64_t *masks, size_t num, uint64_t need, int max_missing, uint8_t *pass);
+
+// bigram signatures of the items, a lower bound of their fuzzy distance
+struct QgramFilter *qgram_new(bool magic);
+void                qgram_free(struct QgramFilter **ptr);
+bool                qgram_magic(const struct QgramFilter *f);
+void                qgram_add(struct QgramFilter *f, uint32_t id, const char *str);
+void                qgram_remove(struct QgramFilter *f, const struct CompletionBoolList *removed);
+bool                qgram_prepare(struct QgramFilter *f, const char *str);
+bool                qgram_check(struct QgramFilter *f, uint32_t id, int max_dist);
+size_t              qgram_stats(const struct QgramFilter *f, size_t *n_rejected);
+size_t              qgram_memory(const struct QgramFilter *f);
+
+// trigram index over the items, to find substring match candidates
+struct NgramIndex *ngram_new(void);
+void               ngram_free(struct NgramIndex **ptr);
+void               ngram_add(struct NgramIndex *idx, uint32_t id, const char *str);
+void               ngram_remove(struct NgramIndex *idx, const struct CompletionBoolList *removed);
+int                ngram_query(const struct NgramIndex *idx, const char *str, struct NgramIdList *ids);
+size_t             ngram_memory(const struct NgramIndex *idx);
+
+// Unicode simple case folding and character classes, generated by casefold.py, see casefold.c
+extern const uint32_t CaseFoldLimit;
+extern const int32_t  CaseFoldDeltas[];
+extern const uint8_t  CaseFoldIndex[];
+extern const uint8_t  CaseFoldBlocks[][128];
+
+/**
+ * compl_casefold - case-fold a character, regardless of the locale
+ *
+ * @param wc character
+ * @retval wchar_t folded character
+ */
+static inline wchar_t compl_casefold(wchar_t wc)
+{
+  uint32_t c = (uint32_t) wc;
+  if (c < 0x80)
+    return ((c >= 'A') && (c <= 'Z')) ? (wchar_t) (c + ('a' - 'A')) : wc;
+  if (c >= CaseFoldLimit)
+    return wc;
+
+  return wc + CaseFoldDeltas[CaseFoldBlocks[CaseFoldIndex[c >> 7]][c & 127]];
+}
+
+/**
+ * enum UnicodeClass - character classes, generated by casefold.py
+ */
+enum UnicodeClass
+{
+  UC_OTHER,  ///< Anything else, e.g. digits and punctuation
+  UC_SPACE,  ///< Whitespace, but not a no-break space
+  UC_LOWER,  ///< Lowercase letter
+  UC_UPPER,  ///< Uppercase or titlecase letter
+  UC_LETTER, ///< Letter without case
+};
+
+extern const uint32_t CharClassLimit;
+extern const uint8_t  CharClassIndex[];
+extern const uint8_t  CharClassBlocks[][128];
+
+/**
+ * compl_char_class - class of a character, regardless of the locale
+ *
+ * @param wc character
+ * @retval enum UnicodeClass
+ */
+static inline enum UnicodeClass compl_char_class(wchar_t wc)
+{
+  uint32_t c = (uint32_t) wc;
+  if (c >= CharClassLimit)
+    return UC_OTHER;
+
+  return CharClassBlocks[CharClassIndex[c >> 7]][c & 127];
+}
+
+// UTF-8 validation and decoding, see utf8.c
+size_t utf8_ascii_prefix(const char *str, size_t len);
+int    utf8_validate(const char *str, size_t len);
+size_t utf8_sanitise(const char *str, size_t len, struct Buffer *buf);
+int    utf8_next(const char *str, wchar_t *wc);
+int    utf8_decode(const char *str, wchar_t *w);
+size_t utf8_encode(const wchar_t *w, char *str);
+
+bool is_ascii(const char *str);
 bool is_mbs(const char *str);
 int mbs_char_count(const char *str);
+char *mbs_fold(const char *str);
 bool mb_equal(const char *stra, const char *strb);
 
 // TODO add fuzzy match function (could be reused for fuzzy finding in pager etc)
 int dist_lev(const char *stra, const char *strb);
 int dist_dam_lev(const char *tar, const Completion *comp);
+int dist_dam_lev_spans(const char *tar, const Completion *comp, struct CompletionSpanList *spans);
+
+// subsequence (fzf-style) matching, optionally recording the match spans
+int dist_subseq(const char *tar, const Completion *comp, struct CompletionSpanList *spans);
 #endif
@@ -0,0 +1,345 @@
+/**
+ * @file
+ * Autocompletion API q-gram count filter for fuzzy matching
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Q-gram count filter, a lower bound of the fuzzy distance.
+ *
+ * Every item keeps the sorted hashes of its bigrams (pairs of neighbouring
+ * characters).  A single edit destroys at most three bigrams of a string: a
+ * transposition those on either side of the swapped pair and the pair itself,
+ * the other edits fewer.  So two strings of n and m characters within k edits
+ * of each other share at least max(n, m) - 1 - 3k bigrams.  Every edit also
+ * changes the length by at most one.  An item failing either bound can't be
+ * within the maximum distance, and doesn't need the kernel.
+ *
+ * As in the kernel, the first characters are left out, they're always aligned.
+ * A hash collision can only add shared bigrams, so the bound stays a lower
+ * one.  Pairs of ASCII characters don't collide at all.
+ */
+
+#include "private.h"
+
+// number of bigram hashes, the ASCII pairs take the first 2^14
+#define QGRAM_HASHES (1 << 16)
+#define QGRAM_ASCII (1 << 14)
+
+/**
+ * struct QgramSig - bigram signature of an item
+ */
+struct QgramSig
+{
+  uint32_t off;      ///< first bigram in QgramFilter.grams
+  uint32_t n_chars;  ///< number of characters, without the first one
+};
+
+ARRAY_HEAD(QgramSigList, struct QgramSig);
+ARRAY_HEAD(QgramHashList, uint16_t);
+
+/**
+ * struct QgramFilter - bigram signatures of the items, and those of the typed string
+ */
+struct QgramFilter
+{
+  struct QgramSigList sigs;    ///< signature of every item, indexed by id
+  struct QgramHashList grams;  ///< sorted bigrams of all items, one after the other
+  bool magic;                  ///< signatures of the normalised forms
+  uint16_t *counts;            ///< number of each bigram in the typed string
+  struct QgramHashList typed;  ///< bigrams of the typed string, to clear the counts
+  int n_chars;                 ///< number of typed characters, without the first one
+  size_t n_checked;            ///< number of items checked
+  size_t n_rejected;           ///< number of items rejected
+};
+
+/**
+ * qgram_hash - hash a pair of characters
+ *
+ * @param a first character
+ * @param b second character
+ * @retval num hash, below QGRAM_HASHES
+ */
+static inline uint16_t qgram_hash(wchar_t a, wchar_t b)
+{
+  if (((uint32_t) a < 0x80) && ((uint32_t) b < 0x80))
+    return ((uint32_t) a << 7) | (uint32_t) b;
+
+  uint32_t hash = ((uint32_t) a * 0x9E3779B1U) ^ ((uint32_t) b * 0x85EBCA77U);
+  hash ^= hash >> 15;
+  return QGRAM_ASCII + (hash % (QGRAM_HASHES - QGRAM_ASCII));
+}
+
+/**
+ * qgram_split - add the bigrams of a string to a list
+ *
+ * @param str   string, valid UTF-8
+ * @param grams list to add the bigrams to
+ * @retval num number of characters, without the first one
+ */
+static int qgram_split(const char *str, struct QgramHashList *grams)
+{
+  wchar_t prev = 0;
+  wchar_t wc = 0;
+  int n_chars = 0;
+  int n = utf8_next(str, &prev);
+  if (n <= 0)
+    return 0;
+
+  for (str += n; (n = utf8_next(str, &wc)) > 0; str += n)
+  {
+    // the first character is aligned anyway, its pair isn't counted
+    if (n_chars > 0)
+    {
+      if (ARRAY_SIZE(grams) == ARRAY_CAPACITY(grams))
+        ARRAY_RESERVE(grams, ARRAY_SIZE(grams) * 2);
+      ARRAY_ADD(grams, qgram_hash(prev, wc));
+    }
+    prev = wc;
+    n_chars++;
+  }
+
+  return n_chars;
+}
+
+static int qgram_cmp(const void *a, const void *b)
+{
+  return (int) *(const uint16_t *) a - (int) *(const uint16_t *) b;
+}
+
+/**
+ * qgram_new - create an empty filter
+ *
+ * @param magic true if the signatures are those of the normalised forms
+ * @retval ptr new filter
+ */
+struct QgramFilter *qgram_new(bool magic)
+{
+  struct QgramFilter *f = mutt_mem_calloc(1, sizeof(struct QgramFilter));
+  ARRAY_INIT(&f->sigs);
+  ARRAY_INIT(&f->grams);
+  ARRAY_INIT(&f->typed);
+  f->magic = magic;
+  return f;
+}
+
+/**
+ * qgram_free - free a filter
+ *
+ * @param ptr filter to free
+ */
+void qgram_free(struct QgramFilter **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
+
+  struct QgramFilter *f = *ptr;
+  ARRAY_FREE(&f->sigs);
+  ARRAY_FREE(&f->grams);
+  ARRAY_FREE(&f->typed);
+  FREE(&f->counts);
+  FREE(ptr);
+}
+
+/**
+ * qgram_magic - does the filter hold the signatures of the normalised forms?
+ *
+ * @param f filter
+ * @retval bool true for normalised forms
+ */
+bool qgram_magic(const struct QgramFilter *f)
+{
+  return f->magic;
+}
+
+/**
+ * qgram_add - add the signature of an item
+ *
+ * @param f   filter
+ * @param id  item id
+ * @param str string of the item (its normalised form for a magic filter)
+ */
+void qgram_add(struct QgramFilter *f, uint32_t id, const char *str)
+{
+  if (!f || !str)
+    return;
+
+  struct QgramSig sig = { ARRAY_SIZE(&f->grams), 0 };
+  sig.n_chars = qgram_split(str, &f->grams);
+  if (sig.n_chars > 1)
+    qsort(f->grams.entries + sig.off, sig.n_chars - 1, sizeof(uint16_t), qgram_cmp);
+
+  if (id >= ARRAY_CAPACITY(&f->sigs))
+    ARRAY_RESERVE(&f->sigs, MAX(id, ARRAY_SIZE(&f->sigs) * 2));
+  ARRAY_SET(&f->sigs, id, sig);
+}
+
+/**
+ * qgram_remove - drop the signatures of removed items
+ *
+ * The bigrams are copied into a new list, so their space is freed as well.
+ *
+ * @param f       filter
+ * @param removed tombstones, indexed by item id
+ */
+void qgram_remove(struct QgramFilter *f, const struct CompletionBoolList *removed)
+{
+  if (!f || !removed)
+    return;
+
+  struct QgramHashList grams = ARRAY_HEAD_INITIALIZER;
+  ARRAY_RESERVE(&grams, ARRAY_SIZE(&f->grams));
+
+  struct QgramSig *sig = NULL;
+  ARRAY_FOREACH(sig, &f->sigs)
+  {
+    uint32_t n_grams = (sig->n_chars > 0) ? sig->n_chars - 1 : 0;
+    const bool *dead = ARRAY_GET(removed, ARRAY_FOREACH_IDX_sig);
+    if (dead && *dead)
+      n_grams = 0;
+
+    uint32_t off = ARRAY_SIZE(&grams);
+    for (uint32_t i = 0; i < n_grams; i++)
+      ARRAY_ADD(&grams, *ARRAY_GET(&f->grams, sig->off + i));
+    sig->off = off;
+    if (dead && *dead)
+      sig->n_chars = 0;
+  }
+
+  ARRAY_FREE(&f->grams);
+  f->grams = grams;
+}
+
+/**
+ * qgram_prepare - count the bigrams of the typed string
+ *
+ * @param f   filter
+ * @param str typed string (normalised for a magic filter)
+ * @retval bool false if the typed string can't be filtered for
+ */
+bool qgram_prepare(struct QgramFilter *f, const char *str)
+{
+  if (!f || !str || (mbs_char_count(str) <= 0))
+    return false;
+
+  if (!f->counts)
+    f->counts = mutt_mem_calloc(QGRAM_HASHES, sizeof(uint16_t));
+
+  uint16_t *h = NULL;
+  ARRAY_FOREACH(h, &f->typed)
+  {
+    f->counts[*h] = 0;
+  }
+  ARRAY_SHRINK(&f->typed, ARRAY_SIZE(&f->typed));
+
+  f->n_chars = qgram_split(str, &f->typed);
+  ARRAY_FOREACH(h, &f->typed)
+  {
+    if (f->counts[*h] < UINT16_MAX)
+      f->counts[*h]++;
+  }
+
+  return true;
+}
+
+/**
+ * qgram_check - can an item be within a distance of the typed string?
+ *
+ * @param f        filter, prepared for the typed string
+ * @param id       item id
+ * @param max_dist maximum distance
+ * @retval bool false if the item is further away for sure
+ */
+bool qgram_check(struct QgramFilter *f, uint32_t id, int max_dist)
+{
+  const struct QgramSig *sig = ARRAY_GET(&f->sigs, id);
+  if (!sig)
+    return true;
+
+  f->n_checked++;
+  int n = f->n_chars;
+  int m = sig->n_chars;
+
+  // every edit changes the length by one at most
+  if (abs(n - m) > max_dist)
+  {
+    f->n_rejected++;
+    return false;
+  }
+
+  int need = MAX(n, m) - 1 - 3 * max_dist;
+  if (need <= 0)
+    return true;
+
+  // the bigrams are sorted, a run of equal ones is counted at once
+  const uint16_t *g = ARRAY_GET(&f->grams, sig->off);
+  int n_grams = m - 1;
+  int shared = 0;
+  int i = 0;
+  while ((i < n_grams) && (shared + (n_grams - i) >= need))
+  {
+    int run = 1;
+    while ((i + run < n_grams) && (g[i + run] == g[i]))
+      run++;
+
+    shared += MIN(run, f->counts[g[i]]);
+    if (shared >= need)
+      return true;
+    i += run;
+  }
+
+  f->n_rejected++;
+  return false;
+}
+
+/**
+ * qgram_stats - number of items checked and rejected
+ *
+ * @param f          filter
+ * @param n_rejected set to the number of rejected items (may be NULL)
+ * @retval num number of checked items
+ */
+size_t qgram_stats(const struct QgramFilter *f, size_t *n_rejected)
+{
+  if (!f)
+    return 0;
+
+  if (n_rejected)
+    *n_rejected = f->n_rejected;
+
+  return f->n_checked;
+}
+
+/**
+ * qgram_memory - memory used by a filter
+ *
+ * @param f filter
+ * @retval num size in bytes
+ */
+size_t qgram_memory(const struct QgramFilter *f)
+{
+  if (!f)
+    return 0;
+
+  return sizeof(struct QgramFilter) + ARRAY_CAPACITY(&f->sigs) * sizeof(struct QgramSig) +
+         (ARRAY_CAPACITY(&f->grams) + ARRAY_CAPACITY(&f->typed)) * sizeof(uint16_t) +
+         (f->counts ? QGRAM_HASHES * sizeof(uint16_t) : 0);
+}
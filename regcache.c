@@ -0,0 +1,223 @@
+/**
+ * @file
+ * Autocompletion API cache of compiled regexes
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Least recently used cache of compiled regexes.
+ *
+ * Every keystroke changes the pattern, but typing, backspacing and typing
+ * again keeps coming back to the same few ones.  The last few patterns stay
+ * compiled, keyed by the pattern and its case sensitivity (the only flag
+ * compl_regcomp() looks at).  Next to the regex_t, an entry keeps the
+ * automaton of the pattern, compiled on its first search over the trie.
+ *
+ * The entries never move, so a regex stays valid until it's evicted, which
+ * only happens when another pattern is looked up.  Patterns failing to
+ * compile aren't cached.
+ */
+
+#include "private.h"
+
+/**
+ * struct RegexCacheEntry - a compiled pattern
+ */
+struct RegexCacheEntry
+{
+  char *pattern;         ///< regex, NULL for an unused entry
+  bool icase;            ///< compiled ignoring case
+  regex_t regex;         ///< compiled regex
+  struct RegexNfa *nfa;  ///< automaton of the regex, NULL if not (yet) compiled
+  bool nfa_tried;        ///< the automaton was compiled, or isn't supported
+  uint64_t used;         ///< last use, by the clock of the cache
+};
+
+/**
+ * struct RegexCache - the last few compiled patterns
+ */
+struct RegexCache
+{
+  struct RegexCacheEntry *entries;  ///< entries, unused ones have no pattern
+  size_t size;                      ///< number of entries
+  uint64_t clock;                   ///< number of lookups so far
+  size_t n_hits;                    ///< number of patterns found compiled
+  size_t n_misses;                  ///< number of patterns compiled
+};
+
+/**
+ * regcache_new - create an empty cache
+ *
+ * @param size number of patterns to keep compiled, at least one
+ * @retval ptr new cache
+ */
+struct RegexCache *regcache_new(size_t size)
+{
+  struct RegexCache *rc = mutt_mem_calloc(1, sizeof(struct RegexCache));
+  rc->size = MAX(size, 1);
+  rc->entries = mutt_mem_calloc(rc->size, sizeof(struct RegexCacheEntry));
+  return rc;
+}
+
+/**
+ * regcache_evict - free the pattern of an entry
+ *
+ * @param e entry
+ */
+static void regcache_evict(struct RegexCacheEntry *e)
+{
+  if (!e->pattern)
+    return;
+
+  regfree(&e->regex);
+  nfa_free(&e->nfa);
+  FREE(&e->pattern);
+  e->nfa_tried = false;
+}
+
+/**
+ * regcache_free - free a cache, and all its regexes
+ *
+ * @param ptr cache to free
+ */
+void regcache_free(struct RegexCache **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
+
+  struct RegexCache *rc = *ptr;
+  for (size_t i = 0; i < rc->size; i++)
+    regcache_evict(&rc->entries[i]);
+  FREE(&rc->entries);
+  FREE(ptr);
+}
+
+/**
+ * regcache_find - find the entry of a pattern
+ *
+ * @param rc      cache
+ * @param pattern regex
+ * @param flags   matching flags
+ * @retval ptr entry, or NULL if the pattern isn't compiled
+ */
+static struct RegexCacheEntry *regcache_find(struct RegexCache *rc,
+                                             const char *pattern, MuttMatchFlags flags)
+{
+  bool icase = (flags & COMPL_MATCH_IGNORECASE);
+  for (size_t i = 0; i < rc->size; i++)
+  {
+    struct RegexCacheEntry *e = &rc->entries[i];
+    if (e->pattern && (e->icase == icase) && mutt_str_equal(e->pattern, pattern))
+      return e;
+  }
+  return NULL;
+}
+
+/**
+ * regcache_get - compiled regex of a pattern
+ *
+ * A pattern not in the cache is compiled, in place of the least recently used
+ * one.
+ *
+ * @param rc      cache
+ * @param pattern regex
+ * @param flags   matching flags, as for compl_regcomp()
+ * @retval ptr compiled regex, owned by the cache, or NULL if it doesn't compile
+ */
+regex_t *regcache_get(struct RegexCache *rc, const char *pattern, MuttMatchFlags flags)
+{
+  if (!rc || !pattern)
+    return NULL;
+
+  rc->clock++;
+  struct RegexCacheEntry *e = regcache_find(rc, pattern, flags);
+  if (e)
+  {
+    rc->n_hits++;
+    e->used = rc->clock;
+    return &e->regex;
+  }
+
+  rc->n_misses++;
+  regex_t regex;
+  if (!compl_regcomp(&regex, pattern, flags))
+    return NULL;
+
+  // an unused entry is the oldest of all
+  e = &rc->entries[0];
+  for (size_t i = 1; (i < rc->size) && e->pattern; i++)
+  {
+    if (!rc->entries[i].pattern || (rc->entries[i].used < e->used))
+      e = &rc->entries[i];
+  }
+
+  regcache_evict(e);
+  e->pattern = mutt_str_dup(pattern);
+  e->icase = (flags & COMPL_MATCH_IGNORECASE);
+  e->regex = regex;
+  e->used = rc->clock;
+  return &e->regex;
+}
+
+/**
+ * regcache_nfa - automaton of a cached pattern
+ *
+ * The automaton is compiled on the first call, and kept with the regex.
+ *
+ * @param rc      cache
+ * @param pattern regex, compiled by regcache_get()
+ * @param flags   matching flags
+ * @retval ptr automaton, owned by the cache, or NULL if the pattern isn't cached or supported
+ */
+struct RegexNfa *regcache_nfa(struct RegexCache *rc, const char *pattern, MuttMatchFlags flags)
+{
+  if (!rc || !pattern)
+    return NULL;
+
+  struct RegexCacheEntry *e = regcache_find(rc, pattern, flags);
+  if (!e)
+    return NULL;
+
+  if (!e->nfa_tried)
+  {
+    e->nfa = nfa_compile(pattern, flags);
+    e->nfa_tried = true;
+  }
+  return e->nfa;
+}
+
+/**
+ * regcache_stats - number of patterns found compiled, and compiled anew
+ *
+ * @param rc       cache
+ * @param n_misses set to the number of patterns compiled (may be NULL)
+ * @retval num number of patterns found compiled
+ */
+size_t regcache_stats(const struct RegexCache *rc, size_t *n_misses)
+{
+  if (!rc)
+    return 0;
+
+  if (n_misses)
+    *n_misses = rc->n_misses;
+
+  return rc->n_hits;
+}
@@ -0,0 +1,368 @@
+/**
+ * @file
+ * Autocompletion API remote lists
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Remote lists, e.g. IMAP folders or NNTP newsgroups.
+ *
+ * Completing never waits for the network: the list is loaded from a local
+ * snapshot, and only refreshed by compl_remote_refresh(), whenever it suits
+ * the caller (e.g. after connecting, or while idle).  A refresh passes the
+ * token of the last fetch to the fetch callback, so the server only needs to
+ * send the changes (e.g. NNTP NEWGROUPS), and the snapshot is rewritten
+ * afterwards.
+ *
+ * The snapshot is a text file: a header line, the token, and one item per
+ * line.  Newlines and backslashes in the token and the items are escaped as
+ * "\n" and "\\".  It's loaded in a single read, and its lines are added with
+ * compl_add_many().
+ */
+
+#include "mutt/file.h"
+#include "private.h"
+
+// first line of a snapshot, a different one means it's ignored
+#define COMPL_SNAPSHOT_HEADER "neomutt-completion-snapshot 2"
+
+/**
+ * compl_snapshot_unescape - undo the escaping of a snapshot line in place
+ *
+ * @param str line, not '\0'-terminated
+ * @param len length of the line
+ * @retval num length of the item
+ */
+static size_t compl_snapshot_unescape(char *str, size_t len)
+{
+  size_t n = 0;
+  for (size_t i = 0; i < len; i++, n++)
+  {
+    if ((str[i] == '\\') && (i + 1 < len))
+    {
+      i++;
+      str[n] = (str[i] == 'n') ? '\n' : str[i];
+    }
+    else
+    {
+      str[n] = str[i];
+    }
+  }
+  return n;
+}
+
+/**
+ * compl_snapshot_write_line - write an escaped line of a snapshot
+ *
+ * @param fp  snapshot
+ * @param str token or item
+ */
+static void compl_snapshot_write_line(FILE *fp, const char *str)
+{
+  if (!strpbrk(str, "\n\\"))
+  {
+    fputs(str, fp);
+    fputc('\n', fp);
+    return;
+  }
+
+  // a token or an item can't span lines
+  for (const char *c = str; *c; c++)
+  {
+    if ((*c == '\n') || (*c == '\\'))
+      fputc('\\', fp);
+    fputc((*c == '\n') ? 'n' : *c, fp);
+  }
+  fputc('\n', fp);
+}
+
+/**
+ * compl_snapshot_load - load the items and the token from a snapshot
+ *
+ * @param remote remote list
+ * @retval num number of loaded items, -1 if there is no usable snapshot
+ */
+static int compl_snapshot_load(CompletionRemote *remote)
+{
+  FILE *fp = mutt_file_fopen(remote->snapshot, "r");
+  if (!fp)
+    return -1;
+
+  char *data = NULL;
+  size_t len = 0;
+  size_t size = 0;
+  while (true)
+  {
+    if (size - len < 4096)
+    {
+      size = MAX(size * 2, 64 * 1024);
+      mutt_mem_realloc(&data, size);
+    }
+
+    size_t num = fread(data + len, 1, size - len - 1, fp);
+    if (num == 0)
+      break;
+    len += num;
+  }
+  mutt_file_fclose(&fp);
+
+  if (!data)
+    return -1;
+  data[len] = '\0';
+
+  // header and token
+  char *header_end = strchr(data, '\n');
+  char *token_end = header_end ? strchr(header_end + 1, '\n') : NULL;
+  if (!token_end || ((size_t) (header_end - data) != strlen(COMPL_SNAPSHOT_HEADER)) ||
+      !mutt_strn_equal(data, COMPL_SNAPSHOT_HEADER, header_end - data))
+  {
+    logwar("CompRemote: ignoring snapshot '%s'.", remote->snapshot);
+    FREE(&data);
+    return -1;
+  }
+
+  char *token = header_end + 1;
+  size_t token_len = token_end - token;
+  if (memchr(token, '\\', token_len))
+    token_len = compl_snapshot_unescape(token, token_len);
+  buf_strcpy_n(remote->token, token, token_len);
+
+  // one item per line, the lines are added in place
+  size_t n_lines = 1;
+  for (const char *c = token_end + 1; *c; c++)
+  {
+    if (*c == '\n')
+      n_lines++;
+  }
+
+  const char **lines = mutt_mem_calloc(n_lines, sizeof(char *));
+  size_t *lens = mutt_mem_calloc(n_lines, sizeof(size_t));
+  size_t n = 0;
+  for (char *line = token_end + 1; *line; n++)
+  {
+    const char *end = strchr(line, '\n');
+    size_t line_len = end ? (size_t) (end - line) : strlen(line);
+    lines[n] = line;
+    lens[n] = memchr(line, '\\', line_len) ? compl_snapshot_unescape(line, line_len) : line_len;
+    line += line_len + (end ? 1 : 0);
+  }
+
+  size_t num = compl_add_many(remote->comp, lines, lens, n);
+
+  FREE(&lines);
+  FREE(&lens);
+  FREE(&data);
+
+  logdeb(4, "Loaded %zu items from '%s'.", num, remote->snapshot);
+  return num;
+}
+
+/**
+ * compl_snapshot_save - write the items and the token to the snapshot
+ *
+ * The snapshot is written to a temporary file first, and renamed, so a crash
+ * never leaves half a snapshot behind.
+ *
+ * @param remote remote list
+ * @retval bool true if the snapshot was written
+ */
+static bool compl_snapshot_save(CompletionRemote *remote)
+{
+  struct Buffer *tmp = buf_new(remote->snapshot);
+  buf_addstr(tmp, ".tmp");
+
+  FILE *fp = mutt_file_fopen(buf_string(tmp), "w");
+  if (!fp)
+  {
+    logerr("CompRemote: can't write snapshot '%s'.", buf_string(tmp));
+    buf_free(&tmp);
+    return false;
+  }
+
+  fprintf(fp, "%s\n", COMPL_SNAPSHOT_HEADER);
+  compl_snapshot_write_line(fp, buf_string(remote->token));
+
+  Completion *comp = remote->comp;
+  CompletionItem *item = NULL;
+  ARRAY_FOREACH_FROM(item, comp->items, 1)
+  {
+    if (compl_is_removed(comp, item->id))
+      continue;
+
+    compl_snapshot_write_line(fp, item->str);
+  }
+
+  bool ok = !ferror(fp);
+  if ((mutt_file_fclose(&fp) != 0) || !ok || (rename(buf_string(tmp), remote->snapshot) != 0))
+  {
+    logerr("CompRemote: can't write snapshot '%s'.", remote->snapshot);
+    remove(buf_string(tmp));
+    buf_free(&tmp);
+    return false;
+  }
+
+  buf_free(&tmp);
+  return true;
+}
+
+/**
+ * compl_remote_new - create a remote list, loading its snapshot
+ *
+ * Nothing is fetched, the list is empty until the first refresh if there is no
+ * snapshot yet.
+ *
+ * @param mode matching mode
+ * @param snapshot path of the local snapshot
+ * @param fetch callback fetching the list from the server
+ * @param data passed to the fetch callback
+ * @retval ptr new remote list, NULL on error
+ */
+CompletionRemote *compl_remote_new(enum MuttMatchMode mode, const char *snapshot,
+                                   CompletionFetch fetch, void *data)
+{
+  if (!snapshot || !fetch)
+  {
+    logerr("CompRemote: a remote list needs a snapshot and a fetch function.");
+    return NULL;
+  }
+
+  CompletionRemote *remote = mutt_mem_calloc(1, sizeof(CompletionRemote));
+  remote->comp = compl_new(mode);
+  remote->snapshot = mutt_str_dup(snapshot);
+  remote->token = buf_new(NULL);
+  remote->fetch = fetch;
+  remote->fetch_data = data;
+
+  compl_snapshot_load(remote);
+  return remote;
+}
+
+/**
+ * compl_remote_replace - replace the list with a complete one from the server
+ *
+ * Items in both lists are kept, so only the difference is applied.
+ *
+ * @param remote remote list
+ * @param list complete list
+ * @retval num number of added and removed items
+ */
+static int compl_remote_replace(CompletionRemote *remote, const struct CompletionStringList *list)
+{
+  Completion *comp = remote->comp;
+  if (compl_get_size(comp) <= 1)
+    return compl_add_many(comp, (const char **) list->entries, NULL, ARRAY_SIZE(list));
+
+  Completion *fresh = compl_new(comp->mode);
+  compl_add_many(fresh, (const char **) list->entries, NULL, ARRAY_SIZE(list));
+
+  int num = 0;
+  struct Buffer *buf = buf_new(NULL);
+  CompletionItem *item = NULL;
+  ARRAY_FOREACH_FROM(item, comp->items, 1)
+  {
+    if (compl_is_removed(comp, item->id) || dedup_find(fresh->dedup, item->str))
+      continue;
+
+    buf_strcpy(buf, item->str);
+    num += compl_remove(comp, buf);
+  }
+
+  ARRAY_FOREACH_FROM(item, fresh->items, 1)
+  {
+    buf_strcpy(buf, item->str);
+    num += compl_add(comp, buf);
+  }
+
+  buf_free(&buf);
+  compl_free(&fresh);
+  return num;
+}
+
+/**
+ * compl_remote_refresh - fetch the changes of a remote list, and update the snapshot
+ *
+ * @param remote remote list
+ * @retval num number of added and removed items, -1 if the fetch failed
+ */
+int compl_remote_refresh(CompletionRemote *remote)
+{
+  if (!remote)
+    return -1;
+
+  struct CompletionStringList added = ARRAY_HEAD_INITIALIZER;
+  struct CompletionStringList removed = ARRAY_HEAD_INITIALIZER;
+  struct Buffer *token = buf_new(NULL);
+
+  const char *since = buf_is_empty(remote->token) ? NULL : buf_string(remote->token);
+  enum CompletionFetchResult rc = remote->fetch(remote->fetch_data, since,
+                                                &added, &removed, token);
+
+  int num = -1;
+  if (rc == COMPL_FETCH_FULL)
+    num = compl_remote_replace(remote, &added);
+  else if (rc == COMPL_FETCH_DELTA)
+    num = compl_apply_delta(remote->comp, &added, &removed);
+  else
+    logwar("CompRemote: fetching the list failed, keeping the snapshot.");
+
+  if (num >= 0)
+  {
+    bool changed = (num > 0) || !buf_str_equal(token, remote->token);
+    buf_copy(remote->token, token);
+    if (changed)
+      compl_snapshot_save(remote);
+  }
+
+  char **str = NULL;
+  ARRAY_FOREACH(str, &added)
+  {
+    FREE(str);
+  }
+  ARRAY_FOREACH(str, &removed)
+  {
+    FREE(str);
+  }
+  ARRAY_FREE(&added);
+  ARRAY_FREE(&removed);
+  buf_free(&token);
+
+  return num;
+}
+
+/**
+ * compl_remote_free - free a remote list
+ *
+ * The snapshot is kept on disk.
+ *
+ * @param ptr remote list to free
+ */
+void compl_remote_free(CompletionRemote **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
+
+  CompletionRemote *remote = *ptr;
+  compl_free(&remote->comp);
+  FREE(&remote->snapshot);
+  buf_free(&remote->token);
+  FREE(ptr);
+}
@@ -0,0 +1,256 @@
+/**
+ * @file
+ * Autocompletion API multi-field rows
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Multi-field rows, e.g. for the Index, where a row has a name, an address and
+ * a subject.
+ *
+ * Every column has its own matching mode and flags.  The fields are stored
+ * column-wise, so a search runs through one column after the other, each being
+ * a contiguous block of strings.  A row matches if any of its fields matches,
+ * its distance is the best distance of its fields plus the bias of the column.
+ *
+ * The first field of a row is the one returned by compl_complete().
+ */
+
+#include "private.h"
+
+/**
+ * add a column to a Completion
+ *
+ * All columns have to be added before the first row.
+ *
+ * @param comp Completion struct
+ * @param mode matching mode of the column
+ * @param flags matching flags of the column
+ * @param bias added to the match distance of the column, to prefer other columns
+ * @retval success 1 if successful, 0 otherwise
+ */
+int compl_add_column(Completion *comp, enum MuttMatchMode mode, MuttMatchFlags flags, int bias)
+{
+  if (!compl_health_check(comp))
+    return 0;
+
+  if (ARRAY_SIZE(comp->items) > 1)
+  {
+    logerr("CompAddColumn: columns have to be added before any items.");
+    return 0;
+  }
+
+  CompletionColumn col = { 0 };
+  col.mode = mode;
+  col.flags = flags;
+  col.bias = bias;
+  col.ascii = true;
+  ARRAY_INIT(&col.offsets);
+
+  // the typed item doesn't have any fields
+  ARRAY_ADD(&col.offsets, compl_pool_add(&col.fields, ""));
+
+  ARRAY_ADD(&comp->columns, col);
+  return 1;
+}
+
+/**
+ * add a row to a Completion
+ *
+ * Rows aren't checked for duplicates, different rows can have the same first
+ * field (e.g. two people with the same name).  The first field is returned as
+ * it is, so it has to be valid UTF-8, invalid sequences in the other fields
+ * are replaced.
+ *
+ * @param comp Completion struct
+ * @param fields one string per column, NULL is treated as an empty field
+ * @retval success 1 if successful, 0 otherwise
+ */
+int compl_add_row(Completion *comp, const char **fields)
+{
+  if (!compl_health_check(comp) || !fields)
+    return 0;
+
+  if (ARRAY_EMPTY(&comp->columns))
+  {
+    logerr("CompAddRow: no columns defined.");
+    return 0;
+  }
+
+  // the first field is the one to complete
+  if (!fields[0] || (fields[0][0] == '\0'))
+    return 0;
+
+  size_t len = strlen(fields[0]);
+  if (utf8_validate(fields[0], len) < 0)
+  {
+    logdeb(4, "Invalid UTF-8 row skipped.");
+    return 0;
+  }
+
+  CompletionItem new_item = { 0 };
+  new_item.str = compl_arena_add(&comp->strings, fields[0], len);
+  new_item.id = comp->next_id++;
+  new_item.is_match = false;
+  new_item.match_dist = -1;
+  new_item.span_slot = -1;
+  new_item.norm_off = COMPL_NORM_SAME;
+
+  struct Buffer *valid = NULL;
+  CompletionColumn *col = NULL;
+  ARRAY_FOREACH(col, &comp->columns)
+  {
+    const char *field = fields[ARRAY_FOREACH_IDX_col];
+    if (field && (utf8_validate(field, strlen(field)) < 0))
+    {
+      if (!valid)
+        valid = buf_new(NULL);
+      utf8_sanitise(field, strlen(field), valid);
+      field = buf_string(valid);
+    }
+
+    // magic columns only ever match the normalised form
+    char *norm = NULL;
+    if ((col->flags & COMPL_MATCH_MAGIC) && (col->mode != COMPL_MODE_REGEX) &&
+        (col->mode != COMPL_MODE_APPROX))
+      norm = mbs_fold(field);
+
+    ARRAY_SET(&col->offsets, new_item.id, compl_pool_add(&col->fields, norm ? norm : field));
+    if (mutt_str_len(field) > comp->max_len)
+      comp->max_len = mutt_str_len(field);
+    if (col->ascii && !is_ascii(field))
+      col->ascii = false;
+    FREE(&norm);
+  }
+  buf_free(&valid);
+
+  dedup_add(comp->dedup, new_item.str, new_item.id);
+  compl_items_reserve(comp, ARRAY_SIZE(comp->items) + 1);
+  ARRAY_ADD(comp->items, new_item);
+  return 1;
+}
+
+/**
+ * match all rows, column by column
+ *
+ * @param comp Completion struct
+ * @retval ptr match distance of every row (-1 for no match), indexed by item id
+ */
+int *compl_rows_score(Completion *comp)
+{
+  int *row_dist = mutt_mem_calloc(comp->next_id, sizeof(int));
+  for (uint32_t id = 0; id < comp->next_id; id++)
+    row_dist[id] = -1;
+
+  const char *tars[COMPL_BATCH_SIZE];
+  uint32_t ids[COMPL_BATCH_SIZE];
+  int dists[COMPL_BATCH_SIZE];
+
+  CompletionColumn *col = NULL;
+  ARRAY_FOREACH(col, &comp->columns)
+  {
+    // the matcher sees the column's mode and flags
+    CompletionSearch search = { 0 };
+    if (!compl_search_init(&search, comp, col->mode, col->flags, col->ascii))
+      continue;
+
+    uint32_t num_rows = ARRAY_SIZE(&col->offsets);
+    uint32_t id = 1;
+    while (id < num_rows)
+    {
+      size_t n = 0;
+      for (; (id < num_rows) && (n < COMPL_BATCH_SIZE); id++)
+      {
+        const char *field = col->fields.data + *ARRAY_GET(&col->offsets, id);
+        if (*field == '\0')
+          continue;
+
+        tars[n] = field;
+        ids[n] = id;
+        n++;
+      }
+
+      compl_search_batch(&search, tars, n, dists);
+
+      for (size_t i = 0; i < n; i++)
+      {
+        if (dists[i] < 0)
+          continue;
+
+        int dist = dists[i] + col->bias;
+        if ((row_dist[ids[i]] < 0) || (dist < row_dist[ids[i]]))
+          row_dist[ids[i]] = dist;
+      }
+    }
+
+    compl_search_free(&search);
+  }
+
+  return row_dist;
+}
+
+/**
+ * rebuild the fields of all columns without the removed rows
+ *
+ * Removed rows keep their id, but point to the empty field of the typed item,
+ * which is never matched.
+ *
+ * @param comp Completion struct
+ */
+void compl_columns_compact(Completion *comp)
+{
+  CompletionColumn *col = NULL;
+  ARRAY_FOREACH(col, &comp->columns)
+  {
+    CompletionPool fields = { 0 };
+    uint32_t empty = compl_pool_add(&fields, "");
+
+    uint32_t *off = NULL;
+    ARRAY_FOREACH(off, &col->offsets)
+    {
+      uint32_t id = ARRAY_FOREACH_IDX_off;
+      if ((id == 0) || compl_is_removed(comp, id))
+        *off = empty;
+      else
+        *off = compl_pool_add(&fields, col->fields.data + *off);
+    }
+
+    compl_pool_free(&col->fields);
+    col->fields = fields;
+  }
+}
+
+/**
+ * free the columns of a Completion
+ *
+ * @param comp Completion struct
+ */
+void compl_columns_free(Completion *comp)
+{
+  CompletionColumn *col = NULL;
+  ARRAY_FOREACH(col, &comp->columns)
+  {
+    compl_pool_free(&col->fields);
+    ARRAY_FREE(&col->offsets);
+  }
+
+  ARRAY_FREE(&comp->columns);
+}
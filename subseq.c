@@ -0,0 +1,441 @@
+/**
+ * @file
+ * Autocompletion API subsequence matching
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Subsequence matching (fzf-style): every typed character has to appear in the
+ * target in the same order, but not necessarily next to each other.  Matches
+ * are scored by their position in the target, e.g. characters at the start of
+ * a word or after a camelCase hump are worth more than ones in the middle of a
+ * word, and gaps between the matched characters cost points.
+ */
+
+#include <ctype.h>
+#include <limits.h>
+#include <string.h>
+#include "private.h"
+
+#define SUBSEQ_SCORE_MATCH           16 ///< Score for every matched character
+#define SUBSEQ_GAP_START             -3 ///< Penalty for the first skipped character
+#define SUBSEQ_GAP_EXTENSION         -1 ///< Penalty for every further skipped character
+#define SUBSEQ_BONUS_BOUNDARY_WHITE  10 ///< Match right after whitespace
+#define SUBSEQ_BONUS_BOUNDARY_DELIM   9 ///< Match right after a delimiter, e.g. '/'
+#define SUBSEQ_BONUS_BOUNDARY         8 ///< Match right after another non-word character
+#define SUBSEQ_BONUS_NONWORD          8 ///< Match on a non-word character itself
+#define SUBSEQ_BONUS_CAMEL123         7 ///< Match on a camelCase hump or a first digit
+#define SUBSEQ_BONUS_CONSECUTIVE      4 ///< Minimum bonus for a consecutive match
+#define SUBSEQ_BONUS_FIRST_MULT       2 ///< The first typed character counts double
+
+// best possible score per character, used to turn scores into distances
+#define SUBSEQ_MAX_FIRST (SUBSEQ_SCORE_MATCH + SUBSEQ_BONUS_BOUNDARY_WHITE * SUBSEQ_BONUS_FIRST_MULT)
+#define SUBSEQ_MAX_NEXT  (SUBSEQ_SCORE_MATCH + SUBSEQ_BONUS_BOUNDARY_WHITE)
+
+// unreachable cell in the scoring matrix (leaves headroom to avoid overflow)
+#define SUBSEQ_NONE (INT_MIN / 4)
+
+/**
+ * enum SubseqCharClass - character classes used for the position bonuses
+ */
+enum SubseqCharClass
+{
+  CC_WHITE,   ///< Whitespace
+  CC_DELIM,   ///< Path-like delimiter
+  CC_NONWORD, ///< Any other non-word character
+  CC_LOWER,   ///< Lowercase letter
+  CC_UPPER,   ///< Uppercase letter
+  CC_LETTER,  ///< Letter without case
+  CC_NUMBER,  ///< Digit
+};
+
+/**
+ * char_class - class of a character, using the generated tables, so the scores
+ * don't depend on the locale
+ *
+ * @param wc character
+ * @retval enum SubseqCharClass
+ */
+static enum SubseqCharClass char_class(wchar_t wc)
+{
+  switch (compl_char_class(wc))
+  {
+    case UC_SPACE:
+      return CC_WHITE;
+    case UC_LOWER:
+      return CC_LOWER;
+    case UC_UPPER:
+      return CC_UPPER;
+    case UC_LETTER:
+      return CC_LETTER;
+    default:
+      break;
+  }
+
+  if ((wc >= '0') && (wc <= '9'))
+    return CC_NUMBER;
+  if (wc && wcschr(L"/,:;|", wc))
+    return CC_DELIM;
+  return CC_NONWORD;
+}
+
+/**
+ * char_bonus - bonus for matching a character, depending on its predecessor
+ *
+ * @param prev class of the previous character in the target
+ * @param cur  class of the matched character
+ * @retval int bonus points
+ */
+static int char_bonus(enum SubseqCharClass prev, enum SubseqCharClass cur)
+{
+  if (cur > CC_NONWORD)
+  {
+    // start of a word
+    if (prev == CC_WHITE)
+      return SUBSEQ_BONUS_BOUNDARY_WHITE;
+    if (prev == CC_DELIM)
+      return SUBSEQ_BONUS_BOUNDARY_DELIM;
+    if (prev == CC_NONWORD)
+      return SUBSEQ_BONUS_BOUNDARY;
+  }
+
+  // camelCase hump or start of a number
+  if ((prev == CC_LOWER && cur == CC_UPPER) || (prev != CC_NUMBER && cur == CC_NUMBER))
+    return SUBSEQ_BONUS_CAMEL123;
+
+  if (cur == CC_WHITE)
+    return SUBSEQ_BONUS_BOUNDARY_WHITE;
+  if (cur == CC_NONWORD || cur == CC_DELIM)
+    return SUBSEQ_BONUS_NONWORD;
+
+  return 0;
+}
+
+/**
+ * consecutive_bonus - bonus for a match directly following another match
+ *
+ * A consecutive run keeps the bonus of its first character, e.g. "app" in
+ * "apple" is worth as much as matching three word starts.  A new word boundary
+ * inside the run starts a new run if that scores better.
+ *
+ * @param bonus position bonus of the matched character
+ * @param chunk bonus of the first character in the run, updated for the new run
+ * @retval int bonus points
+ */
+static int consecutive_bonus(int bonus, int *chunk)
+{
+  if ((bonus >= SUBSEQ_BONUS_BOUNDARY) && (bonus > *chunk))
+  {
+    *chunk = bonus;
+    return bonus;
+  }
+
+  int best = (bonus > *chunk) ? bonus : *chunk;
+  return (best > SUBSEQ_BONUS_CONSECUTIVE) ? best : SUBSEQ_BONUS_CONSECUTIVE;
+}
+
+/**
+ * find_mbchar - find the next occurrence of a (multibyte) character
+ *
+ * memchr() is vectorised by the libc, so the lead byte is located with it and
+ * only candidate positions are compared in full.
+ *
+ * @param str  string to search
+ * @param end  end of the string to search
+ * @param mb   character to look for
+ * @param len  byte length of the character
+ * @retval ptr position of the character, or NULL if not found
+ */
+static const char *find_mbchar(const char *str, const char *end, const char *mb, int len)
+{
+  while (str < end)
+  {
+    str = memchr(str, mb[0], end - str);
+    if (!str || (end - str < len))
+      return NULL;
+    if (memcmp(str, mb, len) == 0)
+      return str;
+    str++;
+  }
+
+  return NULL;
+}
+
+/**
+ * subseq_prefilter - quick check whether src is a subsequence of tar
+ *
+ * This runs on the raw bytes without decoding any characters and rejects most
+ * non-matching targets before the scoring matrix is set up.  Case-insensitive
+ * non-ASCII characters can't be checked bytewise, in which case the check
+ * stops early and accepts the target.
+ *
+ * @param src        typed string
+ * @param tar        target string
+ * @param ignorecase true if matching ignores case
+ * @retval ptr first possible match position of src in tar, or NULL for no match
+ */
+static const char *subseq_prefilter(const char *src, const char *tar, bool ignorecase)
+{
+  const char *end = tar + mutt_str_len(tar);
+  const char *cur = tar;
+  const char *first = NULL;
+
+  while (*src != '\0')
+  {
+    int len = MBCHARLEN(src);
+    if (len < 1)
+      return NULL;
+
+    const char *found = NULL;
+    if (len > 1)
+    {
+      if (ignorecase)
+        return first ? first : tar;
+      found = find_mbchar(cur, end, src, len);
+    }
+    else if (ignorecase && isalpha((unsigned char) *src))
+    {
+      const char lc = compl_casefold(*src);
+      const char uc = lc - ('a' - 'A');
+      // KELVIN SIGN and LONG S fold to 'k' and 's', memchr() can't find them
+      if (((lc == 'k') || (lc == 's')) && !is_ascii(cur))
+        return first ? first : tar;
+      const char *found_lc = memchr(cur, lc, end - cur);
+      const char *found_uc = memchr(cur, uc, found_lc ? found_lc - cur : end - cur);
+      found = found_uc ? found_uc : found_lc;
+    }
+    else
+    {
+      found = memchr(cur, *src, end - cur);
+    }
+
+    if (!found)
+      return NULL;
+    if (!first)
+      first = found;
+
+    cur = found + len;
+    src += len;
+  }
+
+  return first ? first : tar;
+}
+
+/**
+ * dist_subseq - match the typed string as a subsequence of the target
+ *
+ * @param tar   target string
+ * @param comp  Completion
+ * @param spans optional list to record the matched characters in
+ * @retval int distance (lower is better), or -1 if there is no match
+ */
+int dist_subseq(const char *tar, const Completion *comp, struct CompletionSpanList *spans)
+{
+  CompletionQuery *q = compl_query_new(buf_string(comp->typed_item->buf), comp->flags, false);
+  int dist = score_subseq(q, tar, spans);
+  compl_query_free(&q);
+  return dist;
+}
+
+/**
+ * score_subseq_scratch - scratch memory of the subsequence kernel
+ *
+ * @param len_src number of typed characters
+ * @param len_tar number of target characters
+ * @retval num bytes needed for the decoded target, the bonuses, the matrices and the trace
+ */
+size_t score_subseq_scratch(int len_src, size_t len_tar)
+{
+  return (len_tar + 1) * sizeof(wchar_t) +
+         ((size_t) 3 * len_src * len_tar + len_tar + len_src) * sizeof(int);
+}
+
+/**
+ * score_subseq - match a prepared query as a subsequence of the target
+ *
+ * The typed characters have to appear in the target in order, gaps in between
+ * are allowed.  The best alignment is scored with a dynamic programming
+ * matrix (like fzf), rewarding matches at word boundaries, camelCase humps and
+ * consecutive runs, and penalising gaps.  The score is converted into a
+ * distance, so that the best possible alignment has the lowest distance.
+ *
+ * @param q     prepared query
+ * @param tar   target string
+ * @param spans optional list to record the matched characters in
+ * @retval int distance (lower is better), or -1 if there is no match
+ */
+int score_subseq(const CompletionQuery *q, const char *tar, struct CompletionSpanList *spans)
+{
+  const char *src = q->src;
+  bool ignorecase = q->flags & COMPL_MATCH_IGNORECASE;
+
+  if (!tar)
+    tar = "";
+
+  // everything matches an empty string
+  if (*src == '\0')
+    return 0;
+
+  const char *start = subseq_prefilter(src, tar, ignorecase);
+  if (!start)
+    return -1;
+
+  int len_src = q->n_chars;
+  int len_tar = mbs_char_count(tar);
+
+  if (len_src == -1 || len_tar == -1 || len_src > len_tar)
+    return -1;
+
+  // the decoded target, the bonuses and the matrices live in the scratch memory
+  wchar_t *w_tar = compl_scratch_reserve(q->scratch, score_subseq_scratch(len_src, len_tar));
+  int *mem = (int *) (w_tar + len_tar + 1);
+
+  // the typed characters are lowercase already for ignorecase
+  const wchar_t *w_src = q->w_src;
+  utf8_decode(tar, w_tar);
+
+  // the scoring window starts at the first possible match
+  int first = 0;
+  for (const char *c = tar; c < start; c += MBCHARLEN(c))
+    first++;
+
+  const int width = len_tar - first;
+  if (width < len_src)
+    return -1;
+
+  // position bonuses are based on the original case of the target
+  int *bonus = mem;
+  mem += width;
+  enum SubseqCharClass prev = (first == 0) ? CC_WHITE : char_class(w_tar[first - 1]);
+  for (int j = 0; j < width; j++)
+  {
+    enum SubseqCharClass cur = char_class(w_tar[first + j]);
+    bonus[j] = char_bonus(prev, cur);
+    prev = cur;
+  }
+
+  if (ignorecase)
+  {
+    for (int j = first; j < len_tar; j++)
+      w_tar[j] = compl_casefold(w_tar[j]);
+  }
+
+  const wchar_t *w_win = &w_tar[first];
+
+  // m[i][j]: best score with typed char i matched at target char j
+  // s[i][j]: best score with typed char i matched before j and j skipped
+  // c[i][j]: bonus of the first character of the consecutive run ending in m[i][j]
+  int(*m)[width] = (int(*)[width]) mem;
+  int(*s)[width] = (int(*)[width]) (mem + (size_t) len_src * width);
+  int(*c)[width] = (int(*)[width]) (mem + (size_t) 2 * len_src * width);
+
+  for (int i = 0; i < len_src; i++)
+  {
+    for (int j = 0; j < width; j++)
+    {
+      m[i][j] = SUBSEQ_NONE;
+      c[i][j] = bonus[j];
+
+      if (w_src[i] == w_win[j])
+      {
+        if (i == 0)
+        {
+          m[i][j] = SUBSEQ_SCORE_MATCH + bonus[j] * SUBSEQ_BONUS_FIRST_MULT;
+        }
+        else if (j > 0)
+        {
+          // unreachable cells stay unreachable, whatever the bonus
+          int chunk = c[i - 1][j - 1];
+          int from_m = (m[i - 1][j - 1] > SUBSEQ_NONE) ?
+                           m[i - 1][j - 1] + consecutive_bonus(bonus[j], &chunk) :
+                           SUBSEQ_NONE;
+          int from_s = (s[i - 1][j - 1] > SUBSEQ_NONE) ? s[i - 1][j - 1] + bonus[j] : SUBSEQ_NONE;
+          if ((from_m >= from_s) && (from_m > SUBSEQ_NONE))
+          {
+            m[i][j] = SUBSEQ_SCORE_MATCH + from_m;
+            c[i][j] = chunk;
+          }
+          else if (from_s > SUBSEQ_NONE)
+          {
+            m[i][j] = SUBSEQ_SCORE_MATCH + from_s;
+          }
+        }
+      }
+
+      s[i][j] = SUBSEQ_NONE;
+      if (j > 0)
+      {
+        int from_m = m[i][j - 1] + SUBSEQ_GAP_START;
+        int from_s = s[i][j - 1] + SUBSEQ_GAP_EXTENSION;
+        int best = (from_m > from_s) ? from_m : from_s;
+        if (best > SUBSEQ_NONE)
+          s[i][j] = best;
+      }
+    }
+  }
+
+  // trailing characters of the target aren't penalised
+  int score = SUBSEQ_NONE;
+  int end = -1;
+  for (int j = 0; j < width; j++)
+  {
+    if (m[len_src - 1][j] > score)
+    {
+      score = m[len_src - 1][j];
+      end = j;
+    }
+  }
+
+  if (end == -1)
+    return -1;
+
+  // trace the best alignment back to record the match positions
+  if (spans)
+  {
+    int *pos = mem + (size_t) 3 * len_src * width;
+    int j = end;
+    for (int i = len_src - 1; i >= 0; i--)
+    {
+      pos[i] = first + j;
+      if (i == 0)
+        break;
+
+      int chunk = c[i - 1][j - 1];
+      bool from_m = (m[i - 1][j - 1] > SUBSEQ_NONE) &&
+                    (m[i][j] == SUBSEQ_SCORE_MATCH + m[i - 1][j - 1] +
+                                    consecutive_bonus(bonus[j], &chunk));
+      j--;
+
+      // walk back through the gap to the previous match
+      if (!from_m)
+      {
+        while (s[i - 1][j] != m[i - 1][j - 1] + SUBSEQ_GAP_START)
+          j--;
+        j--;
+      }
+    }
+
+    for (int i = 0; i < len_src; i++)
+      compl_span_add(spans, pos[i], 1);
+  }
+
+  return SUBSEQ_MAX_FIRST + SUBSEQ_MAX_NEXT * (len_src - 1) - score;
+}
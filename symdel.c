@@ -0,0 +1,428 @@
+/**
+ * @file
+ * Autocompletion API deletion index for small fuzzy distances
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Symmetric deletion index, for fuzzy queries with a small maximum distance.
+ *
+ * Two strings within k edits (substitutions, insertions, deletions and
+ * transpositions of neighbours) of each other have a common string that is
+ * reached by deleting at most k characters from either of them.  So the
+ * index maps every variant of an item with up to SYMDEL_MAX_DIST characters
+ * deleted to the item, and a query only looks up the variants of the typed
+ * string, instead of calculating a distance per item.
+ *
+ * The variants are only stored as 64-bit hashes.  A collision gives an extra
+ * candidate, which the kernel rejects.  As in the BK-tree, the first
+ * character is left out, because the kernel always aligns it.
+ *
+ * The number of variants grows with the square of the length, so items longer
+ * than SYMDEL_MAX_LEN characters aren't indexed, but always returned.
+ */
+
+#include "private.h"
+
+// maximum number of deleted characters
+#define SYMDEL_MAX_DIST 2
+// longest item (without its first character) with indexed variants
+#define SYMDEL_MAX_LEN 32
+// initial number of hash table slots (power of two)
+#define SYMDEL_INITIAL_SLOTS 1024
+
+/**
+ * struct SymDelSlot - hash table slot, the head of a variant's item list
+ */
+struct SymDelSlot
+{
+  uint64_t key;   ///< hash of the variant, 0 for an empty slot
+  uint32_t head;  ///< first entry of the variant, 0 for none
+};
+
+/**
+ * struct SymDelEntry - an item having a variant
+ */
+struct SymDelEntry
+{
+  uint32_t id;    ///< item id
+  uint32_t next;  ///< next entry of the same variant, 0 for none
+  uint8_t depth;  ///< number of characters deleted from the item
+};
+
+ARRAY_HEAD(SymDelEntryList, struct SymDelEntry);
+
+/**
+ * struct SymDelIndex - hash table of the deletion variants of the items
+ */
+struct SymDelIndex
+{
+  struct SymDelSlot *slots;        ///< hash table
+  size_t num_slots;                ///< size of the hash table (power of two)
+  size_t num_used;                 ///< number of variants in the table
+  struct SymDelEntryList entries;  ///< item lists of the variants, entry 0 is unused
+  struct NgramIdList long_ids;     ///< items too long to index
+  bool magic;                      ///< keys are the normalised forms
+};
+
+/**
+ * symdel_hash - hash a variant, skipping the deleted characters
+ *
+ * @param w    characters
+ * @param len  number of characters
+ * @param del1 first deleted position, -1 for none
+ * @param del2 second deleted position, -1 for none
+ * @retval num hash, never 0
+ */
+static uint64_t symdel_hash(const wchar_t *w, int len, int del1, int del2)
+{
+  // FNV-1a over the code points, with a final mix
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < len; i++)
+  {
+    if ((i == del1) || (i == del2))
+      continue;
+    hash ^= (uint32_t) w[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return hash | (1ULL << 63);
+}
+
+/**
+ * symdel_slot - find the slot of a variant
+ *
+ * @retval ptr slot holding the key, or the empty slot where it belongs
+ */
+static struct SymDelSlot *symdel_slot(const struct SymDelIndex *idx, uint64_t key)
+{
+  size_t mask = idx->num_slots - 1;
+  size_t i = key & mask;
+
+  while (idx->slots[i].key && (idx->slots[i].key != key))
+    i = (i + 1) & mask;
+
+  return &idx->slots[i];
+}
+
+static void symdel_grow(struct SymDelIndex *idx)
+{
+  struct SymDelSlot *old = idx->slots;
+  size_t old_num = idx->num_slots;
+
+  idx->num_slots *= 2;
+  idx->slots = mutt_mem_calloc(idx->num_slots, sizeof(struct SymDelSlot));
+
+  for (size_t i = 0; i < old_num; i++)
+  {
+    if (old[i].key)
+      *symdel_slot(idx, old[i].key) = old[i];
+  }
+
+  FREE(&old);
+}
+
+/**
+ * symdel_decode - decode the part of a string the index is keyed by
+ *
+ * @param str item or typed string
+ * @param len set to the number of characters
+ * @retval ptr allocated wide string, without the first character
+ */
+static wchar_t *symdel_decode(const char *str, int *len)
+{
+  int n = MBCHARLEN(str);
+  if (n > 0)
+    str += n;
+
+  *len = MAX(mbs_char_count(str), 0);
+  wchar_t *w = mutt_mem_calloc(*len + 1, sizeof(wchar_t));
+  if (*len > 0)
+    utf8_decode(str, w);
+  return w;
+}
+
+/**
+ * symdel_insert - add an item to the list of a variant
+ */
+static void symdel_insert(struct SymDelIndex *idx, uint64_t key, uint32_t id, int depth)
+{
+  if ((idx->num_used + 1) * 4 > idx->num_slots * 3)
+    symdel_grow(idx);
+
+  struct SymDelSlot *slot = symdel_slot(idx, key);
+  if (!slot->key)
+  {
+    slot->key = key;
+    idx->num_used++;
+  }
+
+  // repeated characters give the same variant several times, keep the first
+  if (slot->head && (ARRAY_GET(&idx->entries, slot->head)->id == id))
+    return;
+
+  struct SymDelEntry entry = { id, slot->head, depth };
+  if (ARRAY_SIZE(&idx->entries) == ARRAY_CAPACITY(&idx->entries))
+    ARRAY_RESERVE(&idx->entries, ARRAY_SIZE(&idx->entries) * 2);
+  slot->head = ARRAY_SIZE(&idx->entries);
+  ARRAY_ADD(&idx->entries, entry);
+}
+
+/**
+ * symdel_new - create an empty deletion index
+ *
+ * @param magic true if the keys are the normalised forms of the items
+ * @retval ptr new index
+ */
+struct SymDelIndex *symdel_new(bool magic)
+{
+  struct SymDelIndex *idx = mutt_mem_calloc(1, sizeof(struct SymDelIndex));
+  idx->num_slots = SYMDEL_INITIAL_SLOTS;
+  idx->slots = mutt_mem_calloc(idx->num_slots, sizeof(struct SymDelSlot));
+  ARRAY_INIT(&idx->entries);
+  ARRAY_INIT(&idx->long_ids);
+  struct SymDelEntry unused = { 0 };
+  ARRAY_ADD(&idx->entries, unused);
+  idx->magic = magic;
+  return idx;
+}
+
+/**
+ * symdel_free - free a deletion index
+ *
+ * @param ptr index to free
+ */
+void symdel_free(struct SymDelIndex **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
+
+  struct SymDelIndex *idx = *ptr;
+  FREE(&idx->slots);
+  ARRAY_FREE(&idx->entries);
+  ARRAY_FREE(&idx->long_ids);
+  FREE(ptr);
+}
+
+/**
+ * symdel_magic - does the index hold the normalised forms of the items?
+ *
+ * @param idx index
+ * @retval bool true for normalised forms
+ */
+bool symdel_magic(const struct SymDelIndex *idx)
+{
+  return idx->magic;
+}
+
+/**
+ * symdel_add - add the deletion variants of an item to the index
+ *
+ * @param idx index
+ * @param id  item id
+ * @param str string of the item (its normalised form for a magic index)
+ */
+void symdel_add(struct SymDelIndex *idx, uint32_t id, const char *str)
+{
+  if (!idx || !str)
+    return;
+
+  int len = 0;
+  wchar_t *w = symdel_decode(str, &len);
+  if (len > SYMDEL_MAX_LEN)
+  {
+    ARRAY_ADD(&idx->long_ids, id);
+    FREE(&w);
+    return;
+  }
+
+  // by depth, so a variant is listed with its fewest deletions
+  symdel_insert(idx, symdel_hash(w, len, -1, -1), id, 0);
+  for (int i = 0; i < len; i++)
+    symdel_insert(idx, symdel_hash(w, len, i, -1), id, 1);
+  for (int i = 0; i < len; i++)
+    for (int j = i + 1; j < len; j++)
+      symdel_insert(idx, symdel_hash(w, len, i, j), id, 2);
+
+  FREE(&w);
+}
+
+/**
+ * symdel_remove - drop removed items from the index
+ *
+ * The entries are copied into a new list, so the space of the removed ones is
+ * freed as well.
+ *
+ * @param idx     index
+ * @param removed tombstones, indexed by item id
+ */
+void symdel_remove(struct SymDelIndex *idx, const struct CompletionBoolList *removed)
+{
+  if (!idx || !removed)
+    return;
+
+  struct SymDelEntryList entries = ARRAY_HEAD_INITIALIZER;
+  ARRAY_RESERVE(&entries, ARRAY_SIZE(&idx->entries));
+  ARRAY_ADD(&entries, *ARRAY_GET(&idx->entries, 0));
+
+  for (size_t i = 0; i < idx->num_slots; i++)
+  {
+    struct SymDelSlot *slot = &idx->slots[i];
+    if (!slot->key)
+      continue;
+
+    // the lists keep their order, newest item first
+    uint32_t e = slot->head;
+    uint32_t prev = 0;
+    slot->head = 0;
+    for (; e; e = ARRAY_GET(&idx->entries, e)->next)
+    {
+      struct SymDelEntry entry = *ARRAY_GET(&idx->entries, e);
+      const bool *dead = ARRAY_GET(removed, entry.id);
+      if (dead && *dead)
+        continue;
+
+      entry.next = 0;
+      uint32_t pos = ARRAY_SIZE(&entries);
+      ARRAY_ADD(&entries, entry);
+      if (prev)
+        ARRAY_GET(&entries, prev)->next = pos;
+      else
+        slot->head = pos;
+      prev = pos;
+    }
+  }
+
+  ARRAY_FREE(&idx->entries);
+  idx->entries = entries;
+
+  size_t keep = 0;
+  uint32_t *id = NULL;
+  ARRAY_FOREACH(id, &idx->long_ids)
+  {
+    const bool *dead = ARRAY_GET(removed, *id);
+    if (dead && *dead)
+      continue;
+    *ARRAY_GET(&idx->long_ids, keep) = *id;
+    keep++;
+  }
+  ARRAY_SHRINK(&idx->long_ids, ARRAY_SIZE(&idx->long_ids) - keep);
+}
+
+/**
+ * symdel_lookup - add the items of a variant to the candidates
+ */
+static void symdel_lookup(const struct SymDelIndex *idx, uint64_t key,
+                          int max_dist, struct NgramIdList *ids)
+{
+  const struct SymDelSlot *slot = symdel_slot(idx, key);
+  for (uint32_t e = slot->head; e; e = ARRAY_GET(&idx->entries, e)->next)
+  {
+    const struct SymDelEntry *entry = ARRAY_GET(&idx->entries, e);
+    if (entry->depth <= max_dist)
+      ARRAY_ADD(ids, entry->id);
+  }
+}
+
+static int symdel_cmp_id(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *) a;
+  uint32_t y = *(const uint32_t *) b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * symdel_query - find the items that may be within a distance of the typed string
+ *
+ * @param idx      index
+ * @param str      typed string (normalised for a magic index)
+ * @param max_dist maximum distance
+ * @param ids      list to fill with the ascending candidate ids
+ * @retval num number of candidates, or -1 if the distance is too large for the index
+ */
+int symdel_query(const struct SymDelIndex *idx, const char *str, int max_dist,
+                 struct NgramIdList *ids)
+{
+  if (!idx || !str || !ids || (max_dist < 0) || (max_dist > SYMDEL_MAX_DIST))
+    return -1;
+
+  ARRAY_SHRINK(ids, ARRAY_SIZE(ids));
+  uint32_t *id = NULL;
+  ARRAY_FOREACH(id, &idx->long_ids)
+  {
+    ARRAY_ADD(ids, *id);
+  }
+
+  // the indexed items can't be within reach of longer strings
+  int len = 0;
+  wchar_t *w = symdel_decode(str, &len);
+  if (len <= SYMDEL_MAX_LEN + max_dist)
+  {
+    symdel_lookup(idx, symdel_hash(w, len, -1, -1), max_dist, ids);
+    for (int i = 0; (max_dist >= 1) && (i < len); i++)
+      symdel_lookup(idx, symdel_hash(w, len, i, -1), max_dist, ids);
+    for (int i = 0; (max_dist >= 2) && (i < len); i++)
+      for (int j = i + 1; j < len; j++)
+        symdel_lookup(idx, symdel_hash(w, len, i, j), max_dist, ids);
+  }
+  FREE(&w);
+
+  // an item shares several variants with the typed string
+  if (!ARRAY_EMPTY(ids))
+  {
+    qsort(ids->entries, ARRAY_SIZE(ids), sizeof(uint32_t), symdel_cmp_id);
+    size_t keep = 1;
+    for (size_t i = 1; i < ARRAY_SIZE(ids); i++)
+    {
+      if (*ARRAY_GET(ids, i) != *ARRAY_GET(ids, keep - 1))
+      {
+        *ARRAY_GET(ids, keep) = *ARRAY_GET(ids, i);
+        keep++;
+      }
+    }
+    ARRAY_SHRINK(ids, ARRAY_SIZE(ids) - keep);
+  }
+
+  return ARRAY_SIZE(ids);
+}
+
+/**
+ * symdel_memory - memory used by a deletion index
+ *
+ * @param idx        index
+ * @param n_variants set to the number of distinct variants (may be NULL)
+ * @retval num size in bytes
+ */
+size_t symdel_memory(const struct SymDelIndex *idx, size_t *n_variants)
+{
+  if (!idx)
+    return 0;
+
+  if (n_variants)
+    *n_variants = idx->num_used;
+
+  return sizeof(struct SymDelIndex) + idx->num_slots * sizeof(struct SymDelSlot) +
+         ARRAY_CAPACITY(&idx->entries) * sizeof(struct SymDelEntry) +
+         ARRAY_CAPACITY(&idx->long_ids) * sizeof(uint32_t);
+}
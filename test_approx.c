@@ -0,0 +1,232 @@
+/**
+ * @file
+ * Autocompletion API Test: approximate regex matching
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include <stdio.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+
+#define BUF(s1) buf_new(s1)
+
+static const char *Commands[] = {
+  "alias", "alternates", "attachments", "bind", "charset-hook", "color",
+  "folder-hook", "mailboxes", "message-hook", "my_hdr", "named-mailboxes",
+  "reply-hook", "save-hook", "send-hook", "send2-hook", "set", "source",
+  "subscribe", "unalias", "unset", "virtual-mailboxes",
+};
+
+/**
+ * random string over a few characters, so that many of them are close
+ */
+static void random_str(unsigned int *seed, char *str, int max_len)
+{
+  static const char *chars[] = { "a", "b", "c", "ä" };
+  *seed = *seed * 1103515245 + 12345;
+  int len = 1 + (*seed >> 16) % max_len;
+  *str = '\0';
+  for (int i = 0; i < len; i++)
+  {
+    *seed = *seed * 1103515245 + 12345;
+    strcat(str, chars[(*seed >> 16) % 4]);
+  }
+}
+
+/**
+ * fewest edits between a string and any part of another (Sellers)
+ */
+static int edits_anywhere(const char *pat, const char *str)
+{
+  wchar_t p[64] = { 0 };
+  wchar_t s[64] = { 0 };
+  int n = utf8_decode(pat, p);
+  int m = utf8_decode(str, s);
+
+  int col[65];
+  for (int i = 0; i <= n; i++)
+    col[i] = i;
+  int best = col[n];
+  for (int j = 1; j <= m; j++)
+  {
+    int diag = col[0];
+    col[0] = 0;
+    for (int i = 1; i <= n; i++)
+    {
+      int up = col[i];
+      col[i] = MIN(MIN(col[i] + 1, col[i - 1] + 1), diag + ((p[i - 1] == s[j - 1]) ? 0 : 1));
+      diag = up;
+    }
+    best = MIN(best, col[n]);
+  }
+  return best;
+}
+
+void test_approx_literal(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  // plain strings allow the same edits as the textbook algorithm
+  unsigned int seed = 7;
+  for (int q = 0; q < 40; q++)
+  {
+    char pat[64];
+    random_str(&seed, pat, 8);
+    for (int k = 0; k <= 3; k++)
+    {
+      struct RegexApprox *a = approx_new(pat, COMPL_MATCH_NOFLAGS, k);
+      TEST_CHECK(a != NULL);
+      for (int i = 0; i < 50; i++)
+      {
+        char str[64];
+        random_str(&seed, str, 12);
+        int want = edits_anywhere(pat, str);
+        int got = approx_edits(a, str);
+        TEST_CHECK(got == ((want > k) ? -1 : want));
+        TEST_MSG("pattern %s, string %s, k %d: %d vs %d", pat, str, k, got, want);
+      }
+      approx_free(&a);
+      TEST_CHECK(a == NULL);
+    }
+  }
+}
+
+void test_approx_regex(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  static const struct
+  {
+    const char *pattern;
+    const char *str;
+    int edits;
+  } tests[] = {
+    { "colou?r", "color", 0 },       { "colou?r", "colour", 0 },
+    { "colou?r", "colr", 1 },        { "colou?r", "coloeur", 1 },
+    { "(ab)+c", "ababxc", 1 },       { "(ab)+c", "xxac", 1 },
+    { "neo.*dev", "nemutt-dev", 1 }, { "neo.*dev", "neomutt-devel", 0 },
+    { "^inbox", "inbx/lists", 1 },   { "^inbox", "x/inbox", 2 },
+    { "box$", "mailbox", 0 },        { "box$", "boxes", 2 },
+    { "[0-9]+x", "a12y", 1 },        { "s(end|ave)-hook", "sned-hook", 2 },
+    { "ÄPF", "äpfel", 3 },           { "x|yz", "abc", 1 },
+    { "abc", "", 3 },                { "^$", "a", 1 },
+  };
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+  {
+    struct RegexApprox *a = approx_new(tests[i].pattern, COMPL_MATCH_NOFLAGS, 3);
+    int got = approx_edits(a, tests[i].str);
+    TEST_CHECK(got == tests[i].edits);
+    TEST_MSG("pattern %s, string %s: %d vs %d", tests[i].pattern, tests[i].str,
+             got, tests[i].edits);
+    approx_free(&a);
+  }
+
+  // case-insensitive patterns, and the limit
+  struct RegexApprox *a = approx_new("ÄPF", COMPL_MATCH_IGNORECASE, 1);
+  TEST_CHECK(approx_edits(a, "äpfel") == 0);
+  TEST_CHECK(approx_edits(a, "aPfel") == 1);
+  TEST_CHECK(approx_edits(a, "apfl") == 1);
+  TEST_CHECK(approx_edits(a, "afl") == -1);
+  approx_free(&a);
+
+  // without edits, unanchored patterns match as the automaton does
+  static const char *patterns[] = { "INBOX", "neo.*dev", "a+b", "[^a-z]", "(ab|ba)",
+                                    "[[:digit:]]+", "x|y" };
+  static const char *items[] = { "INBOX/Lists", "neomutt-devel", "aab", "ab", "ba",
+                                 "2023", "abc", "x]y", "Straße" };
+  for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++)
+  {
+    struct RegexNfa *nfa = nfa_compile(patterns[p], COMPL_MATCH_NOFLAGS);
+    a = approx_new(patterns[p], COMPL_MATCH_NOFLAGS, 0);
+    for (size_t i = 0; i < sizeof(items) / sizeof(items[0]); i++)
+    {
+      TEST_CHECK((approx_edits(a, items[i]) == 0) == nfa_match(nfa, items[i]));
+      TEST_MSG("pattern %s, item %s", patterns[p], items[i]);
+    }
+    nfa_free(&nfa);
+    approx_free(&a);
+  }
+
+  // patterns the automaton doesn't support aren't compiled
+  TEST_CHECK(approx_new("a{2}", COMPL_MATCH_NOFLAGS, 1) == NULL);
+  TEST_CHECK(approx_new("(ab", COMPL_MATCH_NOFLAGS, 1) == NULL);
+  TEST_CHECK(approx_edits(NULL, "a") == -1);
+}
+
+/**
+ * complete a typed string, and return the distance of an item
+ */
+static int complete_dist(Completion *comp, const char *typed, const char *item)
+{
+  compl_type(comp, BUF(typed));
+  compl_complete(comp);
+  CompletionItem *it = NULL;
+  ARRAY_FOREACH_FROM(it, comp->items, 1)
+  {
+    if (mutt_str_equal(it->str, item))
+      return it->is_match ? it->match_dist : -1;
+  }
+  return -2;
+}
+
+void test_approx_engine(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  Completion *comp = compl_new(COMPL_MODE_APPROX);
+  for (size_t i = 0; i < sizeof(Commands) / sizeof(Commands[0]); i++)
+    compl_add(comp, BUF(Commands[i]));
+
+  // the distance is the number of edits, the closest item comes first
+  compl_type(comp, BUF("^mesage-ho+k"));
+  TEST_CHECK(mutt_str_equal(buf_string(compl_complete(comp)), "message-hook"));
+  TEST_CHECK(complete_dist(comp, "^(sned|svae)-hook$", "send-hook") == 2);
+  TEST_CHECK(complete_dist(comp, "^(sned|svae)-hook$", "save-hook") == 2);
+  TEST_CHECK(complete_dist(comp, "^(sned|svae)-hook$", "reply-hook") == -1);
+
+  // the maximum distance is the number of edits allowed
+  compl_set_max_dist(comp, 1);
+  TEST_CHECK(complete_dist(comp, "^(sned|svae)-hook$", "send-hook") == -1);
+  TEST_CHECK(complete_dist(comp, "^virtual-mailboxe$", "virtual-mailboxes") == 1);
+  compl_set_max_dist(comp, 0);
+  TEST_CHECK(complete_dist(comp, "mailbox", "virtual-mailboxes") == 0);
+  TEST_CHECK(complete_dist(comp, "mailbx", "virtual-mailboxes") == -1);
+
+  // patterns the automaton doesn't support only match without edits
+  compl_set_max_dist(comp, 2);
+  TEST_CHECK(complete_dist(comp, "s{2}", "message-hook") == 0);
+  TEST_CHECK(complete_dist(comp, "s{2}", "send-hook") == -1);
+
+  // the items themselves are matched, not their normalised forms
+  comp->flags = COMPL_MATCH_MAGIC;
+  TEST_CHECK(complete_dist(comp, "my_hdr", "my_hdr") == 0);
+  compl_free(&comp);
+}
+
+TEST_LIST = {
+  { "approx literal", test_approx_literal },
+  { "approx regex", test_approx_regex },
+  { "approx engine", test_approx_engine },
+  { NULL, NULL },
+};
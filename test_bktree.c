@@ -0,0 +1,261 @@
+/**
+ * @file
+ * Autocompletion API Test: BK-tree for fuzzy matching
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include <stdio.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+#include "test_common.h"
+
+#define BUF(s1) buf_new(s1)
+
+static const char *Words[] = { "folder", "inbox", "list", "neomutt", "devel",
+                               "archive", "sent", "drafts", "spam", "work" };
+
+/**
+ * unrestricted damerau-levenshtein distance of two ASCII strings, the slow way
+ */
+static int ref_dist(const char *a, const char *b)
+{
+  int n = strlen(a);
+  int m = strlen(b);
+  int d[32][32];
+  int last[256] = { 0 };
+  const int inf = n + m;
+
+  d[0][0] = inf;
+  for (int i = 0; i <= n; i++)
+  {
+    d[i + 1][0] = inf;
+    d[i + 1][1] = i;
+  }
+  for (int j = 0; j <= m; j++)
+  {
+    d[0][j + 1] = inf;
+    d[1][j + 1] = j;
+  }
+
+  for (int i = 1; i <= n; i++)
+  {
+    int db = 0;
+    for (int j = 1; j <= m; j++)
+    {
+      int k = last[(unsigned char) b[j - 1]];
+      int l = db;
+      int cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+      if (cost == 0)
+        db = j;
+      int best = MIN(d[i][j] + cost, MIN(d[i + 1][j] + 1, d[i][j + 1] + 1));
+      d[i + 1][j + 1] = MIN(best, d[k][l] + (i - k - 1) + 1 + (j - l - 1));
+    }
+    last[(unsigned char) a[i - 1]] = i;
+  }
+
+  return d[n + 1][m + 1];
+}
+
+static bool has_id(const struct NgramIdList *ids, uint32_t id)
+{
+  const uint32_t *p = NULL;
+  ARRAY_FOREACH(p, ids)
+  {
+    if (*p == id)
+      return true;
+  }
+  return false;
+}
+
+void test_bktree_query(void)
+{
+  static const char *items[] = { "xabcd", "xacbd", "xabdc", "xbadc", "xca",
+                                 "xabc", "xa", "xdcba", "xabcde", "xbcde",
+                                 "xeabcd", "xaebcd", "xzzzz", "x", "xab" };
+  const size_t num = sizeof(items) / sizeof(items[0]);
+  struct BkTree *t = bktree_new(false);
+  for (size_t i = 0; i < num; i++)
+    bktree_add(t, i + 1, items[i]);
+  TEST_CHECK(bktree_stats(t, NULL) == num);
+
+  // the tree finds exactly the items within the distance, the first character aside
+  struct NgramIdList ids = ARRAY_HEAD_INITIALIZER;
+  static const char *typed[] = { "xabcd", "yac", "xdcab", "x", "xzz" };
+  for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+  {
+    for (int k = 0; k <= 3; k++)
+    {
+      bktree_query(t, typed[q], k, &ids);
+      for (size_t i = 0; i < num; i++)
+      {
+        bool want = (ref_dist(typed[q] + 1, items[i] + 1) <= k);
+        TEST_CHECK(has_id(&ids, i + 1) == want);
+        TEST_MSG("typed %s, item %s, k %d", typed[q], items[i], k);
+      }
+    }
+  }
+
+  // a transposition with an insertion in between is 2, not 3 as for the kernel
+  TEST_CHECK(ref_dist("ca", "abc") == 2);
+  bktree_query(t, "xabc", 2, &ids);
+  TEST_CHECK(has_id(&ids, 5));
+
+  // close queries don't visit the whole tree
+  size_t n_dist = 0;
+  bktree_query(t, "xzzzz", 0, &ids);
+  bktree_stats(t, &n_dist);
+  TEST_CHECK(ARRAY_SIZE(&ids) == 1);
+  TEST_CHECK(n_dist < num);
+
+  ARRAY_FREE(&ids);
+  bktree_free(&t);
+  TEST_CHECK(t == NULL);
+
+  // multibyte characters count once
+  t = bktree_new(false);
+  bktree_add(t, 1, "Äpfel");
+  bktree_add(t, 2, "Äpfle");
+  bktree_add(t, 3, "Äpfelmus");
+  bktree_query(t, "Äpfél", 1, &ids);
+  TEST_CHECK(ARRAY_SIZE(&ids) == 1);
+  TEST_CHECK(has_id(&ids, 1));
+  ARRAY_FREE(&ids);
+  bktree_free(&t);
+}
+
+/**
+ * fill a Completion with more items than needed for the BK-tree
+ */
+static Completion *big_list(MuttMatchFlags flags, int max_dist)
+{
+  const size_t n_words = sizeof(Words) / sizeof(Words[0]);
+  Completion *comp = compl_new(COMPL_MODE_FUZZY);
+  comp->flags = flags;
+  compl_set_max_dist(comp, max_dist);
+  for (size_t i = 0; i < 3 * COMPL_BKTREE_THRESHOLD; i++)
+  {
+    char item[64];
+    snprintf(item, sizeof(item), "%s%s%zu", Words[i % n_words],
+             Words[(i / n_words) % n_words], i / 100);
+    struct Buffer *buf = BUF(item);
+    compl_add(comp, buf);
+    buf_free(&buf);
+  }
+  return comp;
+}
+
+/**
+ * compare a search with the tree to a full scan with the distance applied afterwards
+ */
+static bool same_dists(Completion *tree, Completion *scan, const char *typed, int k)
+{
+  int *dt = test_score_all(tree, typed);
+  int *ds = test_score_all(scan, typed);
+  bool same = (tree->next_id == scan->next_id);
+  for (uint32_t id = 1; same && (id < tree->next_id); id++)
+  {
+    if (ds[id] > k)
+      ds[id] = -1;
+    same = (dt[id] == ds[id]);
+  }
+  FREE(&dt);
+  FREE(&ds);
+  return same;
+}
+
+void test_bktree_engine(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  static const char *typed[] = { "neomuttdevel3", "nemoutdevl", "spamwrk",
+                                 "sentsent", "x", "archivedrafts9" };
+  Completion *scan = big_list(COMPL_MATCH_NOFLAGS, -1);
+  for (int k = 0; k <= 3; k++)
+  {
+    Completion *tree = big_list(COMPL_MATCH_NOFLAGS, k);
+    for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+    {
+      TEST_CHECK(same_dists(tree, scan, typed[q], k));
+      TEST_MSG("typed %s, k %d", typed[q], k);
+    }
+    TEST_CHECK(tree->bktree != NULL);
+    compl_free(&tree);
+  }
+  TEST_CHECK(scan->bktree == NULL);
+  compl_free(&scan);
+
+  // the maximum distance applies without the tree as well
+  Completion *comp = compl_new(COMPL_MODE_FUZZY);
+  compl_set_max_dist(comp, 1);
+  compl_add(comp, BUF("neomutt"));
+  compl_add(comp, BUF("mutt"));
+  compl_type(comp, BUF("neomut"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "neomutt") == 0);
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "neomut") == 0);
+  TEST_CHECK(comp->bktree == NULL);
+  compl_free(&comp);
+}
+
+void test_bktree_updates(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  Completion *comp = big_list(COMPL_MATCH_NOFLAGS, 2);
+  compl_type(comp, BUF("neomuttdevel"));
+  compl_complete(comp);
+  TEST_CHECK(comp->bktree != NULL);
+
+  // items added later are in the tree
+  compl_add(comp, BUF("neomuttdevil"));
+  compl_type(comp, BUF("neomuttdevil"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "neomuttdevil") == 0);
+  TEST_CHECK(bktree_stats(comp->bktree, NULL) == (size_t) compl_get_size(comp) - 1);
+
+  // removed items stay in the tree, but don't match
+  compl_remove(comp, BUF("neomuttdevil"));
+  compl_type(comp, BUF("neomuttdevil"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(strcmp(buf_string(result), "neomuttdevil") != 0);
+
+  // switching to magic mode rebuilds the tree with the normalised forms
+  compl_add(comp, BUF("NeoMuttDevil"));
+  comp->flags = COMPL_MATCH_MAGIC;
+  compl_type(comp, BUF("NEOMUTTDEVIL"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "NeoMuttDevil") == 0);
+  TEST_CHECK(bktree_magic(comp->bktree));
+  compl_free(&comp);
+
+  Completion *tree = big_list(COMPL_MATCH_MAGIC, 2);
+  Completion *scan = big_list(COMPL_MATCH_MAGIC, -1);
+  TEST_CHECK(same_dists(tree, scan, "NEOMUTTDEVL", 2));
+  TEST_CHECK(same_dists(tree, scan, "SpamWork", 2));
+  compl_free(&tree);
+  compl_free(&scan);
+}
+
+TEST_LIST = {
+  { "bktree query", test_bktree_query },
+  { "bktree engine", test_bktree_engine },
+  { "bktree updates", test_bktree_updates },
+  { NULL, NULL },
+};
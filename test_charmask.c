@@ -0,0 +1,210 @@
+/**
+ * @file
+ * Autocompletion API Test: character class signatures
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include <stdio.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+
+#define BUF(s1) buf_new(s1)
+
+static const char *Items[] = {
+  "INBOX", "INBOX/Lists", "INBOX/Lists/neomutt-devel", "INBOX/Lists/neomutt_users",
+  "INBOX/Archive/2023", "Sent", "Drafts", "Äpfel", "äpfelmus", "Straße",
+  "ΟΔΥΣΣΕΥΣ", "οδυσσευς", "folder-hook", "save_hook", "send2-hook", "a", "ab",
+};
+
+void test_charmask_str(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  // case and the magic separators are folded
+  TEST_CHECK(charmask_str("NeoMutt", false) == charmask_str("neomutt", false));
+  TEST_CHECK(charmask_str("save_hook", false) == charmask_str("save-hook", false));
+  TEST_CHECK(charmask_str("ÄPFEL", false) == charmask_str("äpfel", false));
+  TEST_CHECK(charmask_str("ΟΔΥΣΣΕΥΣ", false) == charmask_str("οδυσσευσ", false));
+
+  // letters and digits have bits of their own
+  TEST_CHECK(charmask_str("a", false) != charmask_str("b", false));
+  TEST_CHECK(charmask_str("1", false) != charmask_str("a", false));
+  TEST_CHECK((charmask_str("abc", false) & charmask_str("xyz", false)) == 0);
+  TEST_CHECK(charmask_str("", false) == 0);
+
+  // the first character can be left out
+  TEST_CHECK(charmask_str("xabc", true) == charmask_str("abc", false));
+  TEST_CHECK(charmask_str("Äbc", true) == charmask_str("bc", false));
+  TEST_CHECK(charmask_str("Ä", true) == 0);
+
+  // a string has all bits of its parts
+  uint64_t all = charmask_str("INBOX/Lists/neomutt-devel", false);
+  static const char *parts[] = { "inbox", "/", "lists/neo", "devel", "-", "t-d" };
+  for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+  {
+    uint64_t part = charmask_str(parts[i], false);
+    TEST_CHECK((all & part) == part);
+    TEST_MSG("part %s", parts[i]);
+  }
+}
+
+void test_charmask_filter(void)
+{
+  uint64_t masks[300];
+  uint8_t pass[300];
+  unsigned long long seed = 42;
+  for (size_t i = 0; i < 300; i++)
+  {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    masks[i] = seed & (seed >> 17);
+  }
+
+  // the same as counting the missing bits one by one
+  for (int k = 0; k <= 3; k++)
+  {
+    for (int q = 0; q < 20; q++)
+    {
+      seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      uint64_t need = seed & (seed >> 13) & (seed >> 29);
+      size_t n_pass = charmask_filter(masks, 300, need, k, pass);
+
+      size_t want_pass = 0;
+      for (size_t i = 0; i < 300; i++)
+      {
+        int missing = 0;
+        for (int b = 0; b < 64; b++)
+          missing += ((need >> b) & 1) && !((masks[i] >> b) & 1);
+        bool want = (missing <= k);
+        want_pass += want;
+        TEST_CHECK(pass[i] == want);
+        TEST_MSG("k %d, mask %zu, %d missing", k, i, missing);
+      }
+      TEST_CHECK(n_pass == want_pass);
+    }
+  }
+
+  // everything passes an empty signature
+  TEST_CHECK(charmask_filter(masks, 300, 0, 0, pass) == 300);
+}
+
+static Completion *mailbox_list(enum MuttMatchMode mode, MuttMatchFlags flags, int max_dist)
+{
+  Completion *comp = compl_new(mode);
+  comp->flags = flags;
+  compl_set_max_dist(comp, max_dist);
+  for (size_t i = 0; i < sizeof(Items) / sizeof(Items[0]); i++)
+  {
+    struct Buffer *buf = BUF(Items[i]);
+    compl_add(comp, buf);
+    buf_free(&buf);
+  }
+  return comp;
+}
+
+/**
+ * compare the distances of a search to those of the matcher, item by item
+ */
+static bool same_as_matcher(Completion *comp, const char *typed)
+{
+  struct Buffer *buf = BUF(typed);
+  compl_type(comp, buf);
+  buf_free(&buf);
+  compl_complete(comp);
+
+  bool same = true;
+  CompletionItem *item = NULL;
+  ARRAY_FOREACH_FROM(item, comp->items, 1)
+  {
+    struct Buffer *tar = BUF(item->str);
+    int want = match_dist(tar, comp);
+    buf_free(&tar);
+    if ((comp->mode == COMPL_MODE_FUZZY) && (want > comp->max_dist))
+      want = -1;
+
+    int got = item->is_match ? item->match_dist : -1;
+    if (got != want)
+    {
+      TEST_MSG("typed %s, item %s: %d vs %d", typed, item->str, got, want);
+      same = false;
+    }
+  }
+  return same;
+}
+
+void test_charmask_engine(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  static const char *typed[] = { "inbox", "INBOX/L", "lists", "NEO", "send_",
+                                 "äpf", "ÄPFEL", "ευς", "hook", "s", "ibxlst", "zz" };
+  static const enum MuttMatchMode modes[] = { COMPL_MODE_EXACT, COMPL_MODE_SUBSTRING,
+                                              COMPL_MODE_SUFFIX, COMPL_MODE_SUBSEQ };
+  static const MuttMatchFlags flags[] = { COMPL_MATCH_NOFLAGS, COMPL_MATCH_IGNORECASE,
+                                          COMPL_MATCH_MAGIC };
+
+  // the filter doesn't change any result
+  for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+  {
+    for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+    {
+      Completion *comp = mailbox_list(modes[m], flags[f], -1);
+      for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+      {
+        TEST_CHECK(same_as_matcher(comp, typed[q]));
+        TEST_MSG("mode %d, flags %d", modes[m], flags[f]);
+      }
+      compl_free(&comp);
+    }
+  }
+
+  for (int k = 0; k <= 3; k++)
+  {
+    for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+    {
+      Completion *comp = mailbox_list(COMPL_MODE_FUZZY, flags[f], k);
+      for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+      {
+        TEST_CHECK(same_as_matcher(comp, typed[q]));
+        TEST_MSG("fuzzy k %d, flags %d", k, flags[f]);
+      }
+      compl_free(&comp);
+    }
+  }
+
+  // items added later, after a search, have their signatures
+  Completion *comp = mailbox_list(COMPL_MODE_SUBSEQ, COMPL_MATCH_IGNORECASE, -1);
+  compl_type(comp, BUF("trsh"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "trsh") == 0);
+  compl_add(comp, BUF("Trash"));
+  compl_type(comp, BUF("TRSH"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "Trash") == 0);
+  TEST_CHECK(*ARRAY_GET(&comp->masks, comp->next_id - 1) == charmask_str("trash", false));
+  compl_free(&comp);
+}
+
+TEST_LIST = {
+  { "charmask str", test_charmask_str },
+  { "charmask filter", test_charmask_filter },
+  { "charmask engine", test_charmask_engine },
+  { NULL, NULL },
+};
@@ -0,0 +1,51 @@
+/**
+ * @file
+ * Autocompletion API Test: helpers shared by the index tests
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "mutt/lib.h"
+#include "lib.h"
+#include "test_common.h"
+
+/**
+ * test_score_all - Score all items, and collect their distances by id
+ * @param comp  Completion struct
+ * @param typed Typed string
+ * @retval ptr Distances indexed by item id, -1 for items that don't match
+ *
+ * The caller must free the array.
+ */
+int *test_score_all(Completion *comp, const char *typed)
+{
+  struct Buffer *buf = buf_new(typed);
+  compl_type(comp, buf);
+  buf_free(&buf);
+  buf = compl_complete(comp);
+  buf_free(&buf);
+
+  int *dists = mutt_mem_calloc(comp->next_id, sizeof(int));
+  CompletionItem *item = NULL;
+  ARRAY_FOREACH_FROM(item, comp->items, 1)
+  {
+    dists[item->id] = item->is_match ? item->match_dist : -1;
+  }
+  return dists;
+}
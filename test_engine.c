@@ -73,7 +73,7 @@ void state_init_from_array(void)
   TEST_CHECK(STR_EQ(result, BUF("ap")));
 
   ARRAY_FREE(&list);
-  compl_free(comp);
+  compl_free(&comp);
 }
 
 void malformed_input(void)
@@ -96,7 +96,7 @@ void malformed_input(void)
   TEST_CHECK(compl_type(comp, BUF("")) == 0);
   TEST_CHECK(compl_add(comp, BUF("")) == 0);
 
-  compl_free(comp);
+  compl_free(&comp);
 }
 
 void state_empty(void)
@@ -111,7 +111,7 @@ void state_empty(void)
 
   TEST_CHECK(STR_EQ(result, BUF("")));
 
-  compl_free(comp);
+  compl_free(&comp);
 }
 
 void state_nomatch(void)
@@ -133,7 +133,7 @@ void state_nomatch(void)
 
   TEST_CHECK(STR_EQ(result, BUF("bertha")));
 
-  compl_free(comp);
+  compl_free(&comp);
 }
 
 void state_single(void)
@@ -160,7 +160,7 @@ void state_single(void)
 
   TEST_CHECK(STR_EQ(result, BUF("ar")));
 
-  compl_free(comp);
+  compl_free(&comp);
 }
 
 void state_single_utf8(void)
@@ -189,7 +189,7 @@ void state_single_utf8(void)
   printf("  äp -> äp: (%s)\n", result->data);
   TEST_CHECK(STR_EQ(result, BUF("äp")));
 
-  compl_free(comp);
+  compl_free(&comp);
 }
 
 void state_multi(void)
@@ -227,7 +227,7 @@ void state_multi(void)
   printf("  ap -> %s\n", result->data);
   TEST_CHECK(STR_EQ(result, BUF("ap")));
 
-  compl_free(comp);
+  compl_free(&comp);
 }
 
 void duplicate_add(void)
@@ -254,7 +254,550 @@ void duplicate_add(void)
   printf("Another duplicate, this time unicode...\n");
   TEST_CHECK(compl_get_size(comp) == 4);
 
-  compl_free(comp);
+  compl_free(&comp);
+}
+
+void highlight_top(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  printf("\n");
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+  TEST_CHECK(compl_set_highlight(comp, 2) == 1);
+
+  compl_add(comp, BUF("apply"));
+  compl_add(comp, BUF("apfel"));
+  compl_add(comp, BUF("arange"));
+  compl_add(comp, BUF("apple"));
+
+  compl_type(comp, BUF("ap"));
+
+  const CompletionSpan *spans = NULL;
+  struct Buffer *result = NULL;
+
+  // the best two matches have their spans recorded
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apfel")));
+  TEST_CHECK(compl_get_spans(comp, &spans) == 1);
+  TEST_CHECK(spans && spans[0].start == 0 && spans[0].len == 2);
+
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apple")));
+  TEST_CHECK(compl_get_spans(comp, &spans) == 1);
+
+  // the third match isn't displayed, so it doesn't keep any spans
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apply")));
+  TEST_CHECK(compl_get_spans(comp, &spans) == 0);
+
+  // the typed string doesn't have any spans
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("ap")));
+  TEST_CHECK(compl_get_spans(comp, &spans) == 0);
+
+  compl_free(&comp);
+}
+
+void highlight_limits(void)
+{
+  printf("\n");
+  Completion *comp = compl_new(COMPL_MODE_SUBSTRING);
+
+  // span slots are numbered with 16 bits
+  TEST_CHECK(compl_set_highlight(NULL, 1) == 0);
+  TEST_CHECK(compl_set_highlight(comp, SIZE_MAX) == 1);
+  TEST_CHECK(comp->n_highlight == COMPL_MAX_HIGHLIGHT);
+  TEST_CHECK(compl_set_highlight(comp, 1) == 1);
+
+  // and so are the positions, the rest of a longer item isn't highlighted
+  struct Buffer *typed = buf_new("needle");
+  struct Buffer *cut = buf_new(NULL);
+  struct Buffer *past = buf_new(NULL);
+  for (int i = 0; i < 70000; i++)
+    buf_addch(past, 'x');
+  buf_addstr(past, "needle");
+  buf_addstr_n(cut, buf_string(past) + 70000 - 65530, 65530 + 6);
+
+  compl_add(comp, cut);
+  compl_type(comp, typed);
+
+  const CompletionSpan *spans = NULL;
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, cut));
+  TEST_CHECK(compl_get_spans(comp, &spans) == 1);
+  TEST_CHECK(spans && (spans[0].start == 65530) && (spans[0].len == 5));
+  buf_free(&result);
+  compl_free(&comp);
+
+  comp = compl_new(COMPL_MODE_SUBSTRING);
+  compl_set_highlight(comp, 1);
+  compl_add(comp, past);
+  compl_type(comp, typed);
+
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, past));
+  TEST_CHECK(compl_get_spans(comp, &spans) == 0);
+  buf_free(&result);
+  compl_free(&comp);
+
+  buf_free(&typed);
+  buf_free(&cut);
+  buf_free(&past);
+}
+
+void remove_items(void)
+{
+  printf("\n");
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+
+  compl_add(comp, BUF("apfel"));
+  compl_add(comp, BUF("apple"));
+  compl_add(comp, BUF("apply"));
+
+  compl_type(comp, BUF("ap"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apfel")));
+
+  TEST_CHECK(compl_remove(comp, BUF("apple")) == 1);
+  TEST_CHECK(compl_remove(comp, BUF("apple")) == 0);
+  TEST_CHECK(compl_remove(comp, BUF("banana")) == 0);
+  TEST_CHECK(compl_get_size(comp) == 3);
+
+  // the search starts over, without the removed item
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apfel")));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apply")));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("ap")));
+  TEST_CHECK(ARRAY_SIZE(comp->items) == 3);
+
+  // removed items can be added again
+  TEST_CHECK(compl_add(comp, BUF("apple")) == 1);
+  TEST_CHECK(compl_add(comp, BUF("apple")) == 0);
+  TEST_CHECK(compl_get_size(comp) == 4);
+
+  compl_free(&comp);
+}
+
+void apply_delta(void)
+{
+  printf("\n");
+  Completion *comp = compl_new(COMPL_MODE_SUBSTRING);
+  char str[32];
+
+  // large enough for the trigram index
+  for (int i = 0; i < 1500; i++)
+  {
+    snprintf(str, sizeof(str), "item-%04d", i);
+    compl_add(comp, BUF(str));
+  }
+  TEST_CHECK(comp->ngrams != NULL);
+
+  struct CompletionStringList added = ARRAY_HEAD_INITIALIZER;
+  struct CompletionStringList removed = ARRAY_HEAD_INITIALIZER;
+  char *add[] = { "item-4242", "item-0001" };
+  char *del[] = { "item-0042", "item-0420", "item-9999" };
+  ARRAY_ADD(&added, add[0]);
+  ARRAY_ADD(&added, add[1]);
+  ARRAY_ADD(&removed, del[0]);
+  ARRAY_ADD(&removed, del[1]);
+  ARRAY_ADD(&removed, del[2]);
+
+  // unknown removals and duplicate additions are skipped
+  TEST_CHECK(compl_apply_delta(comp, &added, &removed) == 3);
+  TEST_CHECK(compl_get_size(comp) == 1500);
+
+  compl_type(comp, BUF("m-0042"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(comp->state == COMPL_STATE_NOMATCH);
+
+  compl_type(comp, BUF("4242"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("item-4242")));
+
+  // removing a quarter of the items compacts the indexes as well
+  for (int i = 1000; i < 1500; i++)
+  {
+    snprintf(str, sizeof(str), "item-%04d", i);
+    compl_remove(comp, BUF(str));
+  }
+  TEST_CHECK(comp->n_garbage == 502);
+
+  compl_type(comp, BUF("m-14"));
+  result = compl_complete(comp);
+  TEST_CHECK(comp->state == COMPL_STATE_NOMATCH);
+  TEST_CHECK(comp->n_garbage == 0);
+  TEST_CHECK(compl_get_size(comp) == 1000);
+
+  compl_type(comp, BUF("m-09"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("item-0900")));
+  TEST_CHECK(comp->state == COMPL_STATE_MULTI);
+
+  ARRAY_FREE(&added);
+  ARRAY_FREE(&removed);
+  compl_free(&comp);
+}
+
+void add_many(void)
+{
+  printf("\n");
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+
+  // duplicates within the batch and empty strings are skipped
+  const char *strs[] = { "apfel", "apple", NULL, "", "apfel", "Äpfel", "apply" };
+  TEST_CHECK(compl_add_many(comp, strs, NULL, 7) == 4);
+  TEST_CHECK(compl_get_size(comp) == 5);
+  TEST_CHECK(!comp->ascii);
+
+  // strings don't need to be terminated, if their lengths are given
+  const char *prefixes[] = { "applesauce", "apfelmus", "Äpfelchen" };
+  const size_t lens[] = { 5, 8, 6 };
+  TEST_CHECK(compl_add_many(comp, prefixes, lens, 3) == 1);
+  TEST_CHECK(compl_add(comp, BUF("apfelmus")) == 0);
+  TEST_CHECK(compl_get_size(comp) == 6);
+
+  compl_type(comp, BUF("apf"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apfel")));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apfelmus")));
+
+  compl_free(&comp);
+
+  // a large batch gets a trigram index, and survives compaction
+  comp = compl_new(COMPL_MODE_SUBSTRING);
+  char **items = mutt_mem_calloc(3000, sizeof(char *));
+  char str[32];
+  for (int i = 0; i < 3000; i++)
+  {
+    snprintf(str, sizeof(str), "item-%04d", i % 2000);
+    items[i] = mutt_str_dup(str);
+  }
+  TEST_CHECK(compl_add_many(comp, (const char **) items, NULL, 3000) == 2000);
+  TEST_CHECK(comp->ngrams != NULL);
+
+  for (int i = 0; i < 1000; i++)
+    compl_remove(comp, BUF(items[i]));
+
+  compl_type(comp, BUF("m-19"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("item-1900")));
+  TEST_CHECK(comp->n_garbage == 0);
+  TEST_CHECK(compl_add(comp, BUF("item-1999")) == 0);
+  TEST_CHECK(compl_add(comp, BUF("item-0999")) == 1);
+
+  for (int i = 0; i < 3000; i++)
+    FREE(&items[i]);
+  FREE(&items);
+  compl_free(&comp);
+}
+
+struct Stream
+{
+  const char **strs;
+  size_t num;
+  size_t pos;
+};
+
+static size_t stream_next(void *data, const char **strs, size_t max)
+{
+  struct Stream *stream = data;
+  size_t num = 0;
+  for (; (num < max) && (stream->pos < stream->num); num++)
+    strs[num] = stream->strs[stream->pos++];
+
+  return num;
+}
+
+void stream_items(void)
+{
+  printf("\n");
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+
+  const char *strs[] = { "banana", "cherry", "apple",  "date",
+                         "fig",    "apricot", "grape", "avocado" };
+  struct Stream stream = { strs, 8, 0 };
+  TEST_CHECK(compl_set_provider(comp, stream_next, &stream, 2) == 1);
+
+  // only the chunks up to the first match are pulled
+  compl_type(comp, BUF("a"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apple")));
+  TEST_CHECK(stream.pos == 4);
+  TEST_CHECK(compl_get_size(comp) == 5);
+
+  // cycling past the last match pulls more
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apricot")));
+  TEST_CHECK(stream.pos == 6);
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("avocado")));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("a")));
+  TEST_CHECK(comp->provider == NULL);
+
+  // the pulled items are kept for the next search
+  compl_type(comp, BUF("gr"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("grape")));
+  TEST_CHECK(compl_get_size(comp) == 9);
+
+  compl_type(comp, BUF("x"));
+  result = compl_complete(comp);
+  TEST_CHECK(comp->state == COMPL_STATE_NOMATCH);
+
+  compl_free(&comp);
+}
+
+void stream_no_match(void)
+{
+  printf("\n");
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+
+  // enough items for the list to grow while cycling, and none of them match
+  const char *strs[64] = { "apple" };
+  char names[63][8];
+  for (int i = 0; i < 63; i++)
+  {
+    snprintf(names[i], sizeof(names[i]), "fig%d", i);
+    strs[i + 1] = names[i];
+  }
+  struct Stream stream = { strs, 64, 0 };
+  TEST_CHECK(compl_set_provider(comp, stream_next, &stream, 2) == 1);
+
+  compl_type(comp, BUF("a"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apple")));
+  buf_free(&result);
+
+  // cycling past the last match pulls the rest, and returns to the typed string
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("a")));
+  buf_free(&result);
+  TEST_CHECK(stream.pos == 64);
+  TEST_CHECK(comp->provider == NULL);
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apple")));
+  buf_free(&result);
+
+  // the same for a search scored in slices
+  stream.pos = 0;
+  compl_free(&comp);
+  comp = compl_new(COMPL_MODE_EXACT);
+  compl_set_provider(comp, stream_next, &stream, 2);
+  compl_type(comp, BUF("fig"));
+  TEST_CHECK(compl_score_step(comp, 0, 0, NULL) == 0);
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("fig0")));
+  buf_free(&result);
+  compl_type(comp, BUF("x"));
+  TEST_CHECK(compl_score_step(comp, 0, 0, NULL) == 0);
+  TEST_CHECK(stream.pos == 64);
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("x")));
+  buf_free(&result);
+
+  compl_free(&comp);
+}
+
+void stream_indexed(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  printf("\n");
+
+  // the trigram index of the first chunks doesn't know the items pulled later
+  static char names[1200][16];
+  const char *strs[1200];
+  for (int i = 0; i < 1200; i++)
+  {
+    snprintf(names[i], sizeof(names[i]), "%s%d", (i < 1100) ? "apple" : "ïtem", i);
+    strs[i] = names[i];
+  }
+
+  struct Stream stream = { strs, 1200, 0 };
+  Completion *comp = compl_new(COMPL_MODE_SUBSTRING);
+  Completion *ref = compl_new(COMPL_MODE_SUBSTRING);
+  compl_add_many(ref, strs, NULL, 1200);
+  compl_set_provider(comp, stream_next, &stream, 64);
+
+  // pulled until the list is indexed
+  compl_type(comp, BUF("apple1050"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apple1050")));
+  buf_free(&result);
+  TEST_CHECK(stream.pos == 1088);
+
+  // pulled until the non-ASCII items match
+  compl_type(comp, BUF("ïtem119"));
+  compl_type(ref, BUF("ïtem119"));
+  result = compl_complete(comp);
+  struct Buffer *expected = compl_complete(ref);
+  TEST_CHECK(STR_EQ(result, expected));
+  buf_free(&result);
+  buf_free(&expected);
+  TEST_CHECK(stream.pos == 1200);
+
+  compl_free(&ref);
+  compl_free(&comp);
+}
+
+void stream_indexed_fuzzy(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  printf("\n");
+
+  // the BK-tree and the trie of the first chunks don't know the items pulled later
+  static char names[600][16];
+  const char *strs[600];
+  for (int i = 0; i < 600; i++)
+  {
+    snprintf(names[i], sizeof(names[i]), "%s%d", (i < 590) ? "apple" : "ïtem", i);
+    strs[i] = names[i];
+  }
+
+  for (int trie = 0; trie < 2; trie++)
+  {
+    struct Stream stream = { strs, 600, 0 };
+    Completion *comp = compl_new(COMPL_MODE_FUZZY);
+    Completion *ref = compl_new(COMPL_MODE_FUZZY);
+    compl_add_many(ref, strs, NULL, 600);
+    compl_set_provider(comp, stream_next, &stream, 16);
+    compl_set_max_dist(comp, 1);
+    compl_set_max_dist(ref, 1);
+    compl_set_trie(comp, trie);
+
+    // pulled until the non-ASCII items match
+    compl_type(comp, BUF("ïtem59"));
+    compl_type(ref, BUF("ïtem59"));
+    struct Buffer *result = compl_complete(comp);
+    struct Buffer *expected = compl_complete(ref);
+    TEST_CHECK(STR_EQ(result, expected));
+    buf_free(&result);
+    buf_free(&expected);
+    TEST_CHECK(stream.pos == 592);
+    compl_free(&ref);
+    compl_free(&comp);
+  }
+}
+
+/**
+ * cycle through the matches, and check they're the same as those of a list searched in one go
+ */
+static void check_same_matches(Completion *comp, Completion *ref)
+{
+  const CompletionSpan *spans = NULL;
+  const CompletionSpan *ref_spans = NULL;
+  for (int i = 0; i < 50; i++)
+  {
+    struct Buffer *result = compl_complete(comp);
+    struct Buffer *expected = compl_complete(ref);
+    TEST_CHECK(STR_EQ(result, expected));
+    TEST_MSG("match %d: %s vs %s", i, buf_string(result), buf_string(expected));
+    TEST_CHECK(compl_get_spans(comp, &spans) == compl_get_spans(ref, &ref_spans));
+    buf_free(&result);
+    buf_free(&expected);
+    if (comp->cur_item->id == 0)
+      break;
+  }
+}
+
+void score_step(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  printf("\n");
+  static const char *words[] = { "inbox", "lists", "neomutt", "devel", "archive", "sent" };
+  Completion *comp = compl_new(COMPL_MODE_FUZZY);
+  Completion *ref = compl_new(COMPL_MODE_FUZZY);
+  compl_set_highlight(comp, 3);
+  compl_set_highlight(ref, 3);
+  for (int i = 0; i < 1000; i++)
+  {
+    char item[64];
+    snprintf(item, sizeof(item), "%s/%s-%d", words[i % 6], words[(i / 6) % 6], i);
+    compl_add(comp, BUF(item));
+    compl_add(ref, BUF(item));
+  }
+
+  // nothing typed, nothing to score
+  size_t n_matches = 1;
+  TEST_CHECK(compl_score_step(comp, 100, 0, &n_matches) == 0);
+  TEST_CHECK(n_matches == 0);
+
+  // every call scores a slice, the matches so far are ranked at the front
+  compl_type(comp, BUF("neomutt/devel-1"));
+  compl_type(ref, BUF("neomutt/devel-1"));
+  int left = 1000;
+  int calls = 0;
+  while (left > 0)
+  {
+    int next = compl_score_step(comp, 100, 0, &n_matches);
+    TEST_CHECK(next == MAX(left - 100, 0));
+    left = next;
+    calls++;
+
+    TEST_CHECK(comp->state == (left ? COMPL_STATE_SCORING : COMPL_STATE_MULTI));
+    TEST_CHECK(n_matches > 0);
+    for (size_t i = 1; i <= n_matches; i++)
+    {
+      CompletionItem *item = ARRAY_GET(comp->items, i);
+      TEST_CHECK(item->is_match);
+      TEST_CHECK((i == 1) || (ARRAY_GET(comp->items, i - 1)->match_dist <= item->match_dist));
+    }
+  }
+  TEST_CHECK(calls == 10);
+  TEST_CHECK(comp->scan == NULL);
+  check_same_matches(comp, ref);
+
+  // typing drops the search, the next call starts over
+  compl_type(comp, BUF("archiv"));
+  compl_type(ref, BUF("archiv"));
+  TEST_CHECK(compl_score_step(comp, 300, 0, NULL) == 700);
+  compl_type(comp, BUF("sent/inbx"));
+  TEST_CHECK(comp->scan == NULL);
+  TEST_CHECK(comp->state == COMPL_STATE_INIT);
+  compl_type(ref, BUF("sent/inbx"));
+  TEST_CHECK(compl_score_step(comp, 300, 0, NULL) == 700);
+
+  // a passed deadline still scores a batch, completing finishes the search
+  TEST_CHECK(compl_score_step(comp, 0, 1, NULL) == 700 - COMPL_BATCH_SIZE);
+  check_same_matches(comp, ref);
+  TEST_CHECK(compl_score_step(comp, 0, compl_now_us() + 1000000, &n_matches) == 0);
+  TEST_CHECK(n_matches > 0);
+
+  // other flags start over
+  compl_type(comp, BUF("INBOX"));
+  compl_type(ref, BUF("INBOX"));
+  TEST_CHECK(compl_score_step(comp, 500, 0, NULL) == 500);
+  comp->flags = COMPL_MATCH_IGNORECASE;
+  ref->flags = COMPL_MATCH_IGNORECASE;
+  TEST_CHECK(compl_score_step(comp, 500, 0, NULL) == 500);
+  TEST_CHECK(compl_score_step(comp, 0, 0, NULL) == 0);
+  check_same_matches(comp, ref);
+  compl_free(&ref);
+  compl_free(&comp);
+
+  // a streamed list pulls more items while none of them match
+  comp = compl_new(COMPL_MODE_EXACT);
+  const char *strs[] = { "banana", "cherry", "apple",  "date",
+                         "fig",    "apricot", "grape", "avocado" };
+  struct Stream stream = { strs, 8, 0 };
+  compl_set_provider(comp, stream_next, &stream, 2);
+  compl_type(comp, BUF("ap"));
+  TEST_CHECK(compl_score_step(comp, 1, 0, &n_matches) == 1);
+  TEST_CHECK(n_matches == 0);
+  TEST_CHECK(compl_score_step(comp, 0, 0, &n_matches) == 0);
+  TEST_CHECK(n_matches == 1);
+  TEST_CHECK(stream.pos == 4);
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apple")));
+  buf_free(&result);
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, BUF("apricot")));
+  buf_free(&result);
+
+  compl_free(&comp);
 }
 
 TEST_LIST = {
@@ -267,5 +810,15 @@ TEST_LIST = {
   { "statemachine single match with utf8 result", state_single_utf8 },
   { "statemachine multi match", state_multi },
   { "statemachine add duplicate", duplicate_add },
+  { "statemachine highlight top matches", highlight_top },
+  { "statemachine highlight limits", highlight_limits },
+  { "statemachine remove items", remove_items },
+  { "statemachine apply delta", apply_delta },
+  { "statemachine add many", add_many },
+  { "statemachine stream items", stream_items },
+  { "statemachine stream without matches", stream_no_match },
+  { "statemachine stream indexed list", stream_indexed },
+  { "statemachine stream fuzzy indexes", stream_indexed_fuzzy },
+  { "statemachine score in slices", score_step },
   { NULL, NULL },
 };
@@ -132,8 +132,191 @@ void test_exact(void)
   TEST_CHECK(match_dist(BUF("世界"), comp) == 1);
 }
 
+void test_anchor(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_SUBSTRING);
+
+  // anywhere in the string, matches closer to the start are better
+  comp->typed_item->buf = BUF("box");
+  TEST_CHECK(match_dist(BUF("box"), comp) == 0);
+  TEST_CHECK(match_dist(BUF("boxes"), comp) == 2);
+  TEST_CHECK(match_dist(BUF("inbox"), comp) == 4);
+  TEST_CHECK(match_dist(BUF("in-box"), comp) == 6);
+  TEST_CHECK(match_dist(BUF("bo"), comp) == -1);
+  TEST_CHECK(match_dist(BUF("INBOX"), comp) == -1);
+  TEST_CHECK(match_dist(BUF(""), comp) == -1);
+
+  comp->typed_item->buf = BUF("äp");
+  TEST_CHECK(match_dist(BUF("Der Äpfel"), comp) == -1);
+  comp->flags = COMPL_MATCH_IGNORECASE;
+  TEST_CHECK(match_dist(BUF("Der Äpfel"), comp) == 11);
+  comp->typed_item->buf = BUF("BOX");
+  TEST_CHECK(match_dist(BUF("inbox"), comp) == 4);
+
+  // at the end of the string only
+  comp->mode = COMPL_MODE_SUFFIX;
+  comp->flags = COMPL_MATCH_NOFLAGS;
+  comp->typed_item->buf = BUF("box");
+  TEST_CHECK(match_dist(BUF("inbox"), comp) == 2);
+  TEST_CHECK(match_dist(BUF("boxes"), comp) == -1);
+  TEST_CHECK(match_dist(BUF("box"), comp) == 0);
+  TEST_CHECK(match_dist(BUF("INBOX"), comp) == -1);
+  comp->flags = COMPL_MATCH_IGNORECASE;
+  TEST_CHECK(match_dist(BUF("INBOX"), comp) == 2);
+  comp->typed_item->buf = BUF("Öl");
+  TEST_CHECK(match_dist(BUF("Sonnenöl"), comp) == 6);
+
+  compl_free(&comp);
+}
+
+void test_anchor_index(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_SUBSTRING);
+  char str[32];
+
+  // enough items to build the trigram index
+  for (int i = 0; i < COMPL_NGRAM_THRESHOLD + 100; i++)
+  {
+    snprintf(str, sizeof(str), "list%d/inbox", i);
+    compl_add(comp, BUF(str));
+  }
+  compl_add(comp, BUF("Lists/neomutt-devel"));
+  compl_add(comp, BUF("Lists/mutt-users"));
+  TEST_CHECK(comp->ngrams != NULL);
+
+  struct NgramIdList ids = ARRAY_HEAD_INITIALIZER;
+  TEST_CHECK(ngram_query(comp->ngrams, "mutt", &ids) == 2);
+  TEST_CHECK(ngram_query(comp->ngrams, "MUTT", &ids) == 2);
+  TEST_CHECK(ngram_query(comp->ngrams, "neomutt", &ids) == 1);
+  TEST_CHECK(ngram_query(comp->ngrams, "nomatch", &ids) == 0);
+  TEST_CHECK(ngram_query(comp->ngrams, "mu", &ids) == -1);
+  // candidates may contain all trigrams without containing the string
+  TEST_CHECK(ngram_query(comp->ngrams, "t99/", &ids) == 2);
+  ARRAY_FREE(&ids);
+
+  // the candidates are verified by the matching kernel
+  compl_type(comp, BUF("mutt-"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(strcmp(buf_string(result), "Lists/mutt-users") == 0);
+  result = compl_complete(comp);
+  TEST_CHECK(strcmp(buf_string(result), "Lists/neomutt-devel") == 0);
+  result = compl_complete(comp);
+  TEST_CHECK(strcmp(buf_string(result), "mutt-") == 0);
+
+  comp->mode = COMPL_MODE_SUFFIX;
+  compl_type(comp, BUF("99/inbox"));
+  result = compl_complete(comp);
+  TEST_CHECK(strcmp(buf_string(result), "list99/inbox") == 0);
+
+  // items added later are indexed as well
+  compl_add(comp, BUF("Lists/mutt-dev"));
+  TEST_CHECK(ngram_query(comp->ngrams, "mutt", &ids) == 3);
+  ARRAY_FREE(&ids);
+
+  compl_free(&comp);
+}
+
+void test_magic(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+  comp->flags = COMPL_MATCH_MAGIC;
+
+  // dash and underscore are equal, case is ignored
+  comp->typed_item->buf = BUF("send-ch");
+  TEST_CHECK(match_dist(BUF("send_charset"), comp) == 5);
+  TEST_CHECK(match_dist(BUF("SEND-CHARSET"), comp) == 5);
+  TEST_CHECK(match_dist(BUF("sendcharset"), comp) == -1);
+  comp->typed_item->buf = BUF("Über_");
+  TEST_CHECK(match_dist(BUF("über-all"), comp) == 3);
+
+  // without the flag, they are different
+  comp->flags = COMPL_MATCH_NOFLAGS;
+  comp->typed_item->buf = BUF("send-ch");
+  TEST_CHECK(match_dist(BUF("send_charset"), comp) == -1);
+
+  // the other modes use the normalised strings as well
+  comp->flags = COMPL_MATCH_MAGIC;
+  comp->mode = COMPL_MODE_FUZZY;
+  comp->typed_item->buf = BUF("sent_charset");
+  TEST_CHECK(match_dist(BUF("Send-Charset"), comp) == 1);
+  comp->mode = COMPL_MODE_SUBSTRING;
+  comp->typed_item->buf = BUF("_CH");
+  TEST_CHECK(match_dist(BUF("send-charset"), comp) == 13);
+
+  // the normalised forms are only stored when they differ
+  comp->mode = COMPL_MODE_EXACT;
+  compl_add(comp, BUF("send_charset"));
+  compl_add(comp, BUF("sendmail"));
+  compl_add(comp, BUF("Send-Wait"));
+  TEST_CHECK(ARRAY_GET(comp->items, 1)->norm_off == 0);
+  TEST_CHECK(ARRAY_GET(comp->items, 2)->norm_off == COMPL_NORM_SAME);
+  TEST_CHECK(ARRAY_GET(comp->items, 3)->norm_off == strlen("send-charset") + 1);
+
+  compl_type(comp, BUF("SEND-"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(strcmp(buf_string(result), "Send-Wait") == 0);
+  result = compl_complete(comp);
+  TEST_CHECK(strcmp(buf_string(result), "send_charset") == 0);
+  result = compl_complete(comp);
+  TEST_CHECK(strcmp(buf_string(result), "SEND-") == 0);
+
+  compl_free(&comp);
+}
+
+void test_casefold(void)
+{
+  // the tables don't depend on the locale
+  setlocale(LC_ALL, "C");
+  TEST_CHECK(compl_casefold(L'A') == L'a');
+  TEST_CHECK(compl_casefold(L'z') == L'z');
+  TEST_CHECK(compl_casefold(L'_') == L'_');
+  TEST_CHECK(compl_casefold(L'\u00C4') == L'\u00E4'); // Ä -> ä
+  TEST_CHECK(compl_casefold(L'\u00B5') == L'\u03BC'); // MICRO SIGN -> μ
+  TEST_CHECK(compl_casefold(L'\u03A3') == L'\u03C3'); // Σ -> σ
+  TEST_CHECK(compl_casefold(L'\u03C2') == L'\u03C3'); // ς -> σ
+  TEST_CHECK(compl_casefold(L'\u017F') == L's');      // LONG S
+  TEST_CHECK(compl_casefold(L'\u212A') == L'k');      // KELVIN SIGN
+  TEST_CHECK(compl_casefold(L'\u1E9E') == L'\u00DF'); // ẞ -> ß
+  TEST_CHECK(compl_casefold(L'\uAB70') == L'\u13A0'); // Cherokee folds to uppercase
+  TEST_CHECK(compl_casefold(L'\u0130') == L'\u0130'); // İ has no simple folding
+  TEST_CHECK(compl_casefold(0x10400) == 0x10428);     // Deseret
+  TEST_CHECK(compl_casefold(0x1E900) == 0x1E922);     // Adlam
+  TEST_CHECK(compl_casefold(0x1F600) == 0x1F600);
+  TEST_CHECK(compl_casefold(0x10FFFF) == 0x10FFFF);
+
+  // all kernels fold the same way
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+  comp->flags = COMPL_MATCH_IGNORECASE;
+  comp->typed_item->buf = BUF("ΟΔΥΣΣ");
+  TEST_CHECK(match_dist(BUF("οδυσσεύς"), comp) == 3);
+  comp->typed_item->buf = BUF("kiss");
+  TEST_CHECK(match_dist(BUF("\u212Ai\u017Fs"), comp) == 0);
+
+  comp->mode = COMPL_MODE_SUBSTRING;
+  comp->typed_item->buf = BUF("σ");
+  TEST_CHECK(match_dist(BUF("ΟΔΥΣΣΕΥΣ"), comp) == 10);
+  comp->mode = COMPL_MODE_SUBSEQ;
+  comp->typed_item->buf = BUF("ks");
+  TEST_CHECK(match_dist(BUF("\u212Aiss"), comp) >= 0);
+
+  comp->flags = COMPL_MATCH_MAGIC;
+  comp->mode = COMPL_MODE_EXACT;
+  comp->typed_item->buf = BUF("µ_");
+  TEST_CHECK(match_dist(BUF("Μ-ALL"), comp) == 3);
+
+  compl_free(&comp);
+}
+
 TEST_LIST = {
   { "match", test_match },
   { "exact", test_exact },
+  { "anchor", test_anchor },
+  { "anchor index", test_anchor_index },
+  { "magic", test_magic },
+  { "casefold", test_casefold },
   { NULL, NULL },
 };
@@ -164,10 +164,45 @@ void test_damerau_levenshtein(void)
   TEST_CHECK(dist_lev("Äpfel", "ÄÄpfel") == 1);
 }
 
+void test_long_items(void)
+{
+  // the matrix of a long item doesn't fit on the stack
+  const size_t len = 300000;
+  char *item = mutt_mem_calloc(len + 1, sizeof(char));
+  memset(item, 'x', len);
+  memcpy(item + len - 7, "neomutt", 7);
+
+  Completion *comp = compl_new(COMPL_MODE_FUZZY);
+  compl_add(comp, BUF(item));
+  compl_add(comp, BUF("neomutt"));
+  TEST_CHECK(comp->max_len == len);
+
+  compl_type(comp, BUF("neomtut"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(strcmp(buf_string(result), "neomutt") == 0);
+
+  // the scratch memory is sized once for the longest item
+  size_t size = comp->scratch->size;
+  TEST_CHECK(size >= score_fuzzy_scratch(7, len));
+  compl_type(comp, BUF("neomuto"));
+  compl_complete(comp);
+  TEST_CHECK(comp->scratch->size == size);
+
+  comp->mode = COMPL_MODE_SUBSEQ;
+  compl_type(comp, BUF("nmtt"));
+  result = compl_complete(comp);
+  TEST_CHECK(strcmp(buf_string(result), "neomutt") == 0);
+  TEST_CHECK(comp->scratch->size >= score_subseq_scratch(4, len));
+
+  compl_free(&comp);
+  FREE(&item);
+}
+
 TEST_LIST = {
   { "mbs_char_count", test_mbs_char_count },
   { "mb_equal", test_mb_equal },
   { "levenshtein", test_levenshtein },
   { "damerau levenshtein", test_damerau_levenshtein },
+  { "long items", test_long_items },
   { NULL, NULL },
 };
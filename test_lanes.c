@@ -0,0 +1,163 @@
+/**
+ * @file
+ * Autocompletion API Test: fuzzy scoring of many items at once
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include <stdio.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+
+#define BUF(s1) buf_new(s1)
+
+#define N_ITEMS 600
+
+/**
+ * random ASCII string over a few characters, so that many of them are close
+ */
+static void random_str(unsigned int *seed, char *str, int max_len)
+{
+  *seed = *seed * 1103515245 + 12345;
+  int len = (*seed >> 16) % (max_len + 1);
+  for (int i = 0; i < len; i++)
+  {
+    *seed = *seed * 1103515245 + 12345;
+    str[i] = "abcd-"[(*seed >> 16) % 5];
+  }
+  str[len] = '\0';
+}
+
+void test_lanes_score(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *ref = compl_new(COMPL_MODE_FUZZY);
+
+  // some items and typed strings are too long for the lanes
+  unsigned int seed = 42;
+  static char items[N_ITEMS][COMPL_LANES_MAX_LEN + 20];
+  const char *tars[N_ITEMS];
+  for (int i = 0; i < N_ITEMS; i++)
+  {
+    random_str(&seed, items[i], (i % 7) ? 12 : COMPL_LANES_MAX_LEN + 16);
+    tars[i] = items[i];
+  }
+
+  // every width gives the distances of the scalar kernel
+  static const int widths[] = { 1, 8, 16, 0 };
+  int dists[N_ITEMS];
+  for (int q = 0; q < 30; q++)
+  {
+    char typed[COMPL_LANES_MAX_LEN + 20];
+    random_str(&seed, typed, (q % 10) ? 10 : COMPL_LANES_MAX_LEN + 16);
+    buf_free(&ref->typed_item->buf);
+    ref->typed_item->buf = BUF(typed);
+    CompletionQuery *query = compl_query_new(typed, COMPL_MATCH_NOFLAGS, true);
+
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+    {
+      if ((widths[w] > 1) && (fuzzy_lanes_width(widths[w]) != widths[w]))
+        continue;
+
+      memset(dists, 0xff, sizeof(dists));
+      fuzzy_lanes_score(query, tars, N_ITEMS, dists, widths[w]);
+      for (int i = 0; i < N_ITEMS; i++)
+      {
+        int want = dist_dam_lev(items[i], ref);
+        if (!TEST_CHECK(dists[i] == want))
+        {
+          TEST_MSG("width %d, typed %s, item %s: %d vs %d", widths[w], typed,
+                   items[i], dists[i], want);
+          break;
+        }
+      }
+    }
+    compl_query_free(&query);
+  }
+
+  compl_free(&ref);
+}
+
+void test_lanes_width(void)
+{
+  // the widest set is picked, and an unknown width falls back to one by one
+  int width = fuzzy_lanes_width(0);
+  TEST_CHECK((width == 1) || (width == 8) || (width == 16));
+  TEST_CHECK(fuzzy_lanes_width(1) == 1);
+  TEST_CHECK(fuzzy_lanes_width(3) == 1);
+  if (width == 16)
+    TEST_CHECK(fuzzy_lanes_width(8) == 8);
+  TEST_MSG("widest %d", width);
+
+  // only ASCII searches use the lanes
+  CompletionQuery *q = compl_query_new("neomutt", COMPL_MATCH_NOFLAGS, true);
+  score_fuzzy_select(q);
+  TEST_CHECK(q->batch == fuzzy_lanes_batch);
+  compl_query_free(&q);
+
+  q = compl_query_new("neomutt", COMPL_MATCH_NOFLAGS, false);
+  score_fuzzy_select(q);
+  TEST_CHECK(q->batch != fuzzy_lanes_batch);
+  compl_query_free(&q);
+}
+
+void test_lanes_engine(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  static const char *items[] = { "alias", "alternates", "alternative_order", "bind",
+                                 "folder-hook", "folder_hook", "mailboxes", "macro",
+                                 "named-mailboxes", "unmailboxes", "a", "" };
+  static const char *typed[] = { "mailbxoes", "folder-hokk", "al", "xyz", "a" };
+  for (int magic = 0; magic <= 1; magic++)
+  {
+    Completion *comp = compl_new(COMPL_MODE_FUZZY);
+    comp->flags = magic ? COMPL_MATCH_MAGIC : COMPL_MATCH_NOFLAGS;
+    for (size_t i = 0; i < sizeof(items) / sizeof(items[0]); i++)
+      compl_add(comp, BUF(items[i]));
+
+    // a search scores the items in lanes, with the distances of the matcher
+    for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+    {
+      compl_type(comp, BUF(typed[q]));
+      compl_complete(comp);
+      CompletionItem *item = NULL;
+      ARRAY_FOREACH_FROM(item, comp->items, 1)
+      {
+        struct Buffer *tar = BUF(item->str);
+        int want = match_dist(tar, comp);
+        buf_free(&tar);
+        TEST_CHECK(item->match_dist == want);
+        TEST_MSG("magic %d, typed %s, item %s: %d vs %d", magic, typed[q],
+                 item->str, item->match_dist, want);
+      }
+    }
+    compl_free(&comp);
+  }
+}
+
+TEST_LIST = {
+  { "lanes score", test_lanes_score },
+  { "lanes width", test_lanes_width },
+  { "lanes engine", test_lanes_engine },
+  { NULL, NULL },
+};
@@ -21,6 +21,7 @@
  */
 
 #include "acutest.h"
+#include <locale.h>
 #include "lib.h"
 #include "private.h"
 
@@ -49,7 +50,182 @@ void test_match_simple()
   TEST_CHECK(match_dist(tar, comp) == 0);
 }
 
+#define SPAN_EQ(span, s, l) ((span)->start == (s) && (span)->len == (l))
+
+void test_match_spans()
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+  struct CompletionSpanList spans = ARRAY_HEAD_INITIALIZER;
+
+  // exact: the typed prefix, counted in characters
+  comp->typed_item->buf = BUF("äp");
+  TEST_CHECK(match_spans(BUF("äpfel"), comp, &spans) == 3);
+  TEST_CHECK(ARRAY_SIZE(&spans) == 1);
+  TEST_CHECK(SPAN_EQ(ARRAY_GET(&spans, 0), 0, 2));
+
+  // no spans for a non-match
+  ARRAY_SHRINK(&spans, ARRAY_SIZE(&spans));
+  TEST_CHECK(match_spans(BUF("apfel"), comp, &spans) == -1);
+  TEST_CHECK(ARRAY_EMPTY(&spans));
+
+  // fuzzy: the characters kept by the edit sequence
+  comp->mode = COMPL_MODE_FUZZY;
+  comp->typed_item->buf = BUF("hello");
+  TEST_CHECK(match_spans(BUF("hxllo"), comp, &spans) == 1);
+  TEST_CHECK(ARRAY_SIZE(&spans) == 2);
+  TEST_CHECK(SPAN_EQ(ARRAY_GET(&spans, 0), 0, 1));
+  TEST_CHECK(SPAN_EQ(ARRAY_GET(&spans, 1), 2, 3));
+
+  // transposed characters are still highlighted
+  ARRAY_SHRINK(&spans, ARRAY_SIZE(&spans));
+  comp->typed_item->buf = BUF("xpäfel");
+  TEST_CHECK(match_spans(BUF("xäpfel"), comp, &spans) == 1);
+  TEST_CHECK(ARRAY_SIZE(&spans) == 1);
+  TEST_CHECK(SPAN_EQ(ARRAY_GET(&spans, 0), 0, 6));
+
+  // regex: the matched part of the string
+  ARRAY_SHRINK(&spans, ARRAY_SIZE(&spans));
+  comp->mode = COMPL_MODE_REGEX;
+  comp->typed_item->buf = BUF("p+l");
+  compl_compile_regex(comp);
+  TEST_CHECK(match_spans(BUF("äpple"), comp, &spans) >= 0);
+  TEST_CHECK(ARRAY_SIZE(&spans) == 1);
+  TEST_CHECK(SPAN_EQ(ARRAY_GET(&spans, 0), 1, 3));
+
+  ARRAY_FREE(&spans);
+  compl_free(&comp);
+}
+
+void test_match_variants()
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  const char *typed[] = { "app", "APP", "a", "" };
+  const char *tars[] = { "apple", "APPLE", "ap", "xapple", "pale", "" };
+  const size_t n_tars = sizeof(tars) / sizeof(tars[0]);
+  const MuttMatchFlags flags[] = { COMPL_MATCH_NOFLAGS, COMPL_MATCH_IGNORECASE };
+  int dists[n_tars];
+
+  // the specialised ASCII variants agree with the generic kernels
+  for (size_t t = 0; t < sizeof(typed) / sizeof(typed[0]); t++)
+  {
+    for (size_t f = 0; f < 2; f++)
+    {
+      CompletionQuery *generic = compl_query_new(typed[t], flags[f], false);
+      CompletionQuery *ascii = compl_query_new(typed[t], flags[f], true);
+      TEST_CHECK(!generic->ascii && ascii->ascii);
+
+      score_exact_select(ascii);
+      ascii->batch(ascii, tars, n_tars, dists);
+      for (size_t i = 0; i < n_tars; i++)
+      {
+        TEST_CHECK(dists[i] == score_exact(generic, tars[i], NULL));
+        TEST_MSG("exact '%s' '%s' flags %d", typed[t], tars[i], flags[f]);
+      }
+
+      score_fuzzy_select(ascii);
+      ascii->batch(ascii, tars, n_tars, dists);
+      for (size_t i = 0; i < n_tars; i++)
+      {
+        TEST_CHECK(dists[i] == score_fuzzy(generic, tars[i], NULL));
+        TEST_MSG("fuzzy '%s' '%s' flags %d", typed[t], tars[i], flags[f]);
+      }
+
+      compl_query_free(&generic);
+      compl_query_free(&ascii);
+    }
+  }
+
+  // a multibyte typed string never uses the ASCII variants
+  CompletionQuery *q = compl_query_new("äp", COMPL_MATCH_NOFLAGS, true);
+  TEST_CHECK(!q->ascii);
+  compl_query_free(&q);
+
+  // the Completion keeps track of its items
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+  compl_add(comp, BUF("apple"));
+  TEST_CHECK(comp->ascii);
+  compl_add(comp, BUF("äpfel"));
+  TEST_CHECK(!comp->ascii);
+
+  // the hint only reaches the built-in exact and fuzzy kernels, through the search
+  compl_type(comp, BUF("app"));
+  CompletionSearch search = { 0 };
+  TEST_CHECK(compl_search_init(&search, comp, COMPL_MODE_FUZZY, COMPL_MATCH_NOFLAGS, true));
+  TEST_CHECK(((CompletionQuery *) search.query)->ascii);
+  compl_search_free(&search);
+  TEST_CHECK(compl_search_init(&search, comp, COMPL_MODE_EXACT, COMPL_MATCH_NOFLAGS, false));
+  TEST_CHECK(!((CompletionQuery *) search.query)->ascii);
+  compl_search_free(&search);
+  compl_free(&comp);
+}
+
+// custom matcher: targets at least as long as the typed string, the shortest first
+static int PrepareCount = 0;
+
+static void *len_prepare(const Completion *comp, const char *typed, MuttMatchFlags flags)
+{
+  (void) comp;
+  (void) flags;
+  PrepareCount++;
+  size_t *len = mutt_mem_malloc(sizeof(size_t));
+  *len = mutt_str_len(typed);
+  return len;
+}
+
+static int len_score(const void *query, const char *tar, struct CompletionSpanList *spans)
+{
+  (void) spans;
+  size_t len = *(const size_t *) query;
+  size_t len_tar = mutt_str_len(tar);
+  return (len_tar >= len) ? (int) (len_tar - len) : -1;
+}
+
+static void len_free(void **query)
+{
+  FREE(query);
+}
+
+void test_match_custom()
+{
+  static const CompletionMatcher matcher = {
+    "length", len_prepare, len_score, NULL, len_free,
+  };
+
+  // a matcher needs at least a score function
+  static const CompletionMatcher broken = { "broken", NULL, NULL, NULL, NULL };
+  TEST_CHECK(compl_register_matcher(NULL) == 0);
+  TEST_CHECK(compl_register_matcher(&broken) == 0);
+
+  enum MuttMatchMode mode = compl_register_matcher(&matcher);
+  TEST_CHECK(mode > COMPL_MODE_SUFFIX);
+
+  Completion *comp = compl_new(mode);
+  compl_add(comp, BUF("a"));
+  compl_add(comp, BUF("abcd"));
+  compl_add(comp, BUF("xyz"));
+  compl_add(comp, BUF("ab"));
+
+  // the typed string is prepared once for all items
+  compl_type(comp, BUF("abc"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(buf_str_equal(result, BUF("xyz")));
+  TEST_CHECK(PrepareCount == 1);
+  result = compl_complete(comp);
+  TEST_CHECK(buf_str_equal(result, BUF("abcd")));
+  result = compl_complete(comp);
+  TEST_CHECK(buf_str_equal(result, BUF("abc")));
+
+  // custom modes work for single strings as well
+  TEST_CHECK(match_dist(BUF("abcde"), comp) == 2);
+
+  compl_free(&comp);
+}
+
 TEST_LIST = {
   { "simple", test_match_simple },
+  { "spans", test_match_spans },
+  { "variants", test_match_variants },
+  { "custom matcher", test_match_custom },
   { NULL, NULL },
 };
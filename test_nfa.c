@@ -0,0 +1,269 @@
+/**
+ * @file
+ * Autocompletion API Test: regex automaton over the trie
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include <stdio.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+
+#define BUF(s1) buf_new(s1)
+
+static const char *Items[] = {
+  "INBOX", "INBOX/Lists", "INBOX/Lists/neomutt-devel", "INBOX/Lists/neomutt-users",
+  "INBOX/Lists/mutt-dev", "INBOX/Archive", "INBOX/Archive/2023", "Sent", "Drafts",
+  "Äpfel", "äpfelmus", "Straße", "ΟΔΥΣΣΕΥΣ", "a", "ab", "ba", "x]y", "a-b", "a.b",
+  "abrakadapple", "line\nbreak", "end\n", "\nstart", "aaa", "tab\there",
+};
+
+static const char *Patterns[] = {
+  "INBOX", "inbox", "^INBOX/L", "Lists/", "neo.*dev", "^.*pple$", "pple$",
+  "^a$", "a+b", "a?b", "(ab|ba)$", "^(a|b)+$", "[a-c]+", "[^a-z]", "[]x]",
+  "[x-]", "[[:digit:]]+", "[[:upper:]]{1}", "äpf", "ÄPF", "^Ä", "Σ+", "ς$",
+  "^break", "line$", "^$", "end$", "^start", "e.b", "a\\.b", "a.b", ".", "x|y",
+  "^(INBOX|Sent)$", "((a))*b", "a**", "(a*)+$", "^[[:alpha:]]+$", "t\\.b",
+  "[^[:alnum:]]", "$", "^",
+};
+
+/**
+ * does a pattern match a string, by regexec() with the flags of score_regex()?
+ */
+static bool posix_match(const char *pattern, MuttMatchFlags flags, const char *str)
+{
+  regex_t regex;
+  if (!compl_regcomp(&regex, pattern, flags))
+    return false;
+  bool match = (regexec(&regex, str, 0, NULL, REG_NOTBOL) == 0);
+  regfree(&regex);
+  return match;
+}
+
+void test_nfa_fixed(void)
+{
+  setlocale(LC_ALL, "C");
+
+  // decoding and case-folding don't depend on the locale, and like regexec()
+  // with REG_NOTBOL, '^' only holds after a newline
+  static const struct
+  {
+    const char *pattern;
+    MuttMatchFlags flags;
+    const char *str;
+    bool match;
+  } tests[] = {
+    { "INBOX", COMPL_MATCH_NOFLAGS, "INBOX/Lists", true },
+    { "inbox", COMPL_MATCH_NOFLAGS, "INBOX", false },
+    { "inbox", COMPL_MATCH_IGNORECASE, "INBOX/Archive", true },
+    { "^INBOX/L", COMPL_MATCH_NOFLAGS, "INBOX/Lists/mutt-dev", false },
+    { "neo.*dev", COMPL_MATCH_NOFLAGS, "INBOX/Lists/neomutt-users", false },
+    { "neo.*dev", COMPL_MATCH_NOFLAGS, "INBOX/Lists/neomutt-devel", true },
+    { "ÄPF", COMPL_MATCH_NOFLAGS, "äpfelmus", false },
+    { "ÄPF", COMPL_MATCH_IGNORECASE, "äpfelmus", true },
+    { "^Ä", COMPL_MATCH_NOFLAGS, "Äpfel", false },
+    { "Σ+", COMPL_MATCH_IGNORECASE, "ΟΔΥΣΣΕΥΣ", true },
+    { "ς$", COMPL_MATCH_IGNORECASE, "ΟΔΥΣΣΕΥΣ", true },
+    { "ς$", COMPL_MATCH_NOFLAGS, "ΟΔΥΣΣΕΥΣ", false },
+    { "a.b", COMPL_MATCH_NOFLAGS, "a-b", true },
+    { "a\\.b", COMPL_MATCH_NOFLAGS, "a-b", false },
+    { "^start", COMPL_MATCH_NOFLAGS, "\nstart", true },
+    { "[[:digit:]]+", COMPL_MATCH_NOFLAGS, "INBOX/Archive/2023", true },
+    { "[[:digit:]]+", COMPL_MATCH_NOFLAGS, "Sent", false },
+    { "(INBOX|Sent)$", COMPL_MATCH_NOFLAGS, "Sent", true },
+    { "^(INBOX|Sent)$", COMPL_MATCH_NOFLAGS, "INBOX/Lists", false },
+    { "(ab|ba)$", COMPL_MATCH_NOFLAGS, "abrakadapple", false },
+    { "[^a-z]", COMPL_MATCH_NOFLAGS, "aaa", false },
+    { "[^a-z]", COMPL_MATCH_NOFLAGS, "a-b", true },
+  };
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+  {
+    struct RegexNfa *nfa = nfa_compile(tests[i].pattern, tests[i].flags);
+    TEST_CHECK(nfa && (nfa_match(nfa, tests[i].str) == tests[i].match));
+    TEST_MSG("pattern %s, flags %d, item %s: want %d", tests[i].pattern,
+             tests[i].flags, tests[i].str, tests[i].match);
+    nfa_free(&nfa);
+  }
+
+  // everything else is left to regexec()
+  static const char *unsupported[] = { "a{2}", "(a)\\1", "\\w+", "\\t", "(ab", "ab)",
+                                       "a|", "|a", "()", "*a", "^*", "[[=a=]]",
+                                       "[[:nope:]]", "[a", "" };
+  for (size_t i = 0; i < sizeof(unsupported) / sizeof(unsupported[0]); i++)
+  {
+    struct RegexNfa *nfa = nfa_compile(unsupported[i], COMPL_MATCH_NOFLAGS);
+    TEST_CHECK(nfa == NULL);
+    TEST_MSG("pattern %s", unsupported[i]);
+    nfa_free(&nfa);
+  }
+}
+
+void test_nfa_match(void)
+{
+  // the results are compared with regexec(), which needs a UTF-8 locale
+  if (!setlocale(LC_ALL, "en_US.UTF-8"))
+    return;
+
+  // the same answer as regexec(), for every supported pattern
+  static const MuttMatchFlags flags[] = { COMPL_MATCH_NOFLAGS, COMPL_MATCH_IGNORECASE };
+  size_t n_compiled = 0;
+  for (size_t f = 0; f < 2; f++)
+  {
+    for (size_t p = 0; p < sizeof(Patterns) / sizeof(Patterns[0]); p++)
+    {
+      struct RegexNfa *nfa = nfa_compile(Patterns[p], flags[f]);
+      if (!nfa)
+        continue;
+
+      n_compiled++;
+      for (size_t i = 0; i < sizeof(Items) / sizeof(Items[0]); i++)
+      {
+        bool want = posix_match(Patterns[p], flags[f], Items[i]);
+        TEST_CHECK(nfa_match(nfa, Items[i]) == want);
+        TEST_MSG("pattern %s, flags %d, item %s: want %d", Patterns[p], flags[f], Items[i], want);
+      }
+      nfa_free(&nfa);
+      TEST_CHECK(nfa == NULL);
+    }
+  }
+  TEST_CHECK(n_compiled + 2 == 2 * sizeof(Patterns) / sizeof(Patterns[0]));
+}
+
+void test_nfa_trie(void)
+{
+  // the results are compared with regexec(), which needs a UTF-8 locale
+  const bool utf8 = setlocale(LC_ALL, "en_US.UTF-8");
+
+  const size_t num = sizeof(Items) / sizeof(Items[0]);
+  struct Trie *t = trie_new(false);
+  for (size_t i = 0; i < num; i++)
+    trie_add(t, i + 1, Items[i]);
+
+  // the items matching on the trie are those matching one by one
+  for (size_t p = 0; utf8 && (p < sizeof(Patterns) / sizeof(Patterns[0])); p++)
+  {
+    struct RegexNfa *nfa = nfa_compile(Patterns[p], COMPL_MATCH_IGNORECASE);
+    if (!nfa)
+      continue;
+
+    uint8_t matched[64] = { 0 };
+    trie_regex(t, nfa, matched);
+    for (size_t i = 0; i < num; i++)
+    {
+      TEST_CHECK(matched[i + 1] == posix_match(Patterns[p], COMPL_MATCH_IGNORECASE, Items[i]));
+      TEST_MSG("pattern %s, item %s", Patterns[p], Items[i]);
+    }
+    nfa_free(&nfa);
+  }
+
+  // without a newline, a line anchor never holds, and nothing is walked
+  struct Trie *lines = trie_new(false);
+  for (size_t i = 0; i < 9; i++)
+    trie_add(lines, i + 1, Items[i]);
+  struct RegexNfa *nfa = nfa_compile("^INBOX", COMPL_MATCH_NOFLAGS);
+  uint8_t matched[64] = { 0 };
+  TEST_CHECK(trie_regex(lines, nfa, matched) == 3);
+  TEST_CHECK(!matched[1] && !matched[2]);
+  nfa_free(&nfa);
+  trie_free(&lines);
+
+  // with one, it may hold below any node
+  nfa = nfa_compile("^start", COMPL_MATCH_NOFLAGS);
+  trie_regex(t, nfa, matched);
+  TEST_CHECK(matched[23] && !matched[21] && !matched[1]);
+  nfa_free(&nfa);
+
+  // and a matching prefix needs no steps below it
+  nfa = nfa_compile("IN", COMPL_MATCH_NOFLAGS);
+  memset(matched, 0, sizeof(matched));
+  size_t steps_prefix = trie_regex(t, nfa, matched);
+  TEST_CHECK(matched[1] && matched[7] && !matched[8]);
+  nfa_free(&nfa);
+  nfa = nfa_compile("INX", COMPL_MATCH_NOFLAGS);
+  TEST_CHECK(trie_regex(t, nfa, matched) > steps_prefix + 40);
+  nfa_free(&nfa);
+
+  trie_free(&t);
+}
+
+void test_nfa_engine(void)
+{
+  // the results are compared with regexec(), which needs a UTF-8 locale
+  if (!setlocale(LC_ALL, "en_US.UTF-8"))
+    return;
+
+  static const char *typed[] = { "^INBOX/L", "neo.*dev", "^(a|b)+$", "a{2}", "[[:digit:]]",
+                                 "Lists", "ÄPF", "zzz" };
+  for (int icase = 0; icase <= 1; icase++)
+  {
+    Completion *scan = compl_new(COMPL_MODE_REGEX);
+    Completion *comp = compl_new(COMPL_MODE_REGEX);
+    scan->flags = icase ? COMPL_MATCH_IGNORECASE : COMPL_MATCH_NOFLAGS;
+    comp->flags = scan->flags | COMPL_MATCH_MAGIC;
+    for (size_t i = 0; i < sizeof(Items) / sizeof(Items[0]); i++)
+    {
+      compl_add(scan, BUF(Items[i]));
+      compl_add(comp, BUF(Items[i]));
+    }
+    TEST_CHECK(compl_set_trie(comp, true));
+
+    // the same distances, and the same completions, as with regexec()
+    for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+    {
+      compl_type(scan, BUF(typed[q]));
+      compl_type(comp, BUF(typed[q]));
+      struct Buffer *want = compl_complete(scan);
+      struct Buffer *got = compl_complete(comp);
+      TEST_CHECK(mutt_str_equal(buf_string(got), buf_string(want)));
+      TEST_MSG("icase %d, typed %s: %s vs %s", icase, typed[q], buf_string(got),
+               buf_string(want));
+
+      for (size_t i = 1; i < ARRAY_SIZE(comp->items); i++)
+      {
+        CompletionItem *a = ARRAY_GET(comp->items, i);
+        CompletionItem *b = NULL;
+        ARRAY_FOREACH_FROM(b, scan->items, 1)
+        {
+          if (b->id == a->id)
+            break;
+        }
+        TEST_CHECK(b && (a->match_dist == b->match_dist));
+        TEST_MSG("icase %d, typed %s, item %s: %d vs %d", icase, typed[q], a->str,
+                 a->match_dist, b ? b->match_dist : -2);
+      }
+    }
+
+    // the trie holds the items themselves, not their normalised forms
+    TEST_CHECK(!trie_magic(comp->trie));
+    compl_free(&scan);
+    compl_free(&comp);
+  }
+}
+
+TEST_LIST = {
+  { "nfa fixed", test_nfa_fixed },
+  { "nfa match", test_nfa_match },
+  { "nfa trie", test_nfa_trie },
+  { "nfa engine", test_nfa_engine },
+  { NULL, NULL },
+};
@@ -0,0 +1,187 @@
+/**
+ * @file
+ * Autocompletion API Test: path completion
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+
+#define STR_EQ(b, s) (strcmp(buf_string(b), s) == 0)
+
+static char TestDir[64];
+
+static void touch(const char *name)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s", TestDir, name);
+  FILE *fp = fopen(path, "w");
+  if (fp)
+    fclose(fp);
+}
+
+static void make_dir(const char *name)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s", TestDir, name);
+  mkdir(path, 0700);
+}
+
+static void remove_entry(const char *name)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s", TestDir, name);
+  remove(path);
+}
+
+// directories modified in the past can be cached
+static void set_mtime(const char *name, time_t mtime)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s", TestDir, name);
+  struct utimbuf times = { mtime, mtime };
+  utime(path, &times);
+}
+
+static void setup(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  snprintf(TestDir, sizeof(TestDir), "/tmp/test_path.%d", (int) getpid());
+  mkdir(TestDir, 0700);
+  make_dir("inbox");
+  make_dir("inbox/cur");
+  make_dir("archive");
+  touch("invoices");
+  touch(".inboxrc");
+  set_mtime("", 1000000000);
+}
+
+static void teardown(void)
+{
+  remove_entry("inbox/cur");
+  remove_entry("inbox");
+  remove_entry("archive");
+  remove_entry("invoices");
+  remove_entry("index");
+  remove_entry(".inboxrc");
+  remove(TestDir);
+}
+
+/**
+ * complete - complete a path relative to the test directory
+ */
+static bool complete(CompletionPath *cp, const char *typed, const char *expected)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s", TestDir, typed);
+  struct Buffer *buf = buf_new(path);
+  struct Buffer *result = compl_path_complete(cp, buf);
+
+  snprintf(path, sizeof(path), "%s/%s", TestDir, expected);
+  bool equal = STR_EQ(result, path);
+  TEST_MSG("expected '%s', got '%s'", path, buf_string(result));
+
+  buf_free(&buf);
+  buf_free(&result);
+  return equal;
+}
+
+void test_path_complete(void)
+{
+  setup();
+  CompletionPath *cp = compl_path_new(COMPL_MODE_EXACT, COMPL_MATCH_NOFLAGS);
+
+  // directories get a trailing slash, passing the result back cycles
+  TEST_CHECK(complete(cp, "in", "inbox/"));
+  TEST_CHECK(complete(cp, "inbox/", "invoices"));
+  TEST_CHECK(complete(cp, "invoices", "in"));
+  TEST_CHECK(complete(cp, "in", "inbox/"));
+
+  // hidden entries need a typed dot
+  TEST_CHECK(complete(cp, ".in", ".inboxrc"));
+  TEST_CHECK(complete(cp, ".inboxrc", ".in"));
+
+  // an empty component lists the directory
+  TEST_CHECK(complete(cp, "", "archive/"));
+  TEST_CHECK(complete(cp, "archive/", "inbox/"));
+  TEST_CHECK(complete(cp, "inbox/", "invoices"));
+  TEST_CHECK(complete(cp, "invoices", ""));
+
+  // one component at a time
+  TEST_CHECK(complete(cp, "inbox/c", "inbox/cur/"));
+  TEST_CHECK(complete(cp, "nope/x", "nope/x"));
+  TEST_CHECK(complete(cp, "xyz", "xyz"));
+
+  compl_path_free(&cp);
+  TEST_CHECK(cp == NULL);
+
+  cp = compl_path_new(COMPL_MODE_FUZZY, COMPL_MATCH_MAGIC);
+  TEST_CHECK(complete(cp, "ARCIVE", "archive/"));
+  compl_path_free(&cp);
+  teardown();
+}
+
+void test_path_cache(void)
+{
+  setup();
+  CompletionPath *cp = compl_path_new(COMPL_MODE_EXACT, COMPL_MATCH_NOFLAGS);
+
+  TEST_CHECK(complete(cp, "inv", "invoices"));
+  CompletionDir *dir = ARRAY_GET(&cp->dirs, (size_t) cp->cur);
+  const Completion *comp = dir->comp;
+  TEST_CHECK(!dir->racy);
+
+  // unchanged directories aren't read again
+  TEST_CHECK(complete(cp, "arc", "archive/"));
+  TEST_CHECK(ARRAY_GET(&cp->dirs, (size_t) cp->cur)->comp == comp);
+  TEST_CHECK(ARRAY_SIZE(&cp->dirs) == 1);
+
+  // a new entry changes the mtime
+  touch("index");
+  set_mtime("", 1000000100);
+  TEST_CHECK(complete(cp, "ind", "index"));
+  TEST_CHECK(compl_get_size(ARRAY_GET(&cp->dirs, (size_t) cp->cur)->comp) == 6);
+
+  // a directory changed right now is read again, even without a new mtime
+  remove_entry("index");
+  TEST_CHECK(complete(cp, "ind", "ind"));
+  TEST_CHECK(ARRAY_GET(&cp->dirs, (size_t) cp->cur)->racy);
+
+  // every directory is cached on its own
+  TEST_CHECK(complete(cp, "inbox/", "inbox/cur/"));
+  TEST_CHECK(ARRAY_SIZE(&cp->dirs) == 2);
+
+  compl_path_free(&cp);
+  teardown();
+}
+
+TEST_LIST = {
+  { "path complete", test_path_complete },
+  { "path cache", test_path_cache },
+  { NULL, NULL },
+};
@@ -0,0 +1,233 @@
+/**
+ * @file
+ * Autocompletion API Test: q-gram count filter for fuzzy matching
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include <stdio.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+#include "test_common.h"
+
+#define BUF(s1) buf_new(s1)
+
+static const char *Commands[] = {
+  "alias", "alternates", "alternative_order", "attachments", "auto_view",
+  "bind", "cd", "charset-hook", "color", "crypt-hook", "exec", "fcc-hook",
+  "folder-hook", "group", "hdr_order", "ifdef", "ifndef", "ignore", "lists",
+  "macro", "mailboxes", "mailto_allow", "mbox-hook", "message-hook", "mono",
+  "my_hdr", "named-mailboxes", "push", "reply-hook", "save-hook", "score",
+  "send-hook", "send2-hook", "set", "setenv", "shutdown-hook", "source",
+  "spam", "startup-hook", "subjectrx", "subscribe", "tag-formats",
+  "tag-transforms", "timeout-hook", "toggle", "unalias", "unset", "virtual-mailboxes",
+};
+
+/**
+ * random string over a few characters, so that many of them are close
+ */
+static void random_str(unsigned int *seed, char *str)
+{
+  static const char *chars[] = { "a", "b", "c", "ä", "ß" };
+  *seed = *seed * 1103515245 + 12345;
+  int len = 1 + (*seed >> 16) % 10;
+  *str = '\0';
+  for (int i = 0; i < len; i++)
+  {
+    *seed = *seed * 1103515245 + 12345;
+    strcat(str, chars[(*seed >> 16) % 5]);
+  }
+}
+
+void test_qgram_check(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *ref = compl_new(COMPL_MODE_FUZZY);
+
+  // the filter never rejects an item within the distance
+  unsigned int seed = 42;
+  char items[200][64];
+  struct QgramFilter *f = qgram_new(false);
+  for (int i = 0; i < 200; i++)
+  {
+    random_str(&seed, items[i]);
+    qgram_add(f, i + 1, items[i]);
+  }
+
+  size_t n_rejected = 0;
+  for (int q = 0; q < 50; q++)
+  {
+    char typed[64];
+    random_str(&seed, typed);
+    buf_free(&ref->typed_item->buf);
+    ref->typed_item->buf = BUF(typed);
+    TEST_CHECK(qgram_prepare(f, typed));
+
+    for (int k = 0; k <= 3; k++)
+    {
+      for (int i = 0; i < 200; i++)
+      {
+        int dist = dist_dam_lev(items[i], ref);
+        if (!qgram_check(f, i + 1, k))
+        {
+          n_rejected++;
+          TEST_CHECK(dist > k);
+          TEST_MSG("typed %s, item %s, k %d, dist %d", typed, items[i], k, dist);
+        }
+      }
+    }
+  }
+
+  // and the rejections are counted
+  size_t rejected = 0;
+  TEST_CHECK(qgram_stats(f, &rejected) == 50 * 4 * 200);
+  TEST_CHECK(rejected == n_rejected);
+  TEST_CHECK(n_rejected > 0);
+  qgram_free(&f);
+  TEST_CHECK(f == NULL);
+
+  // the first characters are aligned anyway, only the rest counts
+  f = qgram_new(false);
+  qgram_add(f, 1, "xneomutt");
+  qgram_add(f, 2, "xtumoen");
+  qgram_add(f, 3, "xneomuttneomutt");
+  qgram_add(f, 4, "x");
+  TEST_CHECK(qgram_prepare(f, "yneomutt"));
+  TEST_CHECK(qgram_check(f, 1, 0));
+  TEST_CHECK(!qgram_check(f, 2, 1));
+  TEST_CHECK(qgram_check(f, 2, 2));
+  TEST_CHECK(!qgram_check(f, 3, 6));
+  TEST_CHECK(qgram_check(f, 3, 7));
+  TEST_CHECK(!qgram_check(f, 4, 6));
+  TEST_CHECK(qgram_check(f, 5, 0));
+  TEST_CHECK(!qgram_prepare(f, ""));
+  qgram_free(&f);
+
+  compl_free(&ref);
+}
+
+static Completion *command_list(enum MuttMatchMode mode, MuttMatchFlags flags, int max_dist)
+{
+  Completion *comp = compl_new(mode);
+  comp->flags = flags;
+  compl_set_max_dist(comp, max_dist);
+  for (size_t i = 0; i < sizeof(Commands) / sizeof(Commands[0]); i++)
+  {
+    struct Buffer *buf = BUF(Commands[i]);
+    compl_add(comp, buf);
+    buf_free(&buf);
+  }
+  return comp;
+}
+
+void test_qgram_engine(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  static const char *typed[] = { "sett", "unste", "Mailbxoes", "folderhook",
+                                 "xource", "s", "SEND_hokk", "alais", "tag-transfrom" };
+  for (int magic = 0; magic <= 1; magic++)
+  {
+    MuttMatchFlags flags = magic ? COMPL_MATCH_MAGIC : COMPL_MATCH_NOFLAGS;
+    Completion *scan = command_list(COMPL_MODE_FUZZY, flags, -1);
+    for (int k = 0; k <= 4; k++)
+    {
+      // the same distances as a full scan, with the limit applied afterwards
+      Completion *comp = command_list(COMPL_MODE_FUZZY, flags, k);
+      for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+      {
+        int *di = test_score_all(comp, typed[q]);
+        int *ds = test_score_all(scan, typed[q]);
+        for (uint32_t id = 1; id < comp->next_id; id++)
+        {
+          TEST_CHECK(di[id] == ((ds[id] > k) ? -1 : ds[id]));
+          TEST_MSG("typed %s, k %d, magic %d, id %u: %d vs %d", typed[q], k,
+                   magic, id, di[id], ds[id]);
+        }
+        FREE(&di);
+        FREE(&ds);
+      }
+
+      // the items left by the character filter are checked, and with small
+      // distances most of them are rejected
+      size_t rejected = 0;
+      size_t checked = qgram_stats(comp->qgrams, &rejected);
+      TEST_CHECK((checked > 0) &&
+                 (checked <= sizeof(typed) / sizeof(typed[0]) * (compl_get_size(comp) - 1)));
+      TEST_CHECK((k > 2) || (rejected * 2 > checked));
+      TEST_MSG("k %d, magic %d: %zu of %zu", k, magic, rejected, checked);
+      compl_free(&comp);
+    }
+
+    // without a limit, nothing is filtered
+    TEST_CHECK(qgram_stats(scan->qgrams, NULL) == 0);
+    compl_free(&scan);
+  }
+}
+
+void test_qgram_updates(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  // items added later have their signatures
+  Completion *comp = command_list(COMPL_MODE_FUZZY, COMPL_MATCH_NOFLAGS, 1);
+  compl_add(comp, BUF("unhook"));
+  compl_type(comp, BUF("unhoko"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "unhook") == 0);
+
+  // removed items don't match, before and after compaction
+  compl_remove(comp, BUF("unhook"));
+  compl_type(comp, BUF("unhok"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "unhok") == 0);
+  for (size_t i = 0; i < 20; i++)
+    compl_remove(comp, BUF(Commands[i]));
+  compl_type(comp, BUF("sorce"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "source") == 0);
+  compl_type(comp, BUF("alais"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "alais") == 0);
+
+  // magic mode rebuilds the signatures with the normalised forms
+  comp->flags = COMPL_MATCH_MAGIC;
+  compl_type(comp, BUF("SAVE_HOKO"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "save-hook") == 0);
+  TEST_CHECK(qgram_magic(comp->qgrams));
+  compl_free(&comp);
+
+  // other lists get them on their first fuzzy search
+  comp = command_list(COMPL_MODE_EXACT, COMPL_MATCH_NOFLAGS, 1);
+  TEST_CHECK(comp->qgrams == NULL);
+  compl_type(comp, BUF("sav"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "save-hook") == 0);
+  TEST_CHECK(comp->qgrams == NULL);
+  comp->mode = COMPL_MODE_FUZZY;
+  compl_type(comp, BUF("svae-hook"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "save-hook") == 0);
+  TEST_CHECK(comp->qgrams != NULL);
+  compl_free(&comp);
+}
+
+TEST_LIST = {
+  { "qgram check", test_qgram_check },
+  { "qgram engine", test_qgram_engine },
+  { "qgram updates", test_qgram_updates },
+  { NULL, NULL },
+};
@@ -0,0 +1,152 @@
+/**
+ * @file
+ * Autocompletion API Test: cache of compiled regexes
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include <stdio.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+
+#define BUF(s1) buf_new(s1)
+
+static const char *Items[] = {
+  "INBOX", "INBOX/Lists", "INBOX/Lists/neomutt-devel", "INBOX/Lists/neomutt-users",
+  "INBOX/Archive", "Sent", "Drafts", "apple", "abrakadapple", "unAPPLE",
+};
+
+void test_regcache_lru(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  struct RegexCache *rc = regcache_new(3);
+
+  // a pattern is compiled once, and found afterwards
+  regex_t *a = regcache_get(rc, "a+b", COMPL_MATCH_NOFLAGS);
+  TEST_CHECK(a != NULL);
+  TEST_CHECK(regcache_get(rc, "a+b", COMPL_MATCH_NOFLAGS) == a);
+  TEST_CHECK(regexec(a, "xaab", 0, NULL, 0) == 0);
+
+  // the case sensitivity is part of the key
+  regex_t *ai = regcache_get(rc, "a+b", COMPL_MATCH_IGNORECASE);
+  TEST_CHECK(ai && (ai != a));
+  TEST_CHECK(regexec(ai, "AB", 0, NULL, 0) == 0);
+  TEST_CHECK(regexec(a, "AB", 0, NULL, 0) == REG_NOMATCH);
+
+  size_t misses = 0;
+  TEST_CHECK(regcache_stats(rc, &misses) == 1);
+  TEST_CHECK(misses == 2);
+
+  // invalid patterns aren't kept
+  TEST_CHECK(regcache_get(rc, "(ab", COMPL_MATCH_NOFLAGS) == NULL);
+  TEST_CHECK(regcache_get(rc, "(ab", COMPL_MATCH_NOFLAGS) == NULL);
+  TEST_CHECK(regcache_stats(rc, &misses) == 1);
+  TEST_CHECK(misses == 4);
+
+  // the least recently used pattern makes room for a new one
+  TEST_CHECK(regcache_get(rc, "c", COMPL_MATCH_NOFLAGS) != NULL);
+  TEST_CHECK(regcache_get(rc, "a+b", COMPL_MATCH_NOFLAGS) == a);
+  TEST_CHECK(regcache_get(rc, "d", COMPL_MATCH_NOFLAGS) != NULL);
+  TEST_CHECK(regcache_stats(rc, &misses) == 2);
+  TEST_CHECK(misses == 6);
+  TEST_CHECK(regcache_get(rc, "a+b", COMPL_MATCH_NOFLAGS) == a);
+  TEST_CHECK(regcache_get(rc, "c", COMPL_MATCH_NOFLAGS) != NULL);
+  TEST_CHECK(regcache_get(rc, "a+b", COMPL_MATCH_IGNORECASE) != NULL);
+  TEST_CHECK(regcache_stats(rc, &misses) == 4);
+  TEST_CHECK(misses == 7);
+
+  // the automaton is kept with the regex, and only for cached patterns
+  struct RegexNfa *nfa = regcache_nfa(rc, "c", COMPL_MATCH_NOFLAGS);
+  TEST_CHECK(nfa && nfa_match(nfa, "abc"));
+  TEST_CHECK(regcache_nfa(rc, "c", COMPL_MATCH_NOFLAGS) == nfa);
+  TEST_CHECK(regcache_nfa(rc, "e", COMPL_MATCH_NOFLAGS) == NULL);
+  TEST_CHECK(regcache_get(rc, "a{2}", COMPL_MATCH_NOFLAGS) != NULL);
+  TEST_CHECK(regcache_nfa(rc, "a{2}", COMPL_MATCH_NOFLAGS) == NULL);
+
+  regcache_free(&rc);
+  TEST_CHECK(rc == NULL);
+  regcache_free(&rc);
+  TEST_CHECK(regcache_get(NULL, "a", COMPL_MATCH_NOFLAGS) == NULL);
+  TEST_CHECK(regcache_stats(NULL, NULL) == 0);
+}
+
+void test_regcache_engine(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  // typing, backspacing and typing again compiles every pattern once
+  static const char *typed[] = { "I", "IN", "INB", "IN", "I", "IN", "INB", "INBO" };
+  Completion *comp = compl_new(COMPL_MODE_REGEX);
+  Completion *ref = compl_new(COMPL_MODE_REGEX);
+  for (size_t i = 0; i < sizeof(Items) / sizeof(Items[0]); i++)
+  {
+    compl_add(comp, BUF(Items[i]));
+    compl_add(ref, BUF(Items[i]));
+  }
+
+  size_t n_compiled = 0;
+  for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+  {
+    compl_type(comp, BUF(typed[q]));
+    struct Buffer *got = compl_complete(comp);
+
+    // the same completions as a list compiling every pattern anew
+    compl_free(&ref);
+    ref = compl_new(COMPL_MODE_REGEX);
+    for (size_t i = 0; i < sizeof(Items) / sizeof(Items[0]); i++)
+      compl_add(ref, BUF(Items[i]));
+    compl_type(ref, BUF(typed[q]));
+    TEST_CHECK(mutt_str_equal(buf_string(got), buf_string(compl_complete(ref))));
+    TEST_MSG("typed %s", typed[q]);
+  }
+  TEST_CHECK(compl_get_regex_stats(comp, &n_compiled) == 4);
+  TEST_CHECK(n_compiled == 4);
+
+  // a case-insensitive search compiles the pattern again
+  comp->flags = COMPL_MATCH_IGNORECASE;
+  compl_type(comp, BUF(".*PPLE"));
+  TEST_CHECK(mutt_str_equal(buf_string(compl_complete(comp)), "apple"));
+  comp->flags = COMPL_MATCH_NOFLAGS;
+  compl_type(comp, BUF("I"));
+  compl_type(comp, BUF(".*PPLE"));
+  TEST_CHECK(mutt_str_equal(buf_string(compl_complete(comp)), "unAPPLE"));
+  TEST_CHECK(compl_get_regex_stats(comp, &n_compiled) == 4);
+  TEST_CHECK(n_compiled == 6);
+
+  // other modes don't compile anything
+  Completion *exact = compl_new(COMPL_MODE_EXACT);
+  compl_add(exact, BUF("apple"));
+  compl_type(exact, BUF("app"));
+  compl_complete(exact);
+  TEST_CHECK(compl_get_regex_stats(exact, &n_compiled) == 0);
+  TEST_CHECK(n_compiled == 0);
+
+  compl_free(&exact);
+  compl_free(&ref);
+  compl_free(&comp);
+}
+
+TEST_LIST = {
+  { "regcache lru", test_regcache_lru },
+  { "regcache engine", test_regcache_engine },
+  { NULL, NULL },
+};
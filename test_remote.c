@@ -0,0 +1,238 @@
+/**
+ * @file
+ * Autocompletion API Test: remote lists
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+
+#define BUF(s1) buf_new(s1)
+#define STR_EQ(b, s) (strcmp(buf_string(b), s) == 0)
+
+/**
+ * struct Server - local stand-in for an NNTP server
+ */
+struct Server
+{
+  bool down;
+  int version;             ///< bumped by every change
+  const char *groups[16];  ///< all groups ever added
+  bool removed[16];        ///< the group has been removed
+  int changed[16];         ///< version of the last change of each group
+  int num;
+  int fetches;
+  bool full;               ///< the last fetch sent the whole list
+  const char *token;       ///< opaque token sent instead of the version
+};
+
+static void server_add(struct Server *srv, const char *group)
+{
+  srv->groups[srv->num] = group;
+  srv->changed[srv->num] = ++srv->version;
+  srv->num++;
+}
+
+static void server_remove(struct Server *srv, const char *group)
+{
+  for (int i = 0; i < srv->num; i++)
+  {
+    if (strcmp(srv->groups[i], group) == 0)
+    {
+      srv->changed[i] = ++srv->version;
+      srv->removed[i] = true;
+    }
+  }
+}
+
+static enum CompletionFetchResult server_fetch(void *data, const char *since,
+                                               struct CompletionStringList *added,
+                                               struct CompletionStringList *removed,
+                                               struct Buffer *token)
+{
+  struct Server *srv = data;
+  srv->fetches++;
+  if (srv->down)
+    return COMPL_FETCH_ERROR;
+
+  int version = since ? atoi(since) : 0;
+  srv->full = (version == 0);
+  for (int i = 0; i < srv->num; i++)
+  {
+    if (srv->full && !srv->removed[i])
+      ARRAY_ADD(added, mutt_str_dup(srv->groups[i]));
+    else if (!srv->full && (srv->changed[i] > version))
+      ARRAY_ADD(srv->removed[i] ? removed : added, mutt_str_dup(srv->groups[i]));
+  }
+
+  char str[16];
+  snprintf(str, sizeof(str), "%d", srv->version);
+  buf_strcpy(token, srv->token ? srv->token : str);
+  return srv->full ? COMPL_FETCH_FULL : COMPL_FETCH_DELTA;
+}
+
+static void remote_snapshot(char *path, size_t len)
+{
+  snprintf(path, len, "/tmp/test_remote.%d", (int) getpid());
+}
+
+void test_remote_snapshot(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  char path[64];
+  remote_snapshot(path, sizeof(path));
+  remove(path);
+
+  struct Server srv = { 0 };
+  server_add(&srv, "comp.mail.mutt");
+  server_add(&srv, "comp.mail.misc");
+  server_add(&srv, "comp.lang.c");
+
+  // no snapshot yet, nothing is fetched until the first refresh
+  CompletionRemote *remote = compl_remote_new(COMPL_MODE_EXACT, path, server_fetch, &srv);
+  TEST_CHECK(remote != NULL);
+  TEST_CHECK(srv.fetches == 0);
+  TEST_CHECK(compl_get_size(remote->comp) == 1);
+
+  TEST_CHECK(compl_remote_refresh(remote) == 3);
+  TEST_CHECK(srv.full);
+  TEST_CHECK(STR_EQ(remote->token, "3"));
+
+  compl_type(remote->comp, BUF("comp.mail"));
+  struct Buffer *result = compl_complete(remote->comp);
+  TEST_CHECK(STR_EQ(result, "comp.mail.misc"));
+  compl_remote_free(&remote);
+  TEST_CHECK(remote == NULL);
+
+  // the snapshot is used while the server is down
+  srv.down = true;
+  remote = compl_remote_new(COMPL_MODE_EXACT, path, server_fetch, &srv);
+  TEST_CHECK(compl_get_size(remote->comp) == 4);
+  TEST_CHECK(STR_EQ(remote->token, "3"));
+  TEST_CHECK(compl_remote_refresh(remote) == -1);
+  TEST_CHECK(compl_get_size(remote->comp) == 4);
+
+  compl_type(remote->comp, BUF("comp.l"));
+  result = compl_complete(remote->comp);
+  TEST_CHECK(STR_EQ(result, "comp.lang.c"));
+
+  // only the changes since the snapshot are fetched
+  srv.down = false;
+  server_add(&srv, "comp.mail.neomutt");
+  server_remove(&srv, "comp.mail.misc");
+  TEST_CHECK(compl_remote_refresh(remote) == 2);
+  TEST_CHECK(!srv.full);
+  TEST_CHECK(STR_EQ(remote->token, "5"));
+  compl_remote_free(&remote);
+
+  remote = compl_remote_new(COMPL_MODE_EXACT, path, server_fetch, &srv);
+  TEST_CHECK(compl_get_size(remote->comp) == 4);
+  compl_type(remote->comp, BUF("comp.mail"));
+  result = compl_complete(remote->comp);
+  TEST_CHECK(STR_EQ(result, "comp.mail.mutt"));
+  result = compl_complete(remote->comp);
+  TEST_CHECK(STR_EQ(result, "comp.mail.neomutt"));
+  result = compl_complete(remote->comp);
+  TEST_CHECK(STR_EQ(result, "comp.mail"));
+
+  // nothing changed, nothing to do
+  TEST_CHECK(compl_remote_refresh(remote) == 0);
+
+  // a full list only applies the difference
+  buf_reset(remote->token);
+  server_add(&srv, "comp.os.linux");
+  TEST_CHECK(compl_remote_refresh(remote) == 1);
+  TEST_CHECK(srv.full);
+  TEST_CHECK(compl_get_size(remote->comp) == 5);
+
+  compl_remote_free(&remote);
+  remove(path);
+}
+
+void test_remote_bad_snapshot(void)
+{
+  char path[64];
+  remote_snapshot(path, sizeof(path));
+
+  FILE *fp = fopen(path, "w");
+  TEST_CHECK(fp != NULL);
+  fputs("some other file\nwith\nlines\n", fp);
+  fclose(fp);
+
+  struct Server srv = { 0 };
+  server_add(&srv, "alt.test");
+
+  // an unknown file is ignored, and replaced on the next refresh
+  CompletionRemote *remote = compl_remote_new(COMPL_MODE_EXACT, path, server_fetch, &srv);
+  TEST_CHECK(compl_get_size(remote->comp) == 1);
+  TEST_CHECK(compl_remote_refresh(remote) == 1);
+  compl_remote_free(&remote);
+
+  remote = compl_remote_new(COMPL_MODE_EXACT, path, server_fetch, &srv);
+  TEST_CHECK(compl_get_size(remote->comp) == 2);
+  compl_remote_free(&remote);
+
+  TEST_CHECK(compl_remote_new(COMPL_MODE_EXACT, NULL, server_fetch, &srv) == NULL);
+  remove(path);
+}
+
+void test_remote_snapshot_escape(void)
+{
+  char path[64];
+  remote_snapshot(path, sizeof(path));
+  remove(path);
+
+  static const char *groups[] = { "two\nlines", "back\\slash", "\\n", "end\\", "\n" };
+  struct Server srv = { 0 };
+  srv.token = "next\\token\n2";
+  for (size_t i = 0; i < sizeof(groups) / sizeof(groups[0]); i++)
+    server_add(&srv, groups[i]);
+
+  CompletionRemote *remote = compl_remote_new(COMPL_MODE_EXACT, path, server_fetch, &srv);
+  TEST_CHECK(compl_remote_refresh(remote) == 5);
+  compl_remote_free(&remote);
+
+  // the token and items with newlines and backslashes survive the snapshot
+  srv.down = true;
+  remote = compl_remote_new(COMPL_MODE_EXACT, path, server_fetch, &srv);
+  TEST_CHECK(STR_EQ(remote->token, "next\\token\n2"));
+  TEST_CHECK(compl_get_size(remote->comp) == 6);
+  for (size_t i = 0; i < sizeof(groups) / sizeof(groups[0]); i++)
+  {
+    CompletionItem *item = ARRAY_GET(remote->comp->items, i + 1);
+    TEST_CHECK(item && mutt_str_equal(item->str, groups[i]));
+    TEST_MSG("item %zu: '%s'", i, item ? item->str : "");
+  }
+  compl_remote_free(&remote);
+  remove(path);
+}
+
+TEST_LIST = {
+  { "remote snapshot", test_remote_snapshot },
+  { "remote bad snapshot", test_remote_bad_snapshot },
+  { "remote snapshot escape", test_remote_snapshot_escape },
+  { NULL, NULL },
+};
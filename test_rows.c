@@ -0,0 +1,162 @@
+/**
+ * @file
+ * Autocompletion API Test: multi-field rows
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+
+#define BUF(s1) buf_new(s1)
+#define STR_EQ(b, s) (strcmp(buf_string(b), s) == 0)
+
+void test_rows_setup(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+  const char *row[] = { "Simon", "simon@example.com", "Hello" };
+
+  // rows need columns
+  TEST_CHECK(compl_add_row(comp, row) == 0);
+
+  TEST_CHECK(compl_add_column(comp, COMPL_MODE_EXACT, COMPL_MATCH_IGNORECASE, 0) == 1);
+  TEST_CHECK(compl_add_column(comp, COMPL_MODE_EXACT, COMPL_MATCH_NOFLAGS, 1) == 1);
+  TEST_CHECK(compl_add_column(comp, COMPL_MODE_SUBSTRING, COMPL_MATCH_MAGIC, 5) == 1);
+
+  TEST_CHECK(compl_add_row(comp, row) == 1);
+
+  // columns can't be added once there are rows, single items can't be added to rows
+  TEST_CHECK(compl_add_column(comp, COMPL_MODE_EXACT, COMPL_MATCH_NOFLAGS, 0) == 0);
+  TEST_CHECK(compl_add(comp, BUF("Simon")) == 0);
+
+  // rows aren't deduplicated, but need a first field
+  TEST_CHECK(compl_add_row(comp, row) == 1);
+  const char *empty[] = { "", "x@example.com", "subject" };
+  TEST_CHECK(compl_add_row(comp, empty) == 0);
+  TEST_CHECK(compl_get_size(comp) == 3);
+
+  // fields are stored column-wise
+  CompletionColumn *col = ARRAY_GET(&comp->columns, 1);
+  TEST_CHECK(ARRAY_SIZE(&col->offsets) == 3);
+  TEST_CHECK(strcmp(col->fields.data + *ARRAY_GET(&col->offsets, 2), "simon@example.com") == 0);
+
+  // magic columns store the normalised form
+  col = ARRAY_GET(&comp->columns, 2);
+  TEST_CHECK(strcmp(col->fields.data + *ARRAY_GET(&col->offsets, 1), "hello") == 0);
+
+  compl_free(&comp);
+}
+
+void test_rows_match(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+
+  // name, address, subject
+  compl_add_column(comp, COMPL_MODE_EXACT, COMPL_MATCH_IGNORECASE, 0);
+  compl_add_column(comp, COMPL_MODE_EXACT, COMPL_MATCH_NOFLAGS, 10);
+  compl_add_column(comp, COMPL_MODE_SUBSTRING, COMPL_MATCH_MAGIC, 20);
+
+  const char *rows[][3] = {
+    { "Flatcap", "rich@flatcap.org", "Re: neomutt-devel" },
+    { "Simon", "flatcap@example.com", "completion" },
+    { "Richard", "rich@example.com", "fix the flat_caps" },
+    { "Pietro", "pietro@example.com", NULL },
+  };
+  for (int i = 0; i < 4; i++)
+    compl_add_row(comp, rows[i]);
+
+  // the name column is preferred by its bias, the subject column matches last
+  compl_type(comp, BUF("flat"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "Flatcap"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "Simon"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "Richard"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "flat"));
+
+  // each column uses its own flags
+  compl_type(comp, BUF("RICH"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "Richard"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "RICH"));
+
+  // the magic subject column, missing fields never match
+  compl_type(comp, BUF("NEOMUTT_DEV"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "Flatcap"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "NEOMUTT_DEV"));
+
+  compl_type(comp, BUF("nomatch"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "nomatch"));
+  TEST_CHECK(comp->state == COMPL_STATE_NOMATCH);
+
+  // rows are removed by their first field
+  TEST_CHECK(compl_remove(comp, BUF("Simon")) == 1);
+  compl_type(comp, BUF("flat"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "Flatcap"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "Richard"));
+
+  compl_free(&comp);
+}
+
+void test_rows_regex(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+
+  compl_add_column(comp, COMPL_MODE_EXACT, COMPL_MATCH_NOFLAGS, 0);
+  compl_add_column(comp, COMPL_MODE_REGEX, COMPL_MATCH_IGNORECASE, 0);
+
+  const char *a[] = { "alice", "alice@EXAMPLE.com" };
+  const char *b[] = { "bob", "bob@example.org" };
+  compl_add_row(comp, a);
+  compl_add_row(comp, b);
+
+  // the regex is compiled for the column, regardless of the mode of the Completion
+  compl_type(comp, BUF("example\\.org$"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "bob"));
+
+  compl_type(comp, BUF("@example"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "bob"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "alice"));
+
+  compl_free(&comp);
+}
+
+TEST_LIST = {
+  { "rows setup", test_rows_setup },
+  { "rows match", test_rows_match },
+  { "rows regex", test_rows_regex },
+  { NULL, NULL },
+};
@@ -0,0 +1,167 @@
+/**
+ * @file
+ * Autocompletion API Test: subsequence matching
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+
+#define BUF(s1) buf_new(s1)
+
+void test_subseq_match(void)
+{
+  // we need to set the locale settings, otherwise UTF8 chars won't work as expected
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_SUBSEQ);
+
+  // abbreviations match, missing or reordered characters don't
+  comp->typed_item->buf = BUF("drvd");
+  TEST_CHECK(dist_subseq("derived", comp, NULL) >= 0);
+  TEST_CHECK(dist_subseq("driver", comp, NULL) == -1);
+  TEST_CHECK(dist_subseq("dvrd", comp, NULL) == -1);
+  TEST_CHECK(dist_subseq("drv", comp, NULL) == -1);
+  TEST_CHECK(dist_subseq("", comp, NULL) == -1);
+  TEST_CHECK(dist_subseq(NULL, comp, NULL) == -1);
+
+  // case-sensitive by default
+  TEST_CHECK(dist_subseq("DeRiVeD", comp, NULL) == -1);
+  comp->flags = COMPL_MATCH_IGNORECASE;
+  TEST_CHECK(dist_subseq("DeRiVeD", comp, NULL) >= 0);
+  comp->typed_item->buf = BUF("DRVD");
+  TEST_CHECK(dist_subseq("derived", comp, NULL) >= 0);
+  comp->flags = COMPL_MATCH_NOFLAGS;
+
+  // multibyte characters count as a single character
+  comp->typed_item->buf = BUF("äl");
+  TEST_CHECK(dist_subseq("äpfel", comp, NULL) >= 0);
+  TEST_CHECK(dist_subseq("Äpfel", comp, NULL) == -1);
+  comp->flags = COMPL_MATCH_IGNORECASE;
+  TEST_CHECK(dist_subseq("Äpfel", comp, NULL) >= 0);
+  comp->flags = COMPL_MATCH_NOFLAGS;
+
+  // an empty typed string matches everything
+  comp->typed_item->buf = BUF("");
+  TEST_CHECK(dist_subseq("apple", comp, NULL) == 0);
+
+  // the mode is available through match_dist
+  comp->typed_item->buf = BUF("drvd");
+  TEST_CHECK(match_dist(BUF("derived"), comp) == dist_subseq("derived", comp, NULL));
+
+  compl_free(&comp);
+}
+
+void test_subseq_score(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_SUBSEQ);
+
+  // consecutive characters beat scattered ones
+  comp->typed_item->buf = BUF("app");
+  TEST_CHECK(dist_subseq("apple", comp, NULL) < dist_subseq("a_p_p", comp, NULL));
+
+  // word boundaries beat characters in the middle of a word
+  comp->typed_item->buf = BUF("fb");
+  TEST_CHECK(dist_subseq("foo_bar", comp, NULL) < dist_subseq("fooxbar", comp, NULL));
+  TEST_CHECK(dist_subseq("foo/bar", comp, NULL) < dist_subseq("fooxbar", comp, NULL));
+
+  // camelCase humps count as word boundaries
+  comp->flags = COMPL_MATCH_IGNORECASE;
+  comp->typed_item->buf = BUF("gc");
+  TEST_CHECK(dist_subseq("getConfig", comp, NULL) < dist_subseq("getconfig", comp, NULL));
+
+  // the best alignment is chosen, not the first one
+  comp->typed_item->buf = BUF("lst");
+  TEST_CHECK(dist_subseq("INBOX/Lists/test", comp, NULL) >= 0);
+  TEST_CHECK(dist_subseq("lxsxtx/list", comp, NULL) < dist_subseq("lxsxtx/lxsxtx", comp, NULL));
+
+  compl_free(&comp);
+}
+
+#define SPAN_EQ(span, s, l) ((span)->start == (s) && (span)->len == (l))
+
+void test_subseq_positions(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_SUBSEQ);
+  struct CompletionSpanList spans = ARRAY_HEAD_INITIALIZER;
+
+  comp->typed_item->buf = BUF("drvd");
+  TEST_CHECK(dist_subseq("derived", comp, &spans) >= 0);
+  TEST_CHECK(ARRAY_SIZE(&spans) == 4);
+  TEST_CHECK(SPAN_EQ(ARRAY_GET(&spans, 0), 0, 1));
+  TEST_CHECK(SPAN_EQ(ARRAY_GET(&spans, 1), 2, 1));
+  TEST_CHECK(SPAN_EQ(ARRAY_GET(&spans, 2), 4, 1));
+  TEST_CHECK(SPAN_EQ(ARRAY_GET(&spans, 3), 6, 1));
+
+  // positions are character indices, prefer the word boundary
+  ARRAY_SHRINK(&spans, ARRAY_SIZE(&spans));
+  comp->typed_item->buf = BUF("fb");
+  TEST_CHECK(dist_subseq("äfbx_fbar", comp, &spans) >= 0);
+  TEST_CHECK(ARRAY_SIZE(&spans) == 1);
+  TEST_CHECK(SPAN_EQ(ARRAY_GET(&spans, 0), 5, 2));
+
+  ARRAY_SHRINK(&spans, ARRAY_SIZE(&spans));
+  comp->flags = COMPL_MATCH_IGNORECASE;
+  comp->typed_item->buf = BUF("lt");
+  TEST_CHECK(dist_subseq("INBOX/Lists/test", comp, &spans) >= 0);
+  TEST_CHECK(ARRAY_SIZE(&spans) == 2);
+  TEST_CHECK(SPAN_EQ(ARRAY_GET(&spans, 0), 6, 1));
+  TEST_CHECK(SPAN_EQ(ARRAY_GET(&spans, 1), 12, 1));
+
+  ARRAY_FREE(&spans);
+  compl_free(&comp);
+}
+
+void test_subseq_engine(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *comp = compl_new(COMPL_MODE_SUBSEQ);
+
+  compl_add(comp, BUF("driver"));
+  compl_add(comp, BUF("deprived"));
+  compl_add(comp, BUF("derived"));
+  compl_add(comp, BUF("drvd"));
+
+  compl_type(comp, BUF("drvd"));
+
+  struct Buffer *result = NULL;
+  result = compl_complete(comp);
+  TEST_CHECK(buf_str_equal(result, BUF("drvd")));
+  result = compl_complete(comp);
+  TEST_CHECK(buf_str_equal(result, BUF("derived")));
+  result = compl_complete(comp);
+  TEST_CHECK(buf_str_equal(result, BUF("deprived")));
+  result = compl_complete(comp);
+  TEST_CHECK(buf_str_equal(result, BUF("drvd")));
+
+  compl_free(&comp);
+}
+
+TEST_LIST = {
+  { "subsequence match", test_subseq_match },
+  { "subsequence score", test_subseq_score },
+  { "subsequence positions", test_subseq_positions },
+  { "subsequence engine", test_subseq_engine },
+  { NULL, NULL },
+};
@@ -0,0 +1,234 @@
+/**
+ * @file
+ * Autocompletion API Test: deletion index for small fuzzy distances
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include <stdio.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+#include "test_common.h"
+
+#define BUF(s1) buf_new(s1)
+
+static const char *Commands[] = {
+  "alias", "alternates", "alternative_order", "attachments", "auto_view",
+  "bind", "cd", "charset-hook", "color", "crypt-hook", "exec", "fcc-hook",
+  "folder-hook", "group", "hdr_order", "ifdef", "ifndef", "ignore", "lists",
+  "macro", "mailboxes", "mailto_allow", "mbox-hook", "message-hook", "mono",
+  "my_hdr", "named-mailboxes", "push", "reply-hook", "save-hook", "score",
+  "send-hook", "send2-hook", "set", "setenv", "shutdown-hook", "source",
+  "spam", "startup-hook", "subjectrx", "subscribe", "tag-formats",
+  "tag-transforms", "timeout-hook", "toggle", "unalias", "unset", "virtual-mailboxes",
+  "an_unusually_long_command_name_with_many_chars",
+};
+
+/**
+ * optimal string alignment distance of two ASCII strings, the slow way
+ */
+static int ref_osa(const char *a, const char *b)
+{
+  int n = strlen(a);
+  int m = strlen(b);
+  int d[64][64];
+
+  for (int i = 0; i <= n; i++)
+    d[i][0] = i;
+  for (int j = 0; j <= m; j++)
+    d[0][j] = j;
+
+  for (int i = 1; i <= n; i++)
+  {
+    for (int j = 1; j <= m; j++)
+    {
+      int cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+      d[i][j] = MIN(d[i - 1][j - 1] + cost, MIN(d[i - 1][j] + 1, d[i][j - 1] + 1));
+      if ((i > 1) && (j > 1) && (a[i - 1] == b[j - 2]) && (a[i - 2] == b[j - 1]))
+        d[i][j] = MIN(d[i][j], d[i - 2][j - 2] + 1);
+    }
+  }
+
+  return d[n][m];
+}
+
+static bool has_id(const struct NgramIdList *ids, uint32_t id)
+{
+  const uint32_t *p = NULL;
+  ARRAY_FOREACH(p, ids)
+  {
+    if (*p == id)
+      return true;
+  }
+  return false;
+}
+
+void test_symdel_query(void)
+{
+  const size_t num = sizeof(Commands) / sizeof(Commands[0]);
+  struct SymDelIndex *idx = symdel_new(false);
+  for (size_t i = 0; i < num; i++)
+    symdel_add(idx, i + 1, Commands[i]);
+
+  // every item within the distance is a candidate, the first character aside
+  static const char *typed[] = { "sett", "unste", "mailbxoes", "folderhook",
+                                 "xource", "s", "send-hokk", "alais" };
+  struct NgramIdList ids = ARRAY_HEAD_INITIALIZER;
+  for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+  {
+    for (int k = 0; k <= 2; k++)
+    {
+      TEST_CHECK(symdel_query(idx, typed[q], k, &ids) >= 0);
+      for (size_t i = 0; i < num; i++)
+      {
+        if (ref_osa(typed[q] + 1, Commands[i] + 1) <= k)
+        {
+          TEST_CHECK(has_id(&ids, i + 1));
+          TEST_MSG("typed %s, item %s, k %d", typed[q], Commands[i], k);
+        }
+      }
+
+      // the candidates are sorted and unique
+      for (size_t i = 1; i < ARRAY_SIZE(&ids); i++)
+        TEST_CHECK(*ARRAY_GET(&ids, i - 1) < *ARRAY_GET(&ids, i));
+    }
+  }
+
+  // few candidates beside the matches, long items are always candidates
+  TEST_CHECK(symdel_query(idx, "sett", 1, &ids) == 2);
+  TEST_CHECK(has_id(&ids, 34));
+  TEST_CHECK(has_id(&ids, num));
+  TEST_CHECK(symdel_query(idx, "sett", 2, &ids) == 4);
+  TEST_CHECK(has_id(&ids, 47));
+
+  // distances beyond the index are left to the caller
+  TEST_CHECK(symdel_query(idx, "sett", 3, &ids) == -1);
+
+  // removed items are dropped, the others are still found
+  struct CompletionBoolList removed = ARRAY_HEAD_INITIALIZER;
+  ARRAY_SET(&removed, 34, true);
+  ARRAY_SET(&removed, num, true);
+  size_t before = symdel_memory(idx, NULL);
+  symdel_remove(idx, &removed);
+  TEST_CHECK(symdel_memory(idx, NULL) <= before);
+  TEST_CHECK(symdel_query(idx, "sett", 1, &ids) == 0);
+  TEST_CHECK(symdel_query(idx, "sett", 2, &ids) == 2);
+  TEST_CHECK(has_id(&ids, 47));
+  TEST_CHECK(symdel_query(idx, "alais", 1, &ids) == 1);
+  TEST_CHECK(has_id(&ids, 1));
+  ARRAY_FREE(&removed);
+
+  ARRAY_FREE(&ids);
+  symdel_free(&idx);
+  TEST_CHECK(idx == NULL);
+}
+
+static Completion *command_list(MuttMatchFlags flags, int max_dist)
+{
+  Completion *comp = compl_new(COMPL_MODE_FUZZY);
+  comp->flags = flags;
+  compl_set_max_dist(comp, max_dist);
+  for (size_t i = 0; i < sizeof(Commands) / sizeof(Commands[0]); i++)
+  {
+    struct Buffer *buf = BUF(Commands[i]);
+    compl_add(comp, buf);
+    buf_free(&buf);
+  }
+  return comp;
+}
+
+void test_symdel_engine(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  static const char *typed[] = { "sett", "unste", "Mailbxoes", "folderhook",
+                                 "xource", "s", "SEND_hokk", "alais" };
+  for (int magic = 0; magic <= 1; magic++)
+  {
+    MuttMatchFlags flags = magic ? COMPL_MATCH_MAGIC : COMPL_MATCH_NOFLAGS;
+    Completion *scan = command_list(flags, -1);
+    for (int k = 0; k <= 3; k++)
+    {
+      // the same distances as a full scan, with the limit applied afterwards
+      Completion *comp = command_list(flags, k);
+      TEST_CHECK(compl_set_symdel(comp, true) == 1);
+      for (size_t q = 0; q < sizeof(typed) / sizeof(typed[0]); q++)
+      {
+        int *di = test_score_all(comp, typed[q]);
+        int *ds = test_score_all(scan, typed[q]);
+        for (uint32_t id = 1; id < comp->next_id; id++)
+        {
+          TEST_CHECK(di[id] == ((ds[id] > k) ? -1 : ds[id]));
+          TEST_MSG("typed %s, k %d, magic %d, id %u: %d vs %d", typed[q], k,
+                   magic, id, di[id], ds[id]);
+        }
+        FREE(&di);
+        FREE(&ds);
+      }
+      compl_free(&comp);
+    }
+    compl_free(&scan);
+  }
+}
+
+void test_symdel_updates(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  // the memory of the index is accounted for
+  Completion *comp = command_list(COMPL_MATCH_NOFLAGS, 1);
+  TEST_CHECK(compl_get_index_memory(comp) == 0);
+  compl_set_symdel(comp, true);
+  size_t size = compl_get_index_memory(comp);
+  TEST_CHECK(size > 0);
+
+  // items added later are indexed
+  compl_add(comp, BUF("unhook"));
+  TEST_CHECK(compl_get_index_memory(comp) >= size);
+  compl_type(comp, BUF("unhoko"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "unhook") == 0);
+
+  // removed items don't match
+  compl_remove(comp, BUF("unhook"));
+  compl_type(comp, BUF("unhok"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "unhok") == 0);
+
+  // magic mode rebuilds the index with the normalised forms
+  comp->flags = COMPL_MATCH_MAGIC;
+  compl_type(comp, BUF("FOLDER_HOKO"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "folder-hook") == 0);
+
+  // disabling the index frees it
+  compl_set_symdel(comp, false);
+  TEST_CHECK(comp->symdel == NULL);
+  TEST_CHECK(compl_get_index_memory(comp) == 0);
+  compl_type(comp, BUF("FOLDER_HOK"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "folder-hook") == 0);
+  compl_free(&comp);
+}
+
+TEST_LIST = {
+  { "symdel query", test_symdel_query },
+  { "symdel engine", test_symdel_engine },
+  { "symdel updates", test_symdel_updates },
+  { NULL, NULL },
+};
@@ -0,0 +1,242 @@
+/**
+ * @file
+ * Autocompletion API Test: trie with incremental fuzzy distances
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include <stdio.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+#include "test_common.h"
+
+#define BUF(s1) buf_new(s1)
+
+static const char *Items[] = {
+  "INBOX", "INBOX/Lists", "INBOX/Lists/neomutt-devel", "INBOX/Lists/neomutt-users",
+  "INBOX/Lists/mutt-dev", "INBOX/Archive", "INBOX/Archive/2023", "Sent",
+  "Drafts", "Äpfel", "Äpfelmus", "Straße", "ΟΔΥΣΣΕΥΣ", "a", "ab", "ba",
+};
+
+/**
+ * check the distances of the trie against the kernel
+ */
+static bool same_as_kernel(struct Trie *t, Completion *ref, const char *typed, int *extended)
+{
+  const size_t num = sizeof(Items) / sizeof(Items[0]);
+  int dists[32] = { 0 };
+
+  buf_free(&ref->typed_item->buf);
+  ref->typed_item->buf = BUF(typed);
+  *extended = trie_fuzzy(t, typed, dists);
+
+  bool same = true;
+  for (size_t i = 0; i < num; i++)
+  {
+    int want = dist_dam_lev(Items[i], ref);
+    if (dists[i + 1] != want)
+    {
+      TEST_MSG("typed %s, item %s: %d vs %d", typed, Items[i], dists[i + 1], want);
+      same = false;
+    }
+  }
+  return same;
+}
+
+void test_trie_fuzzy(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+  Completion *ref = compl_new(COMPL_MODE_FUZZY);
+
+  struct Trie *t = trie_new(false);
+  for (size_t i = 0; i < sizeof(Items) / sizeof(Items[0]); i++)
+    trie_add(t, i + 1, Items[i]);
+
+  // typing character by character, with a typo and its correction
+  static const char *keys[] = { "I", "IN", "INB", "INBO", "INBOX", "INBOX/",
+                                "INBOX/L", "INBOX/Li", "INBOX/Lis", "INBOX/Li",
+                                "INBOX/L", "INBOX/La", "INBOX/Lai", "INBOX/Lits",
+                                "NIBOX/Lits", "x", "Äpfle", "Strasse", "οδυσσευσ",
+                                "ba", "ab", "b" };
+  int extended = 0;
+  for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++)
+  {
+    TEST_CHECK(same_as_kernel(t, ref, keys[k], &extended));
+    TEST_MSG("typed %s", keys[k]);
+  }
+
+  // nothing to do for the same string, or only shrinking it
+  TEST_CHECK(same_as_kernel(t, ref, "ba", &extended));
+  TEST_CHECK(same_as_kernel(t, ref, "b", &extended));
+  TEST_CHECK(extended == 0);
+  TEST_CHECK(same_as_kernel(t, ref, "b", &extended));
+  TEST_CHECK(extended == 0);
+
+  // invalid strings aren't scored
+  int dists[32] = { 0 };
+  TEST_CHECK(trie_fuzzy(t, "", dists) == -1);
+
+  trie_free(&t);
+  TEST_CHECK(t == NULL);
+
+  // items added later get their cells for the current typed string
+  t = trie_new(false);
+  trie_add(t, 1, Items[0]);
+  TEST_CHECK(same_as_kernel(t, ref, "INBOX/Lits", &extended) == false);
+  for (size_t i = 1; i < sizeof(Items) / sizeof(Items[0]); i++)
+    trie_add(t, i + 1, Items[i]);
+  TEST_CHECK(same_as_kernel(t, ref, "INBOX/Lits", &extended));
+  TEST_CHECK(extended == 0);
+  TEST_CHECK(same_as_kernel(t, ref, "INBOX/Lists/neomutt-devel-and-much-longer", &extended));
+  TEST_CHECK(extended > 0);
+  trie_free(&t);
+
+  compl_free(&ref);
+}
+
+static Completion *mailbox_list(MuttMatchFlags flags, bool trie)
+{
+  Completion *comp = compl_new(COMPL_MODE_FUZZY);
+  comp->flags = flags;
+  compl_set_highlight(comp, 3);
+  for (size_t i = 0; i < sizeof(Items) / sizeof(Items[0]); i++)
+    compl_add(comp, BUF(Items[i]));
+  for (int i = 0; i < 200; i++)
+  {
+    char item[64];
+    snprintf(item, sizeof(item), "INBOX/Lists/list-%d", i);
+    compl_add(comp, BUF(item));
+  }
+  if (trie)
+    compl_set_trie(comp, true);
+  return comp;
+}
+
+void test_trie_engine(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  static const char *keys[] = { "i", "in", "inb", "inbox/list-1", "INBOX/lits-12",
+                                "INBOX/lits-1", "inbox_lists", "Äpfle" };
+  for (int magic = 0; magic <= 1; magic++)
+  {
+    MuttMatchFlags flags = magic ? COMPL_MATCH_MAGIC : COMPL_MATCH_NOFLAGS;
+    Completion *trie = mailbox_list(flags, true);
+    Completion *scan = mailbox_list(flags, false);
+    for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++)
+    {
+      // the same distances, completions and spans as the kernel
+      int *dt = test_score_all(trie, keys[k]);
+      int *ds = test_score_all(scan, keys[k]);
+      TEST_CHECK(memcmp(dt, ds, trie->next_id * sizeof(int)) == 0);
+      TEST_MSG("typed %s, magic %d", keys[k], magic);
+      FREE(&dt);
+      FREE(&ds);
+
+      for (int n = 0; n < 4; n++)
+      {
+        const CompletionSpan *st = NULL;
+        const CompletionSpan *ss = NULL;
+        size_t nt = compl_get_spans(trie, &st);
+        size_t ns = compl_get_spans(scan, &ss);
+        TEST_CHECK(strcmp(trie->cur_item->str, scan->cur_item->str) == 0);
+        TEST_CHECK((nt == ns) && ((nt == 0) || (memcmp(st, ss, nt * sizeof(CompletionSpan)) == 0)));
+        TEST_MSG("typed %s, completion %d", keys[k], n);
+        struct Buffer *bt = compl_complete(trie);
+        struct Buffer *bs = compl_complete(scan);
+        buf_free(&bt);
+        buf_free(&bs);
+      }
+    }
+    compl_free(&trie);
+    compl_free(&scan);
+  }
+
+  // with a maximum distance, the character filter applies to the trie's
+  // candidates, or replaces the trie when it passes few items
+  for (int k = 0; k <= 2; k++)
+  {
+    Completion *trie = mailbox_list(COMPL_MATCH_NOFLAGS, true);
+    Completion *scan = mailbox_list(COMPL_MATCH_NOFLAGS, false);
+    compl_set_max_dist(trie, k);
+    compl_set_max_dist(scan, k);
+    for (size_t q = 0; q < sizeof(keys) / sizeof(keys[0]); q++)
+    {
+      int *dt = test_score_all(trie, keys[q]);
+      int *ds = test_score_all(scan, keys[q]);
+      TEST_CHECK(memcmp(dt, ds, trie->next_id * sizeof(int)) == 0);
+      TEST_MSG("typed %s, k %d", keys[q], k);
+      FREE(&dt);
+      FREE(&ds);
+    }
+    compl_free(&trie);
+    compl_free(&scan);
+  }
+
+  // the maximum distance applies to the trie as well
+  Completion *comp = mailbox_list(COMPL_MATCH_NOFLAGS, true);
+  compl_set_max_dist(comp, 1);
+  compl_type(comp, BUF("Snet"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "Sent") == 0);
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "Snet") == 0);
+  compl_free(&comp);
+}
+
+void test_trie_updates(void)
+{
+  setlocale(LC_ALL, "en_US.UTF-8");
+
+  Completion *comp = mailbox_list(COMPL_MATCH_NOFLAGS, false);
+  size_t size = compl_get_index_memory(comp);
+  compl_set_trie(comp, true);
+  TEST_CHECK(compl_get_index_memory(comp) > size);
+  compl_set_max_dist(comp, 1);
+
+  // items added later are in the trie
+  compl_type(comp, BUF("Tras"));
+  compl_complete(comp);
+  compl_add(comp, BUF("Trash"));
+  compl_type(comp, BUF("Trahs"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "Trash") == 0);
+
+  // removed items don't match
+  compl_remove(comp, BUF("Trash"));
+  compl_type(comp, BUF("Trsah"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "Trsah") == 0);
+
+  // magic mode rebuilds the trie with the normalised forms
+  comp->flags = COMPL_MATCH_MAGIC;
+  compl_type(comp, BUF("SETN"));
+  TEST_CHECK(strcmp(buf_string(compl_complete(comp)), "Sent") == 0);
+
+  compl_set_trie(comp, false);
+  TEST_CHECK(comp->trie == NULL);
+  TEST_CHECK(compl_get_index_memory(comp) == size);
+  compl_free(&comp);
+}
+
+TEST_LIST = {
+  { "trie fuzzy", test_trie_fuzzy },
+  { "trie engine", test_trie_engine },
+  { "trie updates", test_trie_updates },
+  { NULL, NULL },
+};
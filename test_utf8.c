@@ -0,0 +1,167 @@
+/**
+ * @file
+ * Autocompletion API Test: UTF-8 validation and decoding
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "acutest.h"
+#include <locale.h>
+#include "mutt/lib.h"
+#include "lib.h"
+#include "private.h"
+
+#define BUF(s1) buf_new(s1)
+#define STR_EQ(b, s) (strcmp(buf_string(b), s) == 0)
+
+static int validate(const char *str)
+{
+  return utf8_validate(str, strlen(str));
+}
+
+void test_utf8_validate(void)
+{
+  TEST_CHECK(validate("") == 0);
+  TEST_CHECK(validate("neomutt") == 7);
+  TEST_CHECK(validate("Über") == 4);
+  TEST_CHECK(validate("€uro") == 4);
+  TEST_CHECK(validate("\xF0\x9F\x98\x80") == 1);
+  TEST_CHECK(validate("\xF4\x8F\xBF\xBF") == 1);
+
+  // long ASCII runs around multibyte characters
+  TEST_CHECK(validate("abcdefghijklmnopqrstuvwxyz-Ä-abcdefghijklmnopqrstuvwxyz") == 55);
+  TEST_CHECK(validate("abcdefghijklmnopqrstuvwxyz-\xC3") == -1);
+
+  // stray continuation bytes, truncated sequences
+  TEST_CHECK(validate("\x80") == -1);
+  TEST_CHECK(validate("a\xBF") == -1);
+  TEST_CHECK(validate("\xC3") == -1);
+  TEST_CHECK(validate("\xE2\x82") == -1);
+  TEST_CHECK(validate("\xE2\x82x") == -1);
+
+  // overlong forms, surrogates, beyond U+10FFFF
+  TEST_CHECK(validate("\xC0\xAF") == -1);
+  TEST_CHECK(validate("\xC1\xBF") == -1);
+  TEST_CHECK(validate("\xE0\x80\xAF") == -1);
+  TEST_CHECK(validate("\xF0\x80\x80\xAF") == -1);
+  TEST_CHECK(validate("\xED\xA0\x80") == -1);
+  TEST_CHECK(validate("\xF4\x90\x80\x80") == -1);
+  TEST_CHECK(validate("\xF5\x80\x80\x80") == -1);
+  TEST_CHECK(validate("\xFF") == -1);
+
+  // the length is respected, not the terminator
+  TEST_CHECK(utf8_validate("Über", 2) == 1);
+  TEST_CHECK(utf8_validate("Über", 1) == -1);
+}
+
+void test_utf8_decode(void)
+{
+  // no locale needed
+  setlocale(LC_ALL, "C");
+
+  const char *str = "a€Ä\xF0\x9F\x98\x80z";
+  wchar_t w[8] = { 0 };
+  TEST_CHECK(utf8_decode(str, w) == 5);
+  TEST_CHECK((w[0] == L'a') && (w[1] == 0x20AC) && (w[2] == 0xC4) &&
+             (w[3] == 0x1F600) && (w[4] == L'z') && (w[5] == L'\0'));
+
+  char out[32] = { 0 };
+  TEST_CHECK(utf8_encode(w, out) == strlen(str));
+  TEST_CHECK(strcmp(out, str) == 0);
+
+  wchar_t wc = 0;
+  TEST_CHECK(utf8_next("", &wc) == 0);
+  TEST_CHECK(utf8_next("\xC3", &wc) == -1);
+  TEST_CHECK((utf8_next("ß", &wc) == 2) && (wc == 0xDF));
+
+  TEST_CHECK(mbs_char_count("Straße") == 6);
+  TEST_CHECK(mbs_char_count("Stra\xDF" "e") == -1);
+  TEST_CHECK(is_mbs("Straße"));
+  TEST_CHECK(!is_mbs("Strasse"));
+  TEST_CHECK(MBCHARLEN("€") == 3);
+  TEST_CHECK(ISBADMBYTE("\x80"));
+}
+
+void test_utf8_sanitise(void)
+{
+  struct Buffer *buf = buf_new(NULL);
+
+  TEST_CHECK(utf8_sanitise("Über", 5, buf) == 0);
+  TEST_CHECK(STR_EQ(buf, "Über"));
+
+  TEST_CHECK(utf8_sanitise("Stra\xDF" "e", 6, buf) == 1);
+  TEST_CHECK(STR_EQ(buf, "Stra\xEF\xBF\xBD" "e"));
+
+  TEST_CHECK(utf8_sanitise("\xE2\x82", 2, buf) == 2);
+  TEST_CHECK(validate(buf_string(buf)) == 2);
+
+  buf_free(&buf);
+}
+
+void test_utf8_ingest(void)
+{
+  setlocale(LC_ALL, "C");
+  Completion *comp = compl_new(COMPL_MODE_EXACT);
+  comp->flags = COMPL_MATCH_IGNORECASE;
+
+  // invalid items are skipped, they can't be returned as they are
+  TEST_CHECK(compl_add(comp, BUF("Straße")) == 1);
+  TEST_CHECK(compl_add(comp, BUF("Stra\xDF" "en")) == 0);
+  const char *strs[] = { "straßen", "Stra\xDF" "enbahn", "\xC0\xAF" };
+  TEST_CHECK(compl_add_many(comp, strs, NULL, 3) == 1);
+  TEST_CHECK(compl_get_size(comp) == 3);
+
+  // UTF-8 works whatever the locale
+  compl_type(comp, BUF("STRASSE"));
+  struct Buffer *result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "STRASSE"));
+  compl_type(comp, BUF("STRAẞE"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "Straße"));
+  result = compl_complete(comp);
+  TEST_CHECK(STR_EQ(result, "straßen"));
+
+  // the typed string is sanitised
+  compl_type(comp, BUF("Stra\xDF"));
+  TEST_CHECK(STR_EQ(comp->typed_item->buf, "Stra\xEF\xBF\xBD"));
+  result = compl_complete(comp);
+  TEST_CHECK(comp->state == COMPL_STATE_NOMATCH);
+
+  compl_free(&comp);
+
+  // rows need a valid first field, the others are sanitised
+  comp = compl_new(COMPL_MODE_EXACT);
+  compl_add_column(comp, COMPL_MODE_EXACT, COMPL_MATCH_NOFLAGS, 0);
+  compl_add_column(comp, COMPL_MODE_SUBSTRING, COMPL_MATCH_NOFLAGS, 0);
+  const char *bad[] = { "Stra\xDF" "e", "street" };
+  const char *good[] = { "Straße", "Hauptstra\xDF" "e" };
+  TEST_CHECK(compl_add_row(comp, bad) == 0);
+  TEST_CHECK(compl_add_row(comp, good) == 1);
+  CompletionColumn *col = ARRAY_GET(&comp->columns, 1);
+  TEST_CHECK(strcmp(col->fields.data + *ARRAY_GET(&col->offsets, 1), "Hauptstra\xEF\xBF\xBD" "e") == 0);
+  compl_free(&comp);
+}
+
+TEST_LIST = {
+  { "utf8 validate", test_utf8_validate },
+  { "utf8 decode", test_utf8_decode },
+  { "utf8 sanitise", test_utf8_sanitise },
+  { "utf8 ingest", test_utf8_ingest },
+  { NULL, NULL },
+};
@@ -0,0 +1,437 @@
+/**
+ * @file
+ * Autocompletion API trie of the items, with incremental fuzzy distances
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * Trie of the items, one node per character.
+ *
+ * The fuzzy distance is computed over the trie instead of per item.  Every
+ * node keeps its column of the distance matrix (one cell per typed
+ * character), which only depends on the characters on the path to the node.
+ * So the items sharing a prefix share its columns, and a cell only depends on
+ * the same and the two previous typed characters.  When the typed string
+ * grows, every node just computes its new cells, when it shrinks, the cells
+ * are kept for the next keystroke.
+ *
+ * Nodes are only ever appended, after their parent, so going through them in
+ * order visits every parent before its children.  The cells are stored by
+ * typed character, so a keystroke runs through a few contiguous rows, instead
+ * of a column per node.
+ *
+ * The same trie lets regex searches step through each distinct prefix once,
+ * see trie_regex().
+ */
+
+#include "private.h"
+
+/**
+ * struct TrieNode - node of a trie, a character of one or more items
+ */
+struct TrieNode
+{
+  wchar_t ch;        ///< character of the node
+  uint32_t parent;   ///< parent node, 0 for the root and its children
+  uint32_t child;    ///< first child, 0 for none
+  uint32_t sibling;  ///< next child of the parent, 0 for none
+  uint32_t depth;    ///< number of characters on the path to the node
+  uint32_t ids;      ///< first item ending at this node, 0 for none
+};
+
+/**
+ * struct TrieId - an item ending at a node
+ */
+struct TrieId
+{
+  uint32_t id;       ///< item id
+  uint32_t next;     ///< next item ending at the same node, 0 for none
+};
+
+ARRAY_HEAD(TrieNodeList, struct TrieNode);
+ARRAY_HEAD(TrieIdList, struct TrieId);
+
+/**
+ * struct Trie - trie of the items, with the fuzzy distance columns of its nodes
+ */
+struct Trie
+{
+  struct TrieNodeList nodes;  ///< all nodes, the first one is the root
+  struct TrieIdList ids;      ///< items ending at the nodes, entry 0 is unused
+  bool magic;                 ///< keys are the normalised forms
+  bool newlines;              ///< an item holds a newline, after which '^' holds
+  int **rows;                 ///< cells of every node, one row per typed character
+  size_t n_rows;              ///< number of allocated rows
+  size_t row_size;            ///< number of nodes each row has room for
+  wchar_t *typed;             ///< typed characters the columns are computed for
+  int n_valid;                ///< number of valid cells of every column
+};
+
+/**
+ * trie_cell - calculate a cell of a node's column
+ *
+ * The cells are those of the fuzzy kernel, the typed string being the source
+ * and the node's path the target.  The first characters are always aligned.
+ *
+ * @param t     trie
+ * @param node  node index, not the root
+ * @param i     typed character of the cell
+ */
+static inline void trie_cell(struct Trie *t, uint32_t node, int i)
+{
+  const struct TrieNode *n = ARRAY_GET(&t->nodes, node);
+  int j = n->depth - 1;
+
+  // the first character of either string
+  if ((j == 0) || (i == 0))
+  {
+    t->rows[i][node] = (j == 0) ? i : j;
+    return;
+  }
+
+  const int *row = t->rows[i];
+  const int *prev = t->rows[i - 1];
+  const wchar_t *src = t->typed;
+  int cost = (src[i] == n->ch) ? 0 : 1;
+  int best = MIN(row[n->parent] + 1, MIN(prev[node] + 1, prev[n->parent] + cost));
+
+  if ((j > 1) && (i > 1) && (src[i - 1] == n->ch))
+  {
+    const struct TrieNode *p = ARRAY_GET(&t->nodes, n->parent);
+    if (src[i] == p->ch)
+      best = MIN(best, t->rows[i - 2][p->parent] + 1);
+  }
+
+  t->rows[i][node] = best;
+}
+
+/**
+ * trie_reserve - make room for the cells of all nodes
+ *
+ * @param t     trie
+ * @param cells number of cells needed per node
+ */
+static void trie_reserve(struct Trie *t, size_t cells)
+{
+  size_t num = ARRAY_CAPACITY(&t->nodes);
+  if (num > t->row_size)
+  {
+    for (size_t i = 0; i < t->n_rows; i++)
+      mutt_mem_realloc(&t->rows[i], num * sizeof(int));
+    t->row_size = num;
+  }
+
+  if (cells <= t->n_rows)
+    return;
+
+  size_t n_rows = MAX(t->n_rows, 8);
+  while (n_rows < cells)
+    n_rows *= 2;
+
+  mutt_mem_realloc(&t->rows, n_rows * sizeof(int *));
+  for (size_t i = t->n_rows; i < n_rows; i++)
+    t->rows[i] = mutt_mem_malloc(t->row_size * sizeof(int));
+  mutt_mem_realloc(&t->typed, n_rows * sizeof(wchar_t));
+  t->n_rows = n_rows;
+}
+
+/**
+ * trie_new - create an empty trie
+ *
+ * @param magic true if the keys are the normalised forms of the items
+ * @retval ptr new trie
+ */
+struct Trie *trie_new(bool magic)
+{
+  struct Trie *t = mutt_mem_calloc(1, sizeof(struct Trie));
+  ARRAY_INIT(&t->nodes);
+  ARRAY_INIT(&t->ids);
+
+  struct TrieNode root = { 0 };
+  ARRAY_ADD(&t->nodes, root);
+  struct TrieId unused = { 0 };
+  ARRAY_ADD(&t->ids, unused);
+
+  t->magic = magic;
+  trie_reserve(t, 8);
+  return t;
+}
+
+/**
+ * trie_free - free a trie
+ *
+ * @param ptr trie to free
+ */
+void trie_free(struct Trie **ptr)
+{
+  if (!ptr || !*ptr)
+    return;
+
+  struct Trie *t = *ptr;
+  ARRAY_FREE(&t->nodes);
+  ARRAY_FREE(&t->ids);
+  for (size_t i = 0; i < t->n_rows; i++)
+    FREE(&t->rows[i]);
+  FREE(&t->rows);
+  FREE(&t->typed);
+  FREE(ptr);
+}
+
+/**
+ * trie_magic - does the trie hold the normalised forms of the items?
+ *
+ * @param t trie
+ * @retval bool true for normalised forms
+ */
+bool trie_magic(const struct Trie *t)
+{
+  return t->magic;
+}
+
+/**
+ * trie_add - add an item to a trie
+ *
+ * New nodes get their columns right away, for the current typed string.
+ *
+ * @param t   trie
+ * @param id  item id
+ * @param str string of the item (its normalised form for a magic trie)
+ */
+void trie_add(struct Trie *t, uint32_t id, const char *str)
+{
+  if (!t || !str || (*str == '\0'))
+    return;
+
+  uint32_t cur = 0;
+  wchar_t wc = 0;
+  int n = 0;
+  while ((n = utf8_next(str, &wc)) > 0)
+  {
+    str += n;
+    if (wc == L'\n')
+      t->newlines = true;
+
+    uint32_t child = ARRAY_GET(&t->nodes, cur)->child;
+    while (child && (ARRAY_GET(&t->nodes, child)->ch != wc))
+      child = ARRAY_GET(&t->nodes, child)->sibling;
+
+    if (child)
+    {
+      cur = child;
+      continue;
+    }
+
+    struct TrieNode node = { 0 };
+    node.ch = wc;
+    node.parent = cur;
+    node.depth = ARRAY_GET(&t->nodes, cur)->depth + 1;
+    node.sibling = ARRAY_GET(&t->nodes, cur)->child;
+
+    if (ARRAY_SIZE(&t->nodes) == ARRAY_CAPACITY(&t->nodes))
+    {
+      ARRAY_RESERVE(&t->nodes, ARRAY_SIZE(&t->nodes) * 2);
+      trie_reserve(t, t->n_rows);
+    }
+    child = ARRAY_SIZE(&t->nodes);
+    ARRAY_GET(&t->nodes, cur)->child = child;
+    ARRAY_ADD(&t->nodes, node);
+    for (int i = 0; i < t->n_valid; i++)
+      trie_cell(t, child, i);
+    cur = child;
+  }
+
+  struct TrieNode *end = ARRAY_GET(&t->nodes, cur);
+  struct TrieId entry = { id, end->ids };
+  if (ARRAY_SIZE(&t->ids) == ARRAY_CAPACITY(&t->ids))
+    ARRAY_RESERVE(&t->ids, ARRAY_SIZE(&t->ids) * 2);
+  end->ids = ARRAY_SIZE(&t->ids);
+  ARRAY_ADD(&t->ids, entry);
+}
+
+/**
+ * trie_remove - drop removed items from a trie
+ *
+ * Their nodes stay, they may be shared, and cost a cell per keystroke.
+ *
+ * @param t       trie
+ * @param removed tombstones, indexed by item id
+ */
+void trie_remove(struct Trie *t, const struct CompletionBoolList *removed)
+{
+  if (!t || !removed)
+    return;
+
+  struct TrieNode *node = NULL;
+  ARRAY_FOREACH(node, &t->nodes)
+  {
+    uint32_t *link = &node->ids;
+    while (*link)
+    {
+      struct TrieId *entry = ARRAY_GET(&t->ids, *link);
+      const bool *dead = ARRAY_GET(removed, entry->id);
+      if (dead && *dead)
+        *link = entry->next;
+      else
+        link = &entry->next;
+    }
+  }
+}
+
+/**
+ * trie_fuzzy - fuzzy distance of the typed string to every item
+ *
+ * Only the cells from the first typed character that changed on are
+ * calculated.
+ *
+ * @param t     trie
+ * @param str   typed string (normalised for a magic trie), not empty
+ * @param dists set to the distance of every item, indexed by id
+ * @retval num number of columns that were extended, or -1 for an invalid string
+ */
+int trie_fuzzy(struct Trie *t, const char *str, int *dists)
+{
+  int len = mbs_char_count(str);
+  if (!t || (len <= 0))
+    return -1;
+
+  trie_reserve(t, len + 1);
+
+  // the columns are still valid up to the first changed character
+  int same = 0;
+  wchar_t wc = 0;
+  int n = 0;
+  for (int i = 0; i < len; i++)
+  {
+    n = utf8_next(str, &wc);
+    str += n;
+    if ((i == same) && (i < t->n_valid) && (t->typed[i] == wc))
+      same++;
+    t->typed[i] = wc;
+  }
+
+  int extended = 0;
+  for (int i = same; i < len; i++)
+  {
+    for (uint32_t node = 1; node < ARRAY_SIZE(&t->nodes); node++)
+      trie_cell(t, node, i);
+    extended = ARRAY_SIZE(&t->nodes) - 1;
+  }
+  t->n_valid = len;
+
+  const int *last = t->rows[len - 1];
+  const struct TrieNode *node = NULL;
+  ARRAY_FOREACH(node, &t->nodes)
+  {
+    for (uint32_t e = node->ids; e; e = ARRAY_GET(&t->ids, e)->next)
+      dists[ARRAY_GET(&t->ids, e)->id] = last[ARRAY_FOREACH_IDX_node];
+  }
+
+  return extended;
+}
+
+/**
+ * enum TrieOutcome - regex outcome of the subtree of a node
+ */
+enum TrieOutcome
+{
+  TRIE_OPEN = 0,  ///< the automaton still has to step through the nodes
+  TRIE_MATCHED,   ///< all items of the subtree match
+  TRIE_FAILED,    ///< no item of the subtree matches
+};
+
+/**
+ * trie_regex - find the items a regex matches
+ *
+ * The automaton steps through the nodes in order, from the state set of the
+ * parent, so every distinct prefix takes a single step.  Once the pattern has
+ * matched a prefix, all items below it match, and once no state is left, none
+ * does (unless a newline may still make a '^' hold).  Either way the nodes
+ * below aren't stepped through.
+ *
+ * @param t       trie, of the items themselves (not the normalised forms)
+ * @param nfa     automaton of the typed pattern
+ * @param matched set to 1 for every matching item, indexed by id, others are left alone
+ * @retval num number of nodes the automaton stepped through
+ */
+size_t trie_regex(const struct Trie *t, struct RegexNfa *nfa, uint8_t *matched)
+{
+  if (!t || !nfa)
+    return 0;
+
+  size_t words = nfa_set_size(nfa);
+  uint64_t *sets = mutt_mem_malloc(ARRAY_SIZE(&t->nodes) * words * sizeof(uint64_t));
+  uint8_t *outcome = mutt_mem_calloc(ARRAY_SIZE(&t->nodes), sizeof(uint8_t));
+  size_t steps = 0;
+
+  nfa_start(nfa, sets);
+  if (nfa_accepts(nfa, sets, false))
+    outcome[0] = TRIE_MATCHED;
+
+  const struct TrieNode *node = NULL;
+  ARRAY_FOREACH_FROM(node, &t->nodes, 1)
+  {
+    size_t idx = ARRAY_FOREACH_IDX_node;
+    bool match = false;
+    outcome[idx] = outcome[node->parent];
+    if (outcome[idx] == TRIE_OPEN)
+    {
+      uint64_t *set = sets + idx * words;
+      int live = nfa_step(nfa, sets + node->parent * words, node->ch, set);
+      steps++;
+
+      // the items ending here are at the end of their strings
+      if (nfa_accepts(nfa, set, false))
+        outcome[idx] = TRIE_MATCHED;
+      else if (node->ids)
+        match = nfa_accepts(nfa, set, true);
+
+      // only a line anchor is left, it holds after a newline at most
+      if ((live == 0) && !t->newlines && (outcome[idx] == TRIE_OPEN))
+        outcome[idx] = TRIE_FAILED;
+    }
+
+    if (!match && (outcome[idx] != TRIE_MATCHED))
+      continue;
+
+    for (uint32_t e = node->ids; e; e = ARRAY_GET(&t->ids, e)->next)
+      matched[ARRAY_GET(&t->ids, e)->id] = 1;
+  }
+
+  FREE(&sets);
+  FREE(&outcome);
+  return steps;
+}
+
+/**
+ * trie_memory - memory used by a trie
+ *
+ * @param t trie
+ * @retval num size in bytes
+ */
+size_t trie_memory(const struct Trie *t)
+{
+  if (!t)
+    return 0;
+
+  return sizeof(struct Trie) + ARRAY_CAPACITY(&t->nodes) * sizeof(struct TrieNode) +
+         ARRAY_CAPACITY(&t->ids) * sizeof(struct TrieId) +
+         t->n_rows * (t->row_size * sizeof(int) + sizeof(int *) + sizeof(wchar_t));
+}
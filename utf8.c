@@ -0,0 +1,298 @@
+/**
+ * @file
+ * Autocompletion API UTF-8 validation and decoding
+ *
+ * @authors
+ * Copyright (C) 2023 Simon V. Reichel <simonreichel@giese-optik.de>
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page completion neomutt completion API
+ *
+ * All strings are UTF-8, whatever the locale.  Items are validated once when
+ * they're added (invalid ones are skipped), and the typed string is sanitised,
+ * so the kernels can decode without checking every byte again.
+ *
+ * Most strings are mostly ASCII, so runs of ASCII bytes are skipped 16 at a
+ * time with SSE2, or 8 at a time on other machines.  Only the multibyte
+ * sequences are checked byte by byte.
+ */
+
+#include "private.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/// Replacement for invalid sequences, U+FFFD
+#define UTF8_REPLACEMENT "\xEF\xBF\xBD"
+
+/**
+ * utf8_ascii_prefix - count the leading ASCII bytes of a string
+ *
+ * @param str string
+ * @param len length of the string in bytes
+ * @retval num number of ASCII bytes before the first non-ASCII one
+ */
+size_t utf8_ascii_prefix(const char *str, size_t len)
+{
+  size_t i = 0;
+
+#ifdef __SSE2__
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i chunk = _mm_loadu_si128((const __m128i *) (str + i));
+    int mask = _mm_movemask_epi8(chunk);
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+#else
+  for (; i + 8 <= len; i += 8)
+  {
+    uint64_t chunk;
+    memcpy(&chunk, str + i, sizeof(chunk));
+    if (chunk & 0x8080808080808080ULL)
+      break;
+  }
+#endif
+
+  while ((i < len) && !((unsigned char) str[i] & 0x80))
+    i++;
+
+  return i;
+}
+
+/**
+ * utf8_seq_len - check the multibyte sequence at the start of a string
+ *
+ * Overlong forms, surrogates and characters beyond U+10FFFF are invalid.
+ *
+ * @param s   string starting with a non-ASCII byte
+ * @param len bytes left in the string
+ * @retval num length of the sequence, or 0 if it's invalid
+ */
+static int utf8_seq_len(const unsigned char *s, size_t len)
+{
+  unsigned char c = s[0];
+  int n = 0;
+  unsigned char lo = 0x80;
+  unsigned char hi = 0xBF;
+
+  if ((c >= 0xC2) && (c <= 0xDF))
+  {
+    n = 2;
+  }
+  else if ((c >= 0xE0) && (c <= 0xEF))
+  {
+    n = 3;
+    if (c == 0xE0)
+      lo = 0xA0;
+    else if (c == 0xED)
+      hi = 0x9F;
+  }
+  else if ((c >= 0xF0) && (c <= 0xF4))
+  {
+    n = 4;
+    if (c == 0xF0)
+      lo = 0x90;
+    else if (c == 0xF4)
+      hi = 0x8F;
+  }
+  else
+  {
+    return 0;
+  }
+
+  if ((size_t) n > len)
+    return 0;
+  if ((s[1] < lo) || (s[1] > hi))
+    return 0;
+  for (int i = 2; i < n; i++)
+  {
+    if ((s[i] & 0xC0) != 0x80)
+      return 0;
+  }
+
+  return n;
+}
+
+/**
+ * utf8_validate - check that a string is valid UTF-8, and count its characters
+ *
+ * @param str string
+ * @param len length of the string in bytes
+ * @retval num number of characters, or -1 if the string isn't valid UTF-8
+ */
+int utf8_validate(const char *str, size_t len)
+{
+  if (!str)
+    return 0;
+
+  const unsigned char *s = (const unsigned char *) str;
+  size_t i = 0;
+  int chars = 0;
+
+  while (i < len)
+  {
+    size_t ascii = utf8_ascii_prefix(str + i, len - i);
+    i += ascii;
+    chars += ascii;
+    if (i == len)
+      break;
+
+    int n = utf8_seq_len(s + i, len - i);
+    if (n == 0)
+      return -1;
+    i += n;
+    chars++;
+  }
+
+  return chars;
+}
+
+/**
+ * utf8_sanitise - copy a string, replacing invalid sequences
+ *
+ * Every byte that doesn't start a valid sequence is replaced by U+FFFD.
+ *
+ * @param str string
+ * @param len length of the string in bytes
+ * @param buf buffer for the valid string
+ * @retval num number of replaced bytes
+ */
+size_t utf8_sanitise(const char *str, size_t len, struct Buffer *buf)
+{
+  const unsigned char *s = (const unsigned char *) str;
+  size_t replaced = 0;
+  size_t i = 0;
+
+  buf_reset(buf);
+  while (i < len)
+  {
+    size_t ascii = utf8_ascii_prefix(str + i, len - i);
+    buf_addstr_n(buf, str + i, ascii);
+    i += ascii;
+    if (i == len)
+      break;
+
+    int n = utf8_seq_len(s + i, len - i);
+    if (n == 0)
+    {
+      buf_addstr(buf, UTF8_REPLACEMENT);
+      replaced++;
+      i++;
+      continue;
+    }
+
+    buf_addstr_n(buf, str + i, n);
+    i += n;
+  }
+
+  return replaced;
+}
+
+/**
+ * utf8_next - decode the character at the start of a string
+ *
+ * @param str string
+ * @param wc  set to the character
+ * @retval num length of the character in bytes, 0 at the end of the string, -1 if invalid
+ */
+int utf8_next(const char *str, wchar_t *wc)
+{
+  const unsigned char *s = (const unsigned char *) str;
+  if (s[0] < 0x80)
+  {
+    *wc = s[0];
+    return s[0] ? 1 : 0;
+  }
+
+  // a terminating NUL fails the continuation byte check
+  int n = utf8_seq_len(s, 4);
+  if (n == 0)
+    return -1;
+
+  if (n == 2)
+    *wc = ((s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+  else if (n == 3)
+    *wc = ((s[0] & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+  else
+    *wc = ((s[0] & 0x07) << 18) | ((s[1] & 0x3F) << 12) | ((s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+
+  return n;
+}
+
+/**
+ * utf8_decode - decode a valid string into wide characters
+ *
+ * @param str string, checked with utf8_validate() or mbs_char_count()
+ * @param w   buffer for the characters and a terminating L'\0'
+ * @retval num number of characters
+ */
+int utf8_decode(const char *str, wchar_t *w)
+{
+  int chars = 0;
+  int n = 0;
+  while ((n = utf8_next(str, &w[chars])) > 0)
+  {
+    str += n;
+    chars++;
+  }
+
+  w[chars] = L'\0';
+  return chars;
+}
+
+/**
+ * utf8_encode - encode wide characters as UTF-8
+ *
+ * @param w   characters, terminated by L'\0'
+ * @param str buffer for the string, 4 bytes per character and a terminating NUL
+ * @retval num length of the string in bytes
+ */
+size_t utf8_encode(const wchar_t *w, char *str)
+{
+  unsigned char *s = (unsigned char *) str;
+  for (; *w; w++)
+  {
+    uint32_t c = *w;
+    if (c < 0x80)
+    {
+      *s++ = c;
+    }
+    else if (c < 0x800)
+    {
+      *s++ = 0xC0 | (c >> 6);
+      *s++ = 0x80 | (c & 0x3F);
+    }
+    else if (c < 0x10000)
+    {
+      *s++ = 0xE0 | (c >> 12);
+      *s++ = 0x80 | ((c >> 6) & 0x3F);
+      *s++ = 0x80 | (c & 0x3F);
+    }
+    else
+    {
+      *s++ = 0xF0 | (c >> 18);
+      *s++ = 0x80 | ((c >> 12) & 0x3F);
+      *s++ = 0x80 | ((c >> 6) & 0x3F);
+      *s++ = 0x80 | (c & 0x3F);
+    }
+  }
+
+  *s = '\0';
+  return (char *) s - str;
+}